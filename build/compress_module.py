@@ -0,0 +1,41 @@
+#!/usr/bin/env python3
+#
+# Compresses a module binary for OTA updates (see compressed_module_header in module_info.h).
+#
+# Usage: compress_module.py <module.bin> <output.bin> [window_bits]
+
+import struct
+import sys
+import zlib
+
+COMPRESSED_MODULE_MAGIC = 0x5a434d50
+COMPRESSED_MODULE_METHOD_DEFLATE = 0
+HEADER_FORMAT = '<IHBBI'
+
+
+def compress(data, window_bits):
+    comp = zlib.compressobj(9, zlib.DEFLATED, -window_bits)  # Raw deflate
+    payload = comp.compress(data) + comp.flush()
+    header = struct.pack(HEADER_FORMAT, COMPRESSED_MODULE_MAGIC, struct.calcsize(HEADER_FORMAT),
+            COMPRESSED_MODULE_METHOD_DEFLATE, window_bits, len(data))
+    return header + payload
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit('Usage: %s <module.bin> <output.bin> [window_bits]' % sys.argv[0])
+    # The device allocates a buffer of 2^window_bits bytes for the decompressor's dictionary
+    window_bits = int(sys.argv[3]) if len(sys.argv) > 3 else 15
+    if window_bits < 9 or window_bits > 15:
+        sys.exit('window_bits should be in the range 9 to 15')
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+    out = compress(data, window_bits)
+    with open(sys.argv[2], 'wb') as f:
+        f.write(out)
+    print('%s: %d bytes, compressed: %d bytes (%.1f%%)' % (sys.argv[1], len(data), len(out),
+            100.0 * len(out) / len(data)))
+
+
+if __name__ == '__main__':
+    main()
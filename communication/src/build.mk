@@ -28,6 +28,7 @@ CPPSRC += $(TARGET_SRC_PATH)/messages.cpp
 CPPSRC += $(TARGET_SRC_PATH)/chunked_transfer.cpp
 CPPSRC += $(TARGET_SRC_PATH)/coap_channel.cpp
 CPPSRC += $(TARGET_SRC_PATH)/publisher.cpp
+CPPSRC += $(TARGET_SRC_PATH)/subscriptions.cpp
 CPPSRC += $(TARGET_SRC_PATH)/protocol_defs.cpp
 CPPSRC += $(TARGET_SRC_PATH)/mbedtls_communication.cpp
 CPPSRC += $(TARGET_SRC_PATH)/communication_diagnostic.cpp
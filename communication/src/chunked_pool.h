@@ -0,0 +1,119 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstdint>
+
+namespace particle
+{
+namespace protocol
+{
+
+/**
+ * A pool of equally sized objects that grows from the heap in chunks of `ChunkSize` objects.
+ *
+ * Released objects are kept in a free list and reused; chunks are returned to the heap only by
+ * `clear()`. This keeps the number of heap allocations and the fragmentation low for
+ * containers of many small nodes.
+ */
+template<typename T, size_t ChunkSize>
+class ChunkedPool
+{
+	union Block
+	{
+		Block* next;
+		alignas(T) uint8_t data[sizeof(T)];
+	};
+
+	struct Chunk
+	{
+		Chunk* next;
+		Block blocks[ChunkSize];
+	};
+
+	Chunk* chunks;
+	Block* free_list;
+	size_t used_count;
+
+public:
+	ChunkedPool() : chunks(nullptr), free_list(nullptr), used_count(0)
+	{
+	}
+
+	~ChunkedPool()
+	{
+		clear();
+	}
+
+	ChunkedPool(const ChunkedPool&) = delete;
+	ChunkedPool& operator=(const ChunkedPool&) = delete;
+
+	/**
+	 * Returns uninitialized storage for one object, or nullptr if the heap is exhausted.
+	 */
+	void* allocate()
+	{
+		if (!free_list)
+		{
+			Chunk* chunk = static_cast<Chunk*>(malloc(sizeof(Chunk)));
+			if (!chunk)
+				return nullptr;
+			chunk->next = chunks;
+			chunks = chunk;
+			for (size_t i = ChunkSize; i > 0; --i)
+			{
+				chunk->blocks[i - 1].next = free_list;
+				free_list = &chunk->blocks[i - 1];
+			}
+		}
+		Block* block = free_list;
+		free_list = block->next;
+		++used_count;
+		return block->data;
+	}
+
+	void release(void* ptr)
+	{
+		Block* block = static_cast<Block*>(ptr);
+		block->next = free_list;
+		free_list = block;
+		--used_count;
+	}
+
+	/**
+	 * Returns all chunks to the heap. Objects still allocated from the pool become invalid.
+	 */
+	void clear()
+	{
+		while (chunks)
+		{
+			Chunk* next = chunks->next;
+			free(chunks);
+			chunks = next;
+		}
+		free_list = nullptr;
+		used_count = 0;
+	}
+
+	size_t used() const { return used_count; }
+};
+
+}}
@@ -21,6 +21,8 @@
 #include "service_debug.h"
 #include "coap.h"
 
+#include <cstdlib>
+
 namespace particle { namespace protocol {
 
 ProtocolError ChunkedTransfer::handle_update_begin(
@@ -64,6 +66,13 @@ ProtocolError ChunkedTransfer::handle_update_begin(
     {
         success = file.chunk_count(file.chunk_size) < MAX_CHUNKS;
     }
+    if (success)
+    {
+        chunk_size = file.chunk_size; // save chunk size since the descriptor size is overwritten
+        success = allocate_buffers();
+        if (!success)
+            reset_updating();
+    }
     Message response;
     channel.response(message, response, 16);
     size_t size = Messages::coded_ack(response.buf(),
@@ -83,13 +92,9 @@ ProtocolError ChunkedTransfer::handle_update_begin(
                     file.chunk_size);
             last_chunk_millis = callbacks->millis();
             chunk_index = 0;
-            chunk_size = file.chunk_size; // save chunk size since the descriptor size is overwritten
             updating = 1;
             Message updateReady;
             channel.create(updateReady);
-            // updateReady will have the maximum capacity
-            int offset = updateReady.capacity() - chunk_bitmap_size();
-            bitmap = queue+offset; // this relies on the fact that we know the channels use a static buffer
 
             // when not in fast OTA mode, the chunk missing buffer is set to 1 since the protocol
             // handles missing chunks one by one. Also we don't know the actual size of the file to
@@ -104,6 +109,10 @@ ProtocolError ChunkedTransfer::handle_update_begin(
             if (error)
                 DEBUG("error sending updateReady");
         }
+        else
+        {
+            release_buffers();
+        }
     }
     return error;
 }
@@ -170,7 +179,8 @@ ProtocolError ChunkedTransfer::handle_chunk(token_t token, Message& message,
         const uint8_t* chunk = queue + payload;
         file.chunk_size = message.length() - payload;
         file.chunk_address = file.file_address + (chunk_index * chunk_size);
-        if (chunk_index >= MAX_CHUNKS)
+        // a chunk past the end of the file would be written outside of the file's region
+        if (chunk_index >= file.chunk_count(chunk_size))
         {
             WARN("invalid chunk index %d", chunk_index);
             return NO_ERROR;
@@ -182,14 +192,25 @@ ProtocolError ChunkedTransfer::handle_chunk(token_t token, Message& message,
                 crc_valid, fast_ota, updating);
         if (crc_valid)
         {
-            callbacks->save_firmware_chunk(file, chunk, NULL);
+            flag_chunk_received(chunk_index);
+            // fast OTA chunks are not confirmed individually and the staged chunks are written
+            // before UpdateDone is answered, so they can be written while the next one is received.
+            // A regular chunk is written before its receipt is confirmed
+            bool saved = fast_ota && stage_chunk(chunk_index, chunk, file.chunk_size);
+            if (!saved)
+            {
+                saved = write_chunk(chunk_index, chunk, file.chunk_size);
+            }
             if (!fast_ota)
             {
                 // message is confirmable for regular OTA or when
-                response_size = Messages::chunk_received(response.buf(), 0, token, ChunkReceivedCode::OK, channel.is_unreliable());
+                response_size = Messages::chunk_received(response.buf(), 0, token,
+                        saved ? ChunkReceivedCode::OK : ChunkReceivedCode::BAD, channel.is_unreliable());
+            }
+            if (saved)
+            {
+                chunk_index++;
             }
-            flag_chunk_received(chunk_index);
-            chunk_index++;
         }
         else
         {
@@ -207,6 +228,8 @@ ProtocolError ChunkedTransfer::handle_chunk(token_t token, Message& message,
             if (error)
                 return error;
         }
+        // write all but the chunk just received, which is written while waiting for the next one
+        flush_staged_chunks(1);
     }
     return NO_ERROR;
 }
@@ -251,6 +274,10 @@ ProtocolError ChunkedTransfer::handle_update_done(token_t token, Message& messag
     Message response;
 
     DEBUG("update done received");
+    if (is_updating())
+    {
+        flush_staged_chunks();
+    }
     chunk_index_t index = next_chunk_missing(0);
     bool missing = index != NO_CHUNKS_MISSING;
     uint8_t* queue = message.buf();
@@ -274,6 +301,7 @@ ProtocolError ChunkedTransfer::handle_update_done(token_t token, Message& messag
     {
         DEBUG("update done - all done!");
         reset_updating();
+        release_buffers();
         callbacks->finish_firmware_update(file, UpdateFlag::SUCCESS, NULL);
     }
     else
@@ -307,15 +335,16 @@ ProtocolError ChunkedTransfer::send_missing_chunks(MessageChannel& channel,
     buf[5] = 'c';
     buf[6] = 0xff; // payload marker
 
-    while ((idx = next_chunk_missing(chunk_index_t(idx)))
-            != NO_CHUNKS_MISSING && sent < count)
+    // the server expects a list of chunk indices, so each run of missing chunks is expanded
+    while (sent < count && (idx = next_chunk_missing(chunk_index_t(idx))) != NO_CHUNKS_MISSING)
     {
-        buf[(sent * 2) + 7] = idx >> 8;
-        buf[(sent * 2) + 8] = idx & 0xFF;
-
-        missed_chunk_index = idx;
-        idx++;
-        sent++;
+        const chunk_index_t end = next_chunk_received(idx);
+        for (; idx < end && sent < count; idx++, sent++)
+        {
+            buf[(sent * 2) + 7] = idx >> 8;
+            buf[(sent * 2) + 8] = idx & 0xFF;
+            missed_chunk_index = idx;
+        }
     }
 
     if (sent > 0)
@@ -333,8 +362,9 @@ ProtocolError ChunkedTransfer::send_missing_chunks(MessageChannel& channel,
 
 ProtocolError ChunkedTransfer::idle(MessageChannel& channel)
 {
-    /* Timeout to resend missing chunks removed.
-     * Leaving idle() here in case we need to add something in the future. */
+    /* Timeout to resend missing chunks removed. */
+    // Write the buffered chunks while waiting for the next one
+    flush_staged_chunks();
     return NO_ERROR;
 }
 
@@ -346,24 +376,132 @@ void ChunkedTransfer::cancel()
         WARN("handle received message failed - aborting transfer");
         callbacks->finish_firmware_update(file, 0, NULL);
     }
+    // the staged chunks are dropped
+    release_buffers();
+}
+
+bool ChunkedTransfer::allocate_buffers()
+{
+    release_buffers();
+    const size_t bitmap_size = chunk_bitmap_size();
+    if (bitmap_size)
+    {
+        bitmap = (uint8_t*)malloc(bitmap_size);
+        if (!bitmap)
+        {
+            WARN("unable to allocate the chunk bitmap");
+            return false;
+        }
+    }
+    if (CHUNKED_TRANSFER_WRITE_BUFFERS > 0 && chunk_size)
+    {
+        // chunks are written synchronously if there's not enough memory to buffer them
+        staging_buffer = (uint8_t*)malloc(size_t(chunk_size) * CHUNKED_TRANSFER_WRITE_BUFFERS);
+        if (staging_buffer)
+        {
+            for (size_t i = 0; i < CHUNKED_TRANSFER_WRITE_BUFFERS; i++)
+            {
+                staged[i].data = staging_buffer + i * chunk_size;
+            }
+        }
+    }
+    return true;
+}
+
+void ChunkedTransfer::release_buffers()
+{
+    free(bitmap);
+    bitmap = nullptr;
+    free(staging_buffer);
+    staging_buffer = nullptr;
+    staged_head = 0;
+    staged_count = 0;
+}
+
+bool ChunkedTransfer::stage_chunk(chunk_index_t idx, const uint8_t* chunk, size_t size)
+{
+    if (!staging_buffer || size > chunk_size)
+    {
+        return false;
+    }
+    if (staged_count == CHUNKED_TRANSFER_WRITE_BUFFERS)
+    {
+        flush_staged_chunks(CHUNKED_TRANSFER_WRITE_BUFFERS - 1);
+    }
+    StagedChunk& staged_chunk = staged[(staged_head + staged_count) % CHUNKED_TRANSFER_WRITE_BUFFERS];
+    memcpy(staged_chunk.data, chunk, size);
+    staged_chunk.size = size;
+    staged_chunk.index = idx;
+    staged_count++;
+    return true;
+}
+
+void ChunkedTransfer::flush_staged_chunks(size_t keep)
+{
+    while (staged_count > keep)
+    {
+        const StagedChunk& staged_chunk = staged[staged_head];
+        staged_head = (staged_head + 1) % CHUNKED_TRANSFER_WRITE_BUFFERS;
+        staged_count--;
+        write_chunk(staged_chunk.index, staged_chunk.data, staged_chunk.size);
+    }
+}
+
+bool ChunkedTransfer::write_chunk(chunk_index_t idx, const uint8_t* chunk, size_t size)
+{
+    file.chunk_size = size;
+    file.chunk_address = file.file_address + (idx * chunk_size);
+    if (callbacks->save_firmware_chunk(file, chunk, NULL))
+    {
+        WARN("unable to save chunk %d", idx);
+        clear_chunk_received(idx);
+        return false;
+    }
+    return true;
 }
 
 
 chunk_index_t ChunkedTransfer::next_chunk_missing(chunk_index_t start)
 {
-    chunk_index_t chunk = NO_CHUNKS_MISSING;
-    chunk_index_t chunks = file.chunk_count(chunk_size);
-    chunk_index_t idx = start;
-    for (; idx < chunks; idx++)
+    const unsigned chunks = file.chunk_count(chunk_size);
+    unsigned idx = start;
+    while (idx < chunks)
     {
+        // skip bytes of received chunks
+        if (!(idx & 7) && chunk_bitmap()[idx >> 3] == 0xFF)
+        {
+            idx += 8;
+            continue;
+        }
         if (!is_chunk_received(idx))
         {
             //serial_dump("next missing chunk %d from %d", idx, start);
-            chunk = idx;
-            break;
+            return idx;
+        }
+        idx++;
+    }
+    return NO_CHUNKS_MISSING;
+}
+
+chunk_index_t ChunkedTransfer::next_chunk_received(chunk_index_t start)
+{
+    const unsigned chunks = file.chunk_count(chunk_size);
+    unsigned idx = start;
+    while (idx < chunks)
+    {
+        // skip bytes of missing chunks
+        if (!(idx & 7) && chunk_bitmap()[idx >> 3] == 0x00)
+        {
+            idx += 8;
+            continue;
+        }
+        if (is_chunk_received(idx))
+        {
+            return idx;
         }
+        idx++;
     }
-    return chunk;
+    return std::min(idx, chunks);
 }
 
 void ChunkedTransfer::set_chunks_received(uint8_t value)
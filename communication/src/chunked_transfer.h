@@ -30,6 +30,15 @@ namespace particle
 namespace protocol
 {
 
+/**
+ * The number of validated chunks that can be held in RAM before they are written to storage.
+ * Buffering lets the acknowledgement for a chunk go out before the chunk is written, so that
+ * the flash write overlaps with receiving the next chunk. 0 writes each chunk as it is received.
+ */
+#ifndef CHUNKED_TRANSFER_WRITE_BUFFERS
+#define CHUNKED_TRANSFER_WRITE_BUFFERS 2
+#endif
+
 class ChunkedTransfer
 {
 
@@ -83,13 +92,53 @@ private:
 	unsigned short chunk_index;
 	unsigned short chunk_size;
 
+	/**
+	 * One bit per chunk of the file, set when the chunk has been received.
+	 */
 	uint8_t* bitmap;
 
+	/**
+	 * A chunk that has been received and validated but not yet written to storage.
+	 */
+	struct StagedChunk
+	{
+		uint8_t* data;
+		uint16_t size;
+		chunk_index_t index;
+	};
+
+	StagedChunk staged[CHUNKED_TRANSFER_WRITE_BUFFERS > 0 ? CHUNKED_TRANSFER_WRITE_BUFFERS : 1];
+	uint8_t* staging_buffer;
+	/**
+	 * The slot of the oldest staged chunk and the number of staged chunks.
+	 */
+	uint8_t staged_head;
+	uint8_t staged_count;
+
 	Callbacks* callbacks;
 
 	bool fast_ota_override;
 	bool fast_ota_value;
 
+	bool allocate_buffers();
+	void release_buffers();
+
+	/**
+	 * Buffers a chunk to be written later. Returns false if the chunk cannot be buffered.
+	 */
+	bool stage_chunk(chunk_index_t idx, const uint8_t* chunk, size_t size);
+
+	/**
+	 * Writes the oldest staged chunks until at most `keep` remain.
+	 */
+	void flush_staged_chunks(size_t keep = 0);
+
+	/**
+	 * Writes a chunk to storage. If the write fails, the chunk is flagged as missing so that
+	 * it is requested again.
+	 */
+	bool write_chunk(chunk_index_t idx, const uint8_t* chunk, size_t size);
+
 protected:
 
 	unsigned chunk_bitmap_size()
@@ -105,7 +154,14 @@ protected:
 	inline void flag_chunk_received(chunk_index_t idx)
 	{
 		//    serial_dump("flagged chunk %d", idx);
-		chunk_bitmap()[idx >> 3] |= uint8_t(1 << (idx & 7));
+		if (idx < file.chunk_count(chunk_size))
+			chunk_bitmap()[idx >> 3] |= uint8_t(1 << (idx & 7));
+	}
+
+	inline void clear_chunk_received(chunk_index_t idx)
+	{
+		if (idx < file.chunk_count(chunk_size))
+			chunk_bitmap()[idx >> 3] &= ~uint8_t(1 << (idx & 7));
 	}
 
 	inline bool is_chunk_received(chunk_index_t idx)
@@ -114,12 +170,22 @@ protected:
 	}
 
 	chunk_index_t next_chunk_missing(chunk_index_t start);
+	/**
+	 * Finds the end of the run of missing chunks that starts at `start`.
+	 */
+	chunk_index_t next_chunk_received(chunk_index_t start);
 	void set_chunks_received(uint8_t value);
 public:
 
 	ChunkedTransfer() :
-			updating(false), callbacks(nullptr), fast_ota_override(false), fast_ota_value(true)
+			updating(false), bitmap(nullptr), staging_buffer(nullptr), staged_head(0), staged_count(0),
+			callbacks(nullptr), fast_ota_override(false), fast_ota_value(true)
+	{
+	}
+
+	~ChunkedTransfer()
 	{
+		release_buffers();
 	}
 
 	void init(Callbacks* callbacks)
@@ -130,7 +196,7 @@ public:
 	void reset()
 	{
 		reset_updating();
-		bitmap = nullptr;
+		release_buffers();
 		last_chunk_millis = 0;
 	}
 
@@ -54,6 +54,41 @@ void CoAPMessageStore::message_timeout(CoAPMessage& msg, Channel& channel)
 		channel.command(MessageChannel::CLOSE);
 }
 
+void CoAPMessageStore::defer(CoAPMessage& msg)
+{
+	msg.set_next(nullptr);
+	if (deferred_tail)
+		deferred_tail->set_next(&msg);
+	else
+		deferred = &msg;
+	deferred_tail = &msg;
+}
+
+void CoAPMessageStore::transmitted(CoAPMessage& msg)
+{
+	msg.set_flag(CoAPMessage::IN_FLIGHT);
+	in_flight++;
+	if (msg.has_flag(CoAPMessage::BARRIER))
+		barrier = true;
+}
+
+void CoAPMessageStore::send_deferred(system_tick_t time, Channel& channel)
+{
+	while (deferred && !barrier && in_flight<window)
+	{
+		CoAPMessage* msg = deferred;
+		remove_deferred(msg, nullptr);
+		msg->prepare_retransmit(time);
+		transmitted(*msg);
+		msg->set_next(head);
+		head = msg;
+		DEBUG("sending deferred message id=%x", msg->get_id());
+		send_message(msg, channel);
+		if (transmitted_callback)
+			transmitted_callback(msg->get_id(), transmitted_callback_data);
+	}
+}
+
 /**
  * Process existing messages, resending any unacknowledged requests to the given channel.
  */
@@ -76,6 +111,7 @@ void CoAPMessageStore::process(system_tick_t time, Channel& channel)
 			msg = msg->get_next();
 		}
 	}
+	send_deferred(time, channel);
 }
 
 
@@ -83,7 +119,7 @@ void CoAPMessageStore::process(system_tick_t time, Channel& channel)
  * Registers that this message has been sent from the application.
  * Confirmable messages, and ack/reset responses are cached.
  */
-ProtocolError CoAPMessageStore::send(Message& msg, system_tick_t time)
+ProtocolError CoAPMessageStore::send(Message& msg, system_tick_t time, bool* deferred)
 {
 	if (!msg.has_id())
 		return MISSING_MESSAGE_ID;
@@ -96,6 +132,20 @@ ProtocolError CoAPMessageStore::send(Message& msg, system_tick_t time)
 		CoAPMessage* coapmsg = CoAPMessage::create(msg);
 		if (coapmsg==nullptr)
 			return INSUFFICIENT_STORAGE;
+		if (coapType==CoAPType::CON && deferred)
+		{
+			if (msg.get_confirm_received())
+				coapmsg->set_flag(CoAPMessage::BARRIER);
+			if (!can_transmit())
+			{
+				DEBUG("deferring message id=%x, %d requests in flight", msg.get_id(), in_flight);
+				clear_message(coapmsg->get_id());
+				defer(*coapmsg);
+				*deferred = true;
+				return NO_ERROR;
+			}
+			transmitted(*coapmsg);
+		}
 		if (coapType==CoAPType::CON)
 			coapmsg->prepare_retransmit(time);
 		else
@@ -126,6 +176,13 @@ ProtocolError CoAPMessageStore::receive(Message& msg, Channel& channel, system_t
 			channel.command(Channel::DISCARD_SESSION, nullptr);
 		}
 		DEBUG("recieved ACK for message id=%x", id);
+		if (msgtype==CoAPType::ACK) {
+			// Only messages that were transmitted once give an unambiguous sample (Karn's algorithm)
+			const CoAPMessage* msg = from_id(id);
+			if (msg && msg->get_transmit_count() == 1 && CoAP::type(msg->get_data()) == CoAPType::CON) {
+				g_cloudRoundTripHistogram.add(time - msg->get_transmit_time());
+			}
+		}
 		if (!clear_message(id)) {		// message didn't exist, means it's already been acknoweldged or is unknown.
 			msg.set_length(0);
 		}
@@ -151,7 +208,12 @@ ProtocolError CoAPMessageStore::receive(Message& msg, Channel& channel, system_t
 			// the timeout here is ideally purely academic since the application will respond immediately with an ACK/RESET
 			// which will be stored in place of this message, with it's own timeout.
 			coapmsg->set_expiration(time+CoAPMessage::MAX_TRANSMIT_SPAN);
-			add(*coapmsg);
+			ProtocolError error = add(*coapmsg);
+			if (error)
+			{
+				delete coapmsg;
+				return error;
+			}
 		}
 	}
 	// else it's a NON message - pass through
@@ -165,7 +227,7 @@ bool CoAPMessageStore::has_unacknowledged_requests() const
 			return true;
 	}
 
-	return false;
+	return deferred != nullptr;
 }
 
 }}
@@ -23,6 +23,15 @@
 #include "timer_hal.h"
 #include "stdlib.h"
 #include "service_debug.h"
+#include <new>
+
+/**
+ * The number of confirmable requests that may be awaiting acknowledgement at the same time.
+ * Further requests are queued and sent as earlier requests are acknowledged.
+ */
+#ifndef COAP_NSTART
+#define COAP_NSTART 4
+#endif
 
 namespace particle
 {
@@ -110,6 +119,11 @@ private:
 	 */
 	system_tick_t timeout;
 
+	/**
+	 * The time when this message was last transmitted.
+	 */
+	system_tick_t transmit_time;
+
 	/**
 	 * The unique 16-bit ID for this message.
 	 */
@@ -121,8 +135,11 @@ private:
 	 */
 	uint8_t transmit_count;
 
-	// padding
-	// uint8_t reserved;
+	/**
+	 * Combination of the Flags values.
+	 */
+	uint8_t flags;
+
 	std::function<void(Delivery)>* delivered;
 
 
@@ -159,10 +176,22 @@ public:
 	/**
 	 * The number of outstanding messages allowed.
 	 */
-	static const uint8_t NSTART = 1;
+	static const uint8_t NSTART = COAP_NSTART;
+
+	enum Flags
+	{
+		/**
+		 * The message has been transmitted and counts towards the NSTART limit.
+		 */
+		IN_FLIGHT = 0x01,
+		/**
+		 * No further requests are transmitted until this message is acknowledged.
+		 */
+		BARRIER = 0x02
+	};
 
 
-	CoAPMessage(message_id_t id_) : next(nullptr), timeout(0), id(id_), transmit_count(0), delivered(nullptr), data_len(0) {
+	CoAPMessage(message_id_t id_) : next(nullptr), timeout(0), transmit_time(0), id(id_), transmit_count(0), flags(0), delivered(nullptr), data_len(0) {
 		message_count++;
 	}
 
@@ -174,7 +203,8 @@ public:
 	static CoAPMessage* create(Message& msg, size_t data_len = 0)
 	{
 		size_t len = data_len && data_len<msg.length() ? data_len : msg.length();
-		uint8_t* memory = new uint8_t[sizeof(CoAPMessage)+len];
+		// allocated with the same function that `delete` releases the message with
+		void* memory = ::operator new(sizeof(CoAPMessage)+len, std::nothrow);
 		if (memory) {
 			CoAPMessage* coapmsg = new (memory)CoAPMessage(msg.get_id());		// in-place new
 			coapmsg->set_data(msg.buf(), len);
@@ -192,10 +222,14 @@ public:
 
 	inline CoAPMessage* get_next() const { return next; }
 	inline void set_next(CoAPMessage* next) { this->next = next; }
+	inline bool has_flag(Flags flag) const { return flags & flag; }
+	inline void set_flag(Flags flag) { flags |= flag; }
 	inline bool matches(message_id_t id) const { return this->id==id; }
 	inline message_id_t get_id() const { return id; }
 	inline void removed() { next = nullptr; }
 	inline system_tick_t get_timeout() const { return timeout; }
+	inline system_tick_t get_transmit_time() const { return transmit_time; }
+	inline uint8_t get_transmit_count() const { return transmit_count; }
 
 	inline void set_delivered_handler(std::function<void(Delivery)>* handler) { this->delivered = handler; }
 
@@ -219,6 +253,7 @@ public:
 	{
 		CoAPType::Enum coapType = CoAP::type(get_data());
 		if (coapType==CoAPType::CON) {
+			transmit_time = now;
 			timeout = now + transmit_timeout(transmit_count);
 			transmit_count++;
 			return transmit_count <= MAX_RETRANSMIT+1;
@@ -293,6 +328,9 @@ inline bool time_has_passed(system_tick_t now, system_tick_t tick)
 
 /**
  * A mix-in class that provides message resending for reliable delivery of messages.
+ *
+ * Requests sent with a window hold at most `window` confirmable messages in flight. Requests
+ * beyond that are queued in order and transmitted by process() as acknowledgements arrive.
  */
 class CoAPMessageStore
 {
@@ -304,10 +342,37 @@ class CoAPMessageStore
 	CoAPMessage* head;
 
 	/**
-	 * Retrieves the message with the given ID and the previous message.
+	 * The first and last of the requests waiting to be transmitted. These requests are not in the list of messages.
+	 */
+	CoAPMessage* deferred;
+	CoAPMessage* deferred_tail;
+
+	/**
+	 * The number of transmitted confirmable requests that are not yet acknowledged.
+	 */
+	uint16_t in_flight;
+
+	/**
+	 * The maximum number of requests in flight.
+	 */
+	uint8_t window;
+
+	/**
+	 * Set while a request marked as a barrier is in flight.
+	 */
+	bool barrier;
+
+	/**
+	 * Notified when a queued request is transmitted.
+	 */
+	void (*transmitted_callback)(message_id_t id, void* data);
+	void* transmitted_callback_data;
+
+	/**
+	 * Retrieves the message with the given ID and the previous message in the given list.
 	 * If no message exists with the given id, nullptr is returned.
 	 */
-	CoAPMessage* for_id(message_id_t id, CoAPMessage*& prev) const
+	static CoAPMessage* for_id(CoAPMessage* head, message_id_t id, CoAPMessage*& prev)
 	{
 		prev = nullptr;
 		CoAPMessage* next = head;
@@ -330,14 +395,55 @@ class CoAPMessageStore
 			previous->set_next(message->get_next());
 		else
 			head = message->get_next();
+		if (message->has_flag(CoAPMessage::IN_FLIGHT))
+		{
+			in_flight--;
+			if (message->has_flag(CoAPMessage::BARRIER))
+				barrier = false;
+		}
+		message->removed();
+	}
+
+	/**
+	 * Removes a queued request given the request and the previous entry in the queue.
+	 */
+	void remove_deferred(CoAPMessage* message, CoAPMessage* previous)
+	{
+		if (previous)
+			previous->set_next(message->get_next());
+		else
+			deferred = message->get_next();
+		if (deferred_tail==message)
+			deferred_tail = previous;
 		message->removed();
 	}
 
+	/**
+	 * Appends a request to the queue of requests waiting for the window to open.
+	 */
+	void defer(CoAPMessage& msg);
+
+	/**
+	 * Records that a confirmable request has been transmitted.
+	 */
+	void transmitted(CoAPMessage& msg);
+
+	/**
+	 * Transmits queued requests while the window allows.
+	 */
+	void send_deferred(system_tick_t time, Channel& channel);
+
+	bool can_transmit() const
+	{
+		return !deferred && !barrier && in_flight<window;
+	}
+
 	void message_timeout(CoAPMessage& msg, Channel& channel);
 
 public:
 
-	CoAPMessageStore() : head(nullptr) {}
+	CoAPMessageStore() : head(nullptr), deferred(nullptr), deferred_tail(nullptr), in_flight(0), window(CoAPMessage::NSTART),
+			barrier(false), transmitted_callback(nullptr), transmitted_callback_data(nullptr) {}
 
 	~CoAPMessageStore() {
 		clear();
@@ -345,11 +451,40 @@ public:
 
 	bool has_messages() const
 	{
-		return head!=nullptr;
+		return head!=nullptr || deferred!=nullptr;
 	}
 
 	bool has_unacknowledged_requests() const;
 
+	/**
+	 * Sets the maximum number of confirmable requests in flight when sending with a window.
+	 */
+	void set_window(uint8_t window)
+	{
+		this->window = window ? window : 1;
+	}
+
+	uint8_t get_window() const { return window; }
+
+	/**
+	 * Sets the function that is called with the ID of a queued request when process() transmits it.
+	 */
+	void set_transmitted_callback(void (*callback)(message_id_t id, void* data), void* data)
+	{
+		transmitted_callback = callback;
+		transmitted_callback_data = data;
+	}
+
+	/**
+	 * The number of confirmable requests that have been transmitted and are awaiting acknowledgement.
+	 */
+	uint16_t requests_in_flight() const { return in_flight; }
+
+	/**
+	 * Determines if there are requests queued for transmission.
+	 */
+	bool has_deferred_requests() const { return deferred!=nullptr; }
+
 	/**
 	 * Retrieves the current confirmable message that is still
 	 * waiting acknowledgement.
@@ -358,7 +493,9 @@ public:
 	CoAPMessage* from_id(message_id_t id) const
 	{
 		CoAPMessage* prev;
-		CoAPMessage* next = for_id(id, prev);
+		CoAPMessage* next = for_id(head, id, prev);
+		if (!next)
+			next = for_id(deferred, id, prev);
 		return next;
 	}
 
@@ -392,9 +529,13 @@ public:
 	CoAPMessage* remove(message_id_t msg_id)
 	{
 		CoAPMessage* prev;
-		CoAPMessage* msg = for_id(msg_id, prev);
+		CoAPMessage* msg = for_id(head, msg_id, prev);
 		if (msg) {
 			remove(msg, prev);
+		} else {
+			msg = for_id(deferred, msg_id, prev);
+			if (msg)
+				remove_deferred(msg, prev);
 		}
 		return msg;
 	}
@@ -428,57 +569,23 @@ public:
 	}
 
 	/**
-	 * Send a message synchronously, waiting for the acknowledgement.
+	 * Registers that this message has been sent from the application.
+	 * Confirmable messages, and ack/reset responses are cached.
 	 */
-	template<typename Time>
-	ProtocolError send_synchronous(Message& msg, Channel& channel, Time& time)
+	ProtocolError send(Message& msg, system_tick_t time)
 	{
-		message_id_t id = msg.get_id();
-		DEBUG("sending message id=%x synchronously", id);
-		CoAPType::Enum coapType = CoAP::type(msg.buf());
-		ProtocolError error = send(msg, time());
-		if (!error)
-			error = channel.send(msg);
-		if (!error && coapType==CoAPType::CON)
-		{
-			CoAPMessage::delivery_fn flag_delivered = [&error](CoAPMessage::Delivery delivered) {
-				if (delivered==CoAPMessage::NOT_DELIVERED)
-					error = MESSAGE_TIMEOUT;
-				else if (delivered==CoAPMessage::DELIVERED_NACK)
-					error = MESSAGE_RESET;
-			};
-			CoAPMessage* coapmsg = from_id(id);
-			if (coapmsg)
-				coapmsg->set_delivered_handler(&flag_delivered);
-			else
-				ERROR("no coapmessage for msg id=%x", id);
-			while (from_id(id)!=nullptr && !error)
-			{
-				msg.clear();
-				msg.set_length(0);
-				error = channel.receive(msg);
-				if (!error && msg.decode_id() && is_ack_or_reset(msg.buf(), msg.length()))
-				{
-					// handle acknowledgements, waiting for the one that
-					// acknowledges the original confirmation.
-					ProtocolError receive_error = receive(msg, channel, time());
-					if (!error)
-						error = receive_error;
-				}
-				// drop CON messages on the floor since we cannot handle them now
-				process(time(), channel);
-			}
-		}
-		clear_message(id);
-		// todo - if msg contains a delivery callback then call that with the outcome of this
-		return error;
+		return send(msg, time, nullptr);
 	}
 
 	/**
-	 * Registers that this message has been sent from the application.
-	 * Confirmable messages, and ack/reset responses are cached.
+	 * Registers that this message is being sent from the application, limiting the number of
+	 * confirmable requests in flight to the window.
+	 *
+	 * @param deferred	When not null, set to true if the message has been queued and must not be
+	 * 					transmitted by the caller. process() transmits it once the window allows.
+	 * 					When null, the window is not applied.
 	 */
-	ProtocolError send(Message& msg, system_tick_t time);
+	ProtocolError send(Message& msg, system_tick_t time, bool* deferred);
 
 	/**
 	 * Notifies the message store that a message has been received.
@@ -501,6 +608,10 @@ public:
 		{
 			delete remove(head->get_id());
 		}
+		while (deferred!=nullptr)
+		{
+			delete remove(deferred->get_id());
+		}
 	}
 
 };
@@ -590,6 +701,21 @@ public:
 		return server;
 	}
 
+	/**
+	 * Sets the number of confirmable requests that may be awaiting acknowledgement at the same time.
+	 */
+	void set_nstart(uint8_t nstart) {
+		client.set_window(nstart);
+	}
+
+	/**
+	 * Sets the function that is called with the ID of a queued request when it is transmitted,
+	 * so that the caller can start waiting for its acknowledgement.
+	 */
+	void set_deferred_transmitted_callback(void (*callback)(message_id_t id, void* data), void* data) {
+		client.set_transmitted_callback(callback, data);
+	}
+
 	/**
 	 * Clear the message stores when the channel is initially established.
 	 */
@@ -604,18 +730,30 @@ public:
 	 * Sends the message reliably. A non-confirmable message
 	 * it is sent once. A confirmable message is sent and resent
 	 * until an ack is received or the message times out.
+	 *
+	 * Confirmable requests are pipelined: up to NSTART requests are in flight and further
+	 * requests are queued and sent as acknowledgements arrive. A request marked with
+	 * confirm_received holds back the requests that follow it until it is acknowledged.
+	 * This method never waits for an acknowledgement; the outcome is reported through
+	 * the completion handler registered for the message ID.
 	 */
 	ProtocolError send(Message& msg) override
 	{
 		if (msg.send_direct())
 			return delegateChannel.send(msg);
 
-		if (msg.is_request() && msg.get_confirm_received())
-			return client.send_synchronous(msg, delegateChannel, millis);
-
-		// determine the type of message.
-		CoAPMessageStore& store = msg.is_request() ? client : server;
-		ProtocolError error = store.send(msg, millis());
+		ProtocolError error;
+		if (msg.is_request())
+		{
+			bool deferred = false;
+			error = client.send(msg, millis(), &deferred);
+			if (deferred)
+				return error;
+		}
+		else
+		{
+			error = server.send(msg, millis());
+		}
 		if (!error)
 			error = channel::send(msg);
 		return error;
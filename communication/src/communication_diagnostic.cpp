@@ -2,3 +2,7 @@
 
 particle::SimpleIntegerDiagnosticData g_rateLimitedEventsCounter(DIAG_ID_CLOUD_RATE_LIMITED_EVENTS, DIAG_NAME_CLOUD_RATE_LIMITED_EVENTS);
 particle::SimpleIntegerDiagnosticData g_unacknowledgedMessageCounter(DIAG_ID_CLOUD_UNACKNOWLEDGED_MESSAGES, DIAG_NAME_CLOUD_UNACKNOWLEDGED_MESSAGES);
+particle::SimpleIntegerDiagnosticData g_queuedEventsCounter(DIAG_ID_CLOUD_QUEUED_EVENTS, DIAG_NAME_CLOUD_QUEUED_EVENTS);
+particle::SimpleIntegerDiagnosticData g_delayedEventsCounter(DIAG_ID_CLOUD_DELAYED_EVENTS, DIAG_NAME_CLOUD_DELAYED_EVENTS);
+particle::HistogramDiagnosticData g_publishQueueWaitHistogram(DIAG_ID_CLOUD_PUBLISH_QUEUE_WAIT, DIAG_NAME_CLOUD_PUBLISH_QUEUE_WAIT);
+particle::HistogramDiagnosticData g_cloudRoundTripHistogram(DIAG_ID_CLOUD_ROUND_TRIP_TIME, DIAG_NAME_CLOUD_ROUND_TRIP_TIME);
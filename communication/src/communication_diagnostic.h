@@ -2,3 +2,7 @@
 
 extern particle::SimpleIntegerDiagnosticData g_rateLimitedEventsCounter;
 extern particle::SimpleIntegerDiagnosticData g_unacknowledgedMessageCounter;
+extern particle::SimpleIntegerDiagnosticData g_queuedEventsCounter;
+extern particle::SimpleIntegerDiagnosticData g_delayedEventsCounter;
+extern particle::HistogramDiagnosticData g_publishQueueWaitHistogram;
+extern particle::HistogramDiagnosticData g_cloudRoundTripHistogram;
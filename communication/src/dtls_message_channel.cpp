@@ -33,6 +33,8 @@ LOG_SOURCE_CATEGORY("comm.dtls")
 #include "timer_hal.h"
 #include <stdio.h>
 #include <string.h>
+#include <memory>
+#include <new>
 #include "dtls_session_persist.h"
 
 namespace particle { namespace protocol {
@@ -229,14 +231,37 @@ inline int DTLSMessageChannel::send(const uint8_t* data, size_t len)
 {
 	if (move_session && len && data[0]==23)
 	{
-		uint8_t d[len+DEVICE_ID_LEN+1];
-		memcpy(d, data, len);
-		d[0] = 254;
-		memcpy(d+len, device_id, DEVICE_ID_LEN);
-		d[len+DEVICE_ID_LEN] = DEVICE_ID_LEN;
-		int result = callbacks.send(d, len+DEVICE_ID_LEN+1, callbacks.tx_context);
+		// The record is sent with the content type replaced and the device ID appended
+		static const uint8_t content_type = 254;
+		static const uint8_t device_id_len = DEVICE_ID_LEN;
+		const size_t total = len+DEVICE_ID_LEN+1;
+		int result = -1;
+		if (callbacks.send_v)
+		{
+			const SparkIoVec iov[] = {
+				{ &content_type, 1 },
+				{ data+1, len-1 },
+				{ device_id, DEVICE_ID_LEN },
+				{ &device_id_len, 1 }
+			};
+			result = callbacks.send_v(iov, sizeof(iov)/sizeof(iov[0]), callbacks.tx_context);
+		}
+		else
+		{
+			// The transport can only send contiguous buffers. This only happens for the first
+			// record after a session is resumed, so the copy is made on the heap rather than
+			// on the stack of the calling thread
+			std::unique_ptr<uint8_t[]> d(new(std::nothrow) uint8_t[total]);
+			if (!d)
+				return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+			d[0] = content_type;
+			memcpy(d.get()+1, data+1, len-1);
+			memcpy(d.get()+len, device_id, DEVICE_ID_LEN);
+			d[len+DEVICE_ID_LEN] = device_id_len;
+			result = callbacks.send(d.get(), total, callbacks.tx_context);
+		}
 		// hide the increased length from DTLS
-		if (result==int(len+DEVICE_ID_LEN+1))
+		if (result==int(total))
 			result = len;
 		return result;
 	}
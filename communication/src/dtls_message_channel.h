@@ -26,6 +26,7 @@
 #include "device_keys.h"
 #include "message_channel.h"
 #include "buffer_message_channel.h"
+#include "spark_protocol_functions.h"
 
 #include "mbedtls/ssl.h"
 #include "mbedtls/ssl_internal.h"
@@ -65,6 +66,10 @@ public:
 		system_tick_t (*millis)();
 		void (*handle_seed)(const uint8_t* seed, size_t length);
 		int (*send)(const unsigned char *buf, uint32_t buflen, void* handle);
+		/**
+		 * Sends several buffers as a single datagram. Optional.
+		 */
+		int (*send_v)(const SparkIoVec* iov, size_t iovcnt, void* handle);
 		int (*receive)(unsigned char *buf, uint32_t buflen, void* handle);
 
 		// persistence
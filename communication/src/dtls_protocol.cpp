@@ -25,8 +25,14 @@ void DTLSProtocol::init(const char *id,
 		channelCallbacks.save = callbacks.save;
 		channelCallbacks.restore = callbacks.restore;
 	}
+	if (callbacks.size>=56) {
+		channelCallbacks.send_v = callbacks.send_v;
+	}
 
 	channel.set_millis(callbacks.millis);
+	channel.set_deferred_transmitted_callback([](message_id_t id, void* data) {
+		static_cast<DTLSProtocol*>(data)->request_transmitted(id);
+	}, this);
 
 	uint8_t core_public[128];
 	int len = extract_public_ec_key_length(core_public, sizeof(core_public), keys.core_private, determine_der_length(keys.core_private, MAX_DEVICE_PRIVATE_KEY_LENGTH));
@@ -82,14 +82,14 @@ public:
 			break;
 		case ProtocolCommands::DISCONNECT:
 			result = wait_confirmable();
-			ack_handlers.clear();
+			clear_pending_messages();
 			break;
 		case ProtocolCommands::WAKE:
 			wake();
 			result = NO_ERROR;
 			break;
 		case ProtocolCommands::TERMINATE:
-			ack_handlers.clear();
+			clear_pending_messages();
 			result = NO_ERROR;
 			break;
 		case ProtocolCommands::FORCE_PING: {
@@ -27,11 +27,14 @@ int LightSSLProtocol::command(ProtocolCommands::Enum command, uint32_t data)
   int result = UNKNOWN;
   switch (command) {
   case ProtocolCommands::SLEEP:
+    result = this->wait_confirmable();
+    break;
   case ProtocolCommands::DISCONNECT:
     result = this->wait_confirmable();
+    clear_pending_messages();
     break;
   case ProtocolCommands::TERMINATE:
-    ack_handlers.clear();
+    clear_pending_messages();
     result = NO_ERROR;
     break;
   }
@@ -289,7 +289,7 @@ int Protocol::begin()
 	timesync_.reset();
 
 	// FIXME: Pending completion handlers should be cancelled at the end of a previous session
-	ack_handlers.clear();
+	clear_pending_messages();
 	last_ack_handlers_update = callbacks.millis();
 
 	uint32_t channel_flags = 0;
@@ -320,14 +320,15 @@ int Protocol::begin()
 	// causing all the application events to be sent.
 
 	LOG(INFO,"Sending HELLO message");
-	error = hello(descriptor.was_ota_upgrade_successful());
+	bool hello_received = false;
+	error = hello(descriptor.was_ota_upgrade_successful(), &hello_received);
 	if (error)
 	{
 		LOG(ERROR,"Could not send HELLO message: %d", error);
 		return error;
 	}
 
-	if (flags & REQUIRE_HELLO_RESPONSE) {
+	if ((flags & REQUIRE_HELLO_RESPONSE) && !hello_received) {
 		LOG(INFO,"Receiving HELLO response");
 		error = hello_response();
 		if (error)
@@ -341,8 +342,10 @@ int Protocol::begin()
 /**
  * Send the hello message over the channel.
  * @param was_ota_upgrade_successful {@code true} if the previous OTA update was successful.
+ * @param hello_received Set to {@code true} if the hello message from the server was received
+ * 		while waiting for the acknowledgement.
  */
-ProtocolError Protocol::hello(bool was_ota_upgrade_successful)
+ProtocolError Protocol::hello(bool was_ota_upgrade_successful, bool* hello_received)
 {
 	Message message;
 	channel.create(message);
@@ -353,7 +356,63 @@ ProtocolError Protocol::hello(bool was_ota_upgrade_successful)
 	message.set_length(len);
 	message.set_confirm_received(true);
 	last_message_millis = callbacks.millis();
-	return channel.send(message);
+	ProtocolError error = channel.send(message);
+	if (error || !channel.is_unreliable())
+		return error;
+
+	// The reliable channel doesn't wait for the acknowledgement. Wait for it here, so that
+	// a resumed session that the server no longer knows about fails the handshake
+	error = wait_for_ack(message.get_id(), HELLO_ACK_TIMEOUT, CoAPMessageType::HELLO, hello_received);
+	if (error)
+	{
+		LOG(ERROR,"HELLO message not acknowledged: %d", error);
+	}
+	return error;
+}
+
+/**
+ * Wait for a confirmable request to be acknowledged, processing the received messages meanwhile.
+ * @param msg_id			The ID of the request.
+ * @param timeout			The duration to wait for the acknowledgement before giving up.
+ * @param message_type		The type of message to report if it's received while waiting.
+ * @param message_received	Set to {@code true} if a message of that type was received.
+ *
+ * @returns NO_ERROR if the request was acknowledged within the timeout.
+ * Returns MESSAGE_TIMEOUT if the request wasn't acknowledged within the timeout,
+ * or MESSAGE_RESET if the server rejected it.
+ */
+ProtocolError Protocol::wait_for_ack(message_id_t msg_id, system_tick_t timeout,
+		CoAPMessageType::Enum message_type, bool* message_received)
+{
+	struct AckState {
+		int error;
+		bool done;
+	} state = { 0, false };
+	add_ack_handler(msg_id, CompletionHandler([](int error, const void* data, void* callback_data, void* reserved) {
+		const auto state = (AckState*)callback_data;
+		state->error = error;
+		state->done = true;
+	}, &state), timeout);
+
+	ProtocolError error = NO_ERROR;
+	while (!state.done)
+	{
+		CoAPMessageType::Enum msgtype;
+		error = event_loop(msgtype);
+		if (error)
+		{
+			// The handler refers to the state on the stack
+			ack_handlers.setError(msg_id, SYSTEM_ERROR_ABORTED);
+			return error;
+		}
+		if (msgtype == message_type && message_received)
+			*message_received = true;
+	}
+	if (state.error == SYSTEM_ERROR_TIMEOUT)
+		return MESSAGE_TIMEOUT;
+	if (state.error)
+		return MESSAGE_RESET;
+	return NO_ERROR;
 }
 
 ProtocolError Protocol::hello_response()
@@ -423,6 +482,12 @@ ProtocolError Protocol::event_loop(CoAPMessageType::Enum& message_type)
 		}
 	}
 
+	// Send the queued events that are within their rate limit again
+	if (!error && !chunkedTransfer.is_updating())
+	{
+		error = publisher.process(channel, t);
+	}
+
 	if (error)
 	{
 		// bail if and only if there was an error
@@ -164,6 +164,14 @@ protected:
 	 */
 	CompletionHandlerMap<message_id_t> ack_handlers;
 
+	/**
+	 * Cancels the completion handlers and the rate-limited events of the current session.
+	 */
+	void clear_pending_messages()
+	{
+		ack_handlers.clear();
+		publisher.clear_queue(SYSTEM_ERROR_ABORTED);
+	}
 
 	void set_protocol_flags(int flags)
 	{
@@ -181,10 +189,18 @@ protected:
 	ProtocolError handle_key_change(Message& message);
 
 	/**
-	 * Send the hello message over the channel.
+	 * Send the hello message over the channel and wait for it to be acknowledged.
 	 * @param was_ota_upgrade_successful {@code true} if the previous OTA update was successful.
+	 * @param hello_received Set to {@code true} if the hello message from the server was received
+	 * 		while waiting for the acknowledgement.
 	 */
-	ProtocolError hello(bool was_ota_upgrade_successful);
+	ProtocolError hello(bool was_ota_upgrade_successful, bool* hello_received);
+
+	/**
+	 * Wait for a confirmable request to be acknowledged, processing the received messages meanwhile.
+	 */
+	ProtocolError wait_for_ack(message_id_t msg_id, system_tick_t timeout,
+			CoAPMessageType::Enum message_type, bool* message_received);
 
 	/**
 	 * Send a hello response
@@ -319,6 +335,15 @@ public:
 		ack_handlers.addHandler(msg_id, std::move(handler), timeout);
 	}
 
+	/**
+	 * Notification that a request held back by the channel has been transmitted. The timeout
+	 * of its acknowledgement handler starts from this point rather than from when it was queued.
+	 */
+	void request_transmitted(message_id_t msg_id)
+	{
+		ack_handlers.restartTimeout(msg_id);
+	}
+
 	/**
 	 * Determines the checksum of the application state.
 	 * Application state comprises cloud functinos, variables and subscriptions.
@@ -359,7 +384,7 @@ public:
 		return !event_loop(message);
 	}
 
-	// Returns true on success, false on sending timeout or rate-limiting failure
+	// Returns true if the event was sent or queued, false on sending failure or when the event was dropped
 	bool send_event(const char *event_name, const char *data, int ttl,
 			EventType::Enum event_type, int flags, CompletionHandler handler)
 	{
@@ -368,14 +393,32 @@ public:
 			handler.setError(SYSTEM_ERROR_BUSY);
 			return false;
 		}
+		// The publisher completes the handler, also when the event is rejected
 		const ProtocolError error = publisher.send_event(channel, event_name, data, ttl, event_type, flags,
 				callbacks.millis(), std::move(handler));
-		if (error != NO_ERROR)
+		return error == NO_ERROR;
+	}
+
+	/**
+	 * Configures the rate limit for user events with the given name prefix.
+	 * See Publisher::set_rate_limit().
+	 */
+	int set_event_rate_limit(const char* prefix, uint16_t burst, system_tick_t interval, uint8_t priority)
+	{
+		return publisher.set_rate_limit(prefix, burst, interval, priority);
+	}
+
+	int get_event_rate_limit_stats(const char* prefix, spark_protocol_event_rate_limit_stats* stats) const
+	{
+		Publisher::RateLimitStats s = {};
+		const int result = publisher.get_rate_limit_stats(prefix, &s);
+		if (result == 0)
 		{
-			handler.setError(toSystemError(error));
-			return false;
+			stats->sent = s.sent;
+			stats->delayed = s.delayed;
+			stats->dropped = s.dropped;
 		}
-		return true;
+		return result;
 	}
 
 	inline bool send_subscription(const char *event_name, const char *device_id)
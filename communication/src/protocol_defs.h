@@ -59,6 +59,8 @@ system_error_t toSystemError(ProtocolError error);
 
 typedef uint16_t chunk_index_t;
 
+// Chunk indices are sent as 16-bit values by both the server and the device, and the largest
+// index is reserved as NO_CHUNKS_MISSING, so a file can't have more chunks than that
 const chunk_index_t NO_CHUNKS_MISSING = 65535;
 const chunk_index_t MAX_CHUNKS        = 65535;
 const size_t MISSED_CHUNKS_TO_SEND    = 40u;
@@ -81,6 +83,7 @@ const size_t MAX_OPTION_DELTA_LENGTH  = 12;
 
 // Timeout in milliseconds given to receive an acknowledgement for a published event
 const unsigned SEND_EVENT_ACK_TIMEOUT = 20000;
+const unsigned HELLO_ACK_TIMEOUT = 45000;
 
 #ifndef PROTOCOL_BUFFER_SIZE
     #if PLATFORM_ID<2
@@ -19,6 +19,271 @@
 
 #include "protocol.h"
 
-void particle::protocol::Publisher::add_ack_handler(message_id_t msg_id, CompletionHandler handler) {
-    protocol->add_ack_handler(msg_id, std::move(handler), SEND_EVENT_ACK_TIMEOUT);
+#include <cstdlib>
+#include <new>
+
+namespace particle { namespace protocol {
+
+namespace {
+
+// 255 system events per ~65 seconds, matching the previous fixed-window limit
+const uint16_t SYSTEM_EVENT_BURST = 255;
+const system_tick_t SYSTEM_EVENT_INTERVAL = 257;
+// 4 user events per second. A larger burst would let more than 4 events through in the first
+// second, as the bucket starts full and keeps refilling
+const uint16_t USER_EVENT_BURST = 1;
+const system_tick_t USER_EVENT_INTERVAL = 250;
+
+} // namespace
+
+Publisher::Publisher(Protocol* protocol) :
+		protocol(protocol),
+		limits(),
+		queue(nullptr),
+		queue_size(0) {
+	limits[SYSTEM_RATE_LIMIT].bucket = TokenBucket(SYSTEM_EVENT_BURST, SYSTEM_EVENT_INTERVAL);
+	limits[SYSTEM_RATE_LIMIT].priority = 1;
+	limits[USER_RATE_LIMIT].bucket = TokenBucket(USER_EVENT_BURST, USER_EVENT_INTERVAL);
+}
+
+Publisher::~Publisher() {
+	clear_queue(SYSTEM_ERROR_CANCELLED);
+	for (RateLimit& limit: limits) {
+		free(limit.prefix);
+	}
+}
+
+int Publisher::set_rate_limit(const char* prefix, uint16_t burst, system_tick_t interval, uint8_t priority) {
+	if (!burst && interval) {
+		// An empty bucket would never let an event through
+		return SYSTEM_ERROR_INVALID_ARGUMENT;
+	}
+	if (!prefix || !*prefix) {
+		RateLimit& limit = limits[USER_RATE_LIMIT];
+		limit.bucket = TokenBucket(burst, interval);
+		limit.priority = priority;
+		return SYSTEM_ERROR_NONE;
+	}
+	if (is_system(prefix)) {
+		return SYSTEM_ERROR_NOT_ALLOWED;
+	}
+	const size_t length = strnlen(prefix, MAX_EVENT_NAME_LENGTH + 1);
+	if (length > MAX_EVENT_NAME_LENGTH) {
+		return SYSTEM_ERROR_INVALID_ARGUMENT;
+	}
+	RateLimit* limit = const_cast<RateLimit*>(find_rate_limit(prefix));
+	if (!limit) {
+		for (size_t i = USER_RATE_LIMIT + 1; i < RATE_LIMIT_COUNT; ++i) {
+			if (!limits[i].prefix) {
+				limit = &limits[i];
+				break;
+			}
+		}
+		if (!limit) {
+			return SYSTEM_ERROR_LIMIT_EXCEEDED;
+		}
+		limit->prefix = (char*)malloc(length + 1);
+		if (!limit->prefix) {
+			return SYSTEM_ERROR_NO_MEMORY;
+		}
+		memcpy(limit->prefix, prefix, length + 1);
+		limit->prefix_length = length;
+		limit->stats = RateLimitStats();
+	}
+	limit->bucket = TokenBucket(burst, interval);
+	limit->priority = priority;
+	return SYSTEM_ERROR_NONE;
+}
+
+int Publisher::get_rate_limit_stats(const char* prefix, RateLimitStats* stats) const {
+	const RateLimit* limit = find_rate_limit(prefix);
+	if (!limit) {
+		return SYSTEM_ERROR_NOT_FOUND;
+	}
+	*stats = limit->stats;
+	return SYSTEM_ERROR_NONE;
+}
+
+const Publisher::RateLimit* Publisher::find_rate_limit(const char* prefix) const {
+	if (!prefix || !*prefix) {
+		return &limits[USER_RATE_LIMIT];
+	}
+	if (!strcmp(prefix, "spark")) {
+		return &limits[SYSTEM_RATE_LIMIT];
+	}
+	for (size_t i = USER_RATE_LIMIT + 1; i < RATE_LIMIT_COUNT; ++i) {
+		if (limits[i].prefix && !strcmp(limits[i].prefix, prefix)) {
+			return &limits[i];
+		}
+	}
+	return nullptr;
+}
+
+Publisher::RateLimit& Publisher::rate_limit(const char* event_name) {
+	if (is_system(event_name)) {
+		return limits[SYSTEM_RATE_LIMIT];
+	}
+	// The longest matching prefix wins
+	RateLimit* match = &limits[USER_RATE_LIMIT];
+	for (size_t i = USER_RATE_LIMIT + 1; i < RATE_LIMIT_COUNT; ++i) {
+		RateLimit& limit = limits[i];
+		if (limit.prefix && limit.prefix_length > match->prefix_length &&
+				!strncmp(event_name, limit.prefix, limit.prefix_length)) {
+			match = &limit;
+		}
+	}
+	return *match;
+}
+
+ProtocolError Publisher::send_event(MessageChannel& channel, const char* event_name,
+		const char* data, int ttl, EventType::Enum event_type, int flags,
+		system_tick_t time, CompletionHandler handler) {
+	RateLimit& limit = rate_limit(event_name);
+	// Events of the same class that are already waiting go first
+	if (!limit.queued && limit.bucket.consume(time)) {
+		++limit.stats.sent;
+		return send_now(channel, event_name, data, ttl, event_type, flags, std::move(handler));
+	}
+	return enqueue(limit, event_name, data, ttl, event_type, flags, time, std::move(handler));
+}
+
+ProtocolError Publisher::process(MessageChannel& channel, system_tick_t time) {
+	QueuedEvent** link = &queue;
+	while (*link) {
+		QueuedEvent* event = *link;
+		RateLimit& limit = *event->limit;
+		if (!limit.bucket.consume(time)) {
+			link = &event->next;
+			continue;
+		}
+		unlink(link);
+		++limit.stats.sent;
+		g_publishQueueWaitHistogram.add(time - event->time);
+		const ProtocolError error = send_now(channel, event->name, event->data, event->ttl,
+				event->event_type, event->flags, std::move(event->handler));
+		destroy(event);
+		if (error != NO_ERROR) {
+			return error;
+		}
+	}
+	return NO_ERROR;
+}
+
+void Publisher::clear_queue(int error) {
+	while (queue) {
+		QueuedEvent* event = queue;
+		unlink(&queue);
+		event->handler.setError(error);
+		destroy(event);
+	}
+}
+
+ProtocolError Publisher::send_now(MessageChannel& channel, const char* event_name,
+		const char* data, int ttl, EventType::Enum event_type, int flags,
+		CompletionHandler handler) {
+	Message message;
+	channel.create(message);
+	bool confirmable = channel.is_unreliable();
+	if (flags & EventType::NO_ACK) {
+		confirmable = false;
+	} else if (flags & EventType::WITH_ACK) {
+		confirmable = true;
+	}
+	size_t msglen = Messages::event(message.buf(), 0, event_name, data, ttl,
+			event_type, confirmable);
+	message.set_length(msglen);
+	const ProtocolError result = channel.send(message);
+	if (result == NO_ERROR) {
+		// Register completion handler only if acknowledgement was requested explicitly
+		if ((flags & EventType::WITH_ACK) && message.has_id()) {
+			add_ack_handler(message.get_id(), std::move(handler));
+		} else {
+			handler.setResult();
+		}
+	} else {
+		handler.setError(toSystemError(result));
+	}
+	return result;
+}
+
+ProtocolError Publisher::enqueue(RateLimit& limit, const char* event_name,
+		const char* data, int ttl, EventType::Enum event_type, int flags,
+		system_tick_t time, CompletionHandler handler) {
+	if (queue_size >= PUBLISHER_QUEUE_SIZE) {
+		// The queue is sorted by priority, so the last event has the lowest priority and was queued last
+		QueuedEvent** last = &queue;
+		while (*last && (*last)->next) {
+			last = &(*last)->next;
+		}
+		QueuedEvent* event = *last;
+		if (!event || event->limit->priority >= limit.priority) {
+			++limit.stats.dropped;
+			g_rateLimitedEventsCounter++;
+			handler.setError(toSystemError(BANDWIDTH_EXCEEDED));
+			return BANDWIDTH_EXCEEDED;
+		}
+		unlink(last);
+		++event->limit->stats.dropped;
+		g_rateLimitedEventsCounter++;
+		event->handler.setError(toSystemError(BANDWIDTH_EXCEEDED));
+		destroy(event);
+	}
+	// The event name and data are stored in the same allocation, right after the queue entry
+	const size_t name_length = strnlen(event_name, MAX_EVENT_NAME_LENGTH);
+	const size_t data_length = data ? strnlen(data, MAX_EVENT_DATA_LENGTH) : 0;
+	const size_t size = sizeof(QueuedEvent) + name_length + 1 + (data ? data_length + 1 : 0);
+	void* mem = malloc(size);
+	if (!mem) {
+		handler.setError(SYSTEM_ERROR_NO_MEMORY);
+		return INSUFFICIENT_STORAGE;
+	}
+	QueuedEvent* event = new(mem) QueuedEvent();
+	char* name_copy = (char*)(event + 1);
+	memcpy(name_copy, event_name, name_length);
+	name_copy[name_length] = '\0';
+	event->name = name_copy;
+	if (data) {
+		char* data_copy = name_copy + name_length + 1;
+		memcpy(data_copy, data, data_length);
+		data_copy[data_length] = '\0';
+		event->data = data_copy;
+	}
+	event->limit = &limit;
+	event->handler = std::move(handler);
+	event->ttl = ttl;
+	event->flags = flags;
+	event->time = time;
+	event->event_type = event_type;
+	// Insert after all events with the same or a higher priority
+	QueuedEvent** link = &queue;
+	while (*link && (*link)->limit->priority >= limit.priority) {
+		link = &(*link)->next;
+	}
+	event->next = *link;
+	*link = event;
+	++queue_size;
+	++limit.queued;
+	++limit.stats.delayed;
+	g_queuedEventsCounter = queue_size;
+	g_delayedEventsCounter++;
+	return NO_ERROR;
+}
+
+void Publisher::unlink(QueuedEvent** link) {
+	QueuedEvent* event = *link;
+	*link = event->next;
+	--queue_size;
+	--event->limit->queued;
+	g_queuedEventsCounter = queue_size;
+}
+
+void Publisher::destroy(QueuedEvent* event) {
+	event->~QueuedEvent();
+	free(event);
+}
+
+void Publisher::add_ack_handler(message_id_t msg_id, CompletionHandler handler) {
+	protocol->add_ack_handler(msg_id, std::move(handler), SEND_EVENT_ACK_TIMEOUT);
 }
+
+}} // namespace particle::protocol
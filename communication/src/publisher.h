@@ -34,95 +34,190 @@ namespace protocol
 
 class Protocol;
 
-class Publisher
+/**
+ * The maximum number of rate limits that can be configured for user event name prefixes.
+ */
+#ifndef PUBLISHER_MAX_RATE_LIMITS
+#define PUBLISHER_MAX_RATE_LIMITS 4
+#endif
+
+/**
+ * The maximum number of over-budget events held back until tokens become available.
+ */
+#ifndef PUBLISHER_QUEUE_SIZE
+#define PUBLISHER_QUEUE_SIZE 8
+#endif
+
+/**
+ * A token bucket that holds up to `burst` tokens and gains one token every `interval` milliseconds.
+ * An interval of 0 disables the limit.
+ */
+class TokenBucket
 {
 public:
-	explicit Publisher(Protocol* protocol) :
-			protocol(protocol)
+	TokenBucket() :
+			TokenBucket(0, 0)
 	{
 	}
 
-	inline bool is_system(const char* event_name)
+	TokenBucket(uint16_t burst, system_tick_t interval) :
+			burst(burst),
+			tokens(burst),
+			interval(interval),
+			last(0)
 	{
-		return !strncmp(event_name, "spark", 5);
 	}
 
-	bool is_rate_limited(bool is_system_event, system_tick_t millis)
+	/**
+	 * Takes a token from the bucket. Returns false if the bucket is empty.
+	 */
+	bool consume(system_tick_t time)
+	{
+		if (!interval)
+			return true;
+		refill(time);
+		if (!tokens)
+			return false;
+		--tokens;
+		return true;
+	}
+
+	uint16_t get_burst() const { return burst; }
+	system_tick_t get_interval() const { return interval; }
+
+private:
+	uint16_t burst;
+	uint16_t tokens;
+	system_tick_t interval;
+	system_tick_t last;
+
+	void refill(system_tick_t time)
 	{
-		if (is_system_event)
+		if (tokens>=burst)
 		{
-			static uint16_t lastMinute = 0;
-			static uint8_t eventsThisMinute = 0;
-
-			uint16_t currentMinute = uint16_t(millis >> 16);
-			if (currentMinute == lastMinute)
-			{      // == handles millis() overflow
-				if (eventsThisMinute == 255)
-					return true;
-			}
-			else
-			{
-				lastMinute = currentMinute;
-				eventsThisMinute = 0;
-			}
-			eventsThisMinute++;
+			// the refill period starts when the first token is taken from a full bucket
+			last = time;
+			return;
 		}
-		else
+		const system_tick_t count = (time - last) / interval;
+		if (count)
 		{
-			static system_tick_t recent_event_ticks[5] =
-			{ (system_tick_t) -1000, (system_tick_t) -1000,
-					(system_tick_t) -1000, (system_tick_t) -1000,
-					(system_tick_t) -1000 };
-			static int evt_tick_idx = 0;
-
-			system_tick_t now = recent_event_ticks[evt_tick_idx] = millis;
-			evt_tick_idx++;
-			evt_tick_idx %= 5;
-			if (now - recent_event_ticks[evt_tick_idx] < 1000)
-			{
-				// exceeded allowable burst of 4 events per second
-				return true;
-			}
+			tokens = (count >= system_tick_t(burst - tokens)) ? burst : tokens + count;
+			last += count * interval;
 		}
-		return false;
 	}
+};
+
+/**
+ * Sends events to the cloud, subject to per-class rate limits.
+ *
+ * System events (prefixed "spark") and user events are limited by separate token buckets.
+ * Further buckets can be configured for user event name prefixes. An event that exceeds its
+ * budget is queued and sent from `process()` once a token is available. The queue is ordered by
+ * the priority of the event's rate limit, and events sharing a rate limit are sent in the order
+ * they were published. When the queue is full, the event with the lowest priority is dropped.
+ */
+class Publisher
+{
+public:
+	struct RateLimitStats
+	{
+		uint32_t sent;
+		uint32_t delayed;
+		uint32_t dropped;
+	};
+
+	explicit Publisher(Protocol* protocol);
+	~Publisher();
+
+	inline bool is_system(const char* event_name)
+	{
+		return !strncmp(event_name, "spark", 5);
+	}
+
+	/**
+	 * Configures the rate limit for user events whose name starts with `prefix`. An empty or
+	 * null prefix configures the default limit for user events.
+	 *
+	 * @param burst The number of events that can be sent back to back. Must be at least 1 unless
+	 *        rate limiting is disabled.
+	 * @param interval The time in milliseconds it takes to regain one event of the burst.
+	 *        0 disables rate limiting for the prefix.
+	 * @param priority The queueing priority of events that exceed the limit. Higher values are sent first.
+	 */
+	int set_rate_limit(const char* prefix, uint16_t burst, system_tick_t interval, uint8_t priority = 0);
+
+	/**
+	 * Retrieves the counters of the rate limit configured for `prefix`.
+	 */
+	int get_rate_limit_stats(const char* prefix, RateLimitStats* stats) const;
 
 	ProtocolError send_event(MessageChannel& channel, const char* event_name,
 			const char* data, int ttl, EventType::Enum event_type, int flags,
-			system_tick_t time, CompletionHandler handler)
-	{
-		bool is_system_event = is_system(event_name);
-		bool rate_limited = is_rate_limited(is_system_event, time);
-		if (rate_limited) {
-			g_rateLimitedEventsCounter++;
-			return BANDWIDTH_EXCEEDED;
-		}
+			system_tick_t time, CompletionHandler handler);
 
-		Message message;
-		channel.create(message);
-		bool confirmable = channel.is_unreliable();
-		if (flags & EventType::NO_ACK) {
-			confirmable = false;
-		} else if (flags & EventType::WITH_ACK) {
-			confirmable = true;
-		}
-		size_t msglen = Messages::event(message.buf(), 0, event_name, data, ttl,
-				event_type, confirmable);
-		message.set_length(msglen);
-		const ProtocolError result = channel.send(message);
-		if (result == NO_ERROR) {
-			// Register completion handler only if acknowledgement was requested explicitly
-			if ((flags & EventType::WITH_ACK) && message.has_id()) {
-			    add_ack_handler(message.get_id(), std::move(handler));
-			} else {
-			    handler.setResult();
-			}
-		}
-		return result;
+	/**
+	 * Sends queued events for which tokens have become available.
+	 */
+	ProtocolError process(MessageChannel& channel, system_tick_t time);
+
+	/**
+	 * Discards all queued events, completing them with the given error.
+	 */
+	void clear_queue(int error);
+
+	size_t queued_events() const
+	{
+		return queue_size;
 	}
 
 private:
+	struct RateLimit
+	{
+		char* prefix;
+		size_t prefix_length;
+		TokenBucket bucket;
+		uint8_t priority;
+		uint8_t queued;
+		RateLimitStats stats;
+	};
+
+	struct QueuedEvent
+	{
+		QueuedEvent* next;
+		RateLimit* limit;
+		CompletionHandler handler;
+		const char* name;
+		const char* data;
+		int ttl;
+		int flags;
+		system_tick_t time; // Time when the event was queued
+		EventType::Enum event_type;
+	};
+
+	enum
+	{
+		SYSTEM_RATE_LIMIT = 0,
+		USER_RATE_LIMIT = 1,
+		RATE_LIMIT_COUNT = PUBLISHER_MAX_RATE_LIMITS + 2
+	};
+
 	Protocol* protocol;
+	RateLimit limits[RATE_LIMIT_COUNT];
+	QueuedEvent* queue;
+	size_t queue_size;
+
+	RateLimit& rate_limit(const char* event_name);
+	const RateLimit* find_rate_limit(const char* prefix) const;
+
+	ProtocolError send_now(MessageChannel& channel, const char* event_name,
+			const char* data, int ttl, EventType::Enum event_type, int flags,
+			CompletionHandler handler);
+	ProtocolError enqueue(RateLimit& limit, const char* event_name,
+			const char* data, int ttl, EventType::Enum event_type, int flags,
+			system_tick_t time, CompletionHandler handler);
+	void unlink(QueuedEvent** link);
+	static void destroy(QueuedEvent* event);
 
 	void add_ack_handler(message_id_t msg_id, CompletionHandler handler);
 };
@@ -214,6 +214,20 @@ int spark_protocol_get_describe_data(ProtocolFacade* protocol, spark_protocol_de
 	return protocol->get_describe_data(data, reserved);
 }
 
+int spark_protocol_set_event_rate_limit(ProtocolFacade* protocol, const char* prefix, uint16_t burst,
+		system_tick_t interval, uint8_t priority, void* reserved)
+{
+	ASSERT_ON_SYSTEM_THREAD();
+	return protocol->set_event_rate_limit(prefix, burst, interval, priority);
+}
+
+int spark_protocol_get_event_rate_limit_stats(ProtocolFacade* protocol, const char* prefix,
+		spark_protocol_event_rate_limit_stats* stats, void* reserved)
+{
+	ASSERT_ON_SYSTEM_THREAD();
+	return protocol->get_event_rate_limit_stats(prefix, stats);
+}
+
 #if HAL_PLATFORM_MESH
 int spark_protocol_mesh_command(ProtocolFacade* protocol, MeshCommand::Enum cmd, uint32_t data, void* extraData, completion_handler_data* completion, void* reserved) {
 	(void)reserved;
@@ -352,5 +366,15 @@ int spark_protocol_get_describe_data(ProtocolFacade* protocol, spark_protocol_de
 	return -1;
 }
 
+int spark_protocol_set_event_rate_limit(ProtocolFacade* protocol, const char* prefix, uint16_t burst,
+		system_tick_t interval, uint8_t priority, void* reserved) {
+	return -1;
+}
+
+int spark_protocol_get_event_rate_limit_stats(ProtocolFacade* protocol, const char* prefix,
+		spark_protocol_event_rate_limit_stats* stats, void* reserved) {
+	return -1;
+}
+
 
 #endif
@@ -54,6 +54,15 @@ enum ProtocolFactory
 	PROTOCOL_DTLS,
 };
 
+/**
+ * A buffer that is sent as part of a larger message (see SparkCallbacks::send_v).
+ */
+struct SparkIoVec
+{
+	const void* data;
+	size_t size;
+};
+
 struct SparkCallbacks
 {
     uint16_t size;
@@ -116,9 +125,17 @@ struct SparkCallbacks
 	int (*restore)(void* data, size_t max_length, uint8_t type, void* reserved);
 
 	// size == 52
+
+	/**
+	 * Sends the concatenation of the given buffers as a single message. Optional.
+	 * Returns the total number of bytes sent.
+	 */
+	int (*send_v)(const SparkIoVec* iov, size_t iovcnt, void* handle);
+
+	// size == 56
 };
 
-PARTICLE_STATIC_ASSERT(SparkCallbacks_size, sizeof(SparkCallbacks)==(sizeof(void*)*13));
+PARTICLE_STATIC_ASSERT(SparkCallbacks_size, sizeof(SparkCallbacks)==(sizeof(void*)*14));
 
 /**
  * Application-supplied callbacks. (Deliberately distinct from the system-supplied
@@ -193,6 +210,29 @@ typedef struct {
 
 int spark_protocol_get_describe_data(ProtocolFacade* protocol, spark_protocol_describe_data* limits, void* reserved);
 
+typedef struct {
+	uint32_t sent;				// number of events sent
+	uint32_t delayed;			// number of events queued because they exceeded the rate limit
+	uint32_t dropped;			// number of events dropped because the queue was full
+} spark_protocol_event_rate_limit_stats;
+
+/**
+ * Configures the rate limit for user events whose name starts with `prefix`. An empty prefix
+ * configures the default limit for user events.
+ *
+ * @param burst The number of events that can be sent back to back (at least 1).
+ * @param interval The time in milliseconds it takes to regain one event of the burst. 0 disables the limit.
+ * @param priority The queueing priority of events that exceed the limit. Higher values are sent first.
+ */
+int spark_protocol_set_event_rate_limit(ProtocolFacade* protocol, const char* prefix, uint16_t burst,
+		system_tick_t interval, uint8_t priority, void* reserved);
+
+/**
+ * Retrieves the counters of the rate limit configured for `prefix`.
+ */
+int spark_protocol_get_event_rate_limit_stats(ProtocolFacade* protocol, const char* prefix,
+		spark_protocol_event_rate_limit_stats* stats, void* reserved);
+
 namespace ProtocolCommands {
   enum Enum {
     SLEEP,
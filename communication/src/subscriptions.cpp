@@ -0,0 +1,286 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include "subscriptions.h"
+
+#include <new>
+
+namespace particle
+{
+namespace protocol
+{
+
+uint32_t Subscriptions::compute_subscriptions_checksum(calculate_crc_fn calculate_crc)
+{
+	if (checksum_fn == calculate_crc)
+		return checksum;
+	uint32_t result = 0;
+	for (Entry* entry = entries; entry; entry = entry->next)
+	{
+		FilteringEventHandler& handler = entry->info;
+		if (!handler.handler)
+			continue;
+		if (!entry->crc_valid || crc_fn != calculate_crc)
+		{
+			entry->crc[0] = calculate_crc((const uint8_t*)handler.device_id, sizeof(handler.device_id));
+			entry->crc[1] = calculate_crc((const uint8_t*)handler.filter, sizeof(handler.filter));
+			entry->crc[2] = calculate_crc((const uint8_t*)&handler.scope, sizeof(handler.scope));
+			entry->crc_valid = true;
+		}
+		uint32_t chk[4];
+		chk[0] = result;
+		chk[1] = entry->crc[0];
+		chk[2] = entry->crc[1];
+		chk[3] = entry->crc[2];
+		result = calculate_crc((const uint8_t*)chk, sizeof(chk));
+	}
+	checksum = result;
+	checksum_fn = calculate_crc;
+	crc_fn = calculate_crc;
+	return result;
+}
+
+bool Subscriptions::index(Entry* entry)
+{
+	const char* filter = entry->info.filter;
+	const size_t length = filter_length(entry->info);
+	Node* node = &root;
+	size_t pos = 0;
+	while (pos < length)
+	{
+		Node** link = &node->child;
+		while (*link && (*link)->label[0] != filter[pos])
+			link = &(*link)->sibling;
+		Node* child = *link;
+		if (!child)
+		{
+			void* mem = node_pool.allocate();
+			if (!mem)
+				return false;
+			child = new(mem) Node();
+			child->label = filter + pos;
+			child->length = length - pos;
+			*link = child;
+			node = child;
+			break;
+		}
+		size_t common = 1;
+		while (common < child->length && pos + common < length && child->label[common] == filter[pos + common])
+			common++;
+		if (common < child->length)
+		{
+			// split the edge at the end of the common prefix
+			void* mem = node_pool.allocate();
+			if (!mem)
+				return false;
+			Node* split = new(mem) Node();
+			split->label = child->label;
+			split->length = common;
+			split->child = child;
+			split->sibling = child->sibling;
+			child->label += common;
+			child->length -= common;
+			child->sibling = nullptr;
+			*link = split;
+			child = split;
+		}
+		node = child;
+		pos += common;
+	}
+	// keep the handlers for the same filter in the order they were added
+	Entry** tail = &node->entries;
+	while (*tail)
+		tail = &(*tail)->next_match;
+	entry->next_match = nullptr;
+	*tail = entry;
+	return true;
+}
+
+void Subscriptions::rebuild_index()
+{
+	node_pool.clear();
+	root = Node();
+	for (Entry* entry = entries; entry; entry = entry->next)
+	{
+		if (entry->info.handler && !index(entry))
+			return;
+	}
+	index_dirty = false;
+}
+
+void Subscriptions::free_removed()
+{
+	Entry* prev = nullptr;
+	for (Entry* entry = entries; entry;)
+	{
+		Entry* next = entry->next;
+		if (!entry->info.handler)
+		{
+			(prev ? prev->next : entries) = next;
+			entry_pool.release(entry);
+		}
+		else
+		{
+			prev = entry;
+		}
+		entry = next;
+	}
+	entries_tail = prev;
+	has_removed = false;
+	if (!entries)
+		entry_pool.clear();
+}
+
+void Subscriptions::update_index()
+{
+	// the index must not change while it is being traversed
+	if (dispatching)
+		return;
+	if (has_removed)
+		free_removed();
+	if (index_dirty)
+		rebuild_index();
+}
+
+void Subscriptions::dispatch(const char* event_name, size_t event_name_length, const char* data,
+		call_event_handler_fn call_event_handler)
+{
+	++dispatching;
+	const Node* node = &root;
+	size_t pos = 0;
+	for (;;)
+	{
+		for (Entry* entry = node->entries; entry; entry = entry->next_match)
+		{
+			FilteringEventHandler& info = entry->info;
+			if (!info.handler)
+				continue; // removed by a handler called earlier
+			// don't call the handler directly, use a callback for it.
+			if (!call_event_handler)
+			{
+				if (info.handler_data)
+				{
+					EventHandlerWithData handler = (EventHandlerWithData) info.handler;
+					handler(info.handler_data, event_name, data);
+				}
+				else
+				{
+					info.handler(event_name, data);
+				}
+			}
+			else
+			{
+				call_event_handler(sizeof(FilteringEventHandler), &info, event_name, data, NULL);
+			}
+		}
+		if (pos == event_name_length)
+			break;
+		const Node* child = node->child;
+		while (child && child->label[0] != event_name[pos])
+			child = child->sibling;
+		if (!child || child->length > event_name_length - pos ||
+				memcmp(child->label, event_name + pos, child->length))
+			break;
+		pos += child->length;
+		node = child;
+	}
+	--dispatching;
+	update_index();
+}
+
+void Subscriptions::remove_event_handlers(const char* event_name)
+{
+	for (Entry* entry = entries; entry; entry = entry->next)
+	{
+		if (NULL == event_name || !strncmp(event_name, entry->info.filter, sizeof(entry->info.filter)))
+		{
+			entry->info.handler = nullptr;
+			has_removed = true;
+			index_dirty = true;
+		}
+	}
+	if (has_removed)
+		checksum_fn = nullptr;
+	update_index();
+}
+
+bool Subscriptions::event_handler_exists(const char *event_name, EventHandler handler,
+		void *handler_data, SubscriptionScope::Enum scope, const char* id)
+{
+	for (Entry* entry = entries; entry; entry = entry->next)
+	{
+		const FilteringEventHandler& info = entry->info;
+		if (info.handler == handler
+				&& info.handler_data == handler_data
+				&& info.scope == scope)
+		{
+			const size_t MAX_FILTER_LEN = sizeof(info.filter);
+			const size_t FILTER_LEN = strnlen(event_name, MAX_FILTER_LEN);
+			if (!strncmp(info.filter, event_name, FILTER_LEN))
+			{
+				const size_t MAX_ID_LEN = sizeof(info.device_id) - 1;
+				const size_t id_len = id ? strnlen(id, MAX_ID_LEN) : 0;
+				if (id_len)
+					return !strncmp(info.device_id, id, id_len);
+				else
+					return !info.device_id[0];
+			}
+		}
+	}
+	return false;
+}
+
+ProtocolError Subscriptions::add_event_handler(const char *event_name, EventHandler handler,
+		void *handler_data, SubscriptionScope::Enum scope, const char* id)
+{
+	if (event_handler_exists(event_name, handler, handler_data, scope, id))
+		return NO_ERROR;
+
+	void* mem = entry_pool.allocate();
+	if (!mem)
+		return INSUFFICIENT_STORAGE;
+	Entry* entry = new(mem) Entry();
+	FilteringEventHandler& info = entry->info;
+	const size_t MAX_FILTER_LEN = sizeof(info.filter);
+	const size_t FILTER_LEN = strnlen(event_name, MAX_FILTER_LEN);
+	memcpy(info.filter, event_name, FILTER_LEN);
+	info.handler = handler;
+	info.handler_data = handler_data;
+	const size_t MAX_ID_LEN = sizeof(info.device_id) - 1;
+	const size_t id_len = id ? strnlen(id, MAX_ID_LEN) : 0;
+	if (id_len)
+		memcpy(info.device_id, id, id_len);
+	info.scope = scope;
+
+	if (!dispatching && !index_dirty && !index(entry))
+	{
+		entry_pool.release(entry);
+		return INSUFFICIENT_STORAGE;
+	}
+	(entries_tail ? entries_tail->next : entries) = entry;
+	entries_tail = entry;
+	checksum_fn = nullptr;
+	if (dispatching)
+		index_dirty = true;
+	update_index();
+	return NO_ERROR;
+}
+
+}
+}
@@ -19,23 +19,94 @@
 
 #pragma once
 
+#include "protocol_defs.h"
+#include "events.h"
+#include "message_channel.h"
+#include "messages.h"
+#include "chunked_pool.h"
+#include <stdint.h>
+
 namespace particle
 {
 namespace protocol
 {
 
-#include "protocol_defs.h"
-#include "events.h"
-#include "message_channel.h"
-#include <stdint.h>
+/**
+ * The number of subscriptions, or filter index nodes, allocated from the heap at a time.
+ */
+#ifndef SUBSCRIPTIONS_POOL_CHUNK_SIZE
+#define SUBSCRIPTIONS_POOL_CHUNK_SIZE 8
+#endif
 
+/**
+ * Holds the event handlers registered by the application.
+ *
+ * The number of subscriptions is only limited by the available memory. The filters are
+ * indexed in a radix trie, so that dispatching an event takes time proportional to the length
+ * of the event name rather than to the number of subscriptions.
+ */
 class Subscriptions
 {
 public:
 	typedef uint32_t (*calculate_crc_fn)(const unsigned char *buf, uint32_t buflen);
+	typedef void (*call_event_handler_fn)(uint16_t size, FilteringEventHandler* handler,
+			const char* event, const char* data, void* reserved);
 
 private:
-	FilteringEventHandler event_handlers[5];
+	/**
+	 * A subscription. `info` is passed to the event handler callback as is.
+	 */
+	struct Entry
+	{
+		FilteringEventHandler info;
+		// the next subscription in the order they were added
+		Entry* next;
+		// the next subscription with the same filter
+		Entry* next_match;
+		// CRCs of the device ID, filter and scope, cached for the subscriptions checksum
+		uint32_t crc[3];
+		bool crc_valid;
+	};
+
+	/**
+	 * A node of the filter index. The label is a substring of one of the indexed filters.
+	 */
+	struct Node
+	{
+		const char* label;
+		uint8_t length;
+		Node* child;
+		Node* sibling;
+		// the subscriptions whose filter ends at this node
+		Entry* entries;
+	};
+
+	ChunkedPool<Entry, SUBSCRIPTIONS_POOL_CHUNK_SIZE> entry_pool;
+	ChunkedPool<Node, SUBSCRIPTIONS_POOL_CHUNK_SIZE> node_pool;
+	Node root;
+	Entry* entries;
+	Entry* entries_tail;
+	// nonzero while event handlers are being called
+	uint8_t dispatching;
+	bool index_dirty;
+	bool has_removed;
+	uint32_t checksum;
+	// the function used for the cached checksum, or null if the subscriptions changed since
+	calculate_crc_fn checksum_fn;
+	// the function used for the cached CRCs of the individual subscriptions
+	calculate_crc_fn crc_fn;
+
+	static size_t filter_length(const FilteringEventHandler& info)
+	{
+		return strnlen(info.filter, sizeof(info.filter));
+	}
+
+	bool index(Entry* entry);
+	void rebuild_index();
+	void update_index();
+	void free_removed();
+	void dispatch(const char* event_name, size_t event_name_length, const char* data,
+			call_event_handler_fn call_event_handler);
 
 protected:
 
@@ -60,31 +131,28 @@ protected:
 
 public:
 
-	Subscriptions()
+	Subscriptions() :
+			root(),
+			entries(nullptr),
+			entries_tail(nullptr),
+			dispatching(0),
+			index_dirty(false),
+			has_removed(false),
+			checksum(0),
+			checksum_fn(nullptr),
+			crc_fn(nullptr)
 	{
-		memset(&event_handlers, 0, sizeof(event_handlers));
 	}
 
-	uint32_t compute_subscriptions_checksum(calculate_crc_fn calculate_crc)
-	{
-		uint32_t checksum = 0;
-		for_each([&checksum, calculate_crc](FilteringEventHandler& handler){
-			uint32_t chk[4];
-			chk[0] = checksum;
-			chk[1] = calculate_crc((const uint8_t*)handler.device_id, sizeof(handler.device_id));
-			chk[2] = calculate_crc((const uint8_t*)handler.filter, sizeof(handler.filter));
-			chk[3] = calculate_crc((const uint8_t*)&handler.scope, sizeof(handler.scope));
-			checksum = calculate_crc((const uint8_t*)chk, sizeof(chk));
-			return NO_ERROR;
-		});
-		return checksum;
-	}
+	/**
+	 * Computes the checksum of all subscriptions. The result and the CRCs of the individual
+	 * subscriptions are cached until the subscriptions change.
+	 */
+	uint32_t compute_subscriptions_checksum(calculate_crc_fn calculate_crc);
 
 	ProtocolError handle_event(Message& message,
-			void (*call_event_handler)(uint16_t size,
-					FilteringEventHandler* handler, const char* event,
-					const char* data, void* reserved),
-					MessageChannel& channel)
+			call_event_handler_fn call_event_handler,
+			MessageChannel& channel)
 	{
 		const unsigned len = message.length();
 		uint8_t* queue = message.buf();
@@ -150,66 +218,18 @@ public:
 		// null terminate event name string
 		event_name[event_name_length] = 0;
 
-		const int NUM_HANDLERS = sizeof(event_handlers)
-				/ sizeof(FilteringEventHandler);
-		for (int i = 0; i < NUM_HANDLERS; i++)
-		{
-			if (NULL == event_handlers[i].handler)
-			{
-				break;
-			}
-			const size_t MAX_FILTER_LENGTH = sizeof(event_handlers[i].filter);
-			const size_t filter_length = strnlen(event_handlers[i].filter,
-					MAX_FILTER_LENGTH);
-
-			if (event_name_length < filter_length)
-			{
-				// does not match this filter, try the next event handler
-				continue;
-			}
-
-			const int cmp = memcmp(event_handlers[i].filter, event_name,
-					filter_length);
-			if (0 == cmp)
-			{
-				// don't call the handler directly, use a callback for it.
-				if (!call_event_handler)
-				{
-					if (event_handlers[i].handler_data)
-					{
-						EventHandlerWithData handler =
-								(EventHandlerWithData) event_handlers[i].handler;
-						handler(event_handlers[i].handler_data,
-								(char *) event_name, (char *) data);
-					}
-					else
-					{
-						event_handlers[i].handler((char *) event_name,
-								(char *) data);
-					}
-				}
-				else
-				{
-					call_event_handler(sizeof(FilteringEventHandler),
-							&event_handlers[i], (const char*) event_name,
-							(const char*) data, NULL);
-				}
-			}
-			// else continue the for loop to try the next handler
-		}
+		dispatch((const char*) event_name, event_name_length, (const char*) data, call_event_handler);
 		return NO_ERROR;
 	}
 
 	template<typename F> ProtocolError for_each(F callback)
 	{
-		const int NUM_HANDLERS = sizeof(event_handlers)
-				/ sizeof(FilteringEventHandler);
 		ProtocolError error = NO_ERROR;
-		for (unsigned i = 0; i < NUM_HANDLERS; i++)
+		for (Entry* entry = entries; entry; entry = entry->next)
 		{
-			if (nullptr != event_handlers[i].handler)
+			if (nullptr != entry->info.handler)
 			{
-				error = callback(event_handlers[i]);
+				error = callback(entry->info);
 				if (error)
 					break;
 			}
@@ -217,100 +237,22 @@ public:
 		return error;
 	}
 
-	void remove_event_handlers(const char* event_name)
-	{
-		if (NULL == event_name)
-		{
-			memset(event_handlers, 0, sizeof(event_handlers));
-		}
-		else
-		{
-			const int NUM_HANDLERS = sizeof(event_handlers)
-					/ sizeof(FilteringEventHandler);
-			int dest = 0;
-			for (int i = 0; i < NUM_HANDLERS; i++)
-			{
-				if (!strcmp(event_name, event_handlers[i].filter))
-				{
-					memset(&event_handlers[i], 0, sizeof(event_handlers[i]));
-				}
-				else
-				{
-					if (dest != i)
-					{
-						memcpy(event_handlers + dest, event_handlers + i,
-								sizeof(event_handlers[i]));
-						memset(event_handlers + i, 0,
-								sizeof(event_handlers[i]));
-					}
-					dest++;
-				}
-			}
-		}
-	}
+	/**
+	 * Removes the handlers with the given filter, or all handlers if `event_name` is null.
+	 */
+	void remove_event_handlers(const char* event_name);
 
 	/**
 	 * Determines if the given handler exists.
 	 */
 	bool event_handler_exists(const char *event_name, EventHandler handler,
-			void *handler_data, SubscriptionScope::Enum scope, const char* id)
-	{
-		const int NUM_HANDLERS = sizeof(event_handlers)
-				/ sizeof(FilteringEventHandler);
-		for (int i = 0; i < NUM_HANDLERS; i++)
-		{
-			if (event_handlers[i].handler == handler
-					&& event_handlers[i].handler_data == handler_data
-					&& event_handlers[i].scope == scope)
-			{
-				const size_t MAX_FILTER_LEN = sizeof(event_handlers[i].filter);
-				const size_t FILTER_LEN = strnlen(event_name, MAX_FILTER_LEN);
-				if (!strncmp(event_handlers[i].filter, event_name, FILTER_LEN))
-				{
-					const size_t MAX_ID_LEN =
-							sizeof(event_handlers[i].device_id) - 1;
-					const size_t id_len = id ? strnlen(id, MAX_ID_LEN) : 0;
-					if (id_len)
-						return !strncmp(event_handlers[i].device_id, id, id_len);
-					else
-						return !event_handlers[i].device_id[0];
-				}
-			}
-		}
-		return false;
-	}
+			void *handler_data, SubscriptionScope::Enum scope, const char* id);
 
 	/**
 	 * Adds the given handler.
 	 */
 	ProtocolError add_event_handler(const char *event_name, EventHandler handler,
-			void *handler_data, SubscriptionScope::Enum scope, const char* id)
-	{
-		if (event_handler_exists(event_name, handler, handler_data, scope, id))
-			return NO_ERROR;
-
-		const int NUM_HANDLERS = sizeof(event_handlers) / sizeof(FilteringEventHandler);
-		for (int i = 0; i < NUM_HANDLERS; i++)
-		{
-			if (NULL == event_handlers[i].handler)
-			{
-				const size_t MAX_FILTER_LEN = sizeof(event_handlers[i].filter);
-				const size_t FILTER_LEN = strnlen(event_name, MAX_FILTER_LEN);
-				memcpy(event_handlers[i].filter, event_name, FILTER_LEN);
-				memset(event_handlers[i].filter + FILTER_LEN, 0, MAX_FILTER_LEN - FILTER_LEN);
-				event_handlers[i].handler = handler;
-				event_handlers[i].handler_data = handler_data;
-				event_handlers[i].device_id[0] = 0;
-				const size_t MAX_ID_LEN = sizeof(event_handlers[i].device_id) - 1;
-				const size_t id_len = id ? strnlen(id, MAX_ID_LEN) : 0;
-				memcpy(event_handlers[i].device_id, id, id_len);
-				event_handlers[i].device_id[id_len] = 0;
-				event_handlers[i].scope = scope;
-				return NO_ERROR;
-			}
-		}
-		return INSUFFICIENT_STORAGE;
-	}
+			void *handler_data, SubscriptionScope::Enum scope, const char* id);
 
 	inline ProtocolError send_subscriptions(MessageChannel& channel)
 	{
@@ -0,0 +1,261 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include <set>
+#include <vector>
+
+#include "chunked_transfer.h"
+
+#include "catch.hpp"
+#include "fakeit.hpp"
+
+using namespace particle::protocol;
+using namespace fakeit;
+
+namespace {
+
+const uint16_t CHUNK_SIZE = 16;
+
+uint32_t checksum(const unsigned char* buf, uint32_t len)
+{
+	uint32_t sum = 0;
+	for (uint32_t i = 0; i < len; i++)
+		sum = sum * 31 + buf[i];
+	return sum;
+}
+
+/**
+ * Drives a ChunkedTransfer with OTA messages and records what it writes and sends.
+ */
+class Transfer
+{
+	Mock<ChunkedTransfer::Callbacks> callbacks;
+	Mock<MessageChannel> channel;
+	uint8_t out[600];
+	uint8_t in[600];
+
+public:
+	ChunkedTransfer transfer;
+	std::vector<uint32_t> written;
+	std::vector<std::vector<uint8_t>> sent;
+	// the number of chunks written when each message was sent
+	std::vector<size_t> written_when_sent;
+	std::set<uint32_t> fail_writes;
+	uint32_t file_length;
+
+	Transfer(uint32_t file_length, bool fast_ota = true) : file_length(file_length)
+	{
+		When(Method(callbacks,prepare_for_firmware_update)).AlwaysReturn(0);
+		When(Method(callbacks,finish_firmware_update)).AlwaysReturn(0);
+		When(Method(callbacks,millis)).AlwaysReturn(0);
+		When(Method(callbacks,calculate_crc)).AlwaysDo(checksum);
+		When(Method(callbacks,save_firmware_chunk)).AlwaysDo([this](FileTransfer::Descriptor& file, const unsigned char* chunk, void*) {
+			REQUIRE(chunk[0] == uint8_t(file.chunk_address / CHUNK_SIZE));
+			if (fail_writes.erase(file.chunk_address))
+				return -1;
+			written.push_back(file.chunk_address);
+			return 0;
+		});
+		When(Method(channel,is_unreliable)).AlwaysReturn(false);
+		When(Method(channel,create)).AlwaysDo([this](Message& msg, size_t) {
+			msg.set_buffer(out, sizeof(out));
+			return NO_ERROR;
+		});
+		When(Method(channel,response)).AlwaysDo([this](Message&, Message& msg, size_t) {
+			msg.set_buffer(out, sizeof(out));
+			return NO_ERROR;
+		});
+		When(Method(channel,send)).AlwaysDo([this](Message& msg) {
+			sent.push_back(std::vector<uint8_t>(msg.buf(), msg.buf() + msg.length()));
+			written_when_sent.push_back(written.size());
+			return NO_ERROR;
+		});
+		transfer.init(&callbacks.get());
+
+		uint8_t begin[20] = { 0x41, 0x02, 0x00, 0x01, 0x01, 0xB1, 'u', 0xFF, uint8_t(fast_ota ? 0x01 : 0x00) };
+		begin[9] = CHUNK_SIZE >> 8;
+		begin[10] = CHUNK_SIZE & 0xFF;
+		begin[11] = file_length >> 24;
+		begin[12] = file_length >> 16;
+		begin[13] = file_length >> 8;
+		begin[14] = file_length;
+		memcpy(in, begin, sizeof(begin));
+		Message message(in, sizeof(in), sizeof(begin));
+		REQUIRE(transfer.handle_update_begin(1, message, channel.get()) == NO_ERROR);
+		REQUIRE(transfer.is_updating());
+	}
+
+	void chunk(uint16_t idx)
+	{
+		const size_t len = std::min<size_t>(CHUNK_SIZE, file_length - idx * CHUNK_SIZE);
+		uint8_t data[CHUNK_SIZE];
+		memset(data, uint8_t(idx), len);
+		const uint32_t crc = checksum(data, len);
+		const uint8_t header[] = { 0x51, 0x02, 0x00, 0x02, 0x01, 0xB1, 'c',
+				0x44, uint8_t(crc >> 24), uint8_t(crc >> 16), uint8_t(crc >> 8), uint8_t(crc),
+				0x02, uint8_t(idx >> 8), uint8_t(idx), 0xFF };
+		memcpy(in, header, sizeof(header));
+		memcpy(in + sizeof(header), data, len);
+		Message message(in, sizeof(in), sizeof(header) + len);
+		REQUIRE(transfer.handle_chunk(1, message, channel.get()) == NO_ERROR);
+	}
+
+	/**
+	 * Sends the next chunk without an index, as in regular OTA.
+	 */
+	void regular_chunk(uint16_t idx)
+	{
+		const size_t len = std::min<size_t>(CHUNK_SIZE, file_length - idx * CHUNK_SIZE);
+		uint8_t data[CHUNK_SIZE];
+		memset(data, uint8_t(idx), len);
+		const uint32_t crc = checksum(data, len);
+		const uint8_t header[] = { 0x41, 0x02, 0x00, 0x02, 0x01, 0xB1, 'c',
+				0x44, uint8_t(crc >> 24), uint8_t(crc >> 16), uint8_t(crc >> 8), uint8_t(crc), 0xFF };
+		memcpy(in, header, sizeof(header));
+		memcpy(in + sizeof(header), data, len);
+		Message message(in, sizeof(in), sizeof(header) + len);
+		REQUIRE(transfer.handle_chunk(1, message, channel.get()) == NO_ERROR);
+	}
+
+	void idle()
+	{
+		REQUIRE(transfer.idle(channel.get()) == NO_ERROR);
+	}
+
+	/**
+	 * Sends UpdateDone and returns the chunk indices requested again.
+	 */
+	std::vector<uint16_t> done()
+	{
+		const uint8_t msg[] = { 0x41, 0x03, 0x00, 0x03, 0x01, 0xB1, 'u' };
+		memcpy(in, msg, sizeof(msg));
+		Message message(in, sizeof(in), sizeof(msg));
+		sent.clear();
+		REQUIRE(transfer.handle_update_done(1, message, channel.get()) == NO_ERROR);
+		std::vector<uint16_t> missing;
+		for (auto& m: sent)
+		{
+			if (m.size() >= 7 && m[4] == 0xB1 && m[5] == 'c')
+			{
+				for (size_t i = 7; i + 1 < m.size(); i += 2)
+					missing.push_back(m[i] << 8 | m[i + 1]);
+			}
+		}
+		return missing;
+	}
+};
+
+} // namespace
+
+SCENARIO("ChunkedTransfer writes a chunk after the next one is received or when idle")
+{
+	Transfer t(CHUNK_SIZE * 3);
+	t.chunk(0);
+	REQUIRE(t.written.empty());
+	t.chunk(1);
+	REQUIRE(t.written == std::vector<uint32_t>({ 0 }));
+	t.idle();
+	REQUIRE(t.written == std::vector<uint32_t>({ 0, CHUNK_SIZE }));
+	t.chunk(2);
+	REQUIRE(t.done().empty());
+	REQUIRE(t.written.size() == 3);
+	REQUIRE_FALSE(t.transfer.is_updating());
+}
+
+SCENARIO("ChunkedTransfer requests the missing chunks of a large file")
+{
+	// larger than a bitmap in the tail of the channel buffer could hold
+	const uint16_t chunks = 6000;
+	Transfer t(CHUNK_SIZE * chunks - 3);
+	std::vector<uint16_t> expected;
+	for (uint16_t i = 0; i < chunks; i++)
+	{
+		if ((i >= 100 && i < 110) || i == 4000 || i >= chunks - 2)
+			expected.push_back(i);
+		else
+			t.chunk(i);
+	}
+	std::vector<uint16_t> missing = t.done();
+	REQUIRE(missing.size() <= MISSED_CHUNKS_TO_SEND);
+	REQUIRE(missing == expected);
+	for (uint16_t i: expected)
+		t.chunk(i);
+	REQUIRE(t.done().empty());
+	REQUIRE(t.written.size() == chunks);
+}
+
+SCENARIO("ChunkedTransfer requests a chunk again when it cannot be written")
+{
+	Transfer t(CHUNK_SIZE * 4);
+	t.fail_writes.insert(CHUNK_SIZE * 2);
+	for (uint16_t i = 0; i < 4; i++)
+		t.chunk(i);
+	REQUIRE(t.done() == std::vector<uint16_t>({ 2 }));
+	t.chunk(2);
+	REQUIRE(t.done().empty());
+	REQUIRE(t.written == std::vector<uint32_t>({ 0, CHUNK_SIZE, CHUNK_SIZE * 3, CHUNK_SIZE * 2 }));
+}
+
+SCENARIO("ChunkedTransfer writes a regular OTA chunk before confirming it")
+{
+	Transfer t(CHUNK_SIZE * 2, false);
+	t.sent.clear();
+	t.written_when_sent.clear();
+	t.regular_chunk(0);
+	REQUIRE(t.written == std::vector<uint32_t>({ 0 }));
+	// the CoAP acknowledgement, then the ChunkReceived response
+	REQUIRE(t.sent.size() == 2);
+	REQUIRE(t.sent.back()[1] == ChunkReceivedCode::OK);
+	REQUIRE(t.written_when_sent.back() == 1);
+
+	AND_WHEN("a chunk cannot be written")
+	{
+		t.fail_writes.insert(CHUNK_SIZE);
+		t.regular_chunk(1);
+		THEN("it is reported as bad so that the server sends it again")
+		{
+			REQUIRE(t.sent.back()[1] == ChunkReceivedCode::BAD);
+			t.regular_chunk(1);
+			REQUIRE(t.sent.back()[1] == ChunkReceivedCode::OK);
+			REQUIRE(t.written == std::vector<uint32_t>({ 0, CHUNK_SIZE }));
+			REQUIRE(t.done().empty());
+		}
+	}
+}
+
+SCENARIO("ChunkedTransfer ignores a chunk past the end of the file")
+{
+	Transfer t(CHUNK_SIZE * 2);
+	t.chunk(0);
+	t.chunk(1);
+	t.chunk(2);
+	t.idle();
+	REQUIRE(t.written == std::vector<uint32_t>({ 0, CHUNK_SIZE }));
+	REQUIRE(t.done().empty());
+}
+
+SCENARIO("ChunkedTransfer drops the staged chunks when the transfer is cancelled")
+{
+	Transfer t(CHUNK_SIZE * 3);
+	t.chunk(0);
+	t.chunk(1);
+	t.transfer.cancel();
+	t.idle();
+	REQUIRE(t.written == std::vector<uint32_t>({ 0 }));
+}
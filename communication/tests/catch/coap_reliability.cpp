@@ -18,6 +18,7 @@
  */
 
 #include <climits>
+#include <vector>
 
 #include "coap_channel.h"
 #include "forward_message_channel.h"
@@ -267,6 +268,68 @@ SCENARIO("adding the same message twice")
 	REQUIRE(CoAPMessage::messages()==0);
 }
 
+SCENARIO("messages with colliding ids can be removed in any order")
+{
+	GIVEN("a message store with messages that hash to the same index position")
+	{
+		CoAPMessageStore store;
+		const message_id_t ids[] = { 0x0010, 0x0110, 0x0011, 0x0210, 0x0012 };
+		for (message_id_t id: ids)
+			REQUIRE(store.add(new CoAPMessage(id))==NO_ERROR);
+
+		WHEN("a message in the middle of a probe sequence is removed")
+		{
+			delete store.remove(0x0110);
+			THEN("the remaining messages can still be retrieved")
+			{
+				REQUIRE(store.from_id(0x0110)==nullptr);
+				for (message_id_t id: ids)
+					if (id!=0x0110)
+						REQUIRE(store.from_id(id)!=nullptr);
+			}
+			AND_WHEN("the first message is removed")
+			{
+				delete store.remove(0x0010);
+				THEN("the remaining messages can still be retrieved")
+				{
+					REQUIRE(store.from_id(0x0011)!=nullptr);
+					REQUIRE(store.from_id(0x0210)!=nullptr);
+					REQUIRE(store.from_id(0x0012)!=nullptr);
+				}
+			}
+		}
+	}
+	REQUIRE(CoAPMessage::messages()==0);
+}
+
+SCENARIO("a message store is not limited to a fixed number of messages")
+{
+	GIVEN("a message store holding many messages")
+	{
+		CoAPMessageStore store;
+		message_id_t id = 0xFFC0;		// wraps around
+		for (size_t i=0; i<100; i++)
+			REQUIRE(store.add(new CoAPMessage(id++))==NO_ERROR);
+
+		THEN("all the messages can be retrieved")
+		{
+			for (message_id_t i=0; i<100; i++)
+				REQUIRE(store.from_id(message_id_t(0xFFC0+i))!=nullptr);
+		}
+		AND_WHEN("a message is removed")
+		{
+			delete store.remove(0xFFF4);
+			THEN("the other messages remain")
+			{
+				REQUIRE(store.from_id(0xFFF4)==nullptr);
+				REQUIRE(store.from_id(0xFFF3)!=nullptr);
+				REQUIRE(store.from_id(0xFFF5)!=nullptr);
+			}
+		}
+	}
+	REQUIRE(CoAPMessage::messages()==0);
+}
+
 void build_message_channel_mock(Mock<MessageChannel>& mock)
 {
 	When(Method(mock,notify_established)).AlwaysReturn(NO_ERROR);
@@ -694,130 +757,6 @@ SCENARIO("a repeated confirmable CoAP message is passed only once to the applica
 	}
 }
 
-template<typename R>
-struct Callme
-{
-	virtual R operator()()=0;
-};
-
-SCENARIO("the send_synchronous method blocks until the message is sent or the send fails or the send times out")
-{
-	GIVEN("A confirmable message marked as confirm received")
-	{
-		uint8_t buf[] = { 0x40, 0, 0x12, 0x34, 0xFF, 1, 2, 3, 4 };
-		Message m(buf, sizeof(buf), sizeof(buf));
-		m.set_confirm_received(true);
-		m.decode_id();
-		Mock<MessageChannel> mock;
-		build_message_channel_mock(mock);
-		MessageChannel& channel = mock.get();
-		CoAPMessageStore store;
-
-		typedef Callme<system_tick_t> time_source;
-		Mock<time_source> mockTime;
-		time_source& time = mockTime.get();
-		system_tick_t time_count = 0;
-		auto time_increment = [&time_count]() { return time_count+=1000; };
-		When(Method(mockTime, operator())).AlwaysDo(time_increment);
-
-		WHEN("the message is sent")
-		{
-			REQUIRE(m.get_id()==0x1234);
-			AND_WHEN("the channel retrieves a response")
-			{
-				uint8_t buf2[5];
-				Message ack(buf2, sizeof(buf2));
-				ack.set_length(Messages::empty_ack(buf2, 0x12, 0x34));
-
-				auto receive_ack = [&ack](Message& msg) {
-					msg.set_buffer(ack.buf(), ack.capacity());
-					msg.set_length(ack.length());
-					return NO_ERROR;
-				};
-				When(Method(mock,receive)).Do(receive_ack);
-
-				auto verify_msg = [&m](Message& msg) {
-					REQUIRE(m.get_id()==msg.get_id());
-					REQUIRE(m.length()==msg.length());
-					REQUIRE(!memcmp(m.buf(), msg.buf(), msg.length()));
-					return NO_ERROR;
-				};
-				When(Method(mock,send)).AlwaysDo(verify_msg);
-
-				THEN("the send_synchronous method returns success")
-				{
-					ProtocolError error = store.send_synchronous(m, channel, time);
-					REQUIRE(error==NO_ERROR);
-					AND_THEN("the CoAP message is purged")
-					{
-						REQUIRE(store.from_id(0x1234)==nullptr);
-					}
-				}
-			}
-
-			AND_WHEN("no response is received")
-			{
-				// receive endlessly receives no packets
-				auto receive_none = [](Message& msg) {
-					msg.set_length(0);
-					return NO_ERROR;
-				};
-				When(Method(mock,receive)).AlwaysDo(receive_none);
-
-				auto verify_msg = [buf](Message& msg) {
-					// NB: the passed in message instance is re-used to retrieve messages from the channel
-					// hence m will be equal to th eempty message. (Previous code tried comparing m==msg which consequently failed.)
-
-					REQUIRE(9==msg.length());
-					REQUIRE(!memcmp(buf, msg.buf(), msg.length()));
-					REQUIRE(0x1234==msg.get_id());
-					return NO_ERROR;
-				};
-				When(Method(mock,send)).AlwaysDo(verify_msg);
-
-				THEN("the send_synchronous method times out")
-				{
-					ProtocolError error = store.send_synchronous(m, channel, time);
-					REQUIRE(error==MESSAGE_TIMEOUT);
-					AND_THEN("the CoAP message is purged")
-					{
-						REQUIRE(store.from_id(0x1234)==nullptr);
-					}
-				}
-			}
-
-			AND_WHEN("the error response IO_ERROR is received on the first send")
-			{
-				When(Method(mock,send)).Return(IO_ERROR);
-				THEN("the send_synchronous method fails with IO_ERROR")
-				{
-					ProtocolError error = store.send_synchronous(m, channel, time);
-					REQUIRE(error==IO_ERROR);
-					AND_THEN("the CoAP message is purged")
-					{
-						REQUIRE(store.from_id(0x1234)==nullptr);
-					}
-				}
-			}
-
-			AND_WHEN("the error response IO_ERROR is received the second send")
-			{
-				When(Method(mock,send)).Return(NO_ERROR);
-				When(Method(mock,send)).Return(IO_ERROR);
-				THEN("the send_synchronous method fails with IO_ERROR")
-				{
-					ProtocolError error = store.send_synchronous(m, channel, time);
-					REQUIRE(error==IO_ERROR);
-					AND_THEN("the CoAP message is purged")
-					{
-						REQUIRE(store.from_id(0x1234)==nullptr);
-					}
-				}
-			}
-		}
-	}
-}
-
 /**
  * A reliable CoAP Channel that uses a forwarding message channel.
  * This allows the actual message channel to be set later (e.g. a mock.)
@@ -1067,7 +1006,7 @@ SCENARIO("client and server can send requests with the same message ID and they
 }
 
 
-SCENARIO("a message flagged as confirm received waits synchronously for acknowledgement")
+SCENARIO("a message flagged as confirm received is sent without waiting for acknowledgement")
 {
 	GIVEN("a message flagged as confirm received and a reliable channel")
 	{
@@ -1093,49 +1032,256 @@ SCENARIO("a message flagged as confirm received waits synchronously for acknowle
 			return NO_ERROR;
 		};
 
+		uint8_t rbuf[16];
+		Message r(rbuf, sizeof(rbuf));
+
 		WHEN("the message is sent and not acknowledged")
 		{
 			When(Method(mock,send)).AlwaysReturn(NO_ERROR);
 			When(Method(mock,receive)).AlwaysDo(no_message);
 			ProtocolError error = channel.send(m);
-			AND_WHEN("the request has timed out")
+			THEN("send returns immediately")
 			{
-				CHECK(ticks>=CoAPMessage::MAX_TRANSMIT_SPAN+0);
+				REQUIRE(error==NO_ERROR);
+				REQUIRE(ticks<=50);
+				Verify(Method(mock,receive)).Exactly(0);
 			}
-			THEN("an error response is returned")
+			AND_WHEN("the request has timed out")
 			{
-				REQUIRE(error==MESSAGE_TIMEOUT);
-				Verify(Method(mock,send)).Exactly(CoAPMessage::MAX_RETRANSMIT+1);
+				while (channel.client_messages().from_id(0x1234) && ticks<CoAPMessage::MAX_TRANSMIT_SPAN*2)
+					channel.receive(r);
+				THEN("the message has been resent MAX_RETRANSMIT times and removed")
+				{
+					CHECK(ticks>=CoAPMessage::MAX_TRANSMIT_SPAN+0);
+					REQUIRE(channel.client_messages().from_id(0x1234)==nullptr);
+					Verify(Method(mock,send)).Exactly(CoAPMessage::MAX_RETRANSMIT+1);
+				}
 			}
 		}
 
 		WHEN("the message is sent and negatively acknowledged")
 		{
 			When(Method(mock,send)).Return(NO_ERROR);
+			REQUIRE(channel.send(m)==NO_ERROR);
 			auto receive_nak = [](Message& msg) {
 				msg.set_length(Messages::reset(msg.buf(), 0x12, 0x34));
 				return NO_ERROR;
 			};
 			When(Method(mock,receive)).Do(receive_nak);
-			ProtocolError error = channel.send(m);
-			THEN("a MESSAGE_RESET response is returned")
+			When(Method(mock,command)).AlwaysReturn(NO_ERROR);
+			REQUIRE(channel.receive(r)==NO_ERROR);
+			THEN("the message is removed and the reset is passed to the application")
 			{
-				REQUIRE(error==MESSAGE_RESET);
-				REQUIRE(ticks<=50);	// was 30 when tested - not critical
+				REQUIRE(channel.client_messages().from_id(0x1234)==nullptr);
+				REQUIRE(r.get_type()==CoAPType::RESET);
 			}
 		}
 
 		WHEN("the message is sent and acknowledged")
 		{
 			When(Method(mock,send)).AlwaysReturn(NO_ERROR);
+			REQUIRE(channel.send(m)==NO_ERROR);
 			When(Method(mock,receive)).Do(receive_server_ack);
-			ProtocolError error = channel.send(m);
-			THEN("a success response is returned")
+			REQUIRE(channel.receive(r)==NO_ERROR);
+			THEN("the message is removed and the acknowledgement is passed to the application")
 			{
-				REQUIRE(error==NO_ERROR);
-				REQUIRE(ticks<=50);	// was 30 when tested - not critical
+				REQUIRE(channel.client_messages().from_id(0x1234)==nullptr);
+				REQUIRE(channel.client_messages().requests_in_flight()==0);
+				REQUIRE(r.get_type()==CoAPType::ACK);
 			}
 		}
+	}
+	REQUIRE(CoAPMessage::messages()==0);
+}
 
+SCENARIO("many unacknowledged messages are each retransmitted when due")
+{
+	GIVEN("a store with confirmable messages sent at different times")
+	{
+		Mock<MessageChannel> mock;
+		MessageChannel& channel = mock.get();
+		build_message_channel_mock(mock);
+		When(Method(mock,send)).AlwaysReturn(NO_ERROR);
+
+		CoAPMessageStore store;
+		const int count = 20;
+		for (int i=0; i<count; i++)
+		{
+			uint8_t buf[] = { 0x40, 0, 0x10, uint8_t(i) };
+			Message m(buf, sizeof(buf), sizeof(buf));
+			m.decode_id();
+			REQUIRE(store.send(m, i*500)==NO_ERROR);
+		}
+
+		WHEN("time passes without any acknowledgements")
+		{
+			int resent = 0;
+			system_tick_t time = 0;
+			// each message expires within MAX_TRANSMIT_SPAN*2 of being sent
+			const system_tick_t last_sent = (count-1)*500;
+			for (; time<last_sent+CoAPMessage::MAX_TRANSMIT_SPAN*2 && store.has_messages(); time += 100)
+			{
+				for (int i=0; i<count; i++)
+				{
+					const CoAPMessage* cm = store.from_id(0x1000+i);
+					if (cm && time_has_passed(time, cm->get_timeout()))
+						resent++;
+				}
+				store.process(time, channel);
+			}
+
+			THEN("every message is retransmitted MAX_RETRANSMIT times and then expires")
+			{
+				REQUIRE(!store.has_messages());
+				Verify(Method(mock,send)).Exactly(count*CoAPMessage::MAX_RETRANSMIT);
+				REQUIRE(resent==count*(CoAPMessage::MAX_RETRANSMIT+1));
+			}
+		}
 	}
+	REQUIRE(CoAPMessage::messages()==0);
+}
+
+SCENARIO("confirmable requests beyond NSTART are queued until earlier requests are acknowledged")
+{
+	GIVEN("a reliable CoAP channel with NSTART of 2")
+	{
+		Mock<MessageChannel> mock;
+		MessageChannel& delegate = mock.get();
+		system_tick_t now = 0;
+		auto time = [&now]() { return now; };
+		ForwardCoAPReliableChannel<decltype(time)> channel(delegate, time);
+		channel.set_nstart(2);
+		std::vector<message_id_t> transmitted;
+		channel.set_deferred_transmitted_callback([](message_id_t id, void* data) {
+			static_cast<std::vector<message_id_t>*>(data)->push_back(id);
+		}, &transmitted);
+
+		std::vector<message_id_t> sent;
+		When(Method(mock,send)).AlwaysDo([&sent](Message& msg) {
+			msg.decode_id();
+			sent.push_back(msg.get_id());
+			return NO_ERROR;
+		});
+
+		WHEN("three confirmable requests are sent")
+		{
+			for (uint8_t i=1; i<=3; i++)
+			{
+				uint8_t buf[] = { 0x40, 0, 0, i, 0xFF, i };
+				Message m(buf, sizeof(buf), sizeof(buf));
+				m.decode_id();
+				REQUIRE(channel.send(m)==NO_ERROR);
+			}
+
+			THEN("only the first two are transmitted")
+			{
+				REQUIRE(sent==std::vector<message_id_t>({ 1, 2 }));
+				REQUIRE(channel.client_messages().requests_in_flight()==2);
+				REQUIRE(channel.client_messages().has_deferred_requests());
+				REQUIRE(channel.client_messages().from_id(3)!=nullptr);
+			}
+
+			AND_WHEN("the first request is acknowledged")
+			{
+				When(Method(mock,receive)).Do([](Message& msg) {
+					msg.set_length(Messages::empty_ack(msg.buf(), 0, 1));
+					return NO_ERROR;
+				});
+				now = 3000;
+				uint8_t buf[16];
+				Message m(buf, sizeof(buf));
+				REQUIRE(channel.receive(m)==NO_ERROR);
+
+				THEN("the queued request is transmitted and its retransmit clock starts then")
+				{
+					REQUIRE(sent==std::vector<message_id_t>({ 1, 2, 3 }));
+					REQUIRE(transmitted==std::vector<message_id_t>({ 3 }));
+					REQUIRE(channel.client_messages().requests_in_flight()==2);
+					REQUIRE(!channel.client_messages().has_deferred_requests());
+					const CoAPMessage* cm = channel.client_messages().from_id(3);
+					REQUIRE(cm!=nullptr);
+					REQUIRE(cm->get_transmit_time()==3000);
+					REQUIRE(cm->get_timeout()>=3000+CoAPMessage::ACK_TIMEOUT);
+				}
+			}
+		}
+	}
+	REQUIRE(CoAPMessage::messages()==0);
+}
+
+SCENARIO("a request marked as confirm received holds back later requests without blocking the sender")
+{
+	GIVEN("a reliable CoAP channel")
+	{
+		Mock<MessageChannel> mock;
+		MessageChannel& delegate = mock.get();
+		system_tick_t now = 0;
+		auto time = [&now]() { return now; };
+		ForwardCoAPReliableChannel<decltype(time)> channel(delegate, time);
+		build_message_channel_mock(mock);
+
+		std::vector<message_id_t> sent;
+		When(Method(mock,send)).AlwaysDo([&sent](Message& msg) {
+			msg.decode_id();
+			sent.push_back(msg.get_id());
+			return NO_ERROR;
+		});
+
+		WHEN("a confirm received request is followed by another request")
+		{
+			uint8_t hello[] = { 0x40, 0, 0, 1, 0xFF, 1 };
+			Message m1(hello, sizeof(hello), sizeof(hello));
+			m1.decode_id();
+			m1.set_confirm_received(true);
+			REQUIRE(channel.send(m1)==NO_ERROR);
+
+			uint8_t event[] = { 0x40, 0, 0, 2, 0xFF, 2 };
+			Message m2(event, sizeof(event), sizeof(event));
+			m2.decode_id();
+			REQUIRE(channel.send(m2)==NO_ERROR);
+
+			THEN("send returns without waiting and only the first request is transmitted")
+			{
+				REQUIRE(sent==std::vector<message_id_t>({ 1 }));
+			}
+
+			AND_WHEN("a request from the server arrives before the acknowledgement")
+			{
+				When(Method(mock,receive)).Do([](Message& msg) {
+					uint8_t con[] = { 0x40, 0x01, 0x55, 0x66 };
+					memcpy(msg.buf(), con, sizeof(con));
+					msg.set_length(sizeof(con));
+					return NO_ERROR;
+				});
+				uint8_t buf[16];
+				Message m(buf, sizeof(buf));
+				REQUIRE(channel.receive(m)==NO_ERROR);
+
+				THEN("the request is passed to the application")
+				{
+					REQUIRE(m.length()==4);
+					REQUIRE(sent==std::vector<message_id_t>({ 1 }));
+				}
+			}
+
+			AND_WHEN("the request is not acknowledged in time")
+			{
+				When(Method(mock,receive)).AlwaysDo([](Message& msg) {
+					msg.set_length(0);
+					return NO_ERROR;
+				});
+				uint8_t buf[16];
+				Message m(buf, sizeof(buf));
+				for (now = 0; now<CoAPMessage::MAX_TRANSMIT_SPAN*2 && channel.client_messages().from_id(1); now += 1000)
+					channel.receive(m);
+
+				THEN("the request expires and the held back request is released")
+				{
+					REQUIRE(channel.client_messages().from_id(1)==nullptr);
+					REQUIRE(sent.back()==2);
+				}
+			}
+		}
+	}
+	REQUIRE(CoAPMessage::messages()==0);
 }
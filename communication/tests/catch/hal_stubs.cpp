@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include "logging.h"
+#include "diagnostics.h"
 
 extern "C" uint32_t HAL_RNG_GetRandomNumber()
 {
@@ -36,6 +37,16 @@ extern "C" void log_message(int level, const char *category, LogAttributes *attr
 {
 }
 
+extern "C" int log_category_level(const char *category, LogCategoryCache *cache, void *reserved)
+{
+	return LOG_LEVEL_ALL;
+}
+
 extern "C" void log_write(int level, const char *category, const char *data, size_t size, void *reserved)
 {
 }
+
+extern "C" int diag_register_source(const diag_source* src, void* reserved)
+{
+	return 0;
+}
@@ -0,0 +1,225 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include <string>
+#include <vector>
+
+#include "publisher.h"
+#include "coap.h"
+
+#include "catch.hpp"
+#include "fakeit.hpp"
+
+using namespace particle::protocol;
+using namespace fakeit;
+using particle::CompletionHandler;
+
+namespace {
+
+/**
+ * Records the names of the events sent through a mocked message channel.
+ */
+struct EventChannel
+{
+	Mock<MessageChannel> mock;
+	uint8_t buf[600];
+	std::vector<std::string> sent;
+
+	EventChannel()
+	{
+		When(Method(mock,is_unreliable)).AlwaysReturn(false);
+		When(Method(mock,create)).AlwaysDo([this](Message& msg, size_t) {
+			msg.set_buffer(buf, sizeof(buf));
+			return NO_ERROR;
+		});
+		When(Method(mock,send)).AlwaysDo([this](Message& msg) {
+			// the event name is the second Uri-Path option, following "e"
+			const uint8_t* p = msg.buf() + 4;
+			p += 1 + (*p & 0x0F);
+			const size_t len = *p & 0x0F;
+			sent.push_back(std::string((const char*)p + 1, len));
+			return NO_ERROR;
+		});
+	}
+
+	MessageChannel& get() { return mock.get(); }
+};
+
+struct Completion
+{
+	int error = 1;
+
+	static void callback(int error, const void*, void* data, void*)
+	{
+		static_cast<Completion*>(data)->error = error;
+	}
+
+	CompletionHandler handler() { return CompletionHandler(callback, this); }
+};
+
+ProtocolError publish(Publisher& publisher, EventChannel& channel, const char* name, system_tick_t time,
+		CompletionHandler handler = CompletionHandler())
+{
+	return publisher.send_event(channel.get(), name, "data", 60, EventType::PRIVATE, 0, time, std::move(handler));
+}
+
+} // namespace
+
+SCENARIO("TokenBucket allows a burst and then one token per interval")
+{
+	TokenBucket bucket(2, 100);
+	REQUIRE(bucket.consume(1000));
+	REQUIRE(bucket.consume(1000));
+	REQUIRE_FALSE(bucket.consume(1050));
+	REQUIRE(bucket.consume(1100));
+	REQUIRE_FALSE(bucket.consume(1150));
+	// idle time refills up to the burst size only
+	REQUIRE(bucket.consume(5000));
+	REQUIRE(bucket.consume(5000));
+	REQUIRE_FALSE(bucket.consume(5000));
+}
+
+SCENARIO("TokenBucket with a zero interval is unlimited")
+{
+	TokenBucket bucket(0, 0);
+	for (int i=0; i<1000; i++)
+		REQUIRE(bucket.consume(0));
+}
+
+SCENARIO("TokenBucket handles millis() overflow")
+{
+	TokenBucket bucket(1, 100);
+	REQUIRE(bucket.consume(system_tick_t(-50)));
+	REQUIRE_FALSE(bucket.consume(system_tick_t(-1)));
+	REQUIRE(bucket.consume(50));
+}
+
+SCENARIO("User events over budget are queued and sent as tokens become available")
+{
+	EventChannel channel;
+	Publisher publisher(nullptr);
+	Completion completions[6];
+	for (int i=0; i<6; i++)
+		REQUIRE(publish(publisher, channel, std::to_string(i).c_str(), 0, completions[i].handler())==NO_ERROR);
+
+	REQUIRE(channel.sent.size()==1);
+	REQUIRE(publisher.queued_events()==5);
+	REQUIRE(completions[0].error==SYSTEM_ERROR_NONE);
+	REQUIRE(completions[1].error==1);
+
+	REQUIRE(publisher.process(channel.get(), 100)==NO_ERROR);
+	REQUIRE(channel.sent.size()==1);
+	REQUIRE(publisher.process(channel.get(), 250)==NO_ERROR);
+	REQUIRE(channel.sent.size()==2);
+	REQUIRE(channel.sent.back()=="1");
+	REQUIRE(completions[1].error==SYSTEM_ERROR_NONE);
+
+	// a new event is sent after the ones already waiting
+	REQUIRE(publish(publisher, channel, "6", 500)==NO_ERROR);
+	REQUIRE(channel.sent.size()==2);
+	for (system_tick_t time=500; time<=1500; time+=250)
+		REQUIRE(publisher.process(channel.get(), time)==NO_ERROR);
+	REQUIRE(channel.sent.size()==7);
+	REQUIRE(channel.sent[5]=="5");
+	REQUIRE(channel.sent.back()=="6");
+	REQUIRE(publisher.queued_events()==0);
+}
+
+SCENARIO("No more than 4 user events are sent in any second")
+{
+	EventChannel channel;
+	Publisher publisher(nullptr);
+	std::vector<system_tick_t> sent;
+	for (system_tick_t time=0; time<5000; time+=10)
+	{
+		const size_t count = channel.sent.size();
+		publish(publisher, channel, "event", time);
+		publisher.process(channel.get(), time);
+		for (size_t i=count; i<channel.sent.size(); i++)
+			sent.push_back(time);
+	}
+	REQUIRE(sent.size()>=19);
+	for (size_t i=4; i<sent.size(); i++)
+		REQUIRE(sent[i]-sent[i-4]>=1000);
+}
+
+SCENARIO("System events have their own budget")
+{
+	EventChannel channel;
+	Publisher publisher(nullptr);
+	for (int i=0; i<4; i++)
+		publish(publisher, channel, "user", 0);
+	REQUIRE(publish(publisher, channel, "spark/status", 0)==NO_ERROR);
+	REQUIRE(channel.sent.size()==2);
+	REQUIRE(channel.sent.back()=="spark/status");
+}
+
+SCENARIO("A prefix rate limit applies to matching events only")
+{
+	EventChannel channel;
+	Publisher publisher(nullptr);
+	REQUIRE(publisher.set_rate_limit("tele", 1, 1000)==SYSTEM_ERROR_NONE);
+	REQUIRE(publisher.set_rate_limit("spark", 1, 1000)==SYSTEM_ERROR_NOT_ALLOWED);
+	REQUIRE(publisher.set_rate_limit("tele", 0, 1000)==SYSTEM_ERROR_INVALID_ARGUMENT);
+	REQUIRE(publisher.set_rate_limit("", 0, 1000)==SYSTEM_ERROR_INVALID_ARGUMENT);
+	REQUIRE(publisher.set_rate_limit("tele", 0, 0)==SYSTEM_ERROR_NONE);
+	REQUIRE(publisher.set_rate_limit("tele", 1, 1000)==SYSTEM_ERROR_NONE);
+
+	publish(publisher, channel, "telemetry", 0);
+	publish(publisher, channel, "telemetry", 0);
+	publish(publisher, channel, "other", 0);
+	REQUIRE(channel.sent.size()==2);
+	REQUIRE(channel.sent.back()=="other");
+
+	Publisher::RateLimitStats stats;
+	REQUIRE(publisher.get_rate_limit_stats("tele", &stats)==SYSTEM_ERROR_NONE);
+	REQUIRE(stats.sent==1);
+	REQUIRE(stats.delayed==1);
+	REQUIRE(stats.dropped==0);
+	REQUIRE(publisher.get_rate_limit_stats("unknown", &stats)==SYSTEM_ERROR_NOT_FOUND);
+}
+
+SCENARIO("When the queue is full, lower priority events are dropped")
+{
+	EventChannel channel;
+	Publisher publisher(nullptr);
+	publisher.set_rate_limit("", 1, 1000);
+	publisher.set_rate_limit("alarm", 1, 1000, 1);
+	publish(publisher, channel, "low", 0);
+	publish(publisher, channel, "alarm", 0);
+
+	Completion low[PUBLISHER_QUEUE_SIZE];
+	for (auto& c: low)
+		REQUIRE(publish(publisher, channel, "low", 0, c.handler())==NO_ERROR);
+	Completion rejected;
+	REQUIRE(publish(publisher, channel, "low", 0, rejected.handler())==BANDWIDTH_EXCEEDED);
+	REQUIRE(rejected.error==toSystemError(BANDWIDTH_EXCEEDED));
+
+	// a higher priority event evicts the most recent low priority one and goes first
+	REQUIRE(publish(publisher, channel, "alarm", 0)==NO_ERROR);
+	REQUIRE(low[PUBLISHER_QUEUE_SIZE-1].error==toSystemError(BANDWIDTH_EXCEEDED));
+	REQUIRE(publisher.queued_events()==PUBLISHER_QUEUE_SIZE);
+	publisher.process(channel.get(), 1000);
+	REQUIRE(channel.sent.size()==4);
+	REQUIRE(channel.sent[2]=="alarm");
+
+	publisher.clear_queue(SYSTEM_ERROR_CANCELLED);
+	REQUIRE(low[1].error==SYSTEM_ERROR_CANCELLED);
+	REQUIRE(publisher.queued_events()==0);
+}
@@ -0,0 +1,212 @@
+/**
+ ******************************************************************************
+ Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+
+ This library is free software; you can redistribute it and/or
+ modify it under the terms of the GNU Lesser General Public
+ License as published by the Free Software Foundation, either
+ version 3 of the License, or (at your option) any later version.
+
+ This library is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ Lesser General Public License for more details.
+
+ You should have received a copy of the GNU Lesser General Public
+ License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ ******************************************************************************
+ */
+
+#include <string>
+#include <vector>
+
+#include "subscriptions.h"
+
+#include "catch.hpp"
+#include "fakeit.hpp"
+
+using namespace particle::protocol;
+using namespace fakeit;
+
+namespace {
+
+/**
+ * Records the filters of the handlers called for an event, and optionally removes a filter
+ * from within the handler.
+ */
+struct Recorder
+{
+	std::vector<std::string> called;
+	Subscriptions* subscriptions = nullptr;
+	const char* unsubscribe = nullptr;
+};
+
+struct Filter
+{
+	Recorder* recorder;
+	std::string filter;
+};
+
+void call_event_handler(uint16_t size, FilteringEventHandler* handler, const char* event, const char*, void*)
+{
+	Filter* f = static_cast<Filter*>(handler->handler_data);
+	f->recorder->called.push_back(f->filter);
+	if (f->recorder->unsubscribe)
+		f->recorder->subscriptions->remove_event_handlers(f->recorder->unsubscribe);
+}
+
+void dummy_handler(const char*, const char*)
+{
+}
+
+uint32_t crc_calls = 0;
+
+uint32_t crc(const unsigned char* buf, uint32_t len)
+{
+	crc_calls++;
+	uint32_t h = 2166136261u;
+	for (uint32_t i = 0; i < len; i++)
+		h = (h ^ buf[i]) * 16777619u;
+	return h;
+}
+
+/**
+ * The checksum as computed before the CRCs were cached.
+ */
+uint32_t reference_checksum(Subscriptions& subscriptions)
+{
+	uint32_t checksum = 0;
+	subscriptions.for_each([&checksum](FilteringEventHandler& handler) {
+		uint32_t chk[4];
+		chk[0] = checksum;
+		chk[1] = crc((const uint8_t*)handler.device_id, sizeof(handler.device_id));
+		chk[2] = crc((const uint8_t*)handler.filter, sizeof(handler.filter));
+		chk[3] = crc((const uint8_t*)&handler.scope, sizeof(handler.scope));
+		checksum = crc((const uint8_t*)chk, sizeof(chk));
+		return NO_ERROR;
+	});
+	return checksum;
+}
+
+class EventDispatcher
+{
+	Mock<MessageChannel> channel;
+	uint8_t buf[600];
+
+public:
+	Subscriptions subscriptions;
+	Recorder recorder;
+	std::vector<Filter*> filters;
+
+	EventDispatcher()
+	{
+		When(Method(channel,is_unreliable)).AlwaysReturn(false);
+		recorder.subscriptions = &subscriptions;
+	}
+
+	~EventDispatcher()
+	{
+		for (Filter* f: filters)
+			delete f;
+	}
+
+	void subscribe(const char* filter)
+	{
+		Filter* f = new Filter{&recorder, filter};
+		filters.push_back(f);
+		REQUIRE(subscriptions.add_event_handler(filter, dummy_handler, f, SubscriptionScope::MY_DEVICES, nullptr)==NO_ERROR);
+	}
+
+	std::vector<std::string> publish(const char* name)
+	{
+		recorder.called.clear();
+		const size_t len = Messages::event(buf, 0, name, "data", 60, EventType::PRIVATE, false);
+		Message message(buf, sizeof(buf), len);
+		REQUIRE(subscriptions.handle_event(message, call_event_handler, channel.get())==NO_ERROR);
+		return recorder.called;
+	}
+};
+
+typedef std::vector<std::string> Strings;
+
+} // namespace
+
+SCENARIO("Subscriptions: an event is dispatched to every handler whose filter is a prefix of the event name")
+{
+	EventDispatcher d;
+	for (const char* filter: { "temp/in", "", "temp", "te", "humidity", "temp/inside/x", "temp/in" })
+		d.subscribe(filter);
+
+	REQUIRE(d.publish("temp/inside") == Strings({ "", "te", "temp", "temp/in", "temp/in" }));
+	REQUIRE(d.publish("humidity") == Strings({ "", "humidity" }));
+	REQUIRE(d.publish("hum") == Strings({ "" }));
+	REQUIRE(d.publish("t") == Strings({ "" }));
+	REQUIRE(d.publish("temp/inside/xyz") == Strings({ "", "te", "temp", "temp/in", "temp/in", "temp/inside/x" }));
+}
+
+SCENARIO("Subscriptions: more handlers than the previous fixed capacity can be added")
+{
+	EventDispatcher d;
+	std::vector<std::string> names;
+	for (int i = 0; i < 60; i++)
+		names.push_back("sensor/" + std::to_string(i));
+	for (auto& n: names)
+		d.subscribe(n.c_str());
+
+	int count = 0;
+	d.subscriptions.for_each([&count](FilteringEventHandler&) { count++; return NO_ERROR; });
+	REQUIRE(count == 60);
+	REQUIRE(d.publish("sensor/42") == Strings({ "sensor/4", "sensor/42" }));
+	REQUIRE(d.publish("sensor/59") == Strings({ "sensor/5", "sensor/59" }));
+}
+
+SCENARIO("Subscriptions: removed handlers are no longer called")
+{
+	EventDispatcher d;
+	d.subscribe("a");
+	d.subscribe("ab");
+	d.subscribe("abc");
+	d.subscriptions.remove_event_handlers("ab");
+	REQUIRE(d.publish("abcd") == Strings({ "a", "abc" }));
+	d.subscribe("ab");
+	REQUIRE(d.publish("abcd") == Strings({ "a", "ab", "abc" }));
+	d.subscriptions.remove_event_handlers(nullptr);
+	REQUIRE(d.publish("abcd").empty());
+	d.subscribe("abc");
+	REQUIRE(d.publish("abcd") == Strings({ "abc" }));
+}
+
+SCENARIO("Subscriptions: a handler can unsubscribe while an event is dispatched")
+{
+	EventDispatcher d;
+	d.subscribe("a");
+	d.subscribe("ab");
+	d.recorder.unsubscribe = "ab";
+	REQUIRE(d.publish("abc") == Strings({ "a" }));
+	d.recorder.unsubscribe = nullptr;
+	REQUIRE(d.publish("abc") == Strings({ "a" }));
+}
+
+SCENARIO("Subscriptions: the checksum is unchanged and cached until the subscriptions change")
+{
+	EventDispatcher d;
+	REQUIRE(d.subscriptions.compute_subscriptions_checksum(crc) == 0);
+	for (const char* filter: { "x", "y/z", "y" })
+		d.subscribe(filter);
+	const uint32_t expected = reference_checksum(d.subscriptions);
+	REQUIRE(d.subscriptions.compute_subscriptions_checksum(crc) == expected);
+
+	crc_calls = 0;
+	REQUIRE(d.subscriptions.compute_subscriptions_checksum(crc) == expected);
+	REQUIRE(crc_calls == 0);
+
+	d.subscribe("w");
+	crc_calls = 0;
+	REQUIRE(d.subscriptions.compute_subscriptions_checksum(crc) == reference_checksum(d.subscriptions));
+	// 3 CRCs for the new subscription and one per subscription to combine them,
+	// plus 4 per subscription for the reference
+	REQUIRE(crc_calls == 3 + 4 + 4 * 4);
+
+	d.subscriptions.remove_event_handlers("y/z");
+	REQUIRE(d.subscriptions.compute_subscriptions_checksum(crc) == reference_checksum(d.subscriptions));
+}
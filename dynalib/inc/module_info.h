@@ -174,6 +174,25 @@ typedef struct module_info_crc_t {
     uint32_t crc32;
 } __attribute__((packed)) module_info_crc_t;
 
+/**
+ * The header of a compressed module image.
+ *
+ * A compressed image consists of this header followed by the module data compressed with raw
+ * deflate (no zlib or gzip framing). The decompressed data is a regular module image.
+ */
+typedef struct compressed_module_header {
+    uint32_t magic;                 // COMPRESSED_MODULE_MAGIC
+    uint16_t size;                  // size of this header
+    uint8_t method;                 // compression method (COMPRESSED_MODULE_METHOD_*)
+    uint8_t window_bits;            // base two logarithm of the window size used by the compressor
+    uint32_t original_size;         // size of the decompressed module, including the CRC
+} __attribute__((packed)) compressed_module_header;
+
+PARTICLE_STATIC_ASSERT(compressed_module_header_size, sizeof(compressed_module_header) == 12);
+
+#define COMPRESSED_MODULE_MAGIC             0x5a434d50 // "PMCZ"
+#define COMPRESSED_MODULE_METHOD_DEFLATE    0
+
 extern const module_info_t module_info;
 extern const module_info_suffix_t module_info_suffix;
 extern const module_info_crc_t module_info_crc;
@@ -103,6 +103,13 @@ bool os_thread_is_current(os_thread_t thread);
  */
 bool os_thread_is_current_within_stack();
 
+/**
+ * Returns the minimum amount of stack space that has remained free since the thread was created.
+ * @param thread    The thread to check
+ * @return The number of bytes, or a negative value if the stack usage is not tracked on this platform.
+ */
+int os_thread_stack_high_water_mark(os_thread_t thread);
+
 /**
  * Waits indefinitely for the given thread to finish.
  * @param thread    The thread to wait for.
@@ -143,6 +143,12 @@ typedef enum {
 
 hal_update_complete_t HAL_FLASH_End(hal_module_t* module);
 
+/**
+ * Cancels the update started with HAL_FLASH_Begin() without applying it, and releases the
+ * resources allocated for it.
+ */
+void HAL_FLASH_Abort(void* reserved);
+
 uint32_t HAL_FLASH_ModuleAddress(uint32_t address);
 uint32_t HAL_FLASH_ModuleLength(uint32_t address);
 bool HAL_FLASH_VerifyCRC32(uint32_t address, uint32_t length);
@@ -235,6 +235,17 @@ ssize_t sock_send(int s, const void* dataptr, size_t size, int flags);
 ssize_t sock_sendto(int s, const void* dataptr, size_t size, int flags,
                     const struct sockaddr* to, socklen_t tolen);
 
+/**
+ * Send a message gathered from multiple buffers through a socket.
+ *
+ * @param[in]  s        a socket that has been created with sock_socket()
+ * @param[in]  msg      the message header: the buffers to send and an optional target address
+ * @param[in]  flags    a combination of MSG_MORE and MSG_DONTWAIT
+ *
+ * @returns    The number of bytes sent or -1 on error, with errno set accordingly.
+ */
+ssize_t sock_sendmsg(int s, const struct msghdr* msg, int flags);
+
 /**
  * Create an endpoint for communication - a socket.
  *
@@ -16,6 +16,7 @@
  */
 
 #include "dns64.h"
+#include "dns_cache.h"
 
 #include "socket_hal_posix.h"
 
@@ -128,9 +129,6 @@ struct Record { // RFC 1035, 4.1.3
 // Maximum size of a UDP message
 const size_t MAX_MESSAGE_SIZE = 512; // RFC 1035, 2.3.4
 
-// Value of the TTL field sent in all response messages
-const uint32_t DEFAULT_TTL = 0; // Do not cache (RFC 1035, 4.1.3)
-
 // Timeout for select() in milliseconds
 const unsigned SOCKET_RECV_TIMEOUT = 1000;
 
@@ -193,7 +191,7 @@ ssize_t writeRecord(char* data, size_t size, const Record& r) {
     Record rr = {};
     rr.type = lwip_htons(r.type);
     rr.cls = lwip_htons(r.cls);
-    rr.ttl = lwip_htons(r.ttl);
+    rr.ttl = lwip_htonl(r.ttl);
     rr.rdlength = lwip_htons(r.rdlength);
     memcpy(data, &rr, sizeof(Record));
     return sizeof(Record);
@@ -321,6 +319,8 @@ struct Dns64::Query {
     Header h;
     Question q;
     uint16_t type;
+    uint32_t ttl; // Remaining lifetime of the resolved address in milliseconds
+    bool noIpv6; // Set if the host couldn't be resolved to an IPv6 address
 };
 
 int Dns64::init(if_t iface, const ip6_addr_t& prefix, uint16_t port) {
@@ -503,7 +503,7 @@ int Dns64::sendResponse(const ip_addr_t& addr, const char* name, const Query& q,
     Record r = {};
     r.type = IP_IS_V6(&raddr) ? Type::AAAA : Type::A;
     r.cls = Class::IN;
-    r.ttl = DEFAULT_TTL;
+    r.ttl = q.ttl / 1000;
     r.rdlength = addrSize;
     data += CHECK(writeRecord(data, end - data, r));
     if (end - data < (ptrdiff_t)addrSize) {
@@ -547,6 +547,17 @@ int Dns64::sendErrorResponse(int error, const char* name, const Query& q, Contex
 }
 
 int Dns64::getHostByName(const char* name, ip_addr_t* addr, Query* q) {
+    const auto cache = DnsCache::instance();
+    auto cached = cache->get(name, (q->type == Type::A) ? LWIP_DNS_ADDRTYPE_IPV4 : LWIP_DNS_ADDRTYPE_IPV6, addr, &q->ttl);
+    if (cached == DnsCache::NOT_FOUND && q->type == Type::AAAA) {
+        q->type = Type::A; // The host is known to have no IPv6 addresses
+        cached = cache->get(name, LWIP_DNS_ADDRTYPE_IPV4, addr, &q->ttl);
+    }
+    if (cached == DnsCache::FOUND) {
+        return GetHostByNameResult::DONE;
+    } else if (cached == DnsCache::NOT_FOUND) {
+        return SYSTEM_ERROR_NOT_FOUND;
+    }
     const uint8_t addrType = (q->type == Type::A) ? LWIP_DNS_ADDRTYPE_IPV4 : LWIP_DNS_ADDRTYPE_IPV6;
     LwipTcpIpCoreLock lock; // LwIP's DNS client API is not thread-safe
     const auto lwipRet = dns_gethostbyname_addrtype(name, addr, Dns64::dnsCallback, q, addrType);
@@ -556,9 +567,20 @@ int Dns64::getHostByName(const char* name, ip_addr_t* addr, Query* q) {
     } else if (lwipRet != ERR_OK) {
         return lwipToSystemError(lwipRet);
     }
+    cacheAddress(name, *addr, q);
     return GetHostByNameResult::DONE;
 }
 
+void Dns64::cacheAddress(const char* name, const ip_addr_t& addr, Query* q) {
+    const auto cache = DnsCache::instance();
+    cache->put(name, (q->type == Type::A) ? LWIP_DNS_ADDRTYPE_IPV4 : LWIP_DNS_ADDRTYPE_IPV6, addr);
+    if (q->noIpv6) {
+        // The DNS server is reachable but the AAAA query has failed, skip it for a while
+        cache->putNotFound(name, LWIP_DNS_ADDRTYPE_IPV6);
+    }
+    q->ttl = DnsCache::POSITIVE_TTL;
+}
+
 void Dns64::dnsCallback(const char* name, const ip_addr_t* addr, void* data) {
     DEBUG("dns_found_callback: name: %s, address: %s", name ? name : "NULL", addr ? IPADDR_NTOA(addr) : "NULL");
     std::unique_ptr<Query> q(static_cast<Query*>(data));
@@ -571,9 +593,11 @@ void Dns64::dnsCallback(const char* name, const ip_addr_t* addr, void* data) {
     }
     int ret = 0;
     if (addr) {
+        cacheAddress(name, *addr, q.get());
         ret = sendResponse(*addr, name, *q, ctx.get());
     } else if (q->type == Type::AAAA) {
         q->type = Type::A; // Try getting an IPv4 address
+        q->noIpv6 = true;
         ip_addr_t addr = {};
         ret = getHostByName(name, &addr, q.get());
         if (ret == GetHostByNameResult::DONE) {
@@ -60,6 +60,7 @@ private:
     static int sendErrorResponse(int error, const char* name, const Query& q, Context* ctx);
 
     static int getHostByName(const char* name, ip_addr_t* addr, Query* q);
+    static void cacheAddress(const char* name, const ip_addr_t& addr, Query* q);
 
     static void dnsCallback(const char* name, const ip_addr_t* addr, void* data);
 };
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "dns_cache.h"
+
+#include "lwiplock.h"
+#include "timer_hal.h"
+#include "diagnostics.h"
+#include "system_error.h"
+
+#include "lwip/dns.h"
+
+#include <cstring>
+#include <cctype>
+
+namespace particle {
+
+namespace net {
+
+namespace {
+
+// Counter reported via the diagnostics service. Updated with the LwIP core lock held
+class Counter {
+public:
+    Counter(uint16_t id, const char* name) :
+            src_{ sizeof(diag_source), 0 /* flags */, id, DIAG_TYPE_INT, name, this /* data */, callback },
+            value_(0) {
+        diag_register_source(&src_, nullptr);
+    }
+
+    Counter& operator++() {
+        ++value_;
+        return *this;
+    }
+
+private:
+    diag_source src_;
+    volatile int32_t value_;
+
+    static int callback(const diag_source* src, int cmd, void* data) {
+        if (cmd != DIAG_SOURCE_CMD_GET) {
+            return SYSTEM_ERROR_NOT_SUPPORTED;
+        }
+        const auto d = static_cast<diag_source_get_cmd_data*>(data);
+        if (d->data) {
+            if (d->data_size < sizeof(int32_t)) {
+                return SYSTEM_ERROR_TOO_LARGE;
+            }
+            const int32_t val = static_cast<const Counter*>(src->data)->value_;
+            memcpy(d->data, &val, sizeof(val));
+        }
+        d->data_size = sizeof(int32_t);
+        return 0;
+    }
+};
+
+// Lookups of names that are too long to be cached are counted as misses
+Counter g_dnsCacheHits(DIAG_ID_NETWORK_DNS_CACHE_HITS, DIAG_NAME_NETWORK_DNS_CACHE_HITS);
+Counter g_dnsCacheMisses(DIAG_ID_NETWORK_DNS_CACHE_MISSES, DIAG_NAME_NETWORK_DNS_CACHE_MISSES);
+
+// Host names are compared case-insensitively (RFC 4343)
+uint32_t nameHash(const char* name, size_t* len) {
+    uint32_t h = 2166136261u; // FNV-1a
+    const char* p = name;
+    for (; *p; ++p) {
+        h = (h ^ (uint8_t)tolower((unsigned char)*p)) * 16777619u;
+    }
+    *len = p - name;
+    return h;
+}
+
+bool nameEquals(const char* name1, const char* name2) {
+    for (; *name1 && *name2; ++name1, ++name2) {
+        if (tolower((unsigned char)*name1) != tolower((unsigned char)*name2)) {
+            return false;
+        }
+    }
+    return *name1 == *name2;
+}
+
+} // particle::net::
+
+DnsCache::Result DnsCache::get(const char* name, uint8_t addrType, ip_addr_t* addr, system_tick_t* ttl) {
+    size_t len = 0;
+    const uint32_t hash = nameHash(name, &len);
+    const LwipTcpIpCoreLock lock;
+    const auto now = HAL_Timer_Get_Milli_Seconds();
+    auto e = (len <= MAX_NAME_LENGTH) ? findEntry(name, hash, addrType, now) : nullptr;
+    if (e && e->found && !isRecordCached(name, addrType)) {
+        e->valid = false; // The record's TTL has elapsed
+        e = nullptr;
+    }
+    if (!e) {
+        ++g_dnsCacheMisses;
+        return Result::MISS;
+    }
+    ++g_dnsCacheHits;
+    if (ttl) {
+        *ttl = (e->found ? POSITIVE_TTL : NEGATIVE_TTL) - (now - e->time);
+    }
+    if (!e->found) {
+        return Result::NOT_FOUND;
+    }
+    if (addr) {
+        ip_addr_copy(*addr, e->addr);
+    }
+    return Result::FOUND;
+}
+
+void DnsCache::put(const char* name, uint8_t addrType, const ip_addr_t& addr) {
+    putEntry(name, addrType, &addr);
+}
+
+void DnsCache::putNotFound(const char* name, uint8_t addrType) {
+    putEntry(name, addrType, nullptr);
+}
+
+void DnsCache::clear() {
+    const LwipTcpIpCoreLock lock;
+    for (auto& e: entries_) {
+        e.valid = false;
+    }
+}
+
+DnsCache* DnsCache::instance() {
+    static DnsCache cache;
+    return &cache;
+}
+
+void DnsCache::putEntry(const char* name, uint8_t addrType, const ip_addr_t* addr) {
+    size_t len = 0;
+    const uint32_t hash = nameHash(name, &len);
+    if (len > MAX_NAME_LENGTH) {
+        return;
+    }
+    const LwipTcpIpCoreLock lock;
+    const auto now = HAL_Timer_Get_Milli_Seconds();
+    auto e = findEntry(name, hash, addrType, now);
+    if (!e) {
+        // Reuse an expired entry or replace the oldest one
+        e = &entries_[0];
+        for (auto& ee: entries_) {
+            if (!ee.valid) {
+                e = &ee;
+                break;
+            }
+            if (now - ee.time > now - e->time) {
+                e = &ee;
+            }
+        }
+        memcpy(e->name, name, len + 1);
+        e->hash = hash;
+        e->addrType = addrType;
+        e->valid = true;
+    }
+    if (addr) {
+        ip_addr_copy(e->addr, *addr);
+    }
+    e->found = (addr != nullptr);
+    e->time = now;
+}
+
+// A positive entry can't outlive the DNS record it was created from. LwIP doesn't report the TTLs
+// of the records but its own table honours them, so the entry is checked against that table. If the
+// record has expired, this also starts a new query, which the caller's lookup then waits for
+bool DnsCache::isRecordCached(const char* name, uint8_t addrType) {
+    ip_addr_t addr = {};
+    return dns_gethostbyname_addrtype(name, &addr, nullptr /* found */, nullptr /* callback_arg */, addrType) == ERR_OK;
+}
+
+DnsCache::Entry* DnsCache::findEntry(const char* name, uint32_t hash, uint8_t addrType, system_tick_t now) {
+    for (auto& e: entries_) {
+        if (!e.valid) {
+            continue;
+        }
+        if (now - e.time >= (e.found ? POSITIVE_TTL : NEGATIVE_TTL)) {
+            e.valid = false; // Expired
+            continue;
+        }
+        if (e.hash == hash && e.addrType == addrType && nameEquals(e.name, name)) {
+            return &e;
+        }
+    }
+    return nullptr;
+}
+
+} // particle::net
+
+} // particle
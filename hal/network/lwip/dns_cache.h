@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_tick_hal.h"
+
+#include "lwip/ip_addr.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace particle {
+
+namespace net {
+
+/**
+ * Resolver cache shared by netdb_hal and the DNS64 proxy.
+ *
+ * Entries are keyed by the host name (case-insensitively) and the LwIP address type of the
+ * lookup (LWIP_DNS_ADDRTYPE_*). A negative entry records that a name has no addresses of
+ * the given type.
+ *
+ * LwIP's DNS client doesn't report the TTLs of the received records, so entries expire after
+ * a fixed time that is kept short. A positive entry is also dropped as soon as its record expires
+ * in LwIP's own table, which honours the record TTLs.
+ */
+class DnsCache {
+public:
+    // Maximum number of entries
+    static const size_t MAX_ENTRIES = 8;
+    // Maximum length of a host name that can be cached
+    static const size_t MAX_NAME_LENGTH = 63;
+    // Maximum lifetime of a positive entry in milliseconds
+    static const system_tick_t POSITIVE_TTL = 60 * 1000;
+    // Lifetime of a negative entry in milliseconds
+    static const system_tick_t NEGATIVE_TTL = 30 * 1000;
+
+    enum Result {
+        MISS,
+        FOUND,
+        NOT_FOUND
+    };
+
+    /**
+     * Look up a cached address.
+     *
+     * @param name Host name.
+     * @param addrType Address type (LWIP_DNS_ADDRTYPE_*).
+     * @param addr Resolved address (only set if `FOUND` is returned).
+     * @param ttl Remaining lifetime of the entry in milliseconds (optional).
+     */
+    Result get(const char* name, uint8_t addrType, ip_addr_t* addr, system_tick_t* ttl = nullptr);
+
+    void put(const char* name, uint8_t addrType, const ip_addr_t& addr);
+    void putNotFound(const char* name, uint8_t addrType);
+
+    void clear();
+
+    static DnsCache* instance();
+
+private:
+    struct Entry {
+        char name[MAX_NAME_LENGTH + 1];
+        ip_addr_t addr;
+        system_tick_t time;
+        uint32_t hash;
+        uint8_t addrType;
+        bool found;
+        bool valid;
+    };
+
+    Entry entries_[MAX_ENTRIES] = {};
+
+    DnsCache() = default;
+
+    void putEntry(const char* name, uint8_t addrType, const ip_addr_t* addr);
+    static bool isRecordCached(const char* name, uint8_t addrType);
+    Entry* findEntry(const char* name, uint32_t hash, uint8_t addrType, system_tick_t now);
+};
+
+} // particle::net
+
+} // particle
@@ -31,6 +31,7 @@ extern "C" {
 #include <lwip/autoip.h>
 
 #include "resolvapi.h"
+#include "dns_cache.h"
 #include "basenetif.h"
 #include "check.h"
 
@@ -200,6 +201,10 @@ void netif_ext_callback_handler(struct netif* netif, netif_nsc_reason_t reason,
             ev.ev_if_link = &ev_if_link;
             ev.ev_if_link->state = args->link_changed.state;
             LOG(INFO, "Netif %s link %s", name, ev.ev_if_link->state ? "UP" : "DOWN");
+            if (!ev.ev_if_link->state) {
+                /* Cached addresses may not be valid on the network we reconnect to */
+                DnsCache::instance()->clear();
+            }
             notify_all_handlers_event(netif, &ev);
             break;
         }
@@ -209,6 +214,9 @@ void netif_ext_callback_handler(struct netif* netif, netif_nsc_reason_t reason,
             ev.ev_if_state = &ev_if_state;
             ev.ev_if_state->state = args->status_changed.state;
             LOG(INFO, "Netif %s state %s", name, ev.ev_if_state->state ? "UP" : "DOWN");
+            if (!ev.ev_if_state->state) {
+                DnsCache::instance()->clear();
+            }
             notify_all_handlers_event(netif, &ev);
             break;
         }
@@ -217,6 +225,8 @@ void netif_ext_callback_handler(struct netif* netif, netif_nsc_reason_t reason,
         case LWIP_NSC_IPV4_GATEWAY_CHANGED:
         case LWIP_NSC_IPV4_SETTINGS_CHANGED: {
             LOG(TRACE, "Netif %s ipv4 configuration changed", name);
+            /* DHCP and IPCP update the DNS servers along with the address */
+            DnsCache::instance()->clear();
             ev.ev_type = IF_EVENT_ADDR;
             struct if_event_addr ev_if_addr = {};
             ev.ev_if_addr = &ev_if_addr;
@@ -263,6 +273,7 @@ void netif_ext_callback_handler(struct netif* netif, netif_nsc_reason_t reason,
         /* TODO: refactor these */
         case LWIP_NSC_IPV6_SET: {
             LOG(TRACE, "Netif %s ipv6 configuration changed", name);
+            DnsCache::instance()->clear();
             ev.ev_type = IF_EVENT_ADDR;
             struct if_event_addr ev_if_addr = {};
             ev.ev_if_addr = &ev_if_addr;
@@ -34,6 +34,8 @@ LOG_SOURCE_CATEGORY("net.nat64")
 #include "lwiplock.h"
 #include "random.h"
 
+#include <new>
+
 using namespace particle::net;
 using namespace particle::net::nat;
 
@@ -68,6 +70,47 @@ uint16_t nextBoundId(uint16_t id, uint16_t min, uint16_t max) {
     return id;
 }
 
+template <size_t N>
+size_t hashIndex(uint32_t h) {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "Number of buckets should be a power of 2");
+    /* Fibonacci hashing, the upper bits are the best mixed ones */
+    h *= 0x9e3779b1;
+    return (h >> 16) & (N - 1);
+}
+
+uint32_t ip6Hash(const ip6_addr_t& addr, uint16_t l4Id) {
+    /* Zones are ignored, the same way they are ignored by the comparison */
+    return addr.addr[0] ^ addr.addr[1] ^ addr.addr[2] ^ addr.addr[3] ^ l4Id;
+}
+
+uint32_t ip4Hash(const ip4_addr_t& addr, uint16_t l4Id) {
+    return ip4_addr_get_u32(&addr) ^ ((uint32_t)l4Id << 16);
+}
+
+uint32_t sessionHash(const BibEntry* bib, const IpTransportAddress& src, const IpTransportAddress& dst) {
+    /* Key by the IPv4 transport address of the remote endpoint */
+    uint32_t h = (uint32_t)(uintptr_t)bib;
+    if (src.isV6()) {
+        ip4_addr_t addr = {};
+        unmap_ipv4_mapped_ipv6(&addr, ip_2_ip6(&dst.address()));
+        h ^= ip4Hash(addr, dst.l4Id());
+    } else {
+        h ^= ip4Hash(*ip_2_ip4(&src.address()), src.l4Id());
+    }
+    return h;
+}
+
+template <typename T, typename NextT>
+void removeFromChain(T** head, T* entry, NextT next) {
+    for (T** p = head; *p != nullptr; p = &((*p)->*next)) {
+        if (*p == entry) {
+            *p = entry->*next;
+            entry->*next = nullptr;
+            return;
+        }
+    }
+}
+
 /* UDP_MIN: 2 minutes (as defined in [RFC4787]) */
 #if PLATFORM_ID != PLATFORM_BORON && PLATFORM_ID != PLATFORM_BSOM
 const uint32_t DEFAULT_UDP_NAT_LIFETIME = 120 * 1000;
@@ -87,11 +130,139 @@ const size_t DEFAULT_MAX_TRANSLATION_ENTRIES = DEFAULT_POOL_SIZE / NAT64_ENTRY_S
 
 const size_t DEFAULT_SESSION_CLEANUP_TIMEOUT = 1000;
 
+uint32_t lifetimeToTicks(uint32_t lifetime) {
+    return (lifetime + DEFAULT_SESSION_CLEANUP_TIMEOUT - 1) / DEFAULT_SESSION_CLEANUP_TIMEOUT;
+}
+
 static_assert(MEMP_NUM_SYS_TIMEOUT > LWIP_NUM_SYS_TIMEOUT_INTERNAL, "An extra timeout should be allocated for NAT64 service. Increase MEMP_NUM_SYS_TIMEOUT");
 
 } /* anonymous */
 
-Nat64::Nat64() {
+/* BibTable */
+BibEntry* BibTable::lookup(const IpTransportAddress& addr) const {
+    if (addr.isV6()) {
+        const auto idx = hashIndex<BUCKET_COUNT>(ip6Hash(*ip_2_ip6(&addr.address()), addr.l4Id()));
+        for (auto entry = buckets6_[idx]; entry != nullptr; entry = entry->next) {
+            if (entry->matches(addr)) {
+                return entry;
+            }
+        }
+    } else if (addr.isV4()) {
+        const auto idx = hashIndex<BUCKET_COUNT>(ip4Hash(*ip_2_ip4(&addr.address()), addr.l4Id()));
+        for (auto entry = buckets4_[idx]; entry != nullptr; entry = entry->next4) {
+            if (entry->matches(addr)) {
+                return entry;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void BibTable::insert(BibEntry* bib) {
+    auto& head6 = buckets6_[hashIndex<BUCKET_COUNT>(ip6Hash(bib->src6().address(), bib->src6().l4Id()))];
+    bib->next = head6;
+    head6 = bib;
+    auto& head4 = buckets4_[hashIndex<BUCKET_COUNT>(ip4Hash(bib->dst4().address(), bib->dst4().l4Id()))];
+    bib->next4 = head4;
+    head4 = bib;
+}
+
+void BibTable::remove(BibEntry* bib) {
+    removeFromChain(&buckets6_[hashIndex<BUCKET_COUNT>(ip6Hash(bib->src6().address(), bib->src6().l4Id()))],
+            bib, &BibEntry::next);
+    removeFromChain(&buckets4_[hashIndex<BUCKET_COUNT>(ip4Hash(bib->dst4().address(), bib->dst4().l4Id()))],
+            bib, &BibEntry::next4);
+}
+
+/* SessionTable */
+SessionEntry* SessionTable::lookup(const BibEntry* bib, const IpTransportAddress& src, const IpTransportAddress& dst) const {
+    const auto idx = hashIndex<BUCKET_COUNT>(sessionHash(bib, src, dst));
+    for (auto s = buckets_[idx]; s != nullptr; s = s->next) {
+        if (s->matches(bib, src, dst)) {
+            return s;
+        }
+    }
+    return nullptr;
+}
+
+void SessionTable::insert(SessionEntry* session) {
+    /* Hash the session the same way as an outgoing packet that belongs to it */
+    auto& head = buckets_[hashIndex<BUCKET_COUNT>(sessionHash(session->bib(), session->src6(), session->dst6()))];
+    session->next = head;
+    head = session;
+}
+
+void SessionTable::remove(SessionEntry* session) {
+    removeFromChain(&buckets_[hashIndex<BUCKET_COUNT>(sessionHash(session->bib(), session->src6(), session->dst6()))],
+            session, &SessionEntry::next);
+}
+
+/* SessionTimerWheel */
+void SessionTimerWheel::schedule(SessionEntry* session) {
+    auto& head = slots_[session->expiry() % SLOT_COUNT];
+    session->nextTimer = head;
+    head = session;
+}
+
+SessionEntry* SessionTimerWheel::take(uint32_t tick) {
+    auto& head = slots_[tick % SLOT_COUNT];
+    auto sessions = head;
+    head = nullptr;
+    return sessions;
+}
+
+/* L4IdAllocator */
+L4IdAllocator::L4IdAllocator(uint16_t min, uint16_t max)
+        : min_(min),
+          max_(max) {
+}
+
+bool L4IdAllocator::init() {
+    if (!bits_) {
+        const size_t words = ((size_t)max_ - min_ + 1 + 31) / 32;
+        bits_.reset(new (std::nothrow) uint32_t[words]());
+    }
+    return (bool)bits_;
+}
+
+bool L4IdAllocator::alloc(uint16_t start, uint16_t* id) {
+    if (!bits_ || start < min_ || start > max_) {
+        return false;
+    }
+    const size_t count = (size_t)max_ - min_ + 1;
+    size_t i = start - min_;
+    /* Skip over fully allocated words. The word of the starting bit may be checked twice */
+    for (size_t n = 0; n < count + 32;) {
+        const size_t bit = i % 32;
+        const size_t avail = std::min<size_t>(32 - bit, count - i);
+        uint32_t free = ~bits_[i / 32] >> bit;
+        if (avail < 32) {
+            free &= (1u << avail) - 1;
+        }
+        if (free) {
+            i += __builtin_ctz(free);
+            bits_[i / 32] |= 1u << (i % 32);
+            *id = min_ + i;
+            return true;
+        }
+        n += avail;
+        i += avail;
+        if (i >= count) {
+            i = 0;
+        }
+    }
+    return false;
+}
+
+void L4IdAllocator::free(uint16_t id) {
+    if (bits_ && id >= min_ && id <= max_) {
+        const size_t i = id - min_;
+        bits_[i / 32] &= ~(1u << (i % 32));
+    }
+}
+
+Nat64::Nat64()
+        : udpPorts_(DEFAULT_UDP_NAT_MIN_PORT, DEFAULT_UDP_NAT_MAX_PORT) {
     IP6_ADDR(&pref64_, PP_HTONL(0x64ff9b), 0, 0, 0);
     unsigned int rVal;
     particle::Random::genSecure((char*)&rVal, sizeof(rVal));
@@ -100,6 +271,7 @@ Nat64::Nat64() {
 
 Nat64::~Nat64() {
     disableSessionTimer();
+    disable(nullptr);
 }
 
 void Nat64::setPref64(const ip6_addr_t* pref64) {
@@ -115,11 +287,16 @@ ip6_addr_t Nat64::getPref64() const {
 bool Nat64::enable(const Rule& rule) {
     LwipTcpIpCoreLock lk;
     disable(nullptr);
-    rule_ = new Rule(rule);
     if (!pool_) {
+        if (!udpPorts_.init()) {
+            LOG(ERROR, "Failed to allocate UDP port bitmap");
+            return false;
+        }
         pool_.reset(new SimpleAllocedPool(DEFAULT_MAX_TRANSLATION_ENTRIES * NAT64_ENTRY_SIZE));
         enableSessionTimer();
     }
+    /* The NAT is only enabled once everything it needs has been allocated */
+    rule_ = new Rule(rule);
     return true;
 }
 
@@ -271,13 +448,17 @@ int Nat64::natInput(const ip_addr_t* src, const ip_addr_t* dst, L4Protocol proto
                   IP6ADDR_NTOA(&bib->src6().address()), bib->src6().l4Id(),
                   IP4ADDR_NTOA(&bib->dst4().address()), bib->dst4().l4Id());
         /* Lookup session */
-        session = bib->lookupSession(srcAddr, dstAddr);
+        session = sessions_.lookup(bib, srcAddr, dstAddr);
 
         /* FIXME: flag to enable full-cone NAT */
         if (!session && dstAddr.isV6()) {
             /* Attempt to create a new session */
             LOG_DEBUG(TRACE, "No matching session found, trying to create one");
-            session = bib->addSession(dstAddr, protoLifetime, *pool_);
+            session = addSession(bib, dstAddr, protoLifetime);
+            if (!session && bib->empty()) {
+                removeBib(bib);
+                bib = nullptr;
+            }
         } else if (!session && dstAddr.isV4()) {
             LOG_DEBUG(WARN, "Not creating a new session, full-cone NAT is not enabled");
         }
@@ -288,8 +469,9 @@ int Nat64::natInput(const ip_addr_t* src, const ip_addr_t* dst, L4Protocol proto
                       IP6ADDR_NTOA(&session->dst6().address()), session->dst6().l4Id(),
                       IP4ADDR_NTOA(&session->src4().address()), session->src4().l4Id(),
                       IP4ADDR_NTOA(&session->dst4().address()), session->dst4().l4Id(),
-                      session->lifetime());
-            session->setLifetime(protoLifetime);
+                      (unsigned long)(session->expiry() - ticks_) * DEFAULT_SESSION_CLEANUP_TIMEOUT);
+            /* The session stays in its timer wheel slot, see timeout() */
+            session->setExpiry(ticks_ + lifetimeToTicks(protoLifetime));
         }
     } else {
         LOG_DEBUG(TRACE, "No matching BIB");
@@ -411,19 +593,15 @@ bool Nat64::filter(const IpTransportAddress& src, const IpTransportAddress& dst,
     return false;
 }
 
+BibTable& Nat64::bibTable(L4Protocol proto) {
+    return proto == L4_PROTO_UDP ? udpBibTable_ : icmpBibTable_;
+}
+
 BibEntry* Nat64::lookupBib(const IpTransportAddress& src, const IpTransportAddress& dst, L4Protocol proto) {
-    BibTable& tbl = proto == L4_PROTO_UDP ? udpBibTable_ : icmpBibTable_;
-    const IpTransportAddress& addr = src.isV6() ? src : dst;
-    for (auto entry = tbl.front(); entry != nullptr; entry = entry->next) {
-        if (entry->matches(addr)) {
-            return entry;
-        }
-    }
-    return nullptr;
+    return bibTable(proto).lookup(src.isV6() ? src : dst);
 }
 
 BibEntry* Nat64::addBib(const IpTransportAddress& src, const IpTransportAddress& dst, L4Protocol proto) {
-    BibTable& tbl = proto == L4_PROTO_UDP ? udpBibTable_ : icmpBibTable_;
 
     if (src.isV4()) {
         LOG_DEBUG(TRACE, "Not creating a new BIB for a connection initiated from IPv4 side");
@@ -443,14 +621,15 @@ BibEntry* Nat64::addBib(const IpTransportAddress& src, const IpTransportAddress&
             if (!ip4_addr_isany(t)) {
                 Ip4TransportAddress src4;
                 src4.setAddress(*t);
-                if (findNextL4Id(src4, proto)) {
-                    if (pool_) {
-                        BibEntry* bib = static_cast<BibEntry*>(pool_->alloc(NAT64_ENTRY_SIZE));
-                        if (bib) {
-                            new (bib) BibEntry(src, src4);
-                            tbl.pushFront(bib);
-                            return bib;
-                        }
+                if (pool_ && findNextL4Id(src4, proto)) {
+                    BibEntry* bib = static_cast<BibEntry*>(pool_->alloc(NAT64_ENTRY_SIZE));
+                    if (bib) {
+                        new (bib) BibEntry(src, src4, proto);
+                        bibTable(proto).insert(bib);
+                        return bib;
+                    }
+                    if (proto == L4_PROTO_UDP) {
+                        udpPorts_.free(src4.port());
                     }
                 }
                 LOG_DEBUG(TRACE, "Failed to allocate new BIB");
@@ -463,6 +642,50 @@ BibEntry* Nat64::addBib(const IpTransportAddress& src, const IpTransportAddress&
     return nullptr;
 }
 
+void Nat64::removeBib(BibEntry* bib) {
+    LOG_DEBUG(TRACE, "%s BIB %s#%u <-> %s#%u removed", bib->proto() == L4_PROTO_UDP ? "UDP" : "ICMP",
+              IP6ADDR_NTOA(&bib->src6().address()), bib->src6().l4Id(),
+              IP4ADDR_NTOA(&bib->dst4().address()), bib->dst4().l4Id());
+    bibTable(bib->proto()).remove(bib);
+    if (bib->proto() == L4_PROTO_UDP) {
+        udpPorts_.free(bib->dst4().port());
+    }
+    bib->~BibEntry();
+    pool_->free(bib);
+}
+
+SessionEntry* Nat64::addSession(BibEntry* bib, const Ip6TransportAddress& dst, uint32_t lifetime) {
+    auto sess = static_cast<SessionEntry*>(pool_->alloc(NAT64_ENTRY_SIZE));
+    if (sess) {
+        new (sess) SessionEntry(bib, dst);
+        sess->setExpiry(ticks_ + lifetimeToTicks(lifetime));
+        bib->addSession();
+        sessions_.insert(sess);
+        timers_.schedule(sess);
+        return sess;
+    }
+
+    LOG_DEBUG(TRACE, "Failed to allocate new session");
+
+    return nullptr;
+}
+
+void Nat64::removeSession(SessionEntry* session) {
+    /* The caller is responsible for taking the session out of the timer wheel */
+    LOG_DEBUG(TRACE, "Session timed out %s#%u <-> %s#%u, %s#%u <-> %s#%u",
+              IP6ADDR_NTOA(&session->src6().address()), session->src6().l4Id(),
+              IP6ADDR_NTOA(&session->dst6().address()), session->dst6().l4Id(),
+              IP4ADDR_NTOA(&session->src4().address()), session->src4().l4Id(),
+              IP4ADDR_NTOA(&session->dst4().address()), session->dst4().l4Id());
+    sessions_.remove(session);
+    auto bib = session->bib();
+    session->~SessionEntry();
+    pool_->free(session);
+    if (bib->removeSession()) {
+        removeBib(bib);
+    }
+}
+
 bool Nat64::findNextL4Id(Ip4TransportAddress& src, L4Protocol proto) {
     if (proto == L4_PROTO_UDP) {
         return findNextUdpPort(src);
@@ -474,18 +697,13 @@ bool Nat64::findNextL4Id(Ip4TransportAddress& src, L4Protocol proto) {
 }
 
 bool Nat64::findNextUdpPort(Ip4TransportAddress& src) {
-    uint16_t port = udpNextPort_;
-    do {
-        src.setPort(port);
-        if (!lookupBib(src, src, L4_PROTO_UDP)) {
-            udpNextPort_ = nextBoundId(port, DEFAULT_UDP_NAT_MIN_PORT, DEFAULT_UDP_NAT_MAX_PORT);
-            return true;
-        }
-
-        port = nextBoundId(port, DEFAULT_UDP_NAT_MIN_PORT, DEFAULT_UDP_NAT_MAX_PORT);
-    } while(port != udpNextPort_);
-
-    return false;
+    uint16_t port = 0;
+    if (!udpPorts_.alloc(udpNextPort_, &port)) {
+        return false;
+    }
+    src.setPort(port);
+    udpNextPort_ = nextBoundId(port, DEFAULT_UDP_NAT_MIN_PORT, DEFAULT_UDP_NAT_MAX_PORT);
+    return true;
 }
 
 bool Nat64::findNextIcmpId(Ip4TransportAddress& src) {
@@ -504,33 +722,19 @@ bool Nat64::findNextIcmpId(Ip4TransportAddress& src) {
 }
 
 void Nat64::timeout(uint32_t dt) {
-    for (auto bib = udpBibTable_.front(), p = static_cast<BibEntry*>(nullptr); bib != nullptr;) {
-        if (bib->timeout(dt, *pool_)) {
-            LOG_DEBUG(TRACE, "UDP BIB %s#%u <-> %s#%u timed out",
-                      IP6ADDR_NTOA(&bib->src6().address()), bib->src6().l4Id(),
-                      IP4ADDR_NTOA(&bib->dst4().address()), bib->dst4().l4Id());
-
-            auto popped = udpBibTable_.pop(bib, p);
-            bib = popped->next;
-            pool_->free(popped);
-        } else {
-            p = bib;
-            bib = bib->next;
-        }
-    }
-
-    for (auto bib = icmpBibTable_.front(), p = static_cast<BibEntry*>(nullptr); bib != nullptr;) {
-        if (bib->timeout(dt, *pool_)) {
-            LOG_DEBUG(TRACE, "ICMP BIB %s#%u <-> %s#%u timed out",
-                      IP6ADDR_NTOA(&bib->src6().address()), bib->src6().l4Id(),
-                      IP4ADDR_NTOA(&bib->dst4().address()), bib->dst4().l4Id());
-
-            auto popped = udpBibTable_.pop(bib, p);
-            bib = popped->next;
-            pool_->free(popped);
-        } else {
-            p = bib;
-            bib = bib->next;
+    for (uint32_t n = dt / DEFAULT_SESSION_CLEANUP_TIMEOUT; n > 0; --n) {
+        ++ticks_;
+        /* Sessions whose lifetime has been extended since they were scheduled are moved
+         * to the slot of their current expiry tick
+         */
+        for (auto s = timers_.take(ticks_); s != nullptr;) {
+            auto next = s->nextTimer;
+            if ((int32_t)(s->expiry() - ticks_) > 0) {
+                timers_.schedule(s);
+            } else {
+                removeSession(s);
+            }
+            s = next;
         }
     }
 }
@@ -143,8 +143,6 @@ class BibEntry;
 class SessionEntry;
 class RuleEntry;
 
-using BibTable = particle::IntrusiveList<BibEntry>;
-using SessionTable = particle::IntrusiveList<SessionEntry>;
 using RuleTable = particle::IntrusiveList<RuleEntry>;
 
 template <typename DerivedT>
@@ -153,55 +151,122 @@ public:
     DerivedT* next;
 };
 
+/* BIB entries are chained by the IPv6 transport address in ListNode::next and by
+ * the IPv4 transport address in next4
+ */
 class BibEntry : public ListNode<BibEntry> {
 public:
-    BibEntry(const Ip6TransportAddress& src6, const Ip4TransportAddress& dst4);
+    BibEntry(const Ip6TransportAddress& src6, const Ip4TransportAddress& dst4, L4Protocol proto);
 
     const Ip6TransportAddress& src6() const;
     const Ip4TransportAddress& dst4() const;
+    L4Protocol proto() const;
 
     bool matches(const IpTransportAddress& addr) const;
     bool empty() const;
 
-    SessionEntry* lookupSession(const IpTransportAddress& src, const IpTransportAddress& dst);
-    SessionEntry* addSession(const Ip6TransportAddress& dst, uint32_t lifetime, particle::SimpleAllocator& allocator);
+    void addSession();
+    bool removeSession();
 
-    bool timeout(uint32_t dt, particle::SimpleAllocator& allocator);
+    BibEntry* next4;
 
 private:
     Ip6TransportAddress src6_;
     Ip4TransportAddress dst4_;
 
-    SessionTable sessions_;
+    uint8_t proto_;
+    uint16_t sessionCount_;
 };
 
+/* Sessions are chained in their hash bucket in ListNode::next and in their timer wheel slot
+ * in nextTimer
+ */
 class SessionEntry : public ListNode<SessionEntry> {
 public:
     SessionEntry(BibEntry* bib, const Ip6TransportAddress& dst6);
 
-    BibEntry* bib();
+    BibEntry* bib() const;
 
     const Ip6TransportAddress& src6() const;
     const Ip6TransportAddress& dst6() const;
     const Ip4TransportAddress& src4() const;
     Ip4TransportAddress dst4() const;
 
-    bool matches(const IpTransportAddress& src, const IpTransportAddress& dst);
+    bool matches(const BibEntry* bib, const IpTransportAddress& src, const IpTransportAddress& dst) const;
 
-    uint32_t setLifetime(uint32_t lifetime);
-    uint32_t lifetime() const;
+    void setExpiry(uint32_t tick);
+    uint32_t expiry() const;
 
-    bool timeout(uint32_t dt);
+    SessionEntry* nextTimer;
 
 private:
     BibEntry* bib_;
     Ip6TransportAddress dst6_;
 
-    uint32_t lifetime_;
+    uint32_t expiry_;
 };
 
 static const size_t NAT64_ENTRY_SIZE = std::max(sizeof(BibEntry), sizeof(SessionEntry));
 
+/* BIB entries of a single protocol indexed by both their IPv6 and IPv4 transport addresses */
+class BibTable {
+public:
+    static const size_t BUCKET_COUNT = 16;
+
+    BibEntry* lookup(const IpTransportAddress& addr) const;
+    void insert(BibEntry* bib);
+    void remove(BibEntry* bib);
+
+private:
+    BibEntry* buckets6_[BUCKET_COUNT] = {};
+    BibEntry* buckets4_[BUCKET_COUNT] = {};
+};
+
+/* Sessions of all BIB entries indexed by the BIB entry and the IPv4 transport address
+ * of the remote endpoint, which is the same for packets in both directions
+ */
+class SessionTable {
+public:
+    static const size_t BUCKET_COUNT = 32;
+
+    SessionEntry* lookup(const BibEntry* bib, const IpTransportAddress& src, const IpTransportAddress& dst) const;
+    void insert(SessionEntry* session);
+    void remove(SessionEntry* session);
+
+private:
+    SessionEntry* buckets_[BUCKET_COUNT] = {};
+};
+
+/* Sessions bucketed by their expiry tick modulo the number of slots. A session is not moved
+ * when its lifetime is extended: it is rescheduled when its slot comes up before it expires.
+ */
+class SessionTimerWheel {
+public:
+    static const size_t SLOT_COUNT = 32;
+
+    void schedule(SessionEntry* session);
+    SessionEntry* take(uint32_t tick);
+
+private:
+    SessionEntry* slots_[SLOT_COUNT] = {};
+};
+
+/* Allocation bitmap for a range of ports or ICMP identifiers */
+class L4IdAllocator {
+public:
+    L4IdAllocator(uint16_t min, uint16_t max);
+
+    bool init();
+
+    bool alloc(uint16_t start, uint16_t* id);
+    void free(uint16_t id);
+
+private:
+    std::unique_ptr<uint32_t[]> bits_;
+    uint16_t min_;
+    uint16_t max_;
+};
+
 class Nat64 {
 public:
     Nat64();
@@ -222,6 +287,10 @@ protected:
 
     BibEntry* lookupBib(const IpTransportAddress& src, const IpTransportAddress& dst, L4Protocol proto);
     BibEntry* addBib(const IpTransportAddress& src, const IpTransportAddress& dst, L4Protocol proto);
+    void removeBib(BibEntry* bib);
+
+    SessionEntry* addSession(BibEntry* bib, const Ip6TransportAddress& dst, uint32_t lifetime);
+    void removeSession(SessionEntry* session);
 
     bool findNextL4Id(Ip4TransportAddress& src, L4Protocol proto);
     bool findNextUdpPort(Ip4TransportAddress& src);
@@ -235,6 +304,7 @@ protected:
     static void timeoutHandlerCb(void* arg);
 
 private:
+    BibTable& bibTable(L4Protocol proto);
 
 private:
     /* TODO: a list of rules */
@@ -244,9 +314,15 @@ private:
     ip6_addr_t pref64_;
 
     BibTable udpBibTable_;
+    L4IdAllocator udpPorts_;
     uint16_t udpNextPort_;
     BibTable icmpBibTable_;
-    uint16_t icmpNextId_;
+    uint16_t icmpNextId_ = 0;
+
+    SessionTable sessions_;
+    SessionTimerWheel timers_;
+    /* Session timer ticks elapsed since the NAT was created */
+    uint32_t ticks_ = 0;
 
     std::unique_ptr<SimpleAllocedPool> pool_;
 };
@@ -408,9 +484,13 @@ inline netif* Rule::outside() const {
 }
 
 /* BibEntry */
-inline BibEntry::BibEntry(const Ip6TransportAddress& src6, const Ip4TransportAddress& dst4)
-        : src6_(src6),
-          dst4_(dst4) {
+inline BibEntry::BibEntry(const Ip6TransportAddress& src6, const Ip4TransportAddress& dst4, L4Protocol proto)
+        : next4(nullptr),
+          src6_(src6),
+          dst4_(dst4),
+          proto_(proto),
+          sessionCount_(0) {
+    next = nullptr;
 }
 
 inline const Ip6TransportAddress& BibEntry::src6() const {
@@ -421,6 +501,10 @@ inline const Ip4TransportAddress& BibEntry::dst4() const {
     return dst4_;
 }
 
+inline L4Protocol BibEntry::proto() const {
+    return static_cast<L4Protocol>(proto_);
+}
+
 inline bool BibEntry::matches(const IpTransportAddress& addr) const {
     if (addr.isV4()) {
         return dst4() == addr;
@@ -432,62 +516,30 @@ inline bool BibEntry::matches(const IpTransportAddress& addr) const {
 }
 
 inline bool BibEntry::empty() const {
-    return sessions_.front() == nullptr;
+    return sessionCount_ == 0;
 }
 
-inline SessionEntry* BibEntry::lookupSession(const IpTransportAddress& src, const IpTransportAddress& dst) {
-    for (auto* s = sessions_.front(); s != nullptr; s = s->next) {
-        if (s->matches(src, dst)) {
-            return s;
-        }
-    }
-
-    return nullptr;
+inline void BibEntry::addSession() {
+    ++sessionCount_;
 }
 
-inline SessionEntry* BibEntry::addSession(const Ip6TransportAddress& dst, uint32_t lifetime, particle::SimpleAllocator& allocator) {
-    auto sess = (SessionEntry*)allocator.alloc(NAT64_ENTRY_SIZE);
-    if (sess) {
-        new(sess) SessionEntry(this, dst);
-        sess->setLifetime(lifetime);
-        sessions_.pushFront(sess);
-        return sess;
+inline bool BibEntry::removeSession() {
+    if (sessionCount_ > 0) {
+        --sessionCount_;
     }
-
-    LOG_DEBUG(TRACE, "Failed to allocate new session");
-
-    return nullptr;
-}
-
-inline bool BibEntry::timeout(uint32_t dt, particle::SimpleAllocator& allocator) {
-    using namespace particle::net;
-    for (auto s = sessions_.front(), p = static_cast<SessionEntry*>(nullptr); s != nullptr;) {
-        if (s->timeout(dt)) {
-            LOG_DEBUG(TRACE, "Session timed out %s#%u <-> %s#%u, %s#%u <-> %s#%u",
-                      IP6ADDR_NTOA(&s->src6().address()), s->src6().l4Id(),
-                      IP6ADDR_NTOA(&s->dst6().address()), s->dst6().l4Id(),
-                      IP4ADDR_NTOA(&s->src4().address()), s->src4().l4Id(),
-                      IP4ADDR_NTOA(&s->dst4().address()), s->dst4().l4Id());
-            auto popped = sessions_.pop(s, p);
-            s = popped->next;
-            allocator.free(popped);
-        } else {
-            p = s;
-            s = s->next;
-        }
-    }
-
     return empty();
 }
 
 /* SessionEntry */
 inline SessionEntry::SessionEntry(BibEntry* bib, const Ip6TransportAddress& dst6)
-        : bib_(bib),
+        : nextTimer(nullptr),
+          bib_(bib),
           dst6_(dst6),
-          lifetime_(0) {
+          expiry_(0) {
+    next = nullptr;
 }
 
-inline BibEntry* SessionEntry::bib() {
+inline BibEntry* SessionEntry::bib() const {
     return bib_;
 }
 
@@ -510,7 +562,10 @@ inline Ip4TransportAddress SessionEntry::dst4() const {
     return Ip4TransportAddress(addr, dst6().port());
 }
 
-inline bool SessionEntry::matches(const IpTransportAddress& src, const IpTransportAddress& dst) {
+inline bool SessionEntry::matches(const BibEntry* bib, const IpTransportAddress& src, const IpTransportAddress& dst) const {
+    if (bib_ != bib) {
+        return false;
+    }
     if (src.isV6()) {
         return src6() == src && dst6() == dst;
     } else if (src.isV4()) {
@@ -520,22 +575,12 @@ inline bool SessionEntry::matches(const IpTransportAddress& src, const IpTranspo
     return false;
 }
 
-inline uint32_t SessionEntry::setLifetime(uint32_t lifetime) {
-    std::swap(lifetime_, lifetime);
-    return lifetime;
-}
-
-inline uint32_t SessionEntry::lifetime() const {
-    return lifetime_;
+inline void SessionEntry::setExpiry(uint32_t tick) {
+    expiry_ = tick;
 }
 
-inline bool SessionEntry::timeout(uint32_t dt) {
-    if (lifetime() <= dt) {
-        setLifetime(0);
-        return true;
-    }
-    setLifetime(lifetime() - dt);
-    return false;
+inline uint32_t SessionEntry::expiry() const {
+    return expiry_;
 }
 
 } } } /* particle::net::nat */
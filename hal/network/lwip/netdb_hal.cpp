@@ -23,17 +23,116 @@
 
 /* netdb_hal_impl.h should get included from netdb_hal.h automagically */
 #include "netdb_hal.h"
+#include "dns_cache.h"
 #include <lwip/sockets.h>
+#include <lwip/dns.h>
 #include <errno.h>
+#include <string.h>
 #include <algorithm>
 
+using particle::net::DnsCache;
+
+namespace {
+
+bool isNumericHost(const char* name) {
+    ip_addr_t addr = {};
+    return ipaddr_aton(name, &addr);
+}
+
+uint8_t familyToAddrType(int family) {
+    switch (family) {
+        case AF_INET: {
+            return LWIP_DNS_ADDRTYPE_IPV4;
+        }
+        case AF_INET6: {
+            return LWIP_DNS_ADDRTYPE_IPV6;
+        }
+        default: {
+            return LWIP_DNS_ADDRTYPE_DEFAULT;
+        }
+    }
+}
+
+bool sockaddrToIpAddr(const struct sockaddr* sa, ip_addr_t* addr) {
+    if (sa->sa_family == AF_INET) {
+        ip4_addr_t a = {};
+        inet_addr_to_ip4addr(&a, &((const struct sockaddr_in*)sa)->sin_addr);
+        ip_addr_copy_from_ip4(*addr, a);
+        return true;
+    } else if (sa->sa_family == AF_INET6) {
+        ip6_addr_t a = {};
+        inet6_addr_to_ip6addr(&a, &((const struct sockaddr_in6*)sa)->sin6_addr);
+        ip_addr_copy_from_ip6(*addr, a);
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Performs a lookup for a single address family. A cached address is converted to its
+ * numeric form and passed to LwIP, so that the result is allocated the same way as usual.
+ */
+int getAddrInfoCached(const char* hostname, const char* servname, const struct addrinfo* hints,
+                      struct addrinfo** res, bool* queried) {
+    *queried = false;
+    if (!hostname || (hints->ai_flags & (AI_NUMERICHOST | AI_CANONNAME)) || isNumericHost(hostname)) {
+        return lwip_getaddrinfo(hostname, servname, hints, res);
+    }
+    const auto cache = DnsCache::instance();
+    const uint8_t addrType = familyToAddrType(hints->ai_family);
+    ip_addr_t addr = {};
+    const auto cached = cache->get(hostname, addrType, &addr);
+    if (cached == DnsCache::NOT_FOUND) {
+        return EAI_FAIL;
+    } else if (cached == DnsCache::FOUND) {
+        char host[IPADDR_STRLEN_MAX] = {};
+        if (ipaddr_ntoa_r(&addr, host, sizeof(host))) {
+            struct addrinfo h = *hints;
+            h.ai_flags |= AI_NUMERICHOST;
+            return lwip_getaddrinfo(host, servname, &h, res);
+        }
+    }
+    *queried = true;
+    const int r = lwip_getaddrinfo(hostname, servname, hints, res);
+    if (r == 0 && *res && (*res)->ai_addr && sockaddrToIpAddr((*res)->ai_addr, &addr)) {
+        cache->put(hostname, addrType, addr);
+    }
+    return r;
+}
+
+} // anonymous
+
 struct hostent* netdb_gethostbyname(const char *name) {
     return lwip_gethostbyname(name);
 }
 
 int netdb_gethostbyname_r(const char* name, struct hostent* ret, char* buf,
                           size_t buflen, struct hostent** result, int* h_errnop) {
-    return lwip_gethostbyname_r(name, ret, buf, buflen, result, h_errnop);
+    if (!name || isNumericHost(name)) {
+        return lwip_gethostbyname_r(name, ret, buf, buflen, result, h_errnop);
+    }
+    const auto cache = DnsCache::instance();
+    ip_addr_t addr = {};
+    if (cache->get(name, LWIP_DNS_ADDRTYPE_DEFAULT, &addr) == DnsCache::FOUND) {
+        char host[IPADDR_STRLEN_MAX] = {};
+        if (ipaddr_ntoa_r(&addr, host, sizeof(host))) {
+            const int r = lwip_gethostbyname_r(host, ret, buf, buflen, result, h_errnop);
+            if (r == 0 && *result) {
+                /* Report the requested name rather than the numeric one if it fits in the buffer */
+                const size_t avail = buf + buflen - (*result)->h_name;
+                if (strlen(name) < avail) {
+                    strcpy((*result)->h_name, name);
+                }
+            }
+            return r;
+        }
+    }
+    const int r = lwip_gethostbyname_r(name, ret, buf, buflen, result, h_errnop);
+    if (r == 0 && *result && (*result)->h_addr_list[0]) {
+        ip_addr_copy(addr, *(const ip_addr_t*)(*result)->h_addr_list[0]);
+        cache->put(name, LWIP_DNS_ADDRTYPE_DEFAULT, addr);
+    }
+    return r;
 }
 
 void netdb_freeaddrinfo(struct addrinfo* ai) {
@@ -48,12 +147,20 @@ int netdb_getaddrinfo(const char* hostname, const char* servname,
 
         /* First perform a lookup with AF_INET6 */
         h.ai_family = AF_INET6;
-        int rinet6 = lwip_getaddrinfo(hostname, servname, &h, res);
+        bool queried6 = false;
+        int rinet6 = getAddrInfoCached(hostname, servname, &h, res, &queried6);
 
         /* Next perform a lookup with AF_INET */
         h.ai_family = AF_INET;
+        bool queried = false;
         /* FIXME: expects that there is either 1 or 0 results from the previous call */
-        int rinet = lwip_getaddrinfo(hostname, servname, &h, rinet6 == 0 && *res ? &((*res)->ai_next) : res);
+        int rinet = getAddrInfoCached(hostname, servname, &h, rinet6 == 0 && *res ? &((*res)->ai_next) : res, &queried);
+
+        if (rinet6 != 0 && queried6 && rinet == 0) {
+            /* The DNS server is reachable and the host has no IPv6 address. Don't send
+             * the AAAA query every time the host is resolved */
+            DnsCache::instance()->putNotFound(hostname, LWIP_DNS_ADDRTYPE_IPV6);
+        }
 
         if (rinet6 == 0 || rinet == 0) {
             return 0;
@@ -61,6 +168,10 @@ int netdb_getaddrinfo(const char* hostname, const char* servname,
 
         return std::max(rinet, rinet6);
     }
+    if (hints) {
+        bool queried = false;
+        return getAddrInfoCached(hostname, servname, hints, res, &queried);
+    }
     return lwip_getaddrinfo(hostname, servname, hints, res);
 }
 
@@ -35,6 +35,7 @@ LOG_SOURCE_CATEGORY("net.th")
 #include <openthread/netdata.h>
 #include "ipaddr_util.h"
 #include "lwiplock.h"
+#include "dns_cache.h"
 
 #include <lwip/opt.h>
 #include "hal_platform.h"
@@ -839,4 +840,5 @@ void OpenThreadNetif::setDns(const ip6_addr_t* addr) {
         dns_setserver(THREAD_DNS_SERVER_INDEX, nullptr);
         LOG(INFO, "No DNS server on mesh network");
     }
+    DnsCache::instance()->clear();
 }
@@ -40,6 +40,7 @@
 #define recvfrom(s, mem, len, flags, from, fromlen) sock_recvfrom(s, mem, len, flags, from, fromlen)
 #define send(s, dataptr, size, flags) sock_send(s, dataptr, size, flags)
 #define sendto(s, dataptr, size, flags, to, tolen) sock_sendto(s, dataptr, size, flags, to, tolen)
+#define sendmsg(s, msg, flags) sock_sendmsg(s, msg, flags)
 #define socket(domain, type, protocol) sock_socket(domain, type, protocol)
 
 #endif /* SYS_SOCKET_H */
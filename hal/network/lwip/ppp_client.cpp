@@ -24,8 +24,10 @@ extern "C" {
 #include <netif/ppp/pppos.h>
 }
 #include <lwip/netifapi.h>
+#include <lwip/tcpip.h>
 #include <netif/ppp/pppapi.h>
 #include <mutex>
+#include <cstring>
 #include "socket_hal.h"
 #include "inet_hal.h"
 #include "system_error.h"
@@ -168,6 +170,9 @@ int Client::input(const uint8_t* data, size_t size) {
       case STATE_CONNECTING:
       case STATE_DISCONNECTING:
       case STATE_CONNECTED: {
+        if (PPP_CLIENT_INPUT_BATCH_SIZE > 0) {
+          return inputBatched(data, size);
+        }
         err_t err = pppos_input_tcpip(pcb_, (u8_t*)data, size);
         if (err) {
           return SYSTEM_ERROR_INTERNAL;
@@ -176,9 +181,58 @@ int Client::input(const uint8_t* data, size_t size) {
       }
     }
   }
+  /* Drop incomplete data received in a previous session */
+  discardInput();
   return SYSTEM_ERROR_INVALID_STATE;
 }
 
+int Client::inputBatched(const uint8_t* data, size_t size) {
+  while (size > 0) {
+    const int n = input_.append(data, size);
+    if (n < 0) {
+      input_.discard();
+      return n;
+    }
+    data += n;
+    size -= n;
+    if (input_.ready()) {
+      const int ret = flushInput();
+      if (ret < 0) {
+        return ret;
+      }
+    }
+  }
+  return 0;
+}
+
+int Client::flushInput() {
+  pbuf* p = input_.take();
+  if (!p) {
+    return 0;
+  }
+  /* One message to the tcpip thread for all the data received so far */
+  err_t err = tcpip_inpkt(p, &if_, &Client::inputPacketCb);
+  if (err != ERR_OK) {
+    pbuf_free(p);
+    return SYSTEM_ERROR_INTERNAL;
+  }
+  return 0;
+}
+
+void Client::discardInput() {
+  input_.discard();
+}
+
+err_t Client::inputPacketCb(pbuf* p, netif* inp) {
+  /* Runs in the tcpip thread */
+  ppp_pcb* pcb = (ppp_pcb*)inp->state;
+  for (pbuf* q = p; q; q = q->next) {
+    pppos_input(pcb, (u8_t*)q->payload, q->len);
+  }
+  pbuf_free(p);
+  return ERR_OK;
+}
+
 void Client::setNotifyCallback(NotifyCallback cb, void* ctx) {
   std::lock_guard<std::mutex> lk(mutex_);
   cb_ = cb;
@@ -32,6 +32,7 @@ extern "C" {
 #include <mutex>
 #include <atomic>
 #include "stream.h"
+#include "ppp_input_batch.h"
 
 #ifdef __cplusplus
 
@@ -122,6 +123,11 @@ private:
   static void loopCb(void* arg);
   void loop();
 
+  int inputBatched(const uint8_t* data, size_t size);
+  int flushInput();
+  void discardInput();
+  static err_t inputPacketCb(pbuf* p, netif* inp);
+
   static uint32_t outputCb(ppp_pcb* pcb, uint8_t* data, uint32_t len, void* ctx);
   uint32_t output(const uint8_t* data, size_t len);
 
@@ -164,6 +170,9 @@ private:
   OutputCallback oCb_ = nullptr;
   void* oCbCtx_ = nullptr;
 
+  /* Received data that hasn't been passed to the tcpip thread yet */
+  InputBatch input_;
+
   bool inited_ = false;
   std::atomic_bool running_;
   std::atomic_bool exit_;
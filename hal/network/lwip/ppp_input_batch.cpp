@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ppp_input_batch.h"
+
+#if defined(PPP_SUPPORT) && PPP_SUPPORT
+
+#include "system_error.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace particle::net::ppp;
+
+namespace {
+
+/* HDLC flag sequence that delimits PPP frames */
+const uint8_t PPP_HDLC_FLAG = 0x7e;
+
+} /* anonymous */
+
+InputBatch::InputBatch(size_t maxSize)
+    : buf_(nullptr),
+      size_(0),
+      maxSize_(std::max<size_t>(std::min<size_t>(maxSize, PBUF_POOL_BUFSIZE), 1)),
+      ready_(false) {
+}
+
+InputBatch::~InputBatch() {
+  discard();
+}
+
+int InputBatch::append(const uint8_t* data, size_t size) {
+  if (!buf_) {
+    /* PBUF_POOL_BUFSIZE bytes of raw data fit in a single pool buffer */
+    buf_ = pbuf_alloc(PBUF_RAW, maxSize_, PBUF_POOL);
+    if (!buf_) {
+      return SYSTEM_ERROR_NO_MEMORY;
+    }
+  }
+  const size_t n = std::min(size, maxSize_ - size_);
+  memcpy((uint8_t*)buf_->payload + size_, data, n);
+  size_ += n;
+  if (size_ == maxSize_ || memchr(data, PPP_HDLC_FLAG, n)) {
+    ready_ = true;
+  }
+  return n;
+}
+
+pbuf* InputBatch::take() {
+  if (!size_) {
+    discard();
+    return nullptr;
+  }
+  pbuf* p = buf_;
+  /* Trim the unused space of the buffer */
+  pbuf_realloc(p, size_);
+  buf_ = nullptr;
+  size_ = 0;
+  ready_ = false;
+  return p;
+}
+
+void InputBatch::discard() {
+  if (buf_) {
+    pbuf_free(buf_);
+  }
+  buf_ = nullptr;
+  size_ = 0;
+  ready_ = false;
+}
+
+#endif /* defined(PPP_SUPPORT) && PPP_SUPPORT */
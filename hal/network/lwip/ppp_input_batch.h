@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HAL_NETWORK_LWIP_PPP_INPUT_BATCH_H
+#define HAL_NETWORK_LWIP_PPP_INPUT_BATCH_H
+
+#include <lwip/opt.h>
+#include <lwip/pbuf.h>
+#include <cstdint>
+#include <cstddef>
+
+/* Maximum number of bytes of received data that are accumulated before being passed
+ * to the tcpip thread. Data is also passed on as soon as a HDLC flag is received.
+ * Set to 0 to pass every received chunk separately.
+ *
+ * A batch occupies a single pool buffer, same as a chunk passed to pppos_input_tcpip(),
+ * so batching doesn't increase the number of pool buffers held by the pending tcpip
+ * messages. Larger values are clamped to PBUF_POOL_BUFSIZE.
+ */
+#ifndef PPP_CLIENT_INPUT_BATCH_SIZE
+#define PPP_CLIENT_INPUT_BATCH_SIZE (PBUF_POOL_BUFSIZE)
+#endif /* PPP_CLIENT_INPUT_BATCH_SIZE */
+
+namespace particle { namespace net { namespace ppp {
+
+/* Accumulates data received from the modem in a pool buffer, so that it can be passed to
+ * the tcpip thread in one message. The batch is ready to be passed on when it's full or
+ * contains a HDLC flag, i.e. the end of a frame.
+ */
+class InputBatch {
+public:
+  explicit InputBatch(size_t maxSize = PPP_CLIENT_INPUT_BATCH_SIZE);
+  ~InputBatch();
+
+  /* Copies as much of the data as fits in the batch. Returns the number of bytes copied
+   * or a negative error code.
+   */
+  int append(const uint8_t* data, size_t size);
+  /* Returns the accumulated data and resets the batch. The caller takes ownership of
+   * the returned buffer, which is null if no data has been accumulated.
+   */
+  pbuf* take();
+  void discard();
+
+  bool ready() const {
+    return ready_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+  size_t maxSize() const {
+    return maxSize_;
+  }
+
+private:
+  pbuf* buf_;
+  size_t size_;
+  size_t maxSize_;
+  bool ready_;
+
+  InputBatch(const InputBatch&) = delete;
+  InputBatch& operator=(const InputBatch&) = delete;
+};
+
+} } } /* namespace particle::net::ppp */
+
+#endif /* HAL_NETWORK_LWIP_PPP_INPUT_BATCH_H */
@@ -17,6 +17,7 @@
 
 #include "resolvapi.h"
 #include "lwiplock.h"
+#include "dns_cache.h"
 #include "ipsockaddr.h"
 #include <lwip/dns.h>
 #include "logging.h"
@@ -115,6 +116,7 @@ int resolv_add_dns_server(const struct sockaddr* server, uint8_t priority) {
         const ip_addr_t* s = dns_getserver(i);
         if (ip_addr_isany(s)) {
             dns_setserver(i, &addr);
+            DnsCache::instance()->clear();
             return 0;
         }
     }
@@ -138,6 +140,7 @@ int resolv_del_dns_server(const struct sockaddr* server) {
         if (!ip_addr_isany(s)) {
             if (ip_addr_cmp_zoneless(&addr, s)) {
                 dns_setserver(i, nullptr);
+                DnsCache::instance()->clear();
                 return 0;
             }
         }
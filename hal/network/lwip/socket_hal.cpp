@@ -83,6 +83,10 @@ ssize_t sock_sendto(int s, const void* dataptr, size_t size, int flags,
   return lwip_sendto(s, dataptr, size, flags, to, tolen);
 }
 
+ssize_t sock_sendmsg(int s, const struct msghdr* msg, int flags) {
+  return lwip_sendmsg(s, msg, flags);
+}
+
 int sock_socket(int domain, int type, int protocol) {
   return lwip_socket(domain, type, protocol);
 }
@@ -58,6 +58,9 @@ const ResultCode RESULT_CODES[] = {
 
 const size_t RESULT_CODE_COUNT = sizeof(RESULT_CODES) / sizeof(RESULT_CODES[0]);
 
+// Indicates that the current line doesn't match any further nodes of the URC prefix tree
+const size_t NO_URC_NODE = (size_t)-1;
+
 size_t appendToBuf(char* dest, size_t destSize, const char* src, size_t srcSize) {
     const size_t n = std::min(srcSize, destSize);
     memcpy(dest, src, n);
@@ -289,6 +292,12 @@ int AtParserImpl::addUrcHandler(const char* prefix, AtParser::UrcHandler handler
     if (!urcHandlers_.append(std::move(h))) {
         return SYSTEM_ERROR_NO_MEMORY;
     }
+    const int ret = buildUrcTree();
+    if (ret < 0) {
+        urcHandlers_.takeLast();
+        buildUrcTree(); // Requires less memory than the tree that couldn't be built
+        return ret;
+    }
     return 0;
 }
 
@@ -296,6 +305,7 @@ void AtParserImpl::removeUrcHandler(const char* prefix) {
     for (int i = 0; i < urcHandlers_.size(); ++i) {
         if (strcmp(urcHandlers_.at(i).prefix, prefix) == 0) {
             urcHandlers_.removeAt(i);
+            buildUrcTree();
             break;
         }
     }
@@ -329,6 +339,7 @@ void AtParserImpl::reset() {
     errorCode_ = 0;
     result_ = AtResponse::OK;
     status_ = StatusFlag::READY | StatusFlag::LINE_BEGIN;
+    resetUrcMatch();
 }
 
 bool AtParserImpl::isConfigValid(const AtParserConfig& conf) {
@@ -376,6 +387,7 @@ int AtParserImpl::waitEcho() {
 
 int AtParserImpl::parseLine(unsigned flags, unsigned* timeout) {
     int ret = ParseResult::NO_MATCH;
+    resetUrcMatch();
     for (;;) {
         if (flags & ParseFlag::PARSE_RESULT) {
             // Check if the line contains a final result code
@@ -490,27 +502,73 @@ int AtParserImpl::parseUrc(const UrcHandler** handler) {
     if (bufPos_ == 0) {
         return ParseResult::READ_MORE;
     }
-    // Look for an URC prefix that matches the buffer contents
-    const UrcHandler* h = nullptr;
-    size_t maxSize = 0;
-    for (size_t i = 0; i < (size_t)urcHandlers_.size(); ++i) {
-        const UrcHandler& h2 = urcHandlers_.at(i);
-        const size_t n = std::min(bufPos_, h2.prefixSize);
-        if (memcmp(buf_, h2.prefix, n) == 0 && n > maxSize) {
-            h = &h2;
-            maxSize = n;
+    // The buffer contents only grow while a line is being parsed, so the prefix tree is
+    // traversed incrementally: characters that have already been matched are not checked again
+    while (urcNode_ != NO_URC_NODE && urcPos_ < bufPos_) {
+        const char c = buf_[urcPos_];
+        size_t i = urcNodes_[urcNode_].child;
+        while (i && urcNodes_[i].c != c) {
+            i = urcNodes_[i].sibling;
+        }
+        if (!i) {
+            urcNode_ = NO_URC_NODE;
+            break;
+        }
+        urcNode_ = i;
+        ++urcPos_;
+        if (urcNodes_[i].handler >= 0) {
+            urcHandler_ = urcNodes_[i].handler;
         }
     }
-    if (!h) {
-        return ParseResult::NO_MATCH;
+    if (urcNode_ != NO_URC_NODE && urcNodes_[urcNode_].child) {
+        return ParseResult::READ_MORE; // A longer prefix may match
     }
-    if (bufPos_ < h->prefixSize) {
-        return ParseResult::READ_MORE;
+    if (urcHandler_ < 0) {
+        return ParseResult::NO_MATCH;
     }
-    *handler = h;
+    *handler = &urcHandlers_.at(urcHandler_);
     return ParseResult::PARSED_URC;
 }
 
+void AtParserImpl::resetUrcMatch() {
+    urcNode_ = urcNodes_.isEmpty() ? NO_URC_NODE : 0;
+    urcPos_ = 0;
+    urcHandler_ = -1;
+}
+
+int AtParserImpl::buildUrcTree() {
+    urcNodes_.clear();
+    if (!urcHandlers_.isEmpty()) {
+        // Root node
+        if (!urcNodes_.append(UrcNode{ '\0', -1, 0, 0 })) {
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+    }
+    for (int i = 0; i < urcHandlers_.size(); ++i) {
+        const UrcHandler& h = urcHandlers_.at(i);
+        size_t node = 0;
+        for (size_t j = 0; j < h.prefixSize; ++j) {
+            const char c = h.prefix[j];
+            size_t child = urcNodes_[node].child;
+            while (child && urcNodes_[child].c != c) {
+                child = urcNodes_[child].sibling;
+            }
+            if (!child) {
+                child = urcNodes_.size();
+                if (!urcNodes_.append(UrcNode{ c, -1, 0, urcNodes_[node].child })) {
+                    urcNodes_.clear();
+                    return SYSTEM_ERROR_NO_MEMORY;
+                }
+                urcNodes_[node].child = child;
+            }
+            node = child;
+        }
+        urcNodes_[node].handler = i;
+    }
+    resetUrcMatch();
+    return 0;
+}
+
 int AtParserImpl::parseEcho() {
     if (bufPos_ == 0) {
         return ParseResult::READ_MORE;
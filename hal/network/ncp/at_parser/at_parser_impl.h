@@ -111,6 +111,14 @@ private:
         void* data; // User data
     };
 
+    // Node of the prefix tree of the URC handlers
+    struct UrcNode {
+        char c; // Last character of the prefix
+        int handler; // Index of the handler with this prefix or -1
+        size_t child; // Index of the first child node or 0
+        size_t sibling; // Index of the next sibling node or 0
+    };
+
     const char* const cmdTerm_; // Command terminator string
     const size_t cmdTermSize_; // Size of the command terminator string
 
@@ -130,6 +138,10 @@ private:
     unsigned status_; // Status flags
 
     Vector<UrcHandler> urcHandlers_; // URC handlers
+    Vector<UrcNode> urcNodes_; // Prefix tree of the URC handlers
+    size_t urcNode_; // Node matching the current line or NO_URC_NODE
+    size_t urcPos_; // Number of characters of the current line matched by the prefix tree
+    int urcHandler_; // Handler with the longest prefix matching the current line or -1
     AtParserConfig conf_; // Parser settings
 
     int readRespLine(char* data, size_t size);
@@ -138,6 +150,8 @@ private:
     int parseLine(unsigned flags, unsigned* timeout);
     int parseResult();
     int parseUrc(const UrcHandler** handler);
+    void resetUrcMatch();
+    int buildUrcTree();
     int parseEcho();
 
     int readLine(char* data, size_t size, unsigned* timeout);
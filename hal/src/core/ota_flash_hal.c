@@ -75,6 +75,10 @@ hal_update_complete_t HAL_FLASH_End(hal_module_t* reserved)
     return HAL_UPDATE_APPLIED_PENDING_RESTART;
 }
 
+void HAL_FLASH_Abort(void* reserved)
+{
+}
+
 void HAL_FLASH_Read_ServerAddress(ServerAddress* server_addr)
 {
     uint8_t buf[EXTERNAL_FLASH_SERVER_DOMAIN_LENGTH];
@@ -106,6 +106,16 @@ bool os_thread_current_within_stack()
     return true;
 }
 
+/**
+ * Returns the minimum amount of stack space that has remained free since the thread was created.
+ * @param thread    The thread to check
+ * @return The number of bytes, or a negative value if the stack usage is not tracked on this platform.
+ */
+int os_thread_stack_high_water_mark(os_thread_t thread)
+{
+    return -1;
+}
+
 /**
  * Waits indefinitely for the given thread to finish.
  * @param thread    The thread to wait for.
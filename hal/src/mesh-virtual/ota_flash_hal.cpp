@@ -58,6 +58,14 @@ int HAL_FLASH_OTA_Validate(hal_module_t* mod, bool userDepsOptional, module_vali
      return HAL_UPDATE_APPLIED;
 }
 
+void HAL_FLASH_Abort(void* reserved)
+{
+    if (output_file) {
+        fclose(output_file);
+        output_file = NULL;
+    }
+}
+
 
 
 /**
@@ -184,6 +184,11 @@ See http://www.FreeRTOS.org/RTOS-Cortex-M3-M4.html. */
 # define configCHECK_FOR_STACK_OVERFLOW 2
 #endif
 
+/* Track the stack usage of the threads in debug builds (see os_thread_stack_high_water_mark()) */
+#ifdef DEBUG_BUILD
+# define INCLUDE_uxTaskGetStackHighWaterMark 1
+#endif
+
 #define xPortPendSVHandler PendSV_Handler
 #define vPortSVCHandler SVC_Handler
 // #define xPortSysTickHandler SysTick_Handler
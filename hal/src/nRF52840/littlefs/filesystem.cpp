@@ -19,6 +19,7 @@
 #include "platform_config.h"
 #include "exflash_hal.h"
 #include "rgbled.h"
+#include "block_cache.h"
 #include <mutex>
 
 using namespace particle::fs;
@@ -60,10 +61,32 @@ __attribute__((weak)) int filesystem_unlock(filesystem_t* fs) {
 
 namespace {
 
+class ExflashStorage {
+public:
+    int read(unsigned offset, void* data, unsigned size) {
+        return hal_exflash_read(offset, (uint8_t*)data, size);
+    }
+
+    int write(unsigned offset, const void* data, unsigned size) {
+        return hal_exflash_write(offset, (const uint8_t*)data, size);
+    }
+
+    int eraseSector(unsigned address) {
+        return hal_exflash_erase_sector(address, 1);
+    }
+};
+
+#if FILESYSTEM_CACHE_PAGES > 0
+/* Accessed only from the littlefs callbacks, which are called with the filesystem locked */
+particle::BlockCache<ExflashStorage, FILESYSTEM_READ_SIZE, FILESYSTEM_CACHE_PAGES, FILESYSTEM_BLOCK_SIZE> s_storage(FILESYSTEM_CACHE_READ_AHEAD);
+#else
+ExflashStorage s_storage;
+#endif /* FILESYSTEM_CACHE_PAGES > 0 */
+
 int fs_read(const struct lfs_config* c, lfs_block_t block,
             lfs_off_t off, void* buffer, lfs_size_t size)
 {
-    int r = hal_exflash_read(block * c->block_size + off, (uint8_t*)buffer, size);
+    int r = s_storage.read(block * c->block_size + off, buffer, size);
     if (r) {
         LOG_DEBUG(ERROR, "fs_read error %d", r);
     }
@@ -73,7 +96,7 @@ int fs_read(const struct lfs_config* c, lfs_block_t block,
 int fs_prog(const struct lfs_config* c, lfs_block_t block,
             lfs_off_t off, const void* buffer, lfs_size_t size)
 {
-    int r = hal_exflash_write(block * c->block_size + off, (const uint8_t*)buffer, size);
+    int r = s_storage.write(block * c->block_size + off, buffer, size);
     if (r) {
         LOG_DEBUG(ERROR, "fs_prog error %d", r);
     }
@@ -82,7 +105,7 @@ int fs_prog(const struct lfs_config* c, lfs_block_t block,
 
 int fs_erase(const struct lfs_config* c, lfs_block_t block)
 {
-    int r = hal_exflash_erase_sector(block * c->block_size, 1);
+    int r = s_storage.eraseSector(block * c->block_size);
     if (r) {
         LOG_DEBUG(ERROR, "fs_erase error %d", r);
     }
@@ -225,6 +248,16 @@ void fs_dump(filesystem_t* fs)
             (unsigned long)(100.0f - (((float)svfs.f_bfree / (float)svfs.f_blocks) * 100)));
     }
 
+#if FILESYSTEM_CACHE_PAGES > 0
+    const particle::BlockCacheStats& cs = s_storage.stats();
+    LOG_PRINTF(TRACE, "Cache: %lu hits, %lu misses, %lu read ahead (%lu used), %lu flash reads\r\n\r\n",
+        (unsigned long)cs.hits,
+        (unsigned long)cs.misses,
+        (unsigned long)cs.readAhead,
+        (unsigned long)cs.readAheadHits,
+        (unsigned long)cs.storeReads);
+#endif /* FILESYSTEM_CACHE_PAGES > 0 */
+
     /* Recursively traverse directories */
     char tmpbuf[(LFS_NAME_MAX + 1) * 2] = {};
     tmpbuf[0] = '/';
@@ -257,6 +290,10 @@ int filesystem_mount(filesystem_t* fs) {
     fs->config.block_count = FILESYSTEM_BLOCK_COUNT;
     fs->config.lookahead = FILESYSTEM_LOOKAHEAD;
 
+#if FILESYSTEM_CACHE_PAGES > 0
+    s_storage.invalidate();
+#endif /* FILESYSTEM_CACHE_PAGES > 0 */
+
 #ifdef LFS_NO_MALLOC
     fs->config.read_buffer = fs->read_buffer;
     fs->config.prog_buffer = fs->prog_buffer;
@@ -327,6 +364,28 @@ filesystem_t* filesystem_get_instance(void* reserved) {
     return &s_instance;
 }
 
+int filesystem_get_cache_stats(filesystem_t* fs, filesystem_cache_stats* stats) {
+    if (!fs || !stats) {
+        return -1;
+    }
+
+#if FILESYSTEM_CACHE_PAGES > 0
+    FsLock lk(fs);
+
+    const particle::BlockCacheStats& s = s_storage.stats();
+    stats->hits = s.hits;
+    stats->misses = s.misses;
+    stats->read_ahead = s.readAhead;
+    stats->read_ahead_hits = s.readAheadHits;
+    stats->bypassed = s.bypassed;
+    stats->flash_reads = s.storeReads;
+
+    return 0;
+#else
+    return -1;
+#endif /* FILESYSTEM_CACHE_PAGES > 0 */
+}
+
 int filesystem_dump_info(filesystem_t* fs) {
     if (!fs) {
         return -1;
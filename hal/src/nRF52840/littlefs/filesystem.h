@@ -27,6 +27,7 @@ extern "C" {
 
 #include <lfs_util.h>
 #include <lfs.h>
+#include "module_info.h"
 
 /* FIXME */
 #define FILESYSTEM_PROG_SIZE    (256)
@@ -37,6 +38,20 @@ extern "C" {
 #define FILESYSTEM_BLOCK_COUNT  (sFLASH_PAGECOUNT / 2)
 #define FILESYSTEM_LOOKAHEAD    (128)
 
+/* Number of FILESYSTEM_READ_SIZE pages cached in RAM, 0 disables the cache */
+#ifndef FILESYSTEM_CACHE_PAGES
+#if MODULE_FUNCTION != MOD_FUNC_BOOTLOADER
+#define FILESYSTEM_CACHE_PAGES  (8)
+#else
+#define FILESYSTEM_CACHE_PAGES  (0)
+#endif /* MODULE_FUNCTION != MOD_FUNC_BOOTLOADER */
+#endif /* FILESYSTEM_CACHE_PAGES */
+
+/* Number of pages read ahead when the flash is read sequentially */
+#ifndef FILESYSTEM_CACHE_READ_AHEAD
+#define FILESYSTEM_CACHE_READ_AHEAD (3)
+#endif /* FILESYSTEM_CACHE_READ_AHEAD */
+
 /* FIXME */
 typedef struct {
     uint16_t version;
@@ -55,10 +70,20 @@ typedef struct {
 #endif /* LFS_NO_MALLOC */
 } filesystem_t;
 
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t read_ahead;
+    uint32_t read_ahead_hits;
+    uint32_t bypassed;
+    uint32_t flash_reads;
+} filesystem_cache_stats;
+
 int filesystem_mount(filesystem_t* fs);
 int filesystem_unmount(filesystem_t* fs);
 filesystem_t* filesystem_get_instance(void* reserved);
 int filesystem_dump_info(filesystem_t* fs);
+int filesystem_get_cache_stats(filesystem_t* fs, filesystem_cache_stats* stats);
 
 int filesystem_lock(filesystem_t* fs);
 int filesystem_unlock(filesystem_t* fs);
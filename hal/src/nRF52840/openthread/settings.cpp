@@ -78,7 +78,7 @@ otError otPlatSettingsAdd(otInstance *aInstance, uint16_t aKey, const uint8_t *a
 
 otError otPlatSettingsDelete(otInstance *aInstance, uint16_t aKey, int aIndex) {
     int r = s_settingsFile.del(aKey, aIndex);
-    return r == 0 ? OT_ERROR_NONE : OT_ERROR_NOT_FOUND;
+    return r > 0 ? OT_ERROR_NONE : OT_ERROR_NOT_FOUND;
 }
 
 void otPlatSettingsWipe(otInstance* aInstance) {
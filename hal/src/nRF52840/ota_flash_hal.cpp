@@ -42,6 +42,7 @@
 #include "hal_platform.h"
 #include "platform_ncp.h"
 #include "deviceid_hal.h"
+#include "ota_inflate.h"
 #include <memory>
 
 #define OTA_CHUNK_SIZE                 (512)
@@ -50,6 +51,13 @@
 
 static hal_update_complete_t flash_bootloader(hal_module_t* mod, uint32_t moduleLength);
 
+namespace {
+
+// Decompresses compressed module images written via HAL_FLASH_Update()
+particle::OtaInflater g_otaInflater;
+
+} // namespace
+
 inline bool matches_mcu(uint8_t bounds_mcu, uint8_t actual_mcu) {
 	return bounds_mcu==HAL_PLATFORM_MCU_ANY || actual_mcu==HAL_PLATFORM_MCU_ANY || (bounds_mcu==actual_mcu);
 }
@@ -335,12 +343,19 @@ uint16_t HAL_OTA_ChunkSize()
 bool HAL_FLASH_Begin(uint32_t address, uint32_t length, void* reserved)
 {
     FLASH_Begin(address, length);
+    g_otaInflater.begin(address, length);
     return true;
 }
 
 int HAL_FLASH_Update(const uint8_t *pBuffer, uint32_t address, uint32_t length, void* reserved)
 {
-    return FLASH_Update(pBuffer, address, length);
+    return g_otaInflater.update(pBuffer, address, length);
+}
+
+void HAL_FLASH_Abort(void* reserved)
+{
+    // Release the decompressor's state of an incomplete compressed update
+    g_otaInflater.end();
 }
 
 static hal_update_complete_t flash_bootloader(hal_module_t* mod, uint32_t moduleLength)
@@ -386,6 +401,11 @@ int HAL_FLASH_OTA_Validate(hal_module_t* mod, bool userDepsOptional, module_vali
     hal_module_t module;
 
     bool module_fetched = fetch_module(&module, &module_ota, userDepsOptional, flags);
+    if (g_otaInflater.isPending())
+    {
+        // A compressed module has not been fully decompressed
+        module_fetched = false;
+    }
 
     if (mod) 
     {
@@ -401,6 +421,7 @@ hal_update_complete_t HAL_FLASH_End(hal_module_t* mod)
     hal_update_complete_t result = HAL_UPDATE_ERROR;
 
     bool module_fetched = !HAL_FLASH_OTA_Validate(&module, true, (module_validation_flags_t)(MODULE_VALIDATION_INTEGRITY | MODULE_VALIDATION_DEPENDENCIES_FULL), NULL);
+    g_otaInflater.end();
 	LOG(INFO, "module fetched %d, checks=%x, result=%x", module_fetched, module.validity_checked, module.validity_result);
     if (module_fetched && (module.validity_checked==module.validity_result))
     {
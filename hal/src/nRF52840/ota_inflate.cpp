@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ota_inflate.h"
+
+#include "ota_flash_hal.h"
+#include "flash_mal.h"
+#include "exflash_hal.h"
+#include "system_error.h"
+#include "logging.h"
+#include "check.h"
+
+#include "miniz.h"
+
+#include <algorithm>
+#include <new>
+#include <cstring>
+
+namespace particle {
+
+namespace {
+
+inline uint32_t alignToSector(uint32_t size) {
+    return (size + sFLASH_PAGESIZE - 1) / sFLASH_PAGESIZE * sFLASH_PAGESIZE;
+}
+
+} // particle::
+
+OtaInflater::OtaInflater() :
+        header_(),
+        fileAddr_(0),
+        fileSize_(0),
+        stagingAddr_(0),
+        erasedEnd_(0),
+        lastOffs_(0),
+        inOffs_(0),
+        outOffs_(0),
+        chunkSize_(0),
+        dictSize_(0),
+        dictOffs_(0),
+        state_(NONE),
+        untracked_(false) {
+}
+
+OtaInflater::~OtaInflater() {
+}
+
+void OtaInflater::begin(uint32_t address, uint32_t length) {
+    reset();
+    header_ = compressed_module_header();
+    fileAddr_ = address;
+    fileSize_ = length;
+    erasedEnd_ = address + alignToSector(length);
+    state_ = UNKNOWN;
+}
+
+int OtaInflater::update(const uint8_t* data, uint32_t address, size_t size) {
+    const uint32_t offs = address - fileAddr_;
+    if (state_ == NONE || address < fileAddr_ || offs + size > fileSize_) {
+        return FLASH_Update(data, address, size);
+    }
+    switch (state_) {
+    case UNKNOWN: {
+        if (offs == 0) {
+            if (size >= sizeof(compressed_module_header) &&
+                    ((const compressed_module_header*)data)->magic == COMPRESSED_MODULE_MAGIC) {
+                return start(data, size);
+            }
+            reset(); // Not compressed
+            return FLASH_Update(data, address, size);
+        }
+        // The chunks that arrive before the first one are written as is. If the file turns out to be
+        // compressed, they are moved to the staging area
+        if (!chunkSize_ && offs + size < fileSize_) {
+            chunkSize_ = size;
+        }
+        CHECK(FLASH_Update(data, address, size));
+        if (!chunkSize_) {
+            lastOffs_ = offs; // The last chunk can't be tracked until the chunk size is known
+        } else if (markReceived(offs, size) < 0) {
+            untracked_ = true;
+        }
+        return 0;
+    }
+    case COMPRESSED: {
+        if (offs == inOffs_) {
+            CHECK(inflate(data, size));
+            inOffs_ += size;
+            return inflateStaged();
+        }
+        if (offs > inOffs_) {
+            return stage(data, offs, size);
+        }
+        return 0; // Already decompressed
+    }
+    default:
+        // The chunks received after the module has been decompressed or the decompression has failed
+        // are ignored. A failed update is reported when the module is validated
+        return 0;
+    }
+}
+
+void OtaInflater::end() {
+    if (state_ == COMPRESSED) {
+        LOG(ERROR, "Compressed module is incomplete");
+    }
+    reset();
+}
+
+int OtaInflater::start(const uint8_t* data, size_t size) {
+    memcpy(&header_, data, sizeof(header_));
+    if (header_.size < sizeof(header_) || header_.size > size || header_.method != COMPRESSED_MODULE_METHOD_DEFLATE ||
+            header_.window_bits < 9 || header_.window_bits > 15) {
+        LOG(ERROR, "Invalid compressed module header");
+        return fail(SYSTEM_ERROR_BAD_DATA);
+    }
+    const uint32_t otaEnd = HAL_OTA_FlashAddress() + HAL_OTA_FlashLength();
+    if (header_.original_size > otaEnd - fileAddr_) {
+        LOG(ERROR, "Decompressed module is too large: %u bytes", (unsigned)header_.original_size);
+        return fail(SYSTEM_ERROR_TOO_LARGE);
+    }
+    if (untracked_ || (chunkSize_ && size != chunkSize_)) {
+        LOG(ERROR, "Unable to stage compressed data");
+        return fail(SYSTEM_ERROR_BAD_DATA);
+    }
+    chunkSize_ = size;
+    if (lastOffs_ && markReceived(lastOffs_, fileSize_ - lastOffs_) < 0) {
+        LOG(ERROR, "Unable to stage compressed data");
+        return fail(SYSTEM_ERROR_BAD_DATA);
+    }
+    // The staging area follows the decompressed module and the range erased by the caller
+    stagingAddr_ = fileAddr_ + alignToSector(std::max(header_.original_size, fileSize_));
+    decomp_.reset(new(std::nothrow) tinfl_decompressor);
+    dictSize_ = 1 << header_.window_bits;
+    dict_.reset(new(std::nothrow) uint8_t[dictSize_]);
+    if (!decomp_ || !dict_) {
+        return fail(SYSTEM_ERROR_NO_MEMORY);
+    }
+    tinfl_init(decomp_.get());
+    if (received_) {
+        if (stagingAddr_ + fileSize_ > otaEnd) {
+            LOG(ERROR, "Not enough space for the staging area");
+            return fail(SYSTEM_ERROR_TOO_LARGE);
+        }
+        uint8_t buf[256];
+        for (uint32_t offs = chunkSize_; offs < fileSize_; offs += chunkSize_) {
+            if (!isReceived(offs)) {
+                continue;
+            }
+            const size_t n = std::min<size_t>(chunkSize_, fileSize_ - offs);
+            CHECK(eraseStaging(offs, n));
+            for (size_t i = 0; i < n; i += sizeof(buf)) {
+                const size_t len = std::min(sizeof(buf), n - i);
+                if (hal_exflash_read(fileAddr_ + offs + i, buf, len) != 0 ||
+                        FLASH_Update(buf, stagingAddr_ + offs + i, len) != 0) {
+                    return fail(SYSTEM_ERROR_IO);
+                }
+            }
+        }
+        // The decompressed module's area needs to be erased again
+        erasedEnd_ = fileAddr_;
+    }
+    state_ = COMPRESSED;
+    LOG(INFO, "Receiving compressed module: %u bytes, decompressed: %u bytes", (unsigned)fileSize_,
+            (unsigned)header_.original_size);
+    CHECK(inflate(data + header_.size, size - header_.size));
+    inOffs_ = size;
+    return inflateStaged();
+}
+
+int OtaInflater::stage(const uint8_t* data, uint32_t offs, size_t size) {
+    // A chunk that can't be staged is dropped. The chunk is requested again and gets decompressed
+    // directly once the preceding data has been received
+    if (stagingAddr_ + fileSize_ > HAL_OTA_FlashAddress() + HAL_OTA_FlashLength()) {
+        LOG(WARN, "Not enough space for the staging area");
+        return SYSTEM_ERROR_TOO_LARGE;
+    }
+    if (offs % chunkSize_ != 0 || (size != chunkSize_ && offs + size != fileSize_)) {
+        LOG(WARN, "Unable to stage compressed data");
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    CHECK(eraseStaging(offs, size));
+    if (FLASH_Update(data, stagingAddr_ + offs, size) != 0) {
+        return fail(SYSTEM_ERROR_IO);
+    }
+    return markReceived(offs, size);
+}
+
+int OtaInflater::inflate(const uint8_t* data, size_t size) {
+    for (;;) {
+        size_t inSize = size;
+        size_t outSize = dictSize_ - dictOffs_;
+        const auto status = tinfl_decompress(decomp_.get(), data, &inSize, dict_.get(), dict_.get() + dictOffs_,
+                &outSize, TINFL_FLAG_HAS_MORE_INPUT);
+        data += inSize;
+        size -= inSize;
+        if (outSize > 0) {
+            CHECK(write(dict_.get() + dictOffs_, outSize));
+            dictOffs_ = (dictOffs_ + outSize) & (dictSize_ - 1);
+        }
+        if (status < TINFL_STATUS_DONE) {
+            LOG(ERROR, "Unable to decompress module: %d", (int)status);
+            return fail(SYSTEM_ERROR_BAD_DATA);
+        }
+        if (status == TINFL_STATUS_DONE) {
+            if (outOffs_ != header_.original_size) {
+                LOG(ERROR, "Unexpected size of the decompressed module: %u bytes", (unsigned)outOffs_);
+                return fail(SYSTEM_ERROR_BAD_DATA);
+            }
+            LOG(INFO, "Module decompressed: %u bytes, compressed: %u bytes", (unsigned)outOffs_, (unsigned)fileSize_);
+            reset();
+            state_ = DONE;
+            return 0;
+        }
+        if (status == TINFL_STATUS_NEEDS_MORE_INPUT && !size) {
+            return 0;
+        }
+    }
+}
+
+int OtaInflater::inflateStaged() {
+    uint8_t buf[256];
+    while (state_ == COMPRESSED && inOffs_ < fileSize_ && isReceived(inOffs_)) {
+        const size_t n = std::min<size_t>(chunkSize_, fileSize_ - inOffs_);
+        for (size_t i = 0; i < n && state_ == COMPRESSED; i += sizeof(buf)) {
+            const size_t len = std::min(sizeof(buf), n - i);
+            if (hal_exflash_read(stagingAddr_ + inOffs_ + i, buf, len) != 0) {
+                return fail(SYSTEM_ERROR_IO);
+            }
+            CHECK(inflate(buf, len));
+        }
+        inOffs_ += n;
+    }
+    return 0;
+}
+
+int OtaInflater::write(const uint8_t* data, size_t size) {
+    if (size > header_.original_size - outOffs_) {
+        LOG(ERROR, "Decompressed module is too large");
+        return fail(SYSTEM_ERROR_TOO_LARGE);
+    }
+    const uint32_t addr = fileAddr_ + outOffs_;
+    while (erasedEnd_ < addr + size) {
+        if (!FLASH_EraseMemory(FLASH_SERIAL, erasedEnd_, sFLASH_PAGESIZE)) {
+            return fail(SYSTEM_ERROR_IO);
+        }
+        erasedEnd_ += sFLASH_PAGESIZE;
+    }
+    if (FLASH_Update(data, addr, size) != 0) {
+        return fail(SYSTEM_ERROR_IO);
+    }
+    outOffs_ += size;
+    return 0;
+}
+
+int OtaInflater::eraseStaging(uint32_t offs, size_t size) {
+    if (!erased_) {
+        const size_t sectors = alignToSector(fileSize_) / sFLASH_PAGESIZE;
+        erased_.reset(new(std::nothrow) uint8_t[(sectors + 7) / 8]());
+        if (!erased_) {
+            return fail(SYSTEM_ERROR_NO_MEMORY);
+        }
+    }
+    for (size_t i = offs / sFLASH_PAGESIZE; i <= (offs + size - 1) / sFLASH_PAGESIZE; ++i) {
+        if (erased_[i / 8] & (1 << (i % 8))) {
+            continue;
+        }
+        if (!FLASH_EraseMemory(FLASH_SERIAL, stagingAddr_ + i * sFLASH_PAGESIZE, sFLASH_PAGESIZE)) {
+            return fail(SYSTEM_ERROR_IO);
+        }
+        erased_[i / 8] |= (1 << (i % 8));
+    }
+    return 0;
+}
+
+int OtaInflater::markReceived(uint32_t offs, size_t size) {
+    // All chunks except the last one are expected to be of the same size
+    if (!chunkSize_ || offs % chunkSize_ != 0 || (size != chunkSize_ && offs + size != fileSize_)) {
+        return SYSTEM_ERROR_BAD_DATA;
+    }
+    if (!received_) {
+        const size_t chunks = (fileSize_ + chunkSize_ - 1) / chunkSize_;
+        received_.reset(new(std::nothrow) uint8_t[(chunks + 7) / 8]());
+        if (!received_) {
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+    }
+    const size_t i = offs / chunkSize_;
+    received_[i / 8] |= (1 << (i % 8));
+    return 0;
+}
+
+bool OtaInflater::isReceived(uint32_t offs) const {
+    if (!received_ || offs % chunkSize_ != 0) {
+        return false;
+    }
+    const size_t i = offs / chunkSize_;
+    return received_[i / 8] & (1 << (i % 8));
+}
+
+int OtaInflater::fail(int error) {
+    reset();
+    state_ = FAILED;
+    return error;
+}
+
+void OtaInflater::reset() {
+    decomp_.reset();
+    dict_.reset();
+    received_.reset();
+    erased_.reset();
+    lastOffs_ = 0;
+    inOffs_ = 0;
+    outOffs_ = 0;
+    chunkSize_ = 0;
+    dictSize_ = 0;
+    dictOffs_ = 0;
+    state_ = NONE;
+    untracked_ = false;
+}
+
+} // particle
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "module_info.h"
+
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+
+struct tinfl_decompressor_tag;
+
+namespace particle {
+
+/**
+ * Decompresses a compressed module image (see `compressed_module_header`) while it's being
+ * written to the OTA region.
+ *
+ * Whether the image is compressed is determined by the first chunk of the file. The decompressed
+ * module is written to the start of the OTA region, so it can be validated and applied the same
+ * way as an uncompressed one.
+ *
+ * The compressed data has to be decompressed in order. Chunks that arrive ahead of the
+ * decompressor, e.g. because a preceding chunk was lost during a fast OTA, are kept in a staging
+ * area that follows the decompressed module in the OTA region and are decompressed once the
+ * missing data has been received.
+ */
+class OtaInflater {
+public:
+    OtaInflater();
+    ~OtaInflater();
+
+    /**
+     * Start a new update. The address range is expected to be erased by the caller.
+     */
+    void begin(uint32_t address, uint32_t length);
+
+    /**
+     * Write a chunk of the file.
+     *
+     * Returns 0 on success or a negative result code in case of an error.
+     */
+    int update(const uint8_t* data, uint32_t address, size_t size);
+
+    /**
+     * Finish or cancel the update and release the decompressor's state.
+     */
+    void end();
+
+    /**
+     * Returns `true` if the decompression of a compressed file is still in progress or has failed.
+     */
+    bool isPending() const {
+        return state_ == COMPRESSED || state_ == FAILED;
+    }
+
+    /**
+     * Returns the size of the compressed file, or 0 if the file is not compressed.
+     *
+     * The size is known once the first chunk of the file has been received and remains available
+     * until a new update is started.
+     */
+    uint32_t compressedSize() const {
+        return isCompressed() ? fileSize_ : 0;
+    }
+
+    /**
+     * Returns the size of the decompressed module, or 0 if the file is not compressed.
+     */
+    uint32_t uncompressedSize() const {
+        return isCompressed() ? header_.original_size : 0;
+    }
+
+private:
+    enum State {
+        NONE, // No update in progress or the file is not compressed
+        UNKNOWN, // The first chunk of the file has not been received yet
+        COMPRESSED,
+        DONE,
+        FAILED
+    };
+
+    std::unique_ptr<tinfl_decompressor_tag> decomp_;
+    std::unique_ptr<uint8_t[]> dict_;
+    std::unique_ptr<uint8_t[]> received_; // Chunks stored in the staging area
+    std::unique_ptr<uint8_t[]> erased_; // Erased sectors of the staging area
+    compressed_module_header header_;
+    uint32_t fileAddr_;
+    uint32_t fileSize_;
+    uint32_t stagingAddr_;
+    uint32_t erasedEnd_; // End of the erased part of the decompressed module's area
+    uint32_t lastOffs_; // Offset of the last chunk if it was received before the first one
+    uint32_t inOffs_; // Offset of the next compressed chunk to decompress
+    uint32_t outOffs_; // Number of decompressed bytes written
+    size_t chunkSize_;
+    size_t dictSize_;
+    size_t dictOffs_;
+    State state_;
+    bool untracked_; // A chunk received before the first one can't be staged
+
+    bool isCompressed() const {
+        return header_.magic == COMPRESSED_MODULE_MAGIC;
+    }
+
+    int start(const uint8_t* data, size_t size);
+    int stage(const uint8_t* data, uint32_t offs, size_t size);
+    int inflate(const uint8_t* data, size_t size);
+    int inflateStaged();
+    int write(const uint8_t* data, size_t size);
+    int eraseStaging(uint32_t offs, size_t size);
+    int markReceived(uint32_t offs, size_t size);
+    bool isReceived(uint32_t offs) const;
+    int fail(int error);
+    void reset();
+};
+
+} // particle
@@ -125,6 +125,16 @@ bool os_thread_current_within_stack()
     return true;
 }
 
+/**
+ * Returns the minimum amount of stack space that has remained free since the thread was created.
+ * @param thread    The thread to check
+ * @return The number of bytes, or a negative value if the stack usage is not tracked on this platform.
+ */
+int os_thread_stack_high_water_mark(os_thread_t thread)
+{
+    return -1;
+}
+
 /**
  * Waits indefinitely for the given thread to finish.
  * @param thread    The thread to wait for.
@@ -453,7 +463,14 @@ int os_semaphore_take(os_semaphore_t semaphore, system_tick_t timeout, bool rese
 
 int os_semaphore_give(os_semaphore_t semaphore, bool reserved)
 {
-    return xSemaphoreGive(semaphore)!=pdTRUE;
+    if (!HAL_IsISR()) {
+        return xSemaphoreGive(semaphore)!=pdTRUE;
+    } else {
+        BaseType_t woken = pdFALSE;
+        int res = xSemaphoreGiveFromISR(semaphore, &woken) != pdTRUE;
+        portYIELD_FROM_ISR(woken);
+        return res;
+    }
 }
 
 /**
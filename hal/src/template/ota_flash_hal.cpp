@@ -68,6 +68,10 @@ hal_update_complete_t HAL_FLASH_End(hal_module_t* mod)
     return HAL_UPDATE_ERROR;
 }
 
+void HAL_FLASH_Abort(void* reserved)
+{
+}
+
 void HAL_FLASH_Read_ServerAddress(ServerAddress* server_addr)
 {
 }
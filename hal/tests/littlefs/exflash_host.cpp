@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "exflash_host.h"
+#include "exflash_hal.h"
+#include "platform_config.h"
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace particle { namespace test {
+
+namespace {
+
+std::vector<uint8_t> g_data(sFLASH_PAGESIZE * sFLASH_PAGECOUNT, 0xff);
+ExflashStats g_stats = {};
+int g_failAfter = -1;
+
+bool checkRange(uintptr_t addr, size_t size) {
+    return addr <= g_data.size() && size <= g_data.size() - addr;
+}
+
+// Returns false if the operation should fail
+bool countOp() {
+    if (g_failAfter < 0) {
+        return true;
+    }
+    if (g_failAfter == 0) {
+        return false;
+    }
+    --g_failAfter;
+    return true;
+}
+
+} // namespace
+
+void exflash_clear() {
+    std::fill(g_data.begin(), g_data.end(), 0xff);
+    exflash_reset_stats();
+}
+
+void exflash_reset_stats() {
+    g_stats = {};
+}
+
+const ExflashStats& exflash_stats() {
+    return g_stats;
+}
+
+void exflash_fail_after(int ops) {
+    g_failAfter = ops;
+}
+
+int exflash_load(const char* file) {
+    FILE* f = fopen(file, "rb");
+    if (!f) {
+        return -1;
+    }
+    std::fill(g_data.begin(), g_data.end(), 0xff);
+    fread(g_data.data(), 1, g_data.size(), f);
+    const bool ok = !ferror(f);
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+int exflash_save(const char* file) {
+    FILE* f = fopen(file, "wb");
+    if (!f) {
+        return -1;
+    }
+    const bool ok = fwrite(g_data.data(), 1, g_data.size(), f) == g_data.size();
+    return (fclose(f) == 0 && ok) ? 0 : -1;
+}
+
+uint8_t* exflash_data() {
+    return g_data.data();
+}
+
+size_t exflash_size() {
+    return g_data.size();
+}
+
+} } // particle::test
+
+using namespace particle::test;
+
+int hal_exflash_read(uintptr_t addr, uint8_t* data_buf, size_t data_size) {
+    if (!checkRange(addr, data_size)) {
+        return -1;
+    }
+    memcpy(data_buf, g_data.data() + addr, data_size);
+    ++g_stats.reads;
+    return 0;
+}
+
+int hal_exflash_write(uintptr_t addr, const uint8_t* data_buf, size_t data_size) {
+    if (!checkRange(addr, data_size)) {
+        return -1;
+    }
+    // A failed write is interrupted halfway through
+    const bool ok = countOp();
+    const size_t size = ok ? data_size : data_size / 2;
+    uint8_t* const p = g_data.data() + addr;
+    for (size_t i = 0; i < size; ++i) {
+        p[i] &= data_buf[i];
+    }
+    ++g_stats.progs;
+    return ok ? 0 : -1;
+}
+
+int hal_exflash_erase_sector(uintptr_t addr, size_t num_sectors) {
+    addr -= addr % sFLASH_PAGESIZE;
+    if (!checkRange(addr, num_sectors * sFLASH_PAGESIZE)) {
+        return -1;
+    }
+    if (!countOp()) {
+        return -1;
+    }
+    memset(g_data.data() + addr, 0xff, num_sectors * sFLASH_PAGESIZE);
+    g_stats.erases += num_sectors;
+    return 0;
+}
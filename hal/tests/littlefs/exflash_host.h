@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * RAM image of the external flash used by the host tests of the filesystem. The image has the
+ * usual NOR semantics: programming can only clear bits and an erase sets a whole sector to 0xff.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace particle { namespace test {
+
+struct ExflashStats {
+    uint64_t reads;
+    uint64_t progs;
+    uint64_t erases;
+};
+
+// Erases the whole image and resets the statistics
+void exflash_clear();
+// Resets the statistics
+void exflash_reset_stats();
+const ExflashStats& exflash_stats();
+
+// Makes the flash operations fail after the specified number of programs and erases.
+// A negative value disables the fault injection
+void exflash_fail_after(int ops);
+
+// Loads the image from a file or saves it to a file
+int exflash_load(const char* file);
+int exflash_save(const char* file);
+
+uint8_t* exflash_data();
+size_t exflash_size();
+
+} } // particle::test
@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tests of the Gen 3 filesystem layer. The filesystem is mounted on a RAM image of the
+ * external flash, so the reads, programs and erases go through the same block device callbacks
+ * and block cache as on the device.
+ */
+
+#include "filesystem.h"
+#include "exflash_host.h"
+
+// Defined by service_debug.h
+#undef INFO
+#undef WARN
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <random>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+using namespace particle::fs;
+using namespace particle::test;
+
+namespace {
+
+filesystem_t* fs() {
+    return filesystem_get_instance(nullptr);
+}
+
+// Simulates a reset of the device
+void remount() {
+    REQUIRE(filesystem_unmount(fs()) == 0);
+    REQUIRE(filesystem_mount(fs()) == 0);
+}
+
+int writeFile(const char* name, const std::string& data) {
+    FsLock lk(fs());
+    lfs_file_t file = {};
+    int r = lfs_file_open(&fs()->instance, &file, name, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+    if (r < 0) {
+        return r;
+    }
+    const lfs_ssize_t n = lfs_file_write(&fs()->instance, &file, data.data(), data.size());
+    r = lfs_file_close(&fs()->instance, &file);
+    if (n < 0) {
+        return n;
+    }
+    return r;
+}
+
+std::string readFile(const char* name) {
+    FsLock lk(fs());
+    lfs_file_t file = {};
+    if (lfs_file_open(&fs()->instance, &file, name, LFS_O_RDONLY) < 0) {
+        return std::string();
+    }
+    std::string data(lfs_file_size(&fs()->instance, &file), '\0');
+    const lfs_ssize_t n = lfs_file_read(&fs()->instance, &file, &data[0], data.size());
+    lfs_file_close(&fs()->instance, &file);
+    return (n == (lfs_ssize_t)data.size()) ? data : std::string();
+}
+
+bool fileExists(const char* name) {
+    FsLock lk(fs());
+    lfs_info info = {};
+    return lfs_stat(&fs()->instance, name, &info) == 0;
+}
+
+std::string randomData(size_t size, unsigned seed) {
+    std::mt19937 rand(seed);
+    std::string data(size, '\0');
+    for (auto& c: data) {
+        c = rand();
+    }
+    return data;
+}
+
+// Mounts the filesystem on a blank flash image
+struct Filesystem {
+    Filesystem() {
+        filesystem_unmount(fs());
+        exflash_fail_after(-1);
+        exflash_clear();
+        REQUIRE(filesystem_mount(fs()) == 0);
+    }
+
+    ~Filesystem() {
+        exflash_fail_after(-1);
+        filesystem_unmount(fs());
+    }
+};
+
+} // namespace
+
+TEST_CASE("filesystem_mount()") {
+    Filesystem f;
+
+    SECTION("formats a blank flash") {
+        REQUIRE(exflash_stats().erases > 0);
+        REQUIRE(exflash_stats().progs > 0);
+        REQUIRE(fileExists("/"));
+        REQUIRE(!fileExists("/file"));
+    }
+
+    SECTION("keeps the files stored on the flash") {
+        const auto data = randomData(10000, 1);
+        REQUIRE(writeFile("/file", data) == 0);
+        REQUIRE(filesystem_unmount(fs()) == 0);
+        exflash_reset_stats();
+        REQUIRE(filesystem_mount(fs()) == 0);
+        REQUIRE(readFile("/file") == data);
+        REQUIRE(exflash_stats().reads > 0);
+        REQUIRE(exflash_stats().erases == 0);
+    }
+
+    SECTION("formats a corrupt flash") {
+        REQUIRE(writeFile("/file", "data") == 0);
+        REQUIRE(filesystem_unmount(fs()) == 0);
+        const auto garbage = randomData(FILESYSTEM_BLOCK_SIZE * 4, 2);
+        memcpy(exflash_data(), garbage.data(), garbage.size());
+        memcpy(exflash_data() + FILESYSTEM_BLOCK_SIZE * FILESYSTEM_BLOCK_COUNT / 2, garbage.data(), garbage.size());
+        REQUIRE(filesystem_mount(fs()) == 0);
+        REQUIRE(!fileExists("/file"));
+        REQUIRE(writeFile("/file", "data") == 0);
+        remount();
+        REQUIRE(readFile("/file") == "data");
+    }
+
+    SECTION("doesn't touch the second half of the flash") {
+        const size_t offs = FILESYSTEM_BLOCK_SIZE * FILESYSTEM_BLOCK_COUNT;
+        memset(exflash_data() + offs, 0x5a, exflash_size() - offs);
+        for (int i = 0; i < 100; ++i) {
+            REQUIRE(writeFile("/file", randomData(8000, i)) == 0);
+        }
+        remount();
+        for (size_t i = offs; i < exflash_size(); ++i) {
+            if (exflash_data()[i] != 0x5a) {
+                FAIL("Flash modified at offset " << i);
+            }
+        }
+    }
+}
+
+TEST_CASE("Filesystem image") {
+    Filesystem f;
+    const auto data = randomData(5000, 3);
+    REQUIRE(writeFile("/file", data) == 0);
+    REQUIRE(filesystem_unmount(fs()) == 0);
+    char name[] = "/tmp/filesystem_test_XXXXXX";
+    const int fd = mkstemp(name);
+    REQUIRE(fd >= 0);
+    close(fd);
+    REQUIRE(exflash_save(name) == 0);
+    exflash_clear();
+    REQUIRE(exflash_load(name) == 0);
+    remove(name);
+    REQUIRE(filesystem_mount(fs()) == 0);
+    REQUIRE(readFile("/file") == data);
+}
+
+TEST_CASE("Interrupted writes") {
+    Filesystem f;
+    const auto data = randomData(3000, 4);
+    REQUIRE(writeFile("/file", data) == 0);
+    // Interrupt the update of the file at different points
+    for (int ops = 0; ops < 20; ++ops) {
+        exflash_fail_after(ops);
+        const auto newData = randomData(3000, 5 + ops);
+        const bool ok = writeFile("/file", newData) == 0;
+        exflash_fail_after(-1);
+        remount();
+        const auto d = readFile("/file");
+        if (ok) {
+            REQUIRE(d == newData);
+            REQUIRE(writeFile("/file", data) == 0);
+        } else {
+            REQUIRE((d == data || d == newData));
+        }
+    }
+}
+
+TEST_CASE("filesystem_get_cache_stats()") {
+    Filesystem f;
+    filesystem_cache_stats stats = {};
+    REQUIRE(filesystem_get_cache_stats(fs(), &stats) == 0);
+    const auto reads = stats.flash_reads;
+    const auto data = randomData(20000, 6);
+    REQUIRE(writeFile("/file", data) == 0);
+    REQUIRE(readFile("/file") == data);
+    REQUIRE(readFile("/file") == data);
+    REQUIRE(filesystem_get_cache_stats(fs(), &stats) == 0);
+    REQUIRE(stats.flash_reads > reads);
+    REQUIRE(stats.hits > 0);
+    REQUIRE(filesystem_get_cache_stats(nullptr, &stats) != 0);
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for littlefs, used by the host tests when the littlefs submodule is not checked
+ * out (see ../littlefs.mk). It implements the subset of the littlefs v1 API that is used by the
+ * firmware, with the same error codes and the same visibility rules for open files: the data
+ * written to a file becomes visible to other handles once the file is synced, and a handle
+ * doesn't see the changes that were made after it was opened.
+ *
+ * The filesystem is stored on the block device provided via lfs_config, as a journal of file
+ * operations, see lfs_host.cpp. It is not meant to be efficient or to match the on-disk format
+ * of littlefs.
+ */
+
+#ifndef LFS_H
+#define LFS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LFS_VERSION 0x00010007
+#define LFS_DISK_VERSION 0x00010001
+
+typedef uint32_t lfs_size_t;
+typedef uint32_t lfs_off_t;
+
+typedef int32_t lfs_ssize_t;
+typedef int32_t lfs_soff_t;
+
+typedef uint32_t lfs_block_t;
+
+#ifndef LFS_NAME_MAX
+#define LFS_NAME_MAX 255
+#endif
+
+enum lfs_error {
+    LFS_ERR_OK = 0,
+    LFS_ERR_IO = -5,
+    LFS_ERR_CORRUPT = -52,
+    LFS_ERR_NOENT = -2,
+    LFS_ERR_EXIST = -17,
+    LFS_ERR_NOTDIR = -20,
+    LFS_ERR_ISDIR = -21,
+    LFS_ERR_NOTEMPTY = -39,
+    LFS_ERR_BADF = -9,
+    LFS_ERR_INVAL = -22,
+    LFS_ERR_NOSPC = -28,
+    LFS_ERR_NOMEM = -12,
+    LFS_ERR_NAMETOOLONG = -36
+};
+
+enum lfs_type {
+    LFS_TYPE_REG = 0x11,
+    LFS_TYPE_DIR = 0x22,
+    LFS_TYPE_SUPERBLOCK = 0x2e
+};
+
+enum lfs_open_flags {
+    LFS_O_RDONLY = 1,
+    LFS_O_WRONLY = 2,
+    LFS_O_RDWR = 3,
+    LFS_O_CREAT = 0x0100,
+    LFS_O_EXCL = 0x0200,
+    LFS_O_TRUNC = 0x0400,
+    LFS_O_APPEND = 0x0800
+};
+
+enum lfs_whence_flags {
+    LFS_SEEK_SET = 0,
+    LFS_SEEK_CUR = 1,
+    LFS_SEEK_END = 2
+};
+
+struct lfs_config {
+    void* context;
+    int (*read)(const struct lfs_config* c, lfs_block_t block, lfs_off_t off, void* buffer, lfs_size_t size);
+    int (*prog)(const struct lfs_config* c, lfs_block_t block, lfs_off_t off, const void* buffer, lfs_size_t size);
+    int (*erase)(const struct lfs_config* c, lfs_block_t block);
+    int (*sync)(const struct lfs_config* c);
+    lfs_size_t read_size;
+    lfs_size_t prog_size;
+    lfs_size_t block_size;
+    lfs_size_t block_count;
+    lfs_size_t lookahead;
+    void* read_buffer;
+    void* prog_buffer;
+    void* lookahead_buffer;
+    void* file_buffer;
+};
+
+struct lfs_info {
+    uint8_t type;
+    lfs_size_t size;
+    char name[LFS_NAME_MAX + 1];
+};
+
+typedef struct lfs_file {
+    void* impl;
+} lfs_file_t;
+
+typedef struct lfs_dir {
+    void* impl;
+} lfs_dir_t;
+
+typedef struct lfs {
+    const struct lfs_config* cfg;
+    void* impl;
+} lfs_t;
+
+int lfs_format(lfs_t* lfs, const struct lfs_config* config);
+int lfs_mount(lfs_t* lfs, const struct lfs_config* config);
+int lfs_unmount(lfs_t* lfs);
+
+int lfs_remove(lfs_t* lfs, const char* path);
+int lfs_rename(lfs_t* lfs, const char* oldpath, const char* newpath);
+int lfs_stat(lfs_t* lfs, const char* path, struct lfs_info* info);
+
+int lfs_file_open(lfs_t* lfs, lfs_file_t* file, const char* path, int flags);
+int lfs_file_close(lfs_t* lfs, lfs_file_t* file);
+int lfs_file_sync(lfs_t* lfs, lfs_file_t* file);
+lfs_ssize_t lfs_file_read(lfs_t* lfs, lfs_file_t* file, void* buffer, lfs_size_t size);
+lfs_ssize_t lfs_file_write(lfs_t* lfs, lfs_file_t* file, const void* buffer, lfs_size_t size);
+lfs_soff_t lfs_file_seek(lfs_t* lfs, lfs_file_t* file, lfs_soff_t off, int whence);
+int lfs_file_truncate(lfs_t* lfs, lfs_file_t* file, lfs_off_t size);
+lfs_soff_t lfs_file_tell(lfs_t* lfs, lfs_file_t* file);
+int lfs_file_rewind(lfs_t* lfs, lfs_file_t* file);
+lfs_soff_t lfs_file_size(lfs_t* lfs, lfs_file_t* file);
+
+int lfs_mkdir(lfs_t* lfs, const char* path);
+int lfs_dir_open(lfs_t* lfs, lfs_dir_t* dir, const char* path);
+int lfs_dir_close(lfs_t* lfs, lfs_dir_t* dir);
+int lfs_dir_read(lfs_t* lfs, lfs_dir_t* dir, struct lfs_info* info);
+int lfs_dir_rewind(lfs_t* lfs, lfs_dir_t* dir);
+
+int lfs_traverse(lfs_t* lfs, int (*cb)(void*, lfs_block_t), void* data);
+int lfs_deorphan(lfs_t* lfs);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LFS_H */
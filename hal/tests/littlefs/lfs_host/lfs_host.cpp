@@ -0,0 +1,1015 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The block device is split into two areas. The active area starts with a superblock record
+ * followed by a journal of records that create, write, truncate, rename and remove files and
+ * directories. Each record is protected by a CRC, so a record that was interrupted by a reset is
+ * detected when the filesystem is mounted and the journal is replayed.
+ *
+ * When the active area is full, the current state of the filesystem is written to the other area
+ * and its superblock, which has a higher sequence number, is written last. A reset during this
+ * leaves the previous area in use.
+ *
+ * The contents of the files are read from the block device. The data written to an open file is
+ * kept in RAM until the file is synced.
+ */
+
+#include "lfs.h"
+#include "lfs_util.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include <cstring>
+
+namespace {
+
+enum RecordType {
+    SUPERBLOCK = 1,
+    MKDIR = 2,
+    CREATE = 3,
+    REMOVE = 4,
+    WRITE = 5,
+    TRUNCATE = 6,
+    RENAME = 7
+};
+
+struct __attribute__((packed)) RecordHeader {
+    uint32_t size; // Size of the record, including the header and the CRC
+    uint16_t type;
+    uint16_t pathSize;
+    uint32_t arg; // File offset for WRITE, file size for TRUNCATE, sequence number for SUPERBLOCK
+};
+
+// A record consists of the header, the path, the data and the CRC of the preceding bytes. The path
+// of RENAME contains the old and new paths separated by a null character
+const uint32_t CRC_SIZE = 4;
+const uint32_t ERASED = 0xffffffff;
+const char SUPERBLOCK_MAGIC[] = "littlefs-host";
+const uint32_t SUPERBLOCK_SIZE = sizeof(RecordHeader) + sizeof(SUPERBLOCK_MAGIC) - 1 + CRC_SIZE;
+
+// Maximum size of the data of a WRITE record written during compaction
+const uint32_t MAX_WRITE_SIZE = 4096;
+
+// Contiguous fragment of file data stored either on the block device or in RAM
+struct Piece {
+    uint32_t offs; // File offset
+    uint32_t size;
+    uint32_t addr; // Address of the data on the block device
+    std::shared_ptr<const std::vector<uint8_t>> ram; // Data in RAM
+    uint32_t ramOffs;
+};
+
+// Non-overlapping pieces sorted by offset. The gaps are read as zeros
+typedef std::vector<Piece> Pieces;
+
+struct Node {
+    bool dir;
+    uint32_t size;
+    Pieces pieces;
+    uint32_t version; // Incremented every time the file is changed
+};
+
+struct File;
+
+struct Volume {
+    const lfs_config* cfg;
+    std::map<std::string, Node> nodes; // The root directory has an empty path
+    std::set<File*> files;
+    uint32_t area; // Active area
+    uint32_t seq; // Sequence number of the active area
+    uint32_t head; // Offset of the next record in the active area
+    uint32_t erasedEnd; // The active area is known to be erased from this offset
+    uint32_t nextVersion;
+    bool compact; // The journal ends with a damaged record and needs to be compacted
+};
+
+struct File {
+    std::string path;
+    int flags;
+    uint32_t pos;
+    uint32_t size;
+    Pieces pieces;
+    uint32_t version; // Version of the node that this handle is based on
+    bool dirty;
+};
+
+struct Dir {
+    std::vector<lfs_info> entries;
+    size_t index;
+};
+
+Volume* volume(lfs_t* lfs) {
+    return (Volume*)lfs->impl;
+}
+
+File* fileImpl(lfs_file_t* file) {
+    return (File*)file->impl;
+}
+
+uint32_t areaSize(const Volume* v) {
+    return v->cfg->block_count / 2 * v->cfg->block_size;
+}
+
+uint32_t areaAddress(const Volume* v, uint32_t area) {
+    return area * areaSize(v);
+}
+
+uint32_t alignUp(uint32_t val, uint32_t align) {
+    return (val + align - 1) / align * align;
+}
+
+uint32_t crc(const uint8_t* data, size_t size) {
+    uint32_t c = 0xffffffff;
+    lfs_crc(&c, data, size);
+    return c;
+}
+
+int result(int r) {
+    return (r > 0) ? LFS_ERR_IO : r;
+}
+
+int flashRead(const Volume* v, uint32_t addr, void* data, uint32_t size) {
+    const auto c = v->cfg;
+    uint8_t* d = (uint8_t*)data;
+    while (size > 0) {
+        const uint32_t offs = addr % c->block_size;
+        const uint32_t n = std::min(size, c->block_size - offs);
+        const int r = c->read(c, addr / c->block_size, offs, d, n);
+        if (r != 0) {
+            return result(r);
+        }
+        addr += n;
+        d += n;
+        size -= n;
+    }
+    return 0;
+}
+
+int flashProg(const Volume* v, uint32_t addr, const void* data, uint32_t size) {
+    const auto c = v->cfg;
+    const uint8_t* d = (const uint8_t*)data;
+    while (size > 0) {
+        const uint32_t offs = addr % c->block_size;
+        const uint32_t n = std::min(size, c->block_size - offs);
+        const int r = c->prog(c, addr / c->block_size, offs, d, n);
+        if (r != 0) {
+            return result(r);
+        }
+        addr += n;
+        d += n;
+        size -= n;
+    }
+    return 0;
+}
+
+// Writes to an area, erasing the blocks starting from the specified offset as needed
+int areaWrite(const Volume* v, uint32_t area, uint32_t* erasedEnd, uint32_t offs, const void* data, uint32_t size) {
+    const auto c = v->cfg;
+    while (*erasedEnd < offs + size) {
+        const int r = c->erase(c, (areaAddress(v, area) + *erasedEnd) / c->block_size);
+        if (r != 0) {
+            return result(r);
+        }
+        *erasedEnd += c->block_size;
+    }
+    return flashProg(v, areaAddress(v, area) + offs, data, size);
+}
+
+void advancePiece(Piece* p, uint32_t n) {
+    p->offs += n;
+    p->size -= n;
+    if (p->ram) {
+        p->ramOffs += n;
+    } else {
+        p->addr += n;
+    }
+}
+
+void putPiece(Pieces* pieces, const Piece& piece) {
+    Pieces out;
+    const uint32_t end = piece.offs + piece.size;
+    for (const Piece& p: *pieces) {
+        if (p.offs + p.size <= piece.offs || p.offs >= end) {
+            out.push_back(p);
+            continue;
+        }
+        if (p.offs < piece.offs) {
+            Piece left = p;
+            left.size = piece.offs - p.offs;
+            out.push_back(left);
+        }
+        if (p.offs + p.size > end) {
+            Piece right = p;
+            advancePiece(&right, end - p.offs);
+            out.push_back(right);
+        }
+    }
+    out.push_back(piece);
+    std::sort(out.begin(), out.end(), [](const Piece& a, const Piece& b) {
+        return a.offs < b.offs;
+    });
+    pieces->swap(out);
+}
+
+void truncatePieces(Pieces* pieces, uint32_t size) {
+    Pieces out;
+    for (const Piece& p: *pieces) {
+        if (p.offs >= size) {
+            continue;
+        }
+        Piece q = p;
+        q.size = std::min(p.size, size - p.offs);
+        out.push_back(q);
+    }
+    pieces->swap(out);
+}
+
+int readPieces(const Volume* v, const Pieces& pieces, uint32_t offs, uint8_t* data, uint32_t size) {
+    memset(data, 0, size);
+    const uint32_t end = offs + size;
+    for (const Piece& p: pieces) {
+        const uint32_t begin = std::max(offs, p.offs);
+        const uint32_t finish = std::min(end, p.offs + p.size);
+        if (begin >= finish) {
+            continue;
+        }
+        if (p.ram) {
+            memcpy(data + begin - offs, p.ram->data() + p.ramOffs + begin - p.offs, finish - begin);
+        } else {
+            const int r = flashRead(v, p.addr + begin - p.offs, data + begin - offs, finish - begin);
+            if (r < 0) {
+                return r;
+            }
+        }
+    }
+    return 0;
+}
+
+// Loads the data stored on the block device into RAM
+int detachPieces(const Volume* v, Pieces* pieces) {
+    for (Piece& p: *pieces) {
+        if (p.ram) {
+            continue;
+        }
+        std::shared_ptr<std::vector<uint8_t>> data(new std::vector<uint8_t>(p.size));
+        const int r = flashRead(v, p.addr, data->data(), p.size);
+        if (r < 0) {
+            return r;
+        }
+        p.ram = data;
+        p.ramOffs = 0;
+    }
+    return 0;
+}
+
+int normalizePath(const char* path, std::string* out) {
+    std::vector<std::string> names;
+    const char* p = path;
+    while (*p) {
+        const char* end = strchr(p, '/');
+        if (!end) {
+            end = p + strlen(p);
+        }
+        const std::string name(p, end - p);
+        if (name == "..") {
+            if (!names.empty()) {
+                names.pop_back();
+            }
+        } else if (!name.empty() && name != ".") {
+            if (name.size() > LFS_NAME_MAX) {
+                return LFS_ERR_NAMETOOLONG;
+            }
+            names.push_back(name);
+        }
+        p = *end ? end + 1 : end;
+    }
+    out->clear();
+    for (const auto& name: names) {
+        if (!out->empty()) {
+            *out += '/';
+        }
+        *out += name;
+    }
+    return 0;
+}
+
+std::string parentPath(const std::string& path) {
+    const auto i = path.rfind('/');
+    return (i == std::string::npos) ? std::string() : path.substr(0, i);
+}
+
+std::string baseName(const std::string& path) {
+    const auto i = path.rfind('/');
+    return (i == std::string::npos) ? path : path.substr(i + 1);
+}
+
+bool isChild(const std::string& path, const std::string& dir) {
+    if (dir.empty()) {
+        return !path.empty();
+    }
+    return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/';
+}
+
+bool hasChildren(const Volume* v, const std::string& dir) {
+    for (const auto& node: v->nodes) {
+        if (isChild(node.first, dir)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Applies a record to the in-memory state. `dataAddr` is the address of the record data
+void applyRecord(Volume* v, uint16_t type, const std::string& path, uint32_t arg, uint32_t dataAddr, uint32_t dataSize) {
+    switch (type) {
+    case MKDIR: {
+        v->nodes[path] = Node{ true, 0, Pieces(), v->nextVersion++ };
+        break;
+    }
+    case CREATE: {
+        v->nodes[path] = Node{ false, 0, Pieces(), v->nextVersion++ };
+        break;
+    }
+    case REMOVE: {
+        v->nodes.erase(path);
+        break;
+    }
+    case WRITE: {
+        Node& node = v->nodes[path];
+        if (dataSize > 0) {
+            putPiece(&node.pieces, Piece{ arg, dataSize, dataAddr, nullptr, 0 });
+        }
+        node.size = std::max(node.size, arg + dataSize);
+        node.version = v->nextVersion++;
+        break;
+    }
+    case TRUNCATE: {
+        Node& node = v->nodes[path];
+        truncatePieces(&node.pieces, arg);
+        node.size = arg;
+        node.version = v->nextVersion++;
+        break;
+    }
+    case RENAME: {
+        const auto i = path.find('\0');
+        const std::string oldPath = path.substr(0, i);
+        const std::string newPath = path.substr(i + 1);
+        std::map<std::string, Node> moved;
+        for (auto it = v->nodes.begin(); it != v->nodes.end();) {
+            if (it->first == oldPath || isChild(it->first, oldPath)) {
+                moved[newPath + it->first.substr(oldPath.size())] = it->second;
+                it = v->nodes.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        v->nodes.erase(newPath);
+        for (auto& node: moved) {
+            v->nodes[node.first] = node.second;
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+std::vector<uint8_t> makeRecord(uint16_t type, const std::string& path, uint32_t arg, const void* data, uint32_t dataSize) {
+    RecordHeader h = {};
+    h.size = sizeof(h) + path.size() + dataSize + CRC_SIZE;
+    h.type = type;
+    h.pathSize = path.size();
+    h.arg = arg;
+    std::vector<uint8_t> rec(h.size);
+    memcpy(rec.data(), &h, sizeof(h));
+    memcpy(rec.data() + sizeof(h), path.data(), path.size());
+    if (dataSize > 0) {
+        memcpy(rec.data() + sizeof(h) + path.size(), data, dataSize);
+    }
+    const uint32_t c = crc(rec.data(), rec.size() - CRC_SIZE);
+    memcpy(rec.data() + rec.size() - CRC_SIZE, &c, CRC_SIZE);
+    return rec;
+}
+
+// Writes the current state of the filesystem to the inactive area and makes it the active one.
+// `reserve` is the number of bytes that need to be available in the new area
+int compact(Volume* v, uint32_t reserve) {
+    // The data of the open files may be stored in the area that is going to be reused
+    for (File* f: v->files) {
+        const int r = detachPieces(v, &f->pieces);
+        if (r < 0) {
+            return r;
+        }
+    }
+    const uint32_t area = v->area ^ 1;
+    uint32_t erasedEnd = 0;
+    uint32_t offs = SUPERBLOCK_SIZE;
+    std::map<std::string, Node> nodes;
+    auto write = [&](uint16_t type, const std::string& path, uint32_t arg, const void* data, uint32_t size, uint32_t* dataAddr) {
+        const auto rec = makeRecord(type, path, arg, data, size);
+        if (offs + rec.size() > areaSize(v)) {
+            return (int)LFS_ERR_NOSPC;
+        }
+        const int r = areaWrite(v, area, &erasedEnd, offs, rec.data(), rec.size());
+        if (r < 0) {
+            return r;
+        }
+        if (dataAddr) {
+            *dataAddr = areaAddress(v, area) + offs + sizeof(RecordHeader) + path.size();
+        }
+        offs += rec.size();
+        return 0;
+    };
+    // Parent directories precede their children in the map
+    for (const auto& it: v->nodes) {
+        const std::string& path = it.first;
+        const Node& node = it.second;
+        if (path.empty()) {
+            nodes[path] = node;
+            continue;
+        }
+        Node n = { node.dir, node.size, Pieces(), node.version };
+        int r = write(node.dir ? MKDIR : CREATE, path, 0, nullptr, 0, nullptr);
+        if (r < 0) {
+            return r;
+        }
+        std::vector<uint8_t> buf;
+        for (uint32_t pos = 0; pos < node.size; pos += MAX_WRITE_SIZE) {
+            const uint32_t size = std::min(MAX_WRITE_SIZE, node.size - pos);
+            buf.resize(size);
+            r = readPieces(v, node.pieces, pos, buf.data(), size);
+            if (r < 0) {
+                return r;
+            }
+            uint32_t addr = 0;
+            r = write(WRITE, path, pos, buf.data(), size, &addr);
+            if (r < 0) {
+                return r;
+            }
+            n.pieces.push_back(Piece{ pos, size, addr, nullptr, 0 });
+        }
+        nodes[path] = n;
+    }
+    if (offs + reserve > areaSize(v)) {
+        return LFS_ERR_NOSPC;
+    }
+    // Make sure the area is erased up to the end of the last record before writing the superblock
+    const auto sb = makeRecord(SUPERBLOCK, SUPERBLOCK_MAGIC, v->seq + 1, nullptr, 0);
+    int r = areaWrite(v, area, &erasedEnd, 0, sb.data(), sb.size());
+    if (r < 0) {
+        return r;
+    }
+    v->nodes.swap(nodes);
+    v->area = area;
+    v->seq += 1;
+    v->head = offs;
+    v->erasedEnd = erasedEnd;
+    v->compact = false;
+    return 0;
+}
+
+// Appends a record to the journal and applies it to the in-memory state
+int commit(Volume* v, uint16_t type, const std::string& path, uint32_t arg, const void* data, uint32_t dataSize) {
+    const auto rec = makeRecord(type, path, arg, data, dataSize);
+    if (v->compact || v->head + rec.size() > areaSize(v)) {
+        const int r = compact(v, rec.size());
+        if (r < 0) {
+            return r;
+        }
+    }
+    const int r = areaWrite(v, v->area, &v->erasedEnd, v->head, rec.data(), rec.size());
+    if (r < 0) {
+        // The record may have been written partially
+        v->compact = true;
+        return r;
+    }
+    const uint32_t dataAddr = areaAddress(v, v->area) + v->head + sizeof(RecordHeader) + path.size();
+    v->head += rec.size();
+    applyRecord(v, type, path, arg, dataAddr, dataSize);
+    return 0;
+}
+
+// Returns the sequence number of an area or 0 if the area doesn't contain a valid superblock
+uint32_t readSuperblock(const Volume* v, uint32_t area) {
+    uint8_t buf[SUPERBLOCK_SIZE] = {};
+    if (flashRead(v, areaAddress(v, area), buf, sizeof(buf)) < 0) {
+        return 0;
+    }
+    RecordHeader h = {};
+    memcpy(&h, buf, sizeof(h));
+    uint32_t c = 0;
+    memcpy(&c, buf + sizeof(buf) - CRC_SIZE, CRC_SIZE);
+    if (h.size != SUPERBLOCK_SIZE || h.type != SUPERBLOCK || h.pathSize != sizeof(SUPERBLOCK_MAGIC) - 1 ||
+            memcmp(buf + sizeof(h), SUPERBLOCK_MAGIC, h.pathSize) != 0 || c != crc(buf, sizeof(buf) - CRC_SIZE)) {
+        return 0;
+    }
+    return h.arg;
+}
+
+int replay(Volume* v) {
+    uint32_t offs = SUPERBLOCK_SIZE;
+    std::vector<uint8_t> rec;
+    for (;;) {
+        RecordHeader h = {};
+        if (offs + sizeof(h) > areaSize(v)) {
+            break;
+        }
+        int r = flashRead(v, areaAddress(v, v->area) + offs, &h, sizeof(h));
+        if (r < 0) {
+            return r;
+        }
+        if (h.size == ERASED) {
+            break;
+        }
+        if (h.size < sizeof(h) + h.pathSize + CRC_SIZE || offs + h.size > areaSize(v)) {
+            v->compact = true;
+            break;
+        }
+        rec.resize(h.size);
+        r = flashRead(v, areaAddress(v, v->area) + offs, rec.data(), rec.size());
+        if (r < 0) {
+            return r;
+        }
+        uint32_t c = 0;
+        memcpy(&c, rec.data() + rec.size() - CRC_SIZE, CRC_SIZE);
+        if (c != crc(rec.data(), rec.size() - CRC_SIZE)) {
+            v->compact = true;
+            break;
+        }
+        const std::string path((const char*)rec.data() + sizeof(h), h.pathSize);
+        const uint32_t dataAddr = areaAddress(v, v->area) + offs + sizeof(h) + h.pathSize;
+        applyRecord(v, h.type, path, h.arg, dataAddr, h.size - sizeof(h) - h.pathSize - CRC_SIZE);
+        offs += h.size;
+    }
+    v->head = offs;
+    v->erasedEnd = alignUp(offs, v->cfg->block_size);
+    return 0;
+}
+
+Node* findNode(Volume* v, const std::string& path) {
+    const auto it = v->nodes.find(path);
+    return (it != v->nodes.end()) ? &it->second : nullptr;
+}
+
+// Checks that the parent directory of a new entry exists
+int checkParent(Volume* v, const std::string& path) {
+    const Node* parent = findNode(v, parentPath(path));
+    if (!parent) {
+        return LFS_ERR_NOENT;
+    }
+    if (!parent->dir) {
+        return LFS_ERR_NOTDIR;
+    }
+    return 0;
+}
+
+} // namespace
+
+extern "C" {
+
+int lfs_format(lfs_t* lfs, const struct lfs_config* config) {
+    if (config->block_count < 2) {
+        return LFS_ERR_INVAL;
+    }
+    Volume v = {};
+    v.cfg = config;
+    v.area = 1;
+    v.nodes[""] = Node{ true, 0, Pieces(), 0 };
+    // Invalidate the superblock of the second area, then write an empty filesystem to the first one
+    int r = config->erase(config, areaAddress(&v, 1) / config->block_size);
+    if (r != 0) {
+        return result(r);
+    }
+    return compact(&v, 0);
+}
+
+int lfs_mount(lfs_t* lfs, const struct lfs_config* config) {
+    if (config->block_count < 2) {
+        return LFS_ERR_INVAL;
+    }
+    std::unique_ptr<Volume> v(new Volume());
+    v->cfg = config;
+    const uint32_t seq0 = readSuperblock(v.get(), 0);
+    const uint32_t seq1 = readSuperblock(v.get(), 1);
+    if (!seq0 && !seq1) {
+        return LFS_ERR_CORRUPT;
+    }
+    if (seq0 && (!seq1 || lfs_scmp(seq0, seq1) > 0)) {
+        v->area = 0;
+        v->seq = seq0;
+    } else {
+        v->area = 1;
+        v->seq = seq1;
+    }
+    v->nodes[""] = Node{ true, 0, Pieces(), 0 };
+    v->nextVersion = 1;
+    const int r = replay(v.get());
+    if (r < 0) {
+        return r;
+    }
+    lfs->cfg = config;
+    lfs->impl = v.release();
+    return 0;
+}
+
+int lfs_unmount(lfs_t* lfs) {
+    Volume* v = volume(lfs);
+    if (v) {
+        for (File* f: v->files) {
+            delete f;
+        }
+        delete v;
+        lfs->impl = nullptr;
+    }
+    return 0;
+}
+
+int lfs_remove(lfs_t* lfs, const char* path) {
+    Volume* v = volume(lfs);
+    std::string p;
+    int r = normalizePath(path, &p);
+    if (r < 0) {
+        return r;
+    }
+    const Node* node = findNode(v, p);
+    if (!node) {
+        return LFS_ERR_NOENT;
+    }
+    if (p.empty()) {
+        return LFS_ERR_INVAL;
+    }
+    if (node->dir && hasChildren(v, p)) {
+        return LFS_ERR_NOTEMPTY;
+    }
+    return commit(v, REMOVE, p, 0, nullptr, 0);
+}
+
+int lfs_rename(lfs_t* lfs, const char* oldpath, const char* newpath) {
+    Volume* v = volume(lfs);
+    std::string oldp, newp;
+    int r = normalizePath(oldpath, &oldp);
+    if (r < 0) {
+        return r;
+    }
+    r = normalizePath(newpath, &newp);
+    if (r < 0) {
+        return r;
+    }
+    const Node* node = findNode(v, oldp);
+    if (!node) {
+        return LFS_ERR_NOENT;
+    }
+    if (oldp.empty() || newp.empty() || isChild(newp, oldp)) {
+        return LFS_ERR_INVAL;
+    }
+    if (oldp == newp) {
+        return 0;
+    }
+    r = checkParent(v, newp);
+    if (r < 0) {
+        return r;
+    }
+    const Node* existing = findNode(v, newp);
+    if (existing) {
+        if (existing->dir != node->dir) {
+            return existing->dir ? LFS_ERR_ISDIR : LFS_ERR_NOTDIR;
+        }
+        if (existing->dir && hasChildren(v, newp)) {
+            return LFS_ERR_NOTEMPTY;
+        }
+    }
+    return commit(v, RENAME, oldp + '\0' + newp, 0, nullptr, 0);
+}
+
+int lfs_stat(lfs_t* lfs, const char* path, struct lfs_info* info) {
+    Volume* v = volume(lfs);
+    std::string p;
+    const int r = normalizePath(path, &p);
+    if (r < 0) {
+        return r;
+    }
+    const Node* node = findNode(v, p);
+    if (!node) {
+        return LFS_ERR_NOENT;
+    }
+    memset(info, 0, sizeof(*info));
+    info->type = node->dir ? LFS_TYPE_DIR : LFS_TYPE_REG;
+    info->size = node->dir ? 0 : node->size;
+    strcpy(info->name, p.empty() ? "/" : baseName(p).c_str());
+    return 0;
+}
+
+int lfs_file_open(lfs_t* lfs, lfs_file_t* file, const char* path, int flags) {
+    Volume* v = volume(lfs);
+    std::string p;
+    int r = normalizePath(path, &p);
+    if (r < 0) {
+        return r;
+    }
+    Node* node = findNode(v, p);
+    if (node) {
+        if (node->dir) {
+            return LFS_ERR_ISDIR;
+        }
+        if ((flags & LFS_O_CREAT) && (flags & LFS_O_EXCL)) {
+            return LFS_ERR_EXIST;
+        }
+    } else {
+        if (!(flags & LFS_O_CREAT)) {
+            return LFS_ERR_NOENT;
+        }
+        r = checkParent(v, p);
+        if (r < 0) {
+            return r;
+        }
+        r = commit(v, CREATE, p, 0, nullptr, 0);
+        if (r < 0) {
+            return r;
+        }
+        node = findNode(v, p);
+    }
+    File* f = new File();
+    f->path = p;
+    f->flags = flags;
+    f->pos = 0;
+    f->size = node->size;
+    f->pieces = node->pieces;
+    f->version = node->version;
+    f->dirty = false;
+    if (flags & LFS_O_TRUNC) {
+        f->size = 0;
+        f->pieces.clear();
+        f->dirty = true;
+    }
+    v->files.insert(f);
+    file->impl = f;
+    return 0;
+}
+
+int lfs_file_sync(lfs_t* lfs, lfs_file_t* file) {
+    Volume* v = volume(lfs);
+    File* f = fileImpl(file);
+    if (!f->dirty) {
+        return 0;
+    }
+    Node* node = findNode(v, f->path);
+    if (!node) {
+        // The file was removed while it was open
+        int r = checkParent(v, f->path);
+        if (r == 0) {
+            r = commit(v, CREATE, f->path, 0, nullptr, 0);
+        }
+        if (r < 0) {
+            return r;
+        }
+        node = findNode(v, f->path);
+    }
+    // Rewrite the whole file if it was changed via another handle since this one was opened
+    Pieces pieces;
+    if (node->version != f->version) {
+        pieces = f->pieces;
+        int r = commit(v, TRUNCATE, f->path, 0, nullptr, 0);
+        if (r < 0) {
+            return r;
+        }
+        std::vector<uint8_t> data(f->size);
+        r = readPieces(v, f->pieces, 0, data.data(), data.size());
+        if (r == 0 && f->size > 0) {
+            r = commit(v, WRITE, f->path, 0, data.data(), data.size());
+        }
+        if (r < 0) {
+            return r;
+        }
+    } else {
+        if (node->size != f->size) {
+            const int r = commit(v, TRUNCATE, f->path, f->size, nullptr, 0);
+            if (r < 0) {
+                return r;
+            }
+        }
+        // Write the data that is stored in RAM, merging adjacent pieces
+        const Pieces& src = f->pieces;
+        for (size_t i = 0; i < src.size();) {
+            if (!src[i].ram) {
+                ++i;
+                continue;
+            }
+            std::vector<uint8_t> data;
+            const uint32_t offs = src[i].offs;
+            while (i < src.size() && src[i].ram && src[i].offs == offs + data.size()) {
+                const Piece& p = src[i++];
+                data.insert(data.end(), p.ram->data() + p.ramOffs, p.ram->data() + p.ramOffs + p.size);
+            }
+            const int r = commit(v, WRITE, f->path, offs, data.data(), data.size());
+            if (r < 0) {
+                return r;
+            }
+        }
+    }
+    node = findNode(v, f->path);
+    f->pieces = node->pieces;
+    f->size = node->size;
+    f->version = node->version;
+    f->dirty = false;
+    return 0;
+}
+
+int lfs_file_close(lfs_t* lfs, lfs_file_t* file) {
+    Volume* v = volume(lfs);
+    File* f = fileImpl(file);
+    if (!f) {
+        return LFS_ERR_BADF;
+    }
+    const int r = lfs_file_sync(lfs, file);
+    v->files.erase(f);
+    delete f;
+    file->impl = nullptr;
+    return r;
+}
+
+lfs_ssize_t lfs_file_read(lfs_t* lfs, lfs_file_t* file, void* buffer, lfs_size_t size) {
+    Volume* v = volume(lfs);
+    File* f = fileImpl(file);
+    if ((f->flags & LFS_O_RDWR) == LFS_O_WRONLY) {
+        return LFS_ERR_BADF;
+    }
+    if (f->pos >= f->size) {
+        return 0;
+    }
+    size = std::min(size, f->size - f->pos);
+    const int r = readPieces(v, f->pieces, f->pos, (uint8_t*)buffer, size);
+    if (r < 0) {
+        return r;
+    }
+    f->pos += size;
+    return size;
+}
+
+lfs_ssize_t lfs_file_write(lfs_t* lfs, lfs_file_t* file, const void* buffer, lfs_size_t size) {
+    File* f = fileImpl(file);
+    if ((f->flags & LFS_O_RDWR) == LFS_O_RDONLY) {
+        return LFS_ERR_BADF;
+    }
+    if (f->flags & LFS_O_APPEND) {
+        f->pos = f->size;
+    }
+    if (size == 0) {
+        return 0;
+    }
+    std::shared_ptr<std::vector<uint8_t>> data(new std::vector<uint8_t>((const uint8_t*)buffer,
+            (const uint8_t*)buffer + size));
+    putPiece(&f->pieces, Piece{ f->pos, size, 0, data, 0 });
+    f->pos += size;
+    f->size = std::max(f->size, f->pos);
+    f->dirty = true;
+    return size;
+}
+
+lfs_soff_t lfs_file_seek(lfs_t* lfs, lfs_file_t* file, lfs_soff_t off, int whence) {
+    File* f = fileImpl(file);
+    int64_t pos = off;
+    if (whence == LFS_SEEK_CUR) {
+        pos += f->pos;
+    } else if (whence == LFS_SEEK_END) {
+        pos += f->size;
+    }
+    if (pos < 0) {
+        return LFS_ERR_INVAL;
+    }
+    f->pos = pos;
+    return pos;
+}
+
+int lfs_file_truncate(lfs_t* lfs, lfs_file_t* file, lfs_off_t size) {
+    File* f = fileImpl(file);
+    if ((f->flags & LFS_O_RDWR) == LFS_O_RDONLY) {
+        return LFS_ERR_BADF;
+    }
+    truncatePieces(&f->pieces, size);
+    f->size = size;
+    f->dirty = true;
+    return 0;
+}
+
+lfs_soff_t lfs_file_tell(lfs_t* lfs, lfs_file_t* file) {
+    return fileImpl(file)->pos;
+}
+
+int lfs_file_rewind(lfs_t* lfs, lfs_file_t* file) {
+    const lfs_soff_t r = lfs_file_seek(lfs, file, 0, LFS_SEEK_SET);
+    return (r < 0) ? r : 0;
+}
+
+lfs_soff_t lfs_file_size(lfs_t* lfs, lfs_file_t* file) {
+    return fileImpl(file)->size;
+}
+
+int lfs_mkdir(lfs_t* lfs, const char* path) {
+    Volume* v = volume(lfs);
+    std::string p;
+    int r = normalizePath(path, &p);
+    if (r < 0) {
+        return r;
+    }
+    if (findNode(v, p)) {
+        return LFS_ERR_EXIST;
+    }
+    r = checkParent(v, p);
+    if (r < 0) {
+        return r;
+    }
+    return commit(v, MKDIR, p, 0, nullptr, 0);
+}
+
+int lfs_dir_open(lfs_t* lfs, lfs_dir_t* dir, const char* path) {
+    Volume* v = volume(lfs);
+    std::string p;
+    const int r = normalizePath(path, &p);
+    if (r < 0) {
+        return r;
+    }
+    const Node* node = findNode(v, p);
+    if (!node) {
+        return LFS_ERR_NOENT;
+    }
+    if (!node->dir) {
+        return LFS_ERR_NOTDIR;
+    }
+    Dir* d = new Dir();
+    lfs_info info = {};
+    info.type = LFS_TYPE_DIR;
+    strcpy(info.name, ".");
+    d->entries.push_back(info);
+    strcpy(info.name, "..");
+    d->entries.push_back(info);
+    for (const auto& it: v->nodes) {
+        if (isChild(it.first, p) && parentPath(it.first) == p) {
+            info = {};
+            info.type = it.second.dir ? LFS_TYPE_DIR : LFS_TYPE_REG;
+            info.size = it.second.dir ? 0 : it.second.size;
+            strcpy(info.name, baseName(it.first).c_str());
+            d->entries.push_back(info);
+        }
+    }
+    d->index = 0;
+    dir->impl = d;
+    return 0;
+}
+
+int lfs_dir_close(lfs_t* lfs, lfs_dir_t* dir) {
+    delete (Dir*)dir->impl;
+    dir->impl = nullptr;
+    return 0;
+}
+
+int lfs_dir_read(lfs_t* lfs, lfs_dir_t* dir, struct lfs_info* info) {
+    Dir* d = (Dir*)dir->impl;
+    if (d->index >= d->entries.size()) {
+        return 0;
+    }
+    *info = d->entries[d->index++];
+    return 1;
+}
+
+int lfs_dir_rewind(lfs_t* lfs, lfs_dir_t* dir) {
+    ((Dir*)dir->impl)->index = 0;
+    return 0;
+}
+
+int lfs_traverse(lfs_t* lfs, int (*cb)(void*, lfs_block_t), void* data) {
+    const Volume* v = volume(lfs);
+    const uint32_t first = areaAddress(v, v->area) / v->cfg->block_size;
+    const uint32_t count = alignUp(v->head, v->cfg->block_size) / v->cfg->block_size;
+    for (uint32_t i = 0; i < count; ++i) {
+        const int r = cb(data, first + i);
+        if (r != 0) {
+            return r;
+        }
+    }
+    return 0;
+}
+
+int lfs_deorphan(lfs_t* lfs) {
+    return 0;
+}
+
+} // extern "C"
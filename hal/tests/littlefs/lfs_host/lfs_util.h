@@ -0,0 +1,35 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for the littlefs utility header, see lfs.h. As in littlefs, the utility functions
+ * are provided by the header specified via LFS_CONFIG, which is lfs_config.h of the Gen 3 port.
+ */
+
+#ifndef LFS_UTIL_H
+#define LFS_UTIL_H
+
+#define LFS_STRINGIZE(x) LFS_STRINGIZE2(x)
+#define LFS_STRINGIZE2(x) #x
+
+#ifndef LFS_CONFIG
+#error "LFS_CONFIG is not defined"
+#endif
+
+#include LFS_STRINGIZE(LFS_CONFIG)
+
+#endif /* LFS_UTIL_H */
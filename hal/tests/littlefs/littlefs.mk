@@ -0,0 +1,43 @@
+## -*- Makefile -*-
+#
+# Host build of the Gen 3 filesystem (hal/src/nRF52840/littlefs/filesystem.cpp) on top of a RAM
+# image of the external flash, see exflash_host.h. Included by the host tests that need a
+# filesystem, after CFLAGS, CSRC and CPPSRC are defined. PROJECT_ROOT needs to be defined as well.
+#
+# The tests are built against littlefs if the submodule is checked out:
+#
+#     git submodule update --init third_party/littlefs/littlefs
+#
+# Otherwise, they are built against a stand-in that implements the littlefs API on the same flash
+# image, see lfs_host/lfs.h.
+
+LITTLEFS_HARNESS_PATH := $(patsubst %/,%,$(dir $(lastword $(MAKEFILE_LIST))))
+LITTLEFS_PATH ?= $(PROJECT_ROOT)/third_party/littlefs/littlefs
+
+ifneq ($(wildcard $(LITTLEFS_PATH)/lfs.c),)
+LITTLEFS_SRC_PATH = $(LITTLEFS_PATH)
+CSRC += lfs.c
+else
+LITTLEFS_SRC_PATH = $(LITTLEFS_HARNESS_PATH)/lfs_host
+CPPSRC += lfs_host.cpp
+endif
+
+# The harness directory goes first, so that its platform headers are used
+INCLUDE_DIRS := $(LITTLEFS_HARNESS_PATH) $(INCLUDE_DIRS)
+INCLUDE_DIRS += $(LITTLEFS_SRC_PATH)
+INCLUDE_DIRS += $(PROJECT_ROOT)/hal/src/nRF52840/littlefs
+INCLUDE_DIRS += $(PROJECT_ROOT)/dynalib/inc
+INCLUDE_DIRS += $(PROJECT_ROOT)/services/inc
+INCLUDE_DIRS += $(PROJECT_ROOT)/hal/inc
+INCLUDE_DIRS += $(PROJECT_ROOT)/hal/shared
+
+# Built as a part of the system firmware
+CFLAGS += -DLFS_CONFIG=lfs_config.h -DMODULE_FUNCTION=4 -DHAL_PLATFORM_FILESYSTEM=1
+CFLAGS += -DLFS_NO_DEBUG -DLFS_NO_WARN
+
+CSRC += crc32_util.c
+CPPSRC += filesystem.cpp lfs_utils.cpp exflash_host.cpp
+
+vpath %.c $(LITTLEFS_SRC_PATH) $(PROJECT_ROOT)/services/src
+vpath %.cpp $(LITTLEFS_SRC_PATH) $(LITTLEFS_HARNESS_PATH) $(PROJECT_ROOT)/hal/src/nRF52840/littlefs
+vpath %.h $(LITTLEFS_HARNESS_PATH) $(LITTLEFS_SRC_PATH) $(PROJECT_ROOT)/hal/src/nRF52840/littlefs $(PROJECT_ROOT)/services/inc
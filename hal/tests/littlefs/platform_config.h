@@ -0,0 +1,28 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host replacement for the platform configuration of the Gen 3 devices. Only the parameters of
+ * the external flash are defined.
+ */
+
+#pragma once
+
+#define sFLASH_PAGESIZE                     0x1000 /* 4096 bytes sector size that needs to be erased */
+#ifndef sFLASH_PAGECOUNT
+#define sFLASH_PAGECOUNT                    1024   /* 4MByte storage */
+#endif
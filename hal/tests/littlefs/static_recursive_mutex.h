@@ -0,0 +1,42 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host replacement for the FreeRTOS-based StaticRecursiveMutex.
+ */
+
+#pragma once
+
+#include "service_debug.h"
+
+#include <mutex>
+
+class StaticRecursiveMutex {
+public:
+    bool lock(unsigned timeout = 0) {
+        mutex_.lock();
+        return true;
+    }
+
+    bool unlock() {
+        mutex_.unlock();
+        return true;
+    }
+
+private:
+    std::recursive_mutex mutex_;
+};
@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for lwIP, used by the NAT64 tests (see ../makefile). The headers in this directory
+ * declare the subset of the lwIP API that is used by nat64.cpp, with the same names and semantics.
+ * Only single-segment pbufs are supported, checksums are not generated and the packets passed to
+ * the output functions are recorded instead of being sent. The functions below let the tests set
+ * up the routing, feed packets and drive the timeouts.
+ */
+
+#pragma once
+
+#include "lwip/ip.h"
+#include "lwip/timeouts.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace particle { namespace test {
+
+struct LwipOutput {
+    ip_addr_t src;
+    ip_addr_t dest;
+    uint8_t hopLimit;
+    uint8_t proto;
+    // Set for the packets sent via ip6_output_if_src()
+    netif* iface;
+    std::vector<uint8_t> data;
+};
+
+// Discards the recorded packets, the routes and the pending timeouts
+void lwip_reset();
+
+// Sets the interface returned by ip4_route() and ip6_route()
+void lwip_set_ip4_route(netif* netif);
+void lwip_set_ip6_route(netif* netif);
+
+// Sets the addresses returned by ip_current_src_addr() and ip_current_dest_addr()
+void lwip_set_current_addr(const ip_addr_t& src, const ip_addr_t& dest);
+
+// Returns the packets passed to the output functions since the last call to lwip_reset()
+std::vector<LwipOutput>& lwip_output();
+// Stops recording the output packets, which only get counted
+void lwip_record_output(bool enabled);
+uint64_t lwip_output_count();
+
+// Calls the handlers of the pending timeouts, as if their time has elapsed
+void lwip_run_timeouts();
+size_t lwip_pending_timeouts();
+
+// Returns the number of pbufs that were cloned but not freed yet
+int lwip_allocated_pbufs();
+
+} } // particle::test
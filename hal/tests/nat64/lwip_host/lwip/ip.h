@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for lwIP, see ../lwip_host.h */
+
+#ifndef LWIP_HDR_IP_H
+#define LWIP_HDR_IP_H
+
+#include "lwip/ip_addr.h"
+#include "lwip/ip4.h"
+#include "lwip/ip6.h"
+
+#define IP_PROTO_ICMP 1
+#define IP_PROTO_UDP 17
+#define IP_PROTO_TCP 6
+
+#define ip_addr_isbroadcast(addr, netif) ((void)(netif), IP_IS_V4(addr) && ip4_addr_get_u32(ip_2_ip4(addr)) == 0xffffffffUL)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* The addresses of the packet that is being processed, see particle::test::lwip_set_current_addr() */
+const ip_addr_t* ip_current_src_addr(void);
+const ip_addr_t* ip_current_dest_addr(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWIP_HDR_IP_H */
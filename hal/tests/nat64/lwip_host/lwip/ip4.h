@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for lwIP, see ../lwip_host.h */
+
+#ifndef LWIP_HDR_IP4_H
+#define LWIP_HDR_IP4_H
+
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+
+#define IP_HLEN 20
+
+#define IP_RF 0x8000U
+#define IP_DF 0x4000U
+#define IP_MF 0x2000U
+#define IP_OFFMASK 0x1fffU
+
+struct ip_hdr {
+    u8_t _v_hl;
+    u8_t _tos;
+    u16_t _len;
+    u16_t _id;
+    u16_t _offset;
+    u8_t _ttl;
+    u8_t _proto;
+    u16_t _chksum;
+    ip4_addr_t src;
+    ip4_addr_t dest;
+};
+
+#define IPH_HL(hdr) ((hdr)->_v_hl & 0x0f)
+#define IPH_HL_BYTES(hdr) ((u8_t)(IPH_HL(hdr) * 4))
+#define IPH_TOS(hdr) ((hdr)->_tos)
+#define IPH_OFFSET(hdr) ((hdr)->_offset)
+#define IPH_TTL(hdr) ((hdr)->_ttl)
+#define IPH_PROTO(hdr) ((hdr)->_proto)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct netif* ip4_route(const ip4_addr_t* dest);
+err_t ip4_output(struct pbuf* p, const ip4_addr_t* src, const ip4_addr_t* dest, u8_t ttl, u8_t tos, u8_t proto);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWIP_HDR_IP4_H */
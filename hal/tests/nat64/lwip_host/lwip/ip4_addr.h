@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for lwIP, see ../lwip_host.h */
+
+#ifndef LWIP_HDR_IP4_ADDR_H
+#define LWIP_HDR_IP4_ADDR_H
+
+#include "lwip/def.h"
+
+typedef struct ip4_addr {
+    u32_t addr;
+} ip4_addr_t;
+
+#define IP4_ADDR(ipaddr, a, b, c, d) \
+        (ipaddr)->addr = PP_HTONL(((u32_t)(a) << 24) | ((u32_t)(b) << 16) | ((u32_t)(c) << 8) | (u32_t)(d))
+#define ip4_addr_get_u32(src_ipaddr) ((src_ipaddr)->addr)
+#define ip4_addr_set_u32(dest_ipaddr, src_u32) ((dest_ipaddr)->addr = (src_u32))
+#define ip4_addr_copy(dest, src) ((dest).addr = (src).addr)
+#define ip4_addr_set_zero(ipaddr) ((ipaddr)->addr = 0)
+#define ip4_addr_isany_val(addr1) ((addr1).addr == 0)
+#define ip4_addr_isany(addr1) ((addr1) == NULL || ip4_addr_isany_val(*(addr1)))
+#define ip4_addr_cmp(addr1, addr2) ((addr1)->addr == (addr2)->addr)
+
+#define IP4ADDR_STRLEN_MAX 16
+
+#endif /* LWIP_HDR_IP4_ADDR_H */
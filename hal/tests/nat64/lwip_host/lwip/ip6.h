@@ -0,0 +1,87 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for lwIP, see ../lwip_host.h */
+
+#ifndef LWIP_HDR_IP6_H
+#define LWIP_HDR_IP6_H
+
+#include "lwip/pbuf.h"
+#include "lwip/netif.h"
+
+#define IP6_HLEN 40
+
+#define IP6_NEXTH_HOPBYHOP 0
+#define IP6_NEXTH_TCP 6
+#define IP6_NEXTH_UDP 17
+#define IP6_NEXTH_ROUTING 43
+#define IP6_NEXTH_FRAGMENT 44
+#define IP6_NEXTH_ICMP6 58
+#define IP6_NEXTH_NONE 59
+#define IP6_NEXTH_DESTOPTS 60
+
+typedef struct ip6_addr_packed {
+    u32_t addr[4];
+} ip6_addr_p_t;
+
+struct ip6_hdr {
+    u32_t _v_tc_fl;
+    u16_t _plen;
+    u8_t _nexth;
+    u8_t _hoplim;
+    ip6_addr_p_t src;
+    ip6_addr_p_t dest;
+};
+
+struct ip6_hbh_hdr {
+    u8_t _nexth;
+    u8_t _hlen;
+};
+
+struct ip6_dest_hdr {
+    u8_t _nexth;
+    u8_t _hlen;
+};
+
+struct ip6_rout_hdr {
+    u8_t _nexth;
+    u8_t _hlen;
+    u8_t _routing_type;
+    u8_t _segments_left;
+};
+
+#define IP6H_TC(hdr) ((u8_t)((lwip_ntohl((hdr)->_v_tc_fl) >> 20) & 0xff))
+#define IP6H_NEXTH(hdr) ((hdr)->_nexth)
+#define IP6H_HOPLIM(hdr) ((hdr)->_hoplim)
+#define IP6_HBH_NEXTH(hdr) ((hdr)->_nexth)
+#define IP6_DEST_NEXTH(hdr) ((hdr)->_nexth)
+#define IP6_ROUT_NEXTH(hdr) ((hdr)->_nexth)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct netif* ip6_route(const ip6_addr_t* src, const ip6_addr_t* dest);
+err_t ip6_output(struct pbuf* p, const ip6_addr_t* src, const ip6_addr_t* dest, u8_t hl, u8_t tc, u8_t nexth);
+err_t ip6_output_if_src(struct pbuf* p, const ip6_addr_t* src, const ip6_addr_t* dest, u8_t hl, u8_t tc,
+        u8_t nexth, struct netif* netif);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWIP_HDR_IP6_H */
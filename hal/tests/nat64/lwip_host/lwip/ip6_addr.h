@@ -0,0 +1,62 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for lwIP, see ../lwip_host.h */
+
+#ifndef LWIP_HDR_IP6_ADDR_H
+#define LWIP_HDR_IP6_ADDR_H
+
+#include "lwip/def.h"
+
+typedef struct ip6_addr {
+    u32_t addr[4];
+    u8_t zone;
+} ip6_addr_t;
+
+#define IP6_NO_ZONE 0
+
+#define IP6_ADDR(ip6addr, idx0, idx1, idx2, idx3) \
+        do { \
+            (ip6addr)->addr[0] = idx0; \
+            (ip6addr)->addr[1] = idx1; \
+            (ip6addr)->addr[2] = idx2; \
+            (ip6addr)->addr[3] = idx3; \
+            (ip6addr)->zone = IP6_NO_ZONE; \
+        } while (0)
+#define ip6_addr_copy(dest, src) ((dest) = (src))
+#define ip6_addr_set(dest, src) (*(dest) = *(src))
+#define ip6_addr_set_zero(ip6addr) memset((ip6addr), 0, sizeof(ip6_addr_t))
+#define ip6_addr_clear_zone(ip6addr) ((ip6addr)->zone = IP6_NO_ZONE)
+#define ip6_addr_cmp_zoneless(addr1, addr2) \
+        ((addr1)->addr[0] == (addr2)->addr[0] && (addr1)->addr[1] == (addr2)->addr[1] && \
+         (addr1)->addr[2] == (addr2)->addr[2] && (addr1)->addr[3] == (addr2)->addr[3])
+#define ip6_addr_cmp(addr1, addr2) (ip6_addr_cmp_zoneless((addr1), (addr2)) && (addr1)->zone == (addr2)->zone)
+
+#define IP6ADDR_STRLEN_MAX 46
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Returns the length of the common prefix of two addresses, up to max_len bits */
+u8_t ip6_addr_common_prefix_length(const ip6_addr_t* addr1, const ip6_addr_t* addr2, u8_t max_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWIP_HDR_IP6_ADDR_H */
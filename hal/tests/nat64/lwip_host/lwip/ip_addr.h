@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Host stand-in for lwIP, see ../lwip_host.h */
+
+#ifndef LWIP_HDR_IP_ADDR_H
+#define LWIP_HDR_IP_ADDR_H
+
+#include "lwip/ip4_addr.h"
+#include "lwip/ip6_addr.h"
+
+enum lwip_ip_addr_type {
+    IPADDR_TYPE_V4 = 0U,
+    IPADDR_TYPE_V6 = 6U,
+    IPADDR_TYPE_ANY = 46U
+};
+
+typedef struct ip_addr {
+    union {
+        ip6_addr_t ip6;
+        ip4_addr_t ip4;
+    } u_addr;
+    u8_t type;
+} ip_addr_t;
+
+#define IP_IS_V4_VAL(ipaddr) ((ipaddr).type == IPADDR_TYPE_V4)
+#define IP_IS_V6_VAL(ipaddr) ((ipaddr).type == IPADDR_TYPE_V6)
+#define IP_IS_V4(ipaddr) IP_IS_V4_VAL(*(ipaddr))
+#define IP_IS_V6(ipaddr) IP_IS_V6_VAL(*(ipaddr))
+#define ip_2_ip4(ipaddr) (&((ipaddr)->u_addr.ip4))
+#define ip_2_ip6(ipaddr) (&((ipaddr)->u_addr.ip6))
+
+#define ip_addr_copy_from_ip4(dest, src) \
+        do { ip4_addr_copy(*ip_2_ip4(&(dest)), (src)); (dest).type = IPADDR_TYPE_V4; } while (0)
+#define ip_addr_copy_from_ip6(dest, src) \
+        do { ip6_addr_copy(*ip_2_ip6(&(dest)), (src)); (dest).type = IPADDR_TYPE_V6; } while (0)
+#define ip_addr_cmp_zoneless(addr1, addr2) \
+        ((addr1)->type == (addr2)->type && (IP_IS_V6(addr1) ? \
+                ip6_addr_cmp_zoneless(ip_2_ip6(addr1), ip_2_ip6(addr2)) : \
+                ip4_addr_cmp(ip_2_ip4(addr1), ip_2_ip4(addr2))))
+
+#define unmap_ipv4_mapped_ipv6(ip4addr, ip6addr) ((ip4addr)->addr = (ip6addr)->addr[3])
+
+#define IPADDR_STRLEN_MAX IP6ADDR_STRLEN_MAX
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+char* ipaddr_ntoa_r(const ip_addr_t* addr, char* buf, int buflen);
+char* ip4addr_ntoa_r(const ip4_addr_t* addr, char* buf, int buflen);
+char* ip6addr_ntoa_r(const ip6_addr_t* addr, char* buf, int buflen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LWIP_HDR_IP_ADDR_H */
@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lwip_host.h"
+
+#include "rng_hal.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+namespace particle { namespace test {
+
+namespace {
+
+struct Timeout {
+    sys_timeout_handler handler;
+    void* arg;
+};
+
+std::vector<LwipOutput> g_output;
+bool g_recordOutput = true;
+uint64_t g_outputCount = 0;
+
+std::vector<Timeout> g_timeouts;
+
+netif* g_ip4Route = nullptr;
+netif* g_ip6Route = nullptr;
+
+ip_addr_t g_currentSrc = {};
+ip_addr_t g_currentDest = {};
+
+int g_pbufs = 0;
+
+void addOutput(pbuf* p, const ip_addr_t& src, const ip_addr_t& dest, u8_t hl, u8_t proto, netif* netif) {
+    ++g_outputCount;
+    if (!g_recordOutput) {
+        return;
+    }
+    LwipOutput out = {};
+    out.src = src;
+    out.dest = dest;
+    out.hopLimit = hl;
+    out.proto = proto;
+    out.iface = netif;
+    const auto data = (const uint8_t*)p->payload;
+    out.data.assign(data, data + p->len);
+    g_output.push_back(std::move(out));
+}
+
+ip_addr_t toIpAddr(const ip4_addr_t& addr) {
+    ip_addr_t a = {};
+    ip_addr_copy_from_ip4(a, addr);
+    return a;
+}
+
+ip_addr_t toIpAddr(const ip6_addr_t& addr) {
+    ip_addr_t a = {};
+    ip_addr_copy_from_ip6(a, addr);
+    return a;
+}
+
+} // unnamed
+
+void lwip_reset() {
+    g_output.clear();
+    g_recordOutput = true;
+    g_outputCount = 0;
+    g_timeouts.clear();
+    g_ip4Route = nullptr;
+    g_ip6Route = nullptr;
+}
+
+void lwip_set_ip4_route(netif* netif) {
+    g_ip4Route = netif;
+}
+
+void lwip_set_ip6_route(netif* netif) {
+    g_ip6Route = netif;
+}
+
+void lwip_set_current_addr(const ip_addr_t& src, const ip_addr_t& dest) {
+    g_currentSrc = src;
+    g_currentDest = dest;
+}
+
+std::vector<LwipOutput>& lwip_output() {
+    return g_output;
+}
+
+void lwip_record_output(bool enabled) {
+    g_recordOutput = enabled;
+}
+
+uint64_t lwip_output_count() {
+    return g_outputCount;
+}
+
+void lwip_run_timeouts() {
+    // The handlers may schedule new timeouts
+    std::vector<Timeout> timeouts;
+    timeouts.swap(g_timeouts);
+    for (const auto& t: timeouts) {
+        t.handler(t.arg);
+    }
+}
+
+size_t lwip_pending_timeouts() {
+    return g_timeouts.size();
+}
+
+int lwip_allocated_pbufs() {
+    return g_pbufs;
+}
+
+} } // particle::test
+
+using namespace particle::test;
+
+pbuf* pbuf_clone(pbuf_layer l, pbuf_type type, pbuf* p) {
+    const auto q = (pbuf*)malloc(sizeof(pbuf) + p->len);
+    if (!q) {
+        return nullptr;
+    }
+    q->next = nullptr;
+    q->payload = q + 1;
+    q->tot_len = p->len;
+    q->len = p->len;
+    memcpy(q->payload, p->payload, p->len);
+    ++g_pbufs;
+    return q;
+}
+
+u8_t pbuf_free(pbuf* p) {
+    if (!p) {
+        return 0;
+    }
+    free(p);
+    --g_pbufs;
+    return 1;
+}
+
+u8_t pbuf_remove_header(pbuf* p, size_t header_size) {
+    if (header_size > p->len) {
+        return 1;
+    }
+    p->payload = (uint8_t*)p->payload + header_size;
+    p->len -= header_size;
+    p->tot_len -= header_size;
+    return 0;
+}
+
+u8_t pbuf_add_header_force(pbuf* p, size_t header_size) {
+    p->payload = (uint8_t*)p->payload - header_size;
+    p->len += header_size;
+    p->tot_len += header_size;
+    return 0;
+}
+
+netif* ip4_route(const ip4_addr_t* dest) {
+    return g_ip4Route;
+}
+
+err_t ip4_output(pbuf* p, const ip4_addr_t* src, const ip4_addr_t* dest, u8_t ttl, u8_t tos, u8_t proto) {
+    addOutput(p, toIpAddr(*src), toIpAddr(*dest), ttl, proto, nullptr);
+    return ERR_OK;
+}
+
+netif* ip6_route(const ip6_addr_t* src, const ip6_addr_t* dest) {
+    return g_ip6Route;
+}
+
+err_t ip6_output(pbuf* p, const ip6_addr_t* src, const ip6_addr_t* dest, u8_t hl, u8_t tc, u8_t nexth) {
+    addOutput(p, toIpAddr(*src), toIpAddr(*dest), hl, nexth, nullptr);
+    return ERR_OK;
+}
+
+err_t ip6_output_if_src(pbuf* p, const ip6_addr_t* src, const ip6_addr_t* dest, u8_t hl, u8_t tc, u8_t nexth,
+        netif* netif) {
+    addOutput(p, toIpAddr(*src), toIpAddr(*dest), hl, nexth, netif);
+    return ERR_OK;
+}
+
+const ip_addr_t* ip_current_src_addr() {
+    return &g_currentSrc;
+}
+
+const ip_addr_t* ip_current_dest_addr() {
+    return &g_currentDest;
+}
+
+u8_t ip6_addr_common_prefix_length(const ip6_addr_t* addr1, const ip6_addr_t* addr2, u8_t max_len) {
+    u8_t len = 0;
+    while (len < max_len) {
+        const unsigned i = len / 32;
+        const uint32_t x = lwip_ntohl(addr1->addr[i] ^ addr2->addr[i]);
+        if (x == 0) {
+            len = std::min<unsigned>(len + 32, max_len);
+            continue;
+        }
+        return std::min<unsigned>(len + __builtin_clz(x), max_len);
+    }
+    return len;
+}
+
+char* ipaddr_ntoa_r(const ip_addr_t* addr, char* buf, int buflen) {
+    return IP_IS_V6(addr) ? ip6addr_ntoa_r(ip_2_ip6(addr), buf, buflen) : ip4addr_ntoa_r(ip_2_ip4(addr), buf, buflen);
+}
+
+char* ip4addr_ntoa_r(const ip4_addr_t* addr, char* buf, int buflen) {
+    const auto b = (const uint8_t*)&addr->addr;
+    snprintf(buf, buflen, "%u.%u.%u.%u", b[0], b[1], b[2], b[3]);
+    return buf;
+}
+
+char* ip6addr_ntoa_r(const ip6_addr_t* addr, char* buf, int buflen) {
+    const auto w = (const uint8_t*)addr->addr;
+    int n = 0;
+    for (int i = 0; i < 16 && n < buflen; i += 2) {
+        n += snprintf(buf + n, buflen - n, i ? ":%x" : "%x", (w[i] << 8) | w[i + 1]);
+    }
+    return buf;
+}
+
+void sys_timeout(u32_t msecs, sys_timeout_handler handler, void* arg) {
+    g_timeouts.push_back({ handler, arg });
+}
+
+void sys_untimeout(sys_timeout_handler handler, void* arg) {
+    g_timeouts.erase(std::remove_if(g_timeouts.begin(), g_timeouts.end(), [=](const Timeout& t) {
+        return t.handler == handler && t.arg == arg;
+    }), g_timeouts.end());
+}
+
+// Used by particle::Random
+uint32_t HAL_RNG_GetRandomNumber() {
+    return rand();
+}
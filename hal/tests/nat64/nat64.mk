@@ -0,0 +1,28 @@
+## -*- Makefile -*-
+#
+# Host build of the NAT64 translator (hal/network/lwip/nat64.cpp) on top of a stand-in for the
+# subset of lwIP it uses, see lwip_host/lwip_host.h. Included by the NAT64 tests and benchmark,
+# after CFLAGS, CSRC and CPPSRC are defined. PROJECT_ROOT needs to be defined as well.
+#
+# The translator is built for the Argon, the Boron uses a longer UDP session lifetime.
+
+NAT64_HARNESS_PATH := $(patsubst %/,%,$(dir $(lastword $(MAKEFILE_LIST))))
+
+# The harness directories go first, so that their lwIP and platform headers are used
+INCLUDE_DIRS := $(NAT64_HARNESS_PATH) $(NAT64_HARNESS_PATH)/lwip_host $(INCLUDE_DIRS)
+INCLUDE_DIRS += $(PROJECT_ROOT)/hal/network/lwip
+INCLUDE_DIRS += $(PROJECT_ROOT)/services/inc
+INCLUDE_DIRS += $(PROJECT_ROOT)/wiring/inc
+INCLUDE_DIRS += $(PROJECT_ROOT)/dynalib/inc
+INCLUDE_DIRS += $(PROJECT_ROOT)/platform/shared/inc
+INCLUDE_DIRS += $(PROJECT_ROOT)/hal/inc
+INCLUDE_DIRS += $(PROJECT_ROOT)/hal/shared
+# interrupts_irq.h
+INCLUDE_DIRS += $(PROJECT_ROOT)/hal/src/gcc
+
+CFLAGS += -DPLATFORM_ID=12
+
+CPPSRC += nat64.cpp lwip_host.cpp
+
+vpath %.cpp $(PROJECT_ROOT)/hal/network/lwip $(NAT64_HARNESS_PATH)/lwip_host
+vpath %.h $(NAT64_HARNESS_PATH) $(NAT64_HARNESS_PATH)/lwip_host $(PROJECT_ROOT)/hal/network/lwip
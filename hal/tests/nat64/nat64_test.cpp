@@ -0,0 +1,412 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tests of the NAT64 translator. The packets are fed to the translator directly, as the
+ * lwIP input hooks would do, and the translated packets are captured by the lwIP stand-in, see
+ * lwip_host/lwip_host.h.
+ */
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include "nat64.h"
+#include "lwip_host.h"
+
+#include <lwip/udp.h>
+
+#include <new>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+using namespace particle::net::nat;
+using namespace particle::test;
+
+namespace {
+
+bool g_failNothrowArrayNew = false;
+
+const uint16_t NAT_MIN_PORT = 40000;
+const uint16_t NAT_MAX_PORT = 49000;
+
+// UDP session lifetime in session timer ticks
+const unsigned UDP_LIFETIME_TICKS = 120;
+
+ip_addr_t ip4Addr(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    ip_addr_t addr = {};
+    addr.type = IPADDR_TYPE_V4;
+    IP4_ADDR(ip_2_ip4(&addr), a, b, c, d);
+    return addr;
+}
+
+ip_addr_t ip6Addr(uint32_t w0, uint32_t w1, uint32_t w2, uint32_t w3) {
+    ip_addr_t addr = {};
+    addr.type = IPADDR_TYPE_V6;
+    IP6_ADDR(ip_2_ip6(&addr), PP_HTONL(w0), PP_HTONL(w1), PP_HTONL(w2), PP_HTONL(w3));
+    return addr;
+}
+
+// Maps an IPv4 address to the default Pref64, 64:ff9b::/96
+ip_addr_t pref64Addr(const ip_addr_t& addr4) {
+    ip_addr_t addr = ip6Addr(0x0064ff9b, 0, 0, 0);
+    ip_2_ip6(&addr)->addr[3] = ip4_addr_get_u32(ip_2_ip4(&addr4));
+    return addr;
+}
+
+bool addrEquals(const ip_addr_t& a, const ip_addr_t& b) {
+    return ip_addr_cmp_zoneless(&a, &b);
+}
+
+struct UdpPacket {
+    uint16_t srcPort;
+    uint16_t destPort;
+    std::vector<uint8_t> payload;
+};
+
+UdpPacket parseUdp(const LwipOutput& out) {
+    REQUIRE(out.proto == IP_PROTO_UDP);
+    REQUIRE(out.data.size() >= UDP_HLEN);
+    UdpPacket p;
+    const auto h = (const udp_hdr*)out.data.data();
+    p.srcPort = lwip_ntohs(h->src);
+    p.destPort = lwip_ntohs(h->dest);
+    p.payload.assign(out.data.begin() + UDP_HLEN, out.data.end());
+    return p;
+}
+
+std::vector<uint8_t> udpPacket(uint16_t srcPort, uint16_t destPort, const std::vector<uint8_t>& payload) {
+    std::vector<uint8_t> d(UDP_HLEN + payload.size());
+    const auto h = (udp_hdr*)d.data();
+    h->src = lwip_htons(srcPort);
+    h->dest = lwip_htons(destPort);
+    h->len = lwip_htons(d.size());
+    std::copy(payload.begin(), payload.end(), d.begin() + UDP_HLEN);
+    return d;
+}
+
+class Nat64Test {
+public:
+    Nat64Test() {
+        lwip_reset();
+        inside_.name[0] = 't';
+        inside_.name[1] = 'h';
+        inside_.num = 0;
+        outside_.name[0] = 'p';
+        outside_.name[1] = 'p';
+        outside_.num = 1;
+        outside_.ip_addr = ip4Addr(10, 0, 0, 10);
+        lwip_set_ip4_route(&outside_);
+        lwip_set_ip6_route(&inside_);
+        nat_.reset(new Nat64());
+    }
+
+    ~Nat64Test() {
+        nat_.reset();
+        CHECK(lwip_pending_timeouts() == 0);
+        CHECK(lwip_allocated_pbufs() == 0);
+    }
+
+    bool enable() {
+        return nat_->enable(Rule(&inside_, &outside_));
+    }
+
+    // Feeds an IPv6 UDP packet received on the inside interface
+    int input6(const ip_addr_t& src, uint16_t srcPort, const ip_addr_t& dest, uint16_t destPort,
+            const std::vector<uint8_t>& payload = { 1, 2, 3 }, uint8_t hopLimit = 64) {
+        std::vector<uint8_t> d(IP6_HLEN);
+        const auto h = (ip6_hdr*)d.data();
+        h->_v_tc_fl = PP_HTONL(0x60000000);
+        h->_nexth = IP_PROTO_UDP;
+        h->_hoplim = hopLimit;
+        memcpy(&h->src, ip_2_ip6(&src)->addr, sizeof(h->src));
+        memcpy(&h->dest, ip_2_ip6(&dest)->addr, sizeof(h->dest));
+        const auto udp = udpPacket(srcPort, destPort, payload);
+        h->_plen = lwip_htons(udp.size());
+        d.insert(d.end(), udp.begin(), udp.end());
+        return input(d, src, dest, &inside_, false);
+    }
+
+    // Feeds an IPv4 UDP packet received on the outside interface
+    int input4(const ip_addr_t& src, uint16_t srcPort, const ip_addr_t& dest, uint16_t destPort,
+            const std::vector<uint8_t>& payload = { 4, 5, 6 }, uint8_t ttl = 64) {
+        std::vector<uint8_t> d(IP_HLEN);
+        const auto h = (ip_hdr*)d.data();
+        h->_v_hl = 0x45;
+        h->_ttl = ttl;
+        h->_proto = IP_PROTO_UDP;
+        h->src = *ip_2_ip4(&src);
+        h->dest = *ip_2_ip4(&dest);
+        const auto udp = udpPacket(srcPort, destPort, payload);
+        h->_len = lwip_htons(IP_HLEN + udp.size());
+        d.insert(d.end(), udp.begin(), udp.end());
+        return input(d, src, dest, &outside_, true);
+    }
+
+    // Sends a packet from the inside and returns the port allocated for it on the outside, or 0
+    uint16_t open(const ip_addr_t& src, uint16_t srcPort, const ip_addr_t& dest4, uint16_t destPort) {
+        lwip_output().clear();
+        input6(src, srcPort, pref64Addr(dest4), destPort);
+        if (lwip_output().empty()) {
+            return 0;
+        }
+        return parseUdp(lwip_output().back()).srcPort;
+    }
+
+    // Sends a reply from the outside and returns true if it was translated
+    bool reply(const ip_addr_t& src4, uint16_t srcPort, uint16_t natPort) {
+        lwip_output().clear();
+        input4(src4, srcPort, outside_.ip_addr, natPort);
+        return !lwip_output().empty();
+    }
+
+    void runTimer(unsigned ticks) {
+        for (unsigned i = 0; i < ticks; ++i) {
+            lwip_run_timeouts();
+        }
+    }
+
+    Nat64& nat() {
+        return *nat_;
+    }
+
+    netif& inside() {
+        return inside_;
+    }
+
+    netif& outside() {
+        return outside_;
+    }
+
+private:
+    netif inside_ = {};
+    netif outside_ = {};
+    std::unique_ptr<Nat64> nat_;
+
+    int input(std::vector<uint8_t>& d, const ip_addr_t& src, const ip_addr_t& dest, netif* in, bool v4) {
+        pbuf p = {};
+        p.payload = d.data();
+        p.len = d.size();
+        p.tot_len = d.size();
+        lwip_set_current_addr(src, dest);
+        int r = 0;
+        if (v4) {
+            r = nat_->ip4Input(&p, (ip_hdr*)d.data(), in);
+        } else {
+            r = nat_->ip6Input(&p, (ip6_hdr*)d.data(), in);
+        }
+        // The input functions restore the payload pointer
+        CHECK(p.payload == d.data());
+        CHECK(p.len == d.size());
+        return r;
+    }
+};
+
+} // unnamed
+
+// The port bitmap of the translator is allocated with the nothrow version of new[]
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    if (g_failNothrowArrayNew) {
+        return nullptr;
+    }
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](std::size_t size) {
+    const auto p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete[](void* p) noexcept {
+    free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    free(p);
+}
+
+TEST_CASE("Nat64") {
+    Nat64Test t;
+    const auto host6 = ip6Addr(0xfd000000, 0, 0, 1);
+    const auto server4 = ip4Addr(18, 0, 0, 1);
+
+    SECTION("doesn't translate packets until it's enabled") {
+        CHECK(t.input6(host6, 5000, pref64Addr(server4), 5684) == 0);
+        CHECK(lwip_output().empty());
+        CHECK(t.input4(server4, 5684, t.outside().ip_addr, NAT_MIN_PORT) == 0);
+        CHECK(lwip_output().empty());
+    }
+
+    SECTION("translates an IPv6 packet to IPv4 and the reply back to IPv6") {
+        REQUIRE(t.enable());
+        CHECK(t.input6(host6, 5000, pref64Addr(server4), 5684, { 1, 2, 3 }) == 1);
+        REQUIRE(lwip_output().size() == 1);
+        auto out = lwip_output().front();
+        CHECK(addrEquals(out.src, t.outside().ip_addr));
+        CHECK(addrEquals(out.dest, server4));
+        CHECK(out.hopLimit == 63);
+        auto udp = parseUdp(out);
+        CHECK(udp.srcPort >= NAT_MIN_PORT);
+        CHECK(udp.srcPort <= NAT_MAX_PORT);
+        CHECK(udp.destPort == 5684);
+        CHECK(udp.payload == std::vector<uint8_t>({ 1, 2, 3 }));
+        const auto natPort = udp.srcPort;
+
+        lwip_output().clear();
+        CHECK(t.input4(server4, 5684, t.outside().ip_addr, natPort, { 4, 5, 6 }) == 1);
+        REQUIRE(lwip_output().size() == 1);
+        out = lwip_output().front();
+        CHECK(addrEquals(out.src, pref64Addr(server4)));
+        CHECK(addrEquals(out.dest, host6));
+        CHECK(out.hopLimit == 63);
+        CHECK(out.iface == nullptr);
+        udp = parseUdp(out);
+        CHECK(udp.srcPort == 5684);
+        CHECK(udp.destPort == 5000);
+        CHECK(udp.payload == std::vector<uint8_t>({ 4, 5, 6 }));
+
+        // The same flow keeps its port
+        CHECK(t.open(host6, 5000, server4, 5684) == natPort);
+    }
+
+    SECTION("sends a reply via the inside interface if it's routed to the outside one") {
+        REQUIRE(t.enable());
+        const auto natPort = t.open(host6, 5000, server4, 5684);
+        REQUIRE(natPort != 0);
+        lwip_set_ip6_route(&t.outside());
+        REQUIRE(t.reply(server4, 5684, natPort));
+        CHECK(lwip_output().front().iface == &t.inside());
+    }
+
+    SECTION("allocates a separate port for each flow") {
+        REQUIRE(t.enable());
+        std::vector<uint16_t> ports;
+        for (unsigned i = 0; i < 8; ++i) {
+            const auto port = t.open(ip6Addr(0xfd000000, 0, 0, 1 + i / 2), 5000 + i % 2, server4, 5684);
+            REQUIRE(port != 0);
+            CHECK(std::find(ports.begin(), ports.end(), port) == ports.end());
+            ports.push_back(port);
+        }
+        // Replies reach their flows
+        for (unsigned i = 0; i < 8; ++i) {
+            REQUIRE(t.reply(server4, 5684, ports[i]));
+            CHECK(addrEquals(lwip_output().front().dest, ip6Addr(0xfd000000, 0, 0, 1 + i / 2)));
+            CHECK(parseUdp(lwip_output().front()).destPort == 5000 + i % 2);
+        }
+    }
+
+    SECTION("doesn't translate packets that don't belong to a session") {
+        REQUIRE(t.enable());
+        // A destination outside of Pref64
+        CHECK(t.input6(host6, 5000, ip6Addr(0x20010db8, 0, 0, 1), 5684) == 0);
+        CHECK(lwip_output().empty());
+        // A connection initiated from the IPv4 side
+        CHECK(t.input4(server4, 5684, t.outside().ip_addr, NAT_MIN_PORT) == 0);
+        CHECK(lwip_output().empty());
+        // A reply from another server
+        const auto natPort = t.open(host6, 5000, server4, 5684);
+        REQUIRE(natPort != 0);
+        CHECK_FALSE(t.reply(ip4Addr(18, 0, 0, 2), 5684, natPort));
+        CHECK_FALSE(t.reply(server4, 5685, natPort));
+    }
+
+    SECTION("consumes packets whose hop limit is exceeded") {
+        REQUIRE(t.enable());
+        CHECK(t.input6(host6, 5000, pref64Addr(server4), 5684, { 1 }, 1) == 1);
+        CHECK(lwip_output().empty());
+    }
+
+    SECTION("removes a session once its lifetime has expired") {
+        REQUIRE(t.enable());
+        auto natPort = t.open(host6, 5000, server4, 5684);
+        REQUIRE(natPort != 0);
+        t.runTimer(UDP_LIFETIME_TICKS - 1);
+        // The reply extends the lifetime of the session as well
+        CHECK(t.reply(server4, 5684, natPort));
+        t.runTimer(UDP_LIFETIME_TICKS);
+        CHECK_FALSE(t.reply(server4, 5684, natPort));
+        // The session is recreated by the next outgoing packet
+        natPort = t.open(host6, 5000, server4, 5684);
+        REQUIRE(natPort != 0);
+        CHECK(t.reply(server4, 5684, natPort));
+    }
+
+    SECTION("extends the lifetime of a session with each packet") {
+        REQUIRE(t.enable());
+        const auto natPort = t.open(host6, 5000, server4, 5684);
+        REQUIRE(natPort != 0);
+        for (unsigned i = 0; i < 5; ++i) {
+            t.runTimer(UDP_LIFETIME_TICKS / 2);
+            CHECK(t.open(host6, 5000, server4, 5684) == natPort);
+        }
+        CHECK(t.reply(server4, 5684, natPort));
+        t.runTimer(UDP_LIFETIME_TICKS);
+        CHECK_FALSE(t.reply(server4, 5684, natPort));
+    }
+
+    SECTION("limits the number of flows and reuses the entries of the expired ones") {
+        REQUIRE(t.enable());
+        lwip_record_output(false);
+        // Each flow takes a BIB entry and a session from the pool
+        unsigned flows = 0;
+        for (;;) {
+            const auto count = lwip_output_count();
+            t.input6(host6, 1000 + flows, pref64Addr(server4), 5684);
+            if (lwip_output_count() == count) {
+                break;
+            }
+            ++flows;
+            REQUIRE(flows <= 6 * 1024 / NAT64_ENTRY_SIZE / 2);
+        }
+        CHECK(flows > 0);
+        t.runTimer(UDP_LIFETIME_TICKS);
+        for (unsigned i = 0; i <= flows; ++i) {
+            const auto count = lwip_output_count();
+            t.input6(host6, 2000 + i, pref64Addr(server4), 5684);
+            CHECK(lwip_output_count() == count + (i < flows ? 1 : 0));
+        }
+    }
+
+    SECTION("stops translating once it's disabled") {
+        REQUIRE(t.enable());
+        const auto natPort = t.open(host6, 5000, server4, 5684);
+        REQUIRE(natPort != 0);
+        CHECK(t.nat().disable(nullptr));
+        lwip_output().clear();
+        CHECK(t.input6(host6, 5000, pref64Addr(server4), 5684) == 0);
+        CHECK(lwip_output().empty());
+        CHECK_FALSE(t.reply(server4, 5684, natPort));
+    }
+
+    SECTION("stays disabled if its state can't be allocated") {
+        g_failNothrowArrayNew = true;
+        const bool ok = t.enable();
+        g_failNothrowArrayNew = false;
+        CHECK_FALSE(ok);
+        CHECK(t.open(host6, 5000, server4, 5684) == 0);
+        CHECK(t.input4(server4, 5684, t.outside().ip_addr, NAT_MIN_PORT) == 0);
+        CHECK(lwip_output().empty());
+        // Enabling it again allocates the state
+        REQUIRE(t.enable());
+        const auto natPort = t.open(host6, 5000, server4, 5684);
+        REQUIRE(natPort != 0);
+        CHECK(t.reply(server4, 5684, natPort));
+    }
+}
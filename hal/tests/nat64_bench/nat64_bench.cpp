@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Translation throughput of the NAT64 translator versus the number of active flows.
+ *
+ * The flows are opened from the IPv6 side, after which an outgoing packet and a reply are
+ * translated for each flow in turn. The cost of a session timer tick is measured with all the
+ * flows active. The translator runs on top of the lwIP stand-in, see hal/tests/nat64.
+ */
+
+#include "nat64.h"
+#include "lwip_host.h"
+
+#include <lwip/udp.h>
+
+#include <chrono>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace particle::net::nat;
+using namespace particle::test;
+
+namespace {
+
+const unsigned FLOWS[] = { 1, 8, 16, 32 };
+const unsigned PACKETS = 200000;
+const unsigned TICKS = 10000;
+
+struct Flow {
+    ip6_addr_t src6;
+    uint16_t srcPort;
+    ip4_addr_t dest4;
+    uint16_t natPort;
+};
+
+struct Packet {
+    std::vector<uint8_t> data;
+    pbuf p;
+    ip_addr_t src;
+    ip_addr_t dest;
+};
+
+struct Result {
+    unsigned flows;
+    double packetNsec;
+    double tickNsec;
+};
+
+netif g_inside = {};
+netif g_outside = {};
+
+void initPacket(Packet* pkt, size_t headerSize, uint16_t srcPort, uint16_t destPort) {
+    pkt->data.assign(headerSize + UDP_HLEN + 16, 0);
+    const auto udp = (udp_hdr*)(pkt->data.data() + headerSize);
+    udp->src = lwip_htons(srcPort);
+    udp->dest = lwip_htons(destPort);
+    udp->len = lwip_htons(UDP_HLEN + 16);
+    pkt->p = {};
+}
+
+int input6(Nat64& nat, Packet& pkt) {
+    pkt.p.payload = pkt.data.data();
+    pkt.p.len = pkt.p.tot_len = pkt.data.size();
+    lwip_set_current_addr(pkt.src, pkt.dest);
+    return nat.ip6Input(&pkt.p, (ip6_hdr*)pkt.data.data(), &g_inside);
+}
+
+int input4(Nat64& nat, Packet& pkt) {
+    pkt.p.payload = pkt.data.data();
+    pkt.p.len = pkt.p.tot_len = pkt.data.size();
+    lwip_set_current_addr(pkt.src, pkt.dest);
+    return nat.ip4Input(&pkt.p, (ip_hdr*)pkt.data.data(), &g_outside);
+}
+
+void makeOutgoing(const Flow& f, Packet* pkt) {
+    initPacket(pkt, IP6_HLEN, f.srcPort, 5684);
+    const auto h = (ip6_hdr*)pkt->data.data();
+    h->_nexth = IP_PROTO_UDP;
+    h->_hoplim = 64;
+    pkt->src = {};
+    ip_addr_copy_from_ip6(pkt->src, f.src6);
+    pkt->dest = {};
+    pkt->dest.type = IPADDR_TYPE_V6;
+    IP6_ADDR(ip_2_ip6(&pkt->dest), PP_HTONL(0x0064ff9b), 0, 0, f.dest4.addr);
+}
+
+void makeReply(const Flow& f, Packet* pkt) {
+    initPacket(pkt, IP_HLEN, 5684, f.natPort);
+    const auto h = (ip_hdr*)pkt->data.data();
+    h->_v_hl = 0x45;
+    h->_ttl = 64;
+    h->_proto = IP_PROTO_UDP;
+    pkt->src = {};
+    ip_addr_copy_from_ip4(pkt->src, f.dest4);
+    pkt->dest = g_outside.ip_addr;
+}
+
+Result run(unsigned flowCount) {
+    lwip_reset();
+    lwip_set_ip4_route(&g_outside);
+    lwip_set_ip6_route(&g_inside);
+    Nat64 nat;
+    nat.enable(Rule(&g_inside, &g_outside));
+
+    std::vector<Flow> flows(flowCount);
+    std::vector<Packet> out(flowCount), in(flowCount);
+    for (unsigned i = 0; i < flowCount; ++i) {
+        auto& f = flows[i];
+        IP6_ADDR(&f.src6, PP_HTONL(0xfd000000), 0, 0, PP_HTONL(1 + i / 4));
+        f.srcPort = 5000 + i % 4;
+        IP4_ADDR(&f.dest4, 18, 0, 0, 1 + i % 5);
+        makeOutgoing(f, &out[i]);
+        lwip_output().clear();
+        input6(nat, out[i]);
+        if (lwip_output().empty()) {
+            fprintf(stderr, "Failed to open flow %u\n", i);
+            exit(1);
+        }
+        f.natPort = lwip_ntohs(((const udp_hdr*)lwip_output().back().data.data())->src);
+        makeReply(f, &in[i]);
+    }
+
+    lwip_record_output(false);
+    const auto count = lwip_output_count();
+    const auto t1 = std::chrono::steady_clock::now();
+    for (unsigned n = 0; n < PACKETS / 2; ++n) {
+        const unsigned i = n % flowCount;
+        input6(nat, out[i]);
+        input4(nat, in[i]);
+    }
+    const auto t2 = std::chrono::steady_clock::now();
+    if (lwip_output_count() - count != PACKETS / 2 * 2) {
+        fprintf(stderr, "Not all packets were translated\n");
+        exit(1);
+    }
+
+    // The sessions are refreshed by the packets above, so none of them expires
+    const auto t3 = std::chrono::steady_clock::now();
+    for (unsigned n = 0; n < TICKS; ++n) {
+        lwip_run_timeouts();
+        if (n % 100 == 0) {
+            for (unsigned i = 0; i < flowCount; ++i) {
+                input6(nat, out[i]);
+            }
+        }
+    }
+    const auto t4 = std::chrono::steady_clock::now();
+
+    Result r = {};
+    r.flows = flowCount;
+    r.packetNsec = std::chrono::duration<double, std::nano>(t2 - t1).count() / (PACKETS / 2 * 2);
+    r.tickNsec = std::chrono::duration<double, std::nano>(t4 - t3).count() / TICKS;
+    return r;
+}
+
+} // namespace
+
+int main() {
+    g_inside.name[0] = 't';
+    g_inside.name[1] = 'h';
+    g_outside.name[0] = 'p';
+    g_outside.name[1] = 'p';
+    g_outside.num = 1;
+    g_outside.ip_addr.type = IPADDR_TYPE_V4;
+    IP4_ADDR(ip_2_ip4(&g_outside.ip_addr), 10, 0, 0, 10);
+
+    printf("Entry size: %u bytes, pool: %u bytes\n\n", (unsigned)NAT64_ENTRY_SIZE, 6 * 1024);
+    printf("%6s %12s %12s\n", "Flows", "Packet (ns)", "Tick (ns)");
+    for (unsigned flows: FLOWS) {
+        const auto r = run(flows);
+        printf("%6u %12.1f %12.1f\n", r.flows, r.packetNsec, r.tickNsec);
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Host replacement for the platform's flash_mal.h. The functions are implemented over a RAM image
+// of the OTA region, see ota_inflate_test.cpp
+
+#include "flash_device_hal.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define sFLASH_PAGESIZE 0x1000
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+bool FLASH_EraseMemory(flash_device_t flashDeviceID, uint32_t startAddress, uint32_t length);
+int FLASH_Update(const uint8_t *pBuffer, uint32_t address, uint32_t bufferSize);
+
+#ifdef __cplusplus
+}
+#endif
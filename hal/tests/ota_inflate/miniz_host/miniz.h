@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for miniz, used by the OTA decompressor tests when the miniz submodule is not
+ * checked out (see ../makefile). It implements the subset of the tinfl/tdefl API that is used by
+ * the decompressor and the tests on top of zlib's raw deflate streams.
+ *
+ * Unlike tinfl, zlib keeps its own window, so the dictionary buffer passed to tinfl_decompress()
+ * only receives the output and a window that is too small for the stream is not detected.
+ */
+
+#ifndef MINIZ_HOST_H
+#define MINIZ_HOST_H
+
+#include <zlib.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS = -4,
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2
+} tinfl_status;
+
+enum {
+    TINFL_FLAG_PARSE_ZLIB_HEADER = 1,
+    TINFL_FLAG_HAS_MORE_INPUT = 2,
+    TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF = 4,
+    TINFL_FLAG_COMPUTE_ADLER32 = 8
+};
+
+enum {
+    TDEFL_HUFFMAN_ONLY = 0,
+    TDEFL_DEFAULT_MAX_PROBES = 128,
+    TDEFL_MAX_PROBES_MASK = 0xfff
+};
+
+typedef struct tinfl_decompressor_tag {
+    z_stream stream;
+    int state; /* 0: not initialized, 1: in progress, 2: done or failed */
+} tinfl_decompressor;
+
+/*
+ * The zlib state is released once the stream has been decompressed or has turned out to be invalid.
+ * The state of a stream that is abandoned midway is leaked, which is acceptable for the tests
+ */
+void tinfl_init(tinfl_decompressor* r);
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const uint8_t* pIn_buf_next, size_t* pIn_buf_size,
+        uint8_t* pOut_buf_start, uint8_t* pOut_buf_next, size_t* pOut_buf_size, uint32_t decomp_flags);
+
+void* tdefl_compress_mem_to_heap(const void* pSrc_buf, size_t src_buf_len, size_t* pOut_len, int flags);
+void mz_free(void* p);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* MINIZ_HOST_H */
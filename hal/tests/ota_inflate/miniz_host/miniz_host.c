@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "miniz.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void tinfl_init(tinfl_decompressor* r) {
+    memset(r, 0, sizeof(*r));
+}
+
+tinfl_status tinfl_decompress(tinfl_decompressor* r, const uint8_t* pIn_buf_next, size_t* pIn_buf_size,
+        uint8_t* pOut_buf_start, uint8_t* pOut_buf_next, size_t* pOut_buf_size, uint32_t decomp_flags) {
+    (void)pOut_buf_start;
+    if (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) {
+        return TINFL_STATUS_BAD_PARAM; /* Not supported */
+    }
+    if (r->state == 2) {
+        *pIn_buf_size = 0;
+        *pOut_buf_size = 0;
+        return TINFL_STATUS_FAILED;
+    }
+    if (r->state == 0) {
+        if (inflateInit2(&r->stream, -MAX_WBITS) != Z_OK) {
+            return TINFL_STATUS_FAILED;
+        }
+        r->state = 1;
+    }
+    z_stream* const s = &r->stream;
+    s->next_in = (Bytef*)pIn_buf_next;
+    s->avail_in = *pIn_buf_size;
+    s->next_out = pOut_buf_next;
+    s->avail_out = *pOut_buf_size;
+    const int ret = inflate(s, Z_NO_FLUSH);
+    *pIn_buf_size -= s->avail_in;
+    *pOut_buf_size -= s->avail_out;
+    if (ret == Z_STREAM_END) {
+        inflateEnd(s);
+        r->state = 2;
+        return TINFL_STATUS_DONE;
+    }
+    if (ret != Z_OK && ret != Z_BUF_ERROR) {
+        inflateEnd(s);
+        r->state = 2;
+        return TINFL_STATUS_FAILED;
+    }
+    if (!s->avail_out) {
+        return TINFL_STATUS_HAS_MORE_OUTPUT;
+    }
+    return (decomp_flags & TINFL_FLAG_HAS_MORE_INPUT) ? TINFL_STATUS_NEEDS_MORE_INPUT :
+            TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS;
+}
+
+void* tdefl_compress_mem_to_heap(const void* pSrc_buf, size_t src_buf_len, size_t* pOut_len, int flags) {
+    (void)flags;
+    z_stream s;
+    memset(&s, 0, sizeof(s));
+    if (deflateInit2(&s, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return NULL;
+    }
+    const size_t size = deflateBound(&s, src_buf_len);
+    void* const buf = malloc(size);
+    if (!buf) {
+        deflateEnd(&s);
+        return NULL;
+    }
+    s.next_in = (Bytef*)pSrc_buf;
+    s.avail_in = src_buf_len;
+    s.next_out = (Bytef*)buf;
+    s.avail_out = size;
+    const int ret = deflate(&s, Z_FINISH);
+    deflateEnd(&s);
+    if (ret != Z_STREAM_END) {
+        free(buf);
+        return NULL;
+    }
+    *pOut_len = size - s.avail_out;
+    return buf;
+}
+
+void mz_free(void* p) {
+    free(p);
+}
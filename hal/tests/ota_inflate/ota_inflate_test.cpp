@@ -0,0 +1,336 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tests of the OTA decompressor. The OTA region is a RAM image of the external flash with the
+ * usual NOR semantics: programming can only clear bits, so a sector that hasn't been erased before
+ * it's written to ends up corrupted.
+ */
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include "ota_inflate.h"
+#include "ota_flash_hal.h"
+#include "flash_mal.h"
+#include "exflash_hal.h"
+
+#include "miniz.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+
+using particle::OtaInflater;
+
+namespace {
+
+const uint32_t OTA_ADDRESS = 0x00200000;
+const uint32_t OTA_LENGTH = 256 * 1024;
+const size_t MODULE_SIZE = 48 * 1024;
+const size_t CHUNK_SIZE = 512;
+
+std::vector<uint8_t> g_flash;
+uint32_t g_otaLength = OTA_LENGTH; // Size of the OTA region reported to the decompressor
+
+// Generates module data that compresses reasonably well but not trivially
+std::vector<uint8_t> makeModule(size_t size) {
+    std::vector<uint8_t> data;
+    std::mt19937 rand(12345);
+    char buf[32];
+    while (data.size() < size) {
+        if (rand() % 8 == 0) {
+            for (int i = 0; i < 16; ++i) {
+                data.push_back(rand() & 0xff);
+            }
+        } else {
+            const int n = snprintf(buf, sizeof(buf), "module data %u;", (unsigned)(rand() % 100));
+            data.insert(data.end(), buf, buf + n);
+        }
+    }
+    data.resize(size);
+    return data;
+}
+
+// Prepends a compressed module header to the module data compressed with raw deflate
+std::vector<uint8_t> compressModule(const std::vector<uint8_t>& module, uint8_t windowBits = 15) {
+    size_t size = 0;
+    const auto data = (uint8_t*)tdefl_compress_mem_to_heap(module.data(), module.size(), &size,
+            TDEFL_DEFAULT_MAX_PROBES);
+    REQUIRE(data);
+    compressed_module_header header = {};
+    header.magic = COMPRESSED_MODULE_MAGIC;
+    header.size = sizeof(header);
+    header.method = COMPRESSED_MODULE_METHOD_DEFLATE;
+    header.window_bits = windowBits;
+    header.original_size = module.size();
+    std::vector<uint8_t> file((const uint8_t*)&header, (const uint8_t*)&header + sizeof(header));
+    file.insert(file.end(), data, data + size);
+    mz_free(data);
+    return file;
+}
+
+size_t chunkCount(const std::vector<uint8_t>& file) {
+    return (file.size() + CHUNK_SIZE - 1) / CHUNK_SIZE;
+}
+
+// Fills the OTA region with garbage and erases the file's range, like the system layer does
+void beginUpdate(OtaInflater* inflater, const std::vector<uint8_t>& file) {
+    g_flash.assign(OTA_LENGTH, 0x00);
+    const uint32_t size = (file.size() + sFLASH_PAGESIZE - 1) / sFLASH_PAGESIZE * sFLASH_PAGESIZE;
+    REQUIRE(FLASH_EraseMemory(FLASH_SERIAL, OTA_ADDRESS, size));
+    inflater->begin(OTA_ADDRESS, file.size());
+}
+
+// Writes the chunks of the file in the specified order. Returns the first error
+int sendChunks(OtaInflater* inflater, const std::vector<uint8_t>& file, const std::vector<size_t>& chunks) {
+    int result = 0;
+    for (size_t i: chunks) {
+        const size_t offs = i * CHUNK_SIZE;
+        const size_t size = std::min(CHUNK_SIZE, file.size() - offs);
+        const int r = inflater->update(file.data() + offs, OTA_ADDRESS + offs, size);
+        if (r < 0 && result == 0) {
+            result = r;
+        }
+    }
+    return result;
+}
+
+std::vector<size_t> chunksInOrder(const std::vector<uint8_t>& file) {
+    std::vector<size_t> chunks;
+    for (size_t i = 0; i < chunkCount(file); ++i) {
+        chunks.push_back(i);
+    }
+    return chunks;
+}
+
+bool flashContains(const std::vector<uint8_t>& data) {
+    return memcmp(g_flash.data(), data.data(), data.size()) == 0;
+}
+
+} // namespace
+
+// Stubs of the HAL functions used by the decompressor
+
+uint32_t HAL_OTA_FlashAddress() {
+    return OTA_ADDRESS;
+}
+
+uint32_t HAL_OTA_FlashLength() {
+    return g_otaLength;
+}
+
+bool FLASH_EraseMemory(flash_device_t flashDeviceID, uint32_t startAddress, uint32_t length) {
+    if (flashDeviceID != FLASH_SERIAL || startAddress < OTA_ADDRESS || startAddress % sFLASH_PAGESIZE != 0 ||
+            startAddress - OTA_ADDRESS + length > OTA_LENGTH) {
+        return false;
+    }
+    memset(g_flash.data() + startAddress - OTA_ADDRESS, 0xff, length);
+    return true;
+}
+
+int FLASH_Update(const uint8_t* pBuffer, uint32_t address, uint32_t bufferSize) {
+    if (address < OTA_ADDRESS || address - OTA_ADDRESS + bufferSize > OTA_LENGTH) {
+        return -1;
+    }
+    uint8_t* const p = g_flash.data() + address - OTA_ADDRESS;
+    for (uint32_t i = 0; i < bufferSize; ++i) {
+        p[i] &= pBuffer[i];
+    }
+    return 0;
+}
+
+int hal_exflash_read(uintptr_t addr, uint8_t* data_buf, size_t data_size) {
+    if (addr < OTA_ADDRESS || addr - OTA_ADDRESS + data_size > OTA_LENGTH) {
+        return -1;
+    }
+    memcpy(data_buf, g_flash.data() + addr - OTA_ADDRESS, data_size);
+    return 0;
+}
+
+TEST_CASE("OtaInflater") {
+    const auto module = makeModule(MODULE_SIZE);
+    const auto file = compressModule(module);
+    REQUIRE(file.size() < module.size() / 2);
+    REQUIRE(chunkCount(file) > 8);
+    OtaInflater inflater;
+    g_otaLength = OTA_LENGTH;
+
+    SECTION("decompresses the chunks received in order") {
+        beginUpdate(&inflater, file);
+        REQUIRE(sendChunks(&inflater, file, chunksInOrder(file)) == 0);
+        REQUIRE(!inflater.isPending());
+        REQUIRE(flashContains(module));
+        inflater.end();
+    }
+
+    SECTION("reports the sizes of a compressed file") {
+        beginUpdate(&inflater, file);
+        REQUIRE(inflater.compressedSize() == 0);
+        REQUIRE(inflater.uncompressedSize() == 0);
+        REQUIRE(sendChunks(&inflater, file, { 0 }) == 0);
+        REQUIRE(inflater.compressedSize() == file.size());
+        REQUIRE(inflater.uncompressedSize() == module.size());
+        REQUIRE(sendChunks(&inflater, file, chunksInOrder(file)) == 0);
+        inflater.end();
+        REQUIRE(inflater.compressedSize() == file.size());
+        REQUIRE(inflater.uncompressedSize() == module.size());
+        // The sizes are reset when a new update is started
+        beginUpdate(&inflater, module);
+        REQUIRE(sendChunks(&inflater, module, chunksInOrder(module)) == 0);
+        REQUIRE(inflater.compressedSize() == 0);
+        REQUIRE(inflater.uncompressedSize() == 0);
+        inflater.end();
+    }
+
+    SECTION("accepts window sizes from 9 to 15 bits") {
+        for (uint8_t bits = 8; bits <= 16; ++bits) {
+            const auto f = compressModule(module, bits);
+            beginUpdate(&inflater, f);
+            const int r = sendChunks(&inflater, f, { 0 });
+            if (bits >= 9 && bits <= 15) {
+                REQUIRE(r == 0);
+            } else {
+                REQUIRE(r < 0);
+            }
+            REQUIRE(inflater.isPending());
+            inflater.end();
+        }
+    }
+
+    SECTION("decompresses the staged chunks once a lost chunk is received") {
+        beginUpdate(&inflater, file);
+        auto chunks = chunksInOrder(file);
+        chunks.erase(chunks.begin() + 3);
+        chunks.erase(chunks.begin() + 5);
+        REQUIRE(sendChunks(&inflater, file, chunks) == 0);
+        REQUIRE(inflater.isPending());
+        // The lost chunks are resent at the end of the transfer, one of them twice
+        REQUIRE(sendChunks(&inflater, file, { 6, 3, 6 }) == 0);
+        REQUIRE(!inflater.isPending());
+        REQUIRE(flashContains(module));
+        inflater.end();
+    }
+
+    SECTION("decompresses reordered chunks") {
+        beginUpdate(&inflater, file);
+        auto chunks = chunksInOrder(file);
+        std::shuffle(chunks.begin() + 1, chunks.end(), std::mt19937(54321));
+        REQUIRE(sendChunks(&inflater, file, chunks) == 0);
+        REQUIRE(!inflater.isPending());
+        REQUIRE(flashContains(module));
+        inflater.end();
+    }
+
+    SECTION("decompresses the chunks received before the first one") {
+        beginUpdate(&inflater, file);
+        auto chunks = chunksInOrder(file);
+        std::reverse(chunks.begin(), chunks.end());
+        REQUIRE(sendChunks(&inflater, file, chunks) == 0);
+        REQUIRE(!inflater.isPending());
+        REQUIRE(flashContains(module));
+        inflater.end();
+    }
+
+    SECTION("reports an incomplete module if a chunk is never received") {
+        beginUpdate(&inflater, file);
+        auto chunks = chunksInOrder(file);
+        chunks.erase(chunks.begin() + 4);
+        REQUIRE(sendChunks(&inflater, file, chunks) == 0);
+        REQUIRE(inflater.isPending());
+        REQUIRE(!flashContains(module));
+        inflater.end();
+        REQUIRE(!inflater.isPending());
+    }
+
+    SECTION("fails if the compressed data is invalid") {
+        auto corrupt = file;
+        corrupt[sizeof(compressed_module_header)] = 0x07; // Final block of the reserved type
+        beginUpdate(&inflater, corrupt);
+        REQUIRE(sendChunks(&inflater, corrupt, chunksInOrder(corrupt)) < 0);
+        REQUIRE(inflater.isPending());
+        inflater.end();
+    }
+
+    SECTION("doesn't produce the original module from a corrupt chunk") {
+        auto corrupt = file;
+        memset(corrupt.data() + 4 * CHUNK_SIZE, 0xff, CHUNK_SIZE);
+        beginUpdate(&inflater, corrupt);
+        sendChunks(&inflater, corrupt, chunksInOrder(corrupt));
+        REQUIRE((inflater.isPending() || !flashContains(module)));
+        inflater.end();
+    }
+
+    SECTION("fails if the decompressed module is larger than specified in the header") {
+        auto corrupt = file;
+        ((compressed_module_header*)corrupt.data())->original_size -= 1;
+        beginUpdate(&inflater, corrupt);
+        REQUIRE(sendChunks(&inflater, corrupt, chunksInOrder(corrupt)) < 0);
+        REQUIRE(inflater.isPending());
+        inflater.end();
+    }
+
+    SECTION("fails if the chunks received before the first one can't be staged") {
+        beginUpdate(&inflater, file);
+        // The chunks are expected to be of the same size
+        REQUIRE(inflater.update(file.data() + 2 * CHUNK_SIZE, OTA_ADDRESS + 2 * CHUNK_SIZE, CHUNK_SIZE / 2) == 0);
+        REQUIRE(inflater.update(file.data() + 4 * CHUNK_SIZE, OTA_ADDRESS + 4 * CHUNK_SIZE, CHUNK_SIZE) == 0);
+        REQUIRE(inflater.update(file.data(), OTA_ADDRESS, CHUNK_SIZE) < 0);
+        REQUIRE(inflater.isPending());
+        inflater.end();
+    }
+
+    SECTION("drops a chunk that can't be staged until it's received in order") {
+        beginUpdate(&inflater, file);
+        REQUIRE(sendChunks(&inflater, file, { 0, 1 }) == 0);
+        // The chunks are expected to be of the same size
+        REQUIRE(inflater.update(file.data() + 3 * CHUNK_SIZE, OTA_ADDRESS + 3 * CHUNK_SIZE, CHUNK_SIZE / 2) < 0);
+        REQUIRE(inflater.isPending());
+        auto chunks = chunksInOrder(file);
+        chunks.erase(chunks.begin(), chunks.begin() + 2);
+        REQUIRE(sendChunks(&inflater, file, chunks) == 0);
+        REQUIRE(!inflater.isPending());
+        REQUIRE(flashContains(module));
+        inflater.end();
+    }
+
+    SECTION("drops the chunks received ahead if there's no space for the staging area") {
+        g_otaLength = MODULE_SIZE;
+        beginUpdate(&inflater, file);
+        auto chunks = chunksInOrder(file);
+        chunks.erase(chunks.begin() + 3);
+        REQUIRE(sendChunks(&inflater, file, chunks) < 0);
+        REQUIRE(inflater.isPending());
+        // The dropped chunks are requested again
+        chunks = chunksInOrder(file);
+        chunks.erase(chunks.begin(), chunks.begin() + 3);
+        REQUIRE(sendChunks(&inflater, file, chunks) == 0);
+        REQUIRE(!inflater.isPending());
+        REQUIRE(flashContains(module));
+        inflater.end();
+    }
+
+    SECTION("writes an uncompressed module as is") {
+        beginUpdate(&inflater, module);
+        REQUIRE(sendChunks(&inflater, module, chunksInOrder(module)) == 0);
+        REQUIRE(!inflater.isPending());
+        REQUIRE(flashContains(module));
+        inflater.end();
+    }
+}
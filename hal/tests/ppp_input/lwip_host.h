@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host stand-in for lwIP, used by the PPP input tests (see ../makefile). The headers in this
+ * directory declare the subset of the lwIP API that is used by ppp_input_batch.cpp, with the same
+ * names and semantics. Only the pool buffers are supported: the pool holds PBUF_POOL_SIZE buffers
+ * of PBUF_POOL_BUFSIZE bytes each, and an allocation fails when all of them are in use.
+ */
+
+#pragma once
+
+#include "lwip/pbuf.h"
+
+namespace particle { namespace test {
+
+// Returns the number of pool buffers that are in use
+int lwip_allocated_pbufs();
+
+// Returns the maximum number of pool buffers that have been in use at the same time
+int lwip_max_allocated_pbufs();
+
+// Resets the maximum number of pool buffers in use to the current number
+void lwip_reset_pbuf_stats();
+
+} } // particle::test
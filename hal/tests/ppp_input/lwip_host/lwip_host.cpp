@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lwip_host.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cassert>
+
+namespace {
+
+int g_pbufs = 0;
+int g_maxPbufs = 0;
+
+} // namespace
+
+namespace particle { namespace test {
+
+int lwip_allocated_pbufs() {
+    return g_pbufs;
+}
+
+int lwip_max_allocated_pbufs() {
+    return g_maxPbufs;
+}
+
+void lwip_reset_pbuf_stats() {
+    g_maxPbufs = g_pbufs;
+}
+
+} } // particle::test
+
+pbuf* pbuf_alloc(pbuf_layer l, u16_t length, pbuf_type type) {
+    // The PPP client only allocates raw pool buffers
+    assert(l == PBUF_RAW && type == PBUF_POOL);
+    assert(length <= PBUF_POOL_BUFSIZE);
+    if (g_pbufs == PBUF_POOL_SIZE) {
+        return nullptr;
+    }
+    const auto p = (pbuf*)malloc(sizeof(pbuf) + PBUF_POOL_BUFSIZE);
+    if (!p) {
+        return nullptr;
+    }
+    p->next = nullptr;
+    p->payload = p + 1;
+    p->tot_len = length;
+    p->len = length;
+    ++g_pbufs;
+    g_maxPbufs = std::max(g_maxPbufs, g_pbufs);
+    return p;
+}
+
+void pbuf_realloc(pbuf* p, u16_t size) {
+    // Buffers can only be shrunk
+    if (size < p->tot_len) {
+        p->tot_len = size;
+        p->len = size;
+    }
+}
+
+u8_t pbuf_free(pbuf* p) {
+    if (!p) {
+        return 0;
+    }
+    free(p);
+    --g_pbufs;
+    return 1;
+}
@@ -0,0 +1,306 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tests of the batching of the data received by the PPP client. The data is fed to the
+ * batch the same way as in Client::inputBatched(), and the batches that would be passed to the
+ * tcpip thread are collected instead.
+ */
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include "ppp_input_batch.h"
+#include "lwip_host.h"
+
+#include "system_error.h"
+
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+
+using namespace particle::net::ppp;
+using namespace particle::test;
+
+namespace {
+
+const uint8_t FLAG = 0x7e;
+
+typedef std::vector<uint8_t> Bytes;
+
+// Feeds the data to the batch and collects the batches that are ready to be passed on
+int feed(InputBatch* batch, const uint8_t* data, size_t size, std::vector<Bytes>* out) {
+    while (size > 0) {
+        const int n = batch->append(data, size);
+        if (n < 0) {
+            batch->discard();
+            return n;
+        }
+        data += n;
+        size -= n;
+        if (batch->ready()) {
+            pbuf* p = batch->take();
+            REQUIRE(p != nullptr);
+            REQUIRE(p->next == nullptr);
+            REQUIRE(p->tot_len == p->len);
+            const auto d = (const uint8_t*)p->payload;
+            out->push_back(Bytes(d, d + p->len));
+            pbuf_free(p);
+        }
+    }
+    return 0;
+}
+
+int feed(InputBatch* batch, const Bytes& data, std::vector<Bytes>* out) {
+    return feed(batch, data.data(), data.size(), out);
+}
+
+// Generates a HDLC frame with the given number of payload bytes, which don't contain the flag
+Bytes frame(size_t size) {
+    Bytes d;
+    d.push_back(FLAG);
+    for (size_t i = 0; i < size; ++i) {
+        d.push_back(rand() % (FLAG - 1) + 1);
+    }
+    d.push_back(FLAG);
+    return d;
+}
+
+Bytes join(const std::vector<Bytes>& bufs) {
+    Bytes d;
+    for (const auto& b: bufs) {
+        d.insert(d.end(), b.begin(), b.end());
+    }
+    return d;
+}
+
+bool hasFlag(const Bytes& d) {
+    return memchr(d.data(), FLAG, d.size()) != nullptr;
+}
+
+} // namespace
+
+TEST_CASE("InputBatch") {
+    REQUIRE(lwip_allocated_pbufs() == 0);
+
+    SECTION("batch size") {
+        SECTION("defaults to the size of a pool buffer") {
+            InputBatch b;
+            CHECK(b.maxSize() == PBUF_POOL_BUFSIZE);
+        }
+        SECTION("is limited to the size of a pool buffer") {
+            InputBatch b(PBUF_POOL_BUFSIZE * 2);
+            CHECK(b.maxSize() == PBUF_POOL_BUFSIZE);
+        }
+        SECTION("can be smaller than a pool buffer") {
+            InputBatch b(100);
+            CHECK(b.maxSize() == 100);
+        }
+    }
+
+    SECTION("data without a flag is accumulated until the batch is full") {
+        InputBatch b(100);
+        Bytes d(60, 0x01);
+        CHECK(b.append(d.data(), d.size()) == 60);
+        CHECK(b.size() == 60);
+        CHECK_FALSE(b.ready());
+        CHECK(lwip_allocated_pbufs() == 1);
+        // Only the data that fits is copied
+        CHECK(b.append(d.data(), d.size()) == 40);
+        CHECK(b.size() == 100);
+        CHECK(b.ready());
+        CHECK(b.append(d.data(), d.size()) == 0);
+        CHECK(lwip_allocated_pbufs() == 1);
+        pbuf* p = b.take();
+        REQUIRE(p != nullptr);
+        CHECK(p->len == 100);
+        CHECK(p->tot_len == 100);
+        CHECK(b.size() == 0);
+        CHECK_FALSE(b.ready());
+        pbuf_free(p);
+    }
+
+    SECTION("a batch with a flag is ready") {
+        InputBatch b(100);
+        Bytes d(10, 0x01);
+        SECTION("flag at the beginning of the data") {
+            d.front() = FLAG;
+            CHECK(b.append(d.data(), d.size()) == 10);
+            CHECK(b.ready());
+        }
+        SECTION("flag at the end of the data") {
+            d.back() = FLAG;
+            CHECK(b.append(d.data(), d.size()) == 10);
+            CHECK(b.ready());
+        }
+        SECTION("flag in the previously appended data") {
+            d.back() = FLAG;
+            CHECK(b.append(d.data(), d.size()) == 10);
+            d.back() = 0x01;
+            CHECK(b.append(d.data(), d.size()) == 10);
+            CHECK(b.ready());
+            CHECK(b.size() == 20);
+        }
+        SECTION("flag past the data that fits in the batch") {
+            Bytes d2(110, 0x01);
+            d2[100] = FLAG;
+            CHECK(b.append(d2.data(), 99) == 99);
+            CHECK_FALSE(b.ready());
+            // The flag isn't copied, the batch is ready because it's full
+            CHECK(b.append(d2.data() + 99, 11) == 1);
+            CHECK(b.ready());
+            CHECK(b.size() == 100);
+        }
+        b.discard();
+    }
+
+    SECTION("taking the data trims the buffer") {
+        InputBatch b;
+        const auto d = frame(10);
+        CHECK(b.append(d.data(), d.size()) == (int)d.size());
+        CHECK(b.ready());
+        pbuf* p = b.take();
+        REQUIRE(p != nullptr);
+        CHECK(p->len == d.size());
+        CHECK(Bytes((uint8_t*)p->payload, (uint8_t*)p->payload + p->len) == d);
+        pbuf_free(p);
+        // An empty batch doesn't hold a buffer
+        CHECK(b.take() == nullptr);
+        CHECK(b.append(d.data(), 0) == 0);
+        CHECK(b.take() == nullptr);
+        CHECK(lwip_allocated_pbufs() == 0);
+    }
+
+    SECTION("discarding the data frees the buffer") {
+        {
+            InputBatch b;
+            Bytes d(10, 0x01);
+            CHECK(b.append(d.data(), d.size()) == 10);
+            CHECK(lwip_allocated_pbufs() == 1);
+            b.discard();
+            CHECK(lwip_allocated_pbufs() == 0);
+            CHECK(b.size() == 0);
+            CHECK(b.take() == nullptr);
+            CHECK(b.append(d.data(), d.size()) == 10);
+            CHECK(lwip_allocated_pbufs() == 1);
+        }
+        // So does the destructor
+        CHECK(lwip_allocated_pbufs() == 0);
+    }
+
+    SECTION("fails if the pool is exhausted") {
+        std::vector<pbuf*> pool;
+        while (pbuf* p = pbuf_alloc(PBUF_RAW, PBUF_POOL_BUFSIZE, PBUF_POOL)) {
+            pool.push_back(p);
+        }
+        CHECK(pool.size() == PBUF_POOL_SIZE);
+        InputBatch b;
+        Bytes d(10, 0x01);
+        CHECK(b.append(d.data(), d.size()) == SYSTEM_ERROR_NO_MEMORY);
+        CHECK(b.size() == 0);
+        pbuf_free(pool.back());
+        pool.pop_back();
+        CHECK(b.append(d.data(), d.size()) == 10);
+        b.discard();
+        for (auto p: pool) {
+            pbuf_free(p);
+        }
+    }
+
+    CHECK(lwip_allocated_pbufs() == 0);
+}
+
+TEST_CASE("Feeding a stream of HDLC frames") {
+    srand(1);
+    lwip_reset_pbuf_stats();
+
+    SECTION("a frame split into chunks is passed on when a chunk with a flag is received") {
+        InputBatch b;
+        const auto f = frame(1000);
+        std::vector<Bytes> out;
+        for (size_t i = 0; i < f.size(); i += 31) {
+            CHECK(feed(&b, f.data() + i, std::min<size_t>(31, f.size() - i), &out) == 0);
+        }
+        // The chunk with the opening flag and the chunks up to the closing flag
+        REQUIRE(out.size() == 2);
+        CHECK(out[0] == Bytes(f.begin(), f.begin() + 31));
+        CHECK(join(out) == f);
+        CHECK(b.size() == 0);
+    }
+
+    SECTION("data following a flag in the same chunk stays in the batch") {
+        InputBatch b;
+        const auto f1 = frame(20);
+        const auto f2 = frame(20);
+        Bytes chunk(f1.begin() + 1, f1.end());
+        chunk.insert(chunk.end(), f2.begin(), f2.begin() + 5);
+        std::vector<Bytes> out;
+        CHECK(feed(&b, f1.data(), 1, &out) == 0);
+        CHECK(feed(&b, chunk, &out) == 0);
+        REQUIRE(out.size() == 2);
+        // The beginning of the next frame is passed on along with the end of the previous one
+        CHECK(out[1] == chunk);
+        CHECK(feed(&b, Bytes(f2.begin() + 5, f2.end()), &out) == 0);
+        REQUIRE(out.size() == 3);
+        CHECK(join(out) == join({ f1, f2 }));
+    }
+
+    SECTION("a frame larger than the batch is split") {
+        InputBatch b;
+        const auto f = frame(PBUF_POOL_BUFSIZE * 2);
+        std::vector<Bytes> out;
+        CHECK(feed(&b, Bytes(f.begin() + 1, f.end()), &out) == 0);
+        REQUIRE(out.size() == 3);
+        CHECK(out[0].size() == PBUF_POOL_BUFSIZE);
+        CHECK(out[1].size() == PBUF_POOL_BUFSIZE);
+        CHECK(out[2].back() == FLAG);
+        CHECK(join(out) == Bytes(f.begin() + 1, f.end()));
+    }
+
+    SECTION("the data is passed on in order and every batch is full or ends a frame") {
+        const size_t chunkSizes[] = { 1, 7, 31, 127, 1000, 4096 };
+        for (size_t chunkSize: chunkSizes) {
+            InputBatch b;
+            Bytes stream;
+            for (int i = 0; i < 50; ++i) {
+                const auto f = frame(rand() % 1500);
+                stream.insert(stream.end(), f.begin(), f.end());
+            }
+            std::vector<Bytes> out;
+            for (size_t i = 0; i < stream.size(); i += chunkSize) {
+                CHECK(feed(&b, stream.data() + i, std::min(chunkSize, stream.size() - i), &out) == 0);
+            }
+            // The stream ends with a flag
+            CHECK(b.size() == 0);
+            CHECK(join(out) == stream);
+            for (const auto& d: out) {
+                CHECK((d.size() == PBUF_POOL_BUFSIZE || hasFlag(d)));
+                CHECK(d.size() <= PBUF_POOL_BUFSIZE);
+            }
+            if (chunkSize <= 127) {
+                // Fewer batches than chunks
+                const size_t chunks = (stream.size() + chunkSize - 1) / chunkSize;
+                CHECK(out.size() < chunks);
+            }
+        }
+    }
+
+    // A batch never holds more than one pool buffer
+    CHECK(lwip_max_allocated_pbufs() <= 1);
+    CHECK(lwip_allocated_pbufs() == 0);
+}
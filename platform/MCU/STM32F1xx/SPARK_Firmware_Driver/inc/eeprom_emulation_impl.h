@@ -28,4 +28,10 @@ constexpr uintptr_t EEPROM_SectorBase2 = 0x8004400;
 constexpr size_t EEPROM_SectorSize1 = 1*1024;
 constexpr size_t EEPROM_SectorSize2 = 1*1024;
 
-using FlashEEPROM = EEPROMEmulation<InternalFlashStore, EEPROM_SectorBase1, EEPROM_SectorSize1, EEPROM_SectorBase2, EEPROM_SectorSize2>;
+// The RAM shadow takes FlashEEPROM::capacity() bytes of static RAM
+#ifndef EEPROM_EMULATION_RAM_SHADOW
+#define EEPROM_EMULATION_RAM_SHADOW 1
+#endif
+
+using FlashEEPROM = EEPROMEmulation<InternalFlashStore, EEPROM_SectorBase1, EEPROM_SectorSize1, EEPROM_SectorBase2, EEPROM_SectorSize2,
+        EEPROM_EMULATION_RAM_SHADOW>;
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "system_error.h"
+
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+/**
+ * AES-CCM (RFC 3610) that processes the data of a message incrementally, as it becomes available.
+ *
+ * `CipherT` provides the block cipher. Its `int encrypt(const uint8_t* in, uint8_t* out)` method
+ * encrypts a single 16-byte block with the key and returns a negative error code on failure.
+ * `NonceSize` and `TagSize` are the sizes of the nonce and the authentication tag in bytes.
+ */
+template<typename CipherT, size_t NonceSize, size_t TagSize>
+class AesCcm {
+public:
+    static_assert(NonceSize >= 7 && NonceSize <= 13, "Invalid nonce size");
+    static_assert(TagSize >= 4 && TagSize <= 16 && TagSize % 2 == 0, "Invalid tag size");
+
+    static const size_t BLOCK_SIZE = 16;
+
+    AesCcm() :
+            mac_(),
+            ctr_(),
+            stream_(),
+            tagMask_(),
+            offs_(0) {
+    }
+
+    ~AesCcm() {
+        memset(mac_, 0, sizeof(mac_));
+        memset(ctr_, 0, sizeof(ctr_));
+        memset(stream_, 0, sizeof(stream_));
+        memset(tagMask_, 0, sizeof(tagMask_));
+    }
+
+    /**
+     * Starts a message.
+     *
+     * @param nonce Nonce.
+     * @param aad Additional authenticated data.
+     * @param aadSize Size of the additional data.
+     * @param size Size of the data that will be encrypted or decrypted.
+     */
+    int start(const char* nonce, const char* aad, size_t aadSize, size_t size) {
+        if ((size >> (LENGTH_SIZE * 8)) || aadSize >= MAX_AAD_SIZE) {
+            return SYSTEM_ERROR_TOO_LARGE;
+        }
+        // First block of the CBC-MAC: flags, nonce and the message length
+        mac_[0] = (aadSize ? 0x40 : 0x00) | (((TagSize - 2) / 2) << 3) | (LENGTH_SIZE - 1);
+        memcpy(mac_ + 1, nonce, NonceSize);
+        for (size_t i = 0; i < LENGTH_SIZE; ++i) {
+            mac_[BLOCK_SIZE - 1 - i] = (uint8_t)(size >> (i * 8));
+        }
+        int r = cipher_.encrypt(mac_, mac_);
+        if (r < 0) {
+            return r;
+        }
+        // Additional data, prepended with its length and padded with zeros to a block boundary
+        if (aadSize > 0) {
+            size_t n = 0;
+            mac_[n++] ^= (uint8_t)(aadSize >> 8);
+            mac_[n++] ^= (uint8_t)aadSize;
+            for (size_t i = 0; i < aadSize; ++i) {
+                mac_[n++] ^= (uint8_t)aad[i];
+                if (n == BLOCK_SIZE || i == aadSize - 1) {
+                    r = cipher_.encrypt(mac_, mac_);
+                    if (r < 0) {
+                        return r;
+                    }
+                    n = 0;
+                }
+            }
+        }
+        // Counter block 0 is used to encrypt the authentication tag
+        ctr_[0] = LENGTH_SIZE - 1;
+        memcpy(ctr_ + 1, nonce, NonceSize);
+        memset(ctr_ + 1 + NonceSize, 0, LENGTH_SIZE);
+        r = cipher_.encrypt(ctr_, stream_);
+        if (r < 0) {
+            return r;
+        }
+        memcpy(tagMask_, stream_, TagSize);
+        offs_ = BLOCK_SIZE;
+        return 0;
+    }
+
+    /**
+     * Encrypts a fragment of the message data. The input and output buffers can be the same.
+     */
+    int encrypt(const char* in, char* out, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            int r = nextBlock();
+            if (r < 0) {
+                return r;
+            }
+            const uint8_t b = in[i];
+            out[i] = b ^ stream_[offs_];
+            r = update(b);
+            if (r < 0) {
+                return r;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Decrypts a fragment of the message data. The input and output buffers can be the same.
+     */
+    int decrypt(const char* in, char* out, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            int r = nextBlock();
+            if (r < 0) {
+                return r;
+            }
+            const uint8_t b = (uint8_t)in[i] ^ stream_[offs_];
+            out[i] = b;
+            r = update(b);
+            if (r < 0) {
+                return r;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Computes the authentication tag of the message.
+     */
+    int finish(char* tag) {
+        if (offs_ > 0 && offs_ < BLOCK_SIZE) {
+            // Process the last partial block, padded with zeros
+            const int r = cipher_.encrypt(mac_, mac_);
+            if (r < 0) {
+                return r;
+            }
+        }
+        for (size_t i = 0; i < TagSize; ++i) {
+            tag[i] = mac_[i] ^ tagMask_[i];
+        }
+        return 0;
+    }
+
+    /**
+     * Verifies the authentication tag of the message.
+     *
+     * Returns `SYSTEM_ERROR_BAD_DATA` if the tag doesn't match.
+     */
+    int verify(const char* tag) {
+        char t[TagSize] = {};
+        const int r = finish(t);
+        if (r < 0) {
+            return r;
+        }
+        uint8_t diff = 0;
+        for (size_t i = 0; i < TagSize; ++i) {
+            diff |= t[i] ^ tag[i];
+        }
+        if (diff != 0) {
+            return SYSTEM_ERROR_BAD_DATA;
+        }
+        return 0;
+    }
+
+    CipherT& cipher() {
+        return cipher_;
+    }
+
+private:
+    // Size of the length field of the counter blocks
+    static const size_t LENGTH_SIZE = 15 - NonceSize;
+    // Longer additional data would need a different length encoding
+    static const size_t MAX_AAD_SIZE = 0xff00;
+
+    CipherT cipher_;
+    uint8_t mac_[BLOCK_SIZE]; // CBC-MAC state
+    uint8_t ctr_[BLOCK_SIZE]; // Counter block
+    uint8_t stream_[BLOCK_SIZE]; // Key stream for the current block
+    uint8_t tagMask_[TagSize]; // Key stream for the authentication tag
+    size_t offs_; // Offset in the current block
+
+    // Generates the key stream for the next block if the current one has been used up
+    int nextBlock() {
+        if (offs_ < BLOCK_SIZE) {
+            return 0;
+        }
+        for (size_t i = BLOCK_SIZE; i > 1 + NonceSize && ++ctr_[i - 1] == 0; --i) {
+        }
+        const int r = cipher_.encrypt(ctr_, stream_);
+        if (r < 0) {
+            return r;
+        }
+        offs_ = 0;
+        return 0;
+    }
+
+    // Updates the CBC-MAC with a byte of plaintext data
+    int update(uint8_t b) {
+        mac_[offs_++] ^= b;
+        if (offs_ == BLOCK_SIZE) {
+            return cipher_.encrypt(mac_, mac_);
+        }
+        return 0;
+    }
+};
+
+} // particle
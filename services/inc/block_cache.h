@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+namespace particle {
+
+struct BlockCacheStats {
+    uint32_t hits; // Pages read from the cache
+    uint32_t misses; // Pages read from the store on demand
+    uint32_t readAhead; // Pages read from the store ahead of time
+    uint32_t readAheadHits; // Pages read ahead of time that were used
+    uint32_t bypassed; // Reads larger than the cache
+    uint32_t storeReads; // Read operations performed on the store
+};
+
+/**
+ * Read cache for a flash storage (see `FlashStorage` in flash_storage.h).
+ *
+ * The cache keeps `PageCount` pages of `PageSize` bytes each, evicted in LRU order. Pages missing
+ * from the cache are read from the store in a single operation per contiguous run. If a read
+ * continues where the previous one ended, up to `readAhead` following pages of the same sector are
+ * read along with the requested ones.
+ *
+ * Writes and erasures are passed through to the store. Cached copies of the affected pages are
+ * dropped rather than updated, so that data read back after a write, e.g. to verify it, comes from
+ * the flash itself.
+ *
+ * The cache is not thread-safe.
+ */
+template<typename Store, size_t PageSize, size_t PageCount, size_t SectorSize>
+class BlockCache {
+public:
+    static_assert(PageSize > 0 && PageCount > 0, "Invalid cache size");
+    static_assert(SectorSize % PageSize == 0, "Sector size is not a multiple of the page size");
+
+    explicit BlockCache(size_t readAhead = 0) :
+            pages_(),
+            stats_(),
+            nextOffs_(NO_OFFSET),
+            readAhead_(std::min(readAhead, PageCount - 1)),
+            tick_(0) {
+    }
+
+    int read(unsigned offset, void* data, unsigned size) {
+        if (size >= PageCount * PageSize) {
+            // Reading this much through the cache would only evict everything that is in it
+            ++stats_.bypassed;
+            ++stats_.storeReads;
+            nextOffs_ = offset + size;
+            return store_.read(offset, data, size);
+        }
+        const bool seq = (offset == nextOffs_);
+        nextOffs_ = offset + size;
+        const unsigned end = offset + size;
+        auto d = (uint8_t*)data;
+        while (offset < end) {
+            const unsigned pageAddr = offset - offset % PageSize;
+            const size_t pageOffs = offset - pageAddr;
+            int index = find(pageAddr);
+            size_t pageCount = 1;
+            if (index >= 0) {
+                auto& p = pages_[index];
+                ++stats_.hits;
+                if (p.readAhead) {
+                    ++stats_.readAheadHits;
+                    p.readAhead = false;
+                }
+                p.lastUse = ++tick_;
+            } else {
+                // The requested pages are read into adjacent slots and can be copied at once
+                const int r = fetch(pageAddr, end, seq, &index, &pageCount);
+                if (r != 0) {
+                    nextOffs_ = NO_OFFSET;
+                    return r;
+                }
+            }
+            const size_t n = std::min<size_t>(pageCount * PageSize - pageOffs, end - offset);
+            memcpy(d, data_ + index * PageSize + pageOffs, n);
+            d += n;
+            offset += n;
+        }
+        return 0;
+    }
+
+    int write(unsigned offset, const void* data, unsigned size) {
+        invalidate(offset, size);
+        return store_.write(offset, data, size);
+    }
+
+    int eraseSector(unsigned address) {
+        const unsigned sectorAddr = address - address % SectorSize;
+        invalidate(sectorAddr, SectorSize);
+        return store_.eraseSector(address);
+    }
+
+    /**
+     * Drop all cached pages.
+     */
+    void invalidate() {
+        for (auto& p: pages_) {
+            p.valid = false;
+        }
+        nextOffs_ = NO_OFFSET;
+    }
+
+    const BlockCacheStats& stats() const {
+        return stats_;
+    }
+
+    void resetStats() {
+        stats_ = BlockCacheStats();
+    }
+
+    Store& store() {
+        return store_;
+    }
+
+private:
+    struct Page {
+        unsigned addr;
+        uint32_t lastUse;
+        bool valid;
+        bool readAhead; // Read ahead of time and not used yet
+    };
+
+    static const unsigned NO_OFFSET = (unsigned)-1;
+
+    Store store_;
+    Page pages_[PageCount];
+    uint8_t data_[PageSize * PageCount] __attribute__((aligned(4)));
+    BlockCacheStats stats_;
+    unsigned nextOffs_; // End of the last read
+    size_t readAhead_;
+    uint32_t tick_;
+
+    int find(unsigned pageAddr) const {
+        for (size_t i = 0; i < PageCount; ++i) {
+            if (pages_[i].valid && pages_[i].addr == pageAddr) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // Reads the page at `pageAddr` and the missing pages that follow it, up to the end of the
+    // current read, or beyond it if the read is sequential
+    int fetch(unsigned pageAddr, unsigned end, bool seq, int* index, size_t* demandCount) {
+        const unsigned sectorEnd = pageAddr - pageAddr % SectorSize + SectorSize;
+        size_t count = 1;
+        while (count < PageCount && pageAddr + count * PageSize < end &&
+                pageAddr + count * PageSize < sectorEnd && find(pageAddr + count * PageSize) < 0) {
+            ++count;
+        }
+        const size_t demand = count;
+        if (seq) {
+            const size_t maxCount = std::min(PageCount, demand + readAhead_);
+            while (count < maxCount && pageAddr + count * PageSize < sectorEnd &&
+                    find(pageAddr + count * PageSize) < 0) {
+                ++count;
+            }
+        }
+        // The pages are read into adjacent slots. Pick the run of slots that were used least recently
+        size_t slot = 0;
+        uint32_t slotUse = 0;
+        for (size_t i = 0; i + count <= PageCount; ++i) {
+            uint32_t use = 0;
+            for (size_t j = i; j < i + count; ++j) {
+                if (pages_[j].valid) {
+                    use = std::max(use, pages_[j].lastUse);
+                }
+            }
+            if (i == 0 || use < slotUse) {
+                slot = i;
+                slotUse = use;
+                if (!use) {
+                    break;
+                }
+            }
+        }
+        for (size_t i = slot; i < slot + count; ++i) {
+            pages_[i].valid = false;
+        }
+        ++stats_.storeReads;
+        const int r = store_.read(pageAddr, data_ + slot * PageSize, count * PageSize);
+        if (r != 0) {
+            return r;
+        }
+        const uint32_t use = ++tick_;
+        for (size_t i = 0; i < count; ++i) {
+            auto& p = pages_[slot + i];
+            p.addr = pageAddr + i * PageSize;
+            p.lastUse = use;
+            p.valid = true;
+            p.readAhead = (i >= demand);
+        }
+        stats_.misses += demand;
+        stats_.readAhead += count - demand;
+        *index = slot;
+        *demandCount = demand;
+        return 0;
+    }
+
+    void invalidate(unsigned offset, size_t size) {
+        const unsigned end = offset + size;
+        for (auto& p: pages_) {
+            if (p.valid && p.addr < end && p.addr + PageSize > offset) {
+                p.valid = false;
+            }
+        }
+    }
+};
+
+} // particle
@@ -248,7 +248,7 @@ public:
     bool addHandler(const KeyT& key, CompletionHandler&& handler, system_tick_t timeout) {
         if (handler) {
             const system_tick_t t = ticks_ + timeout; // Handler expiration time
-            if (handlers_.append(Handler(key, std::move(handler), t))) {
+            if (handlers_.append(Handler(key, std::move(handler), t, timeout))) {
                 if (t < timeoutTicks_) {
                     timeoutTicks_ = t; // Update nearest expiration time
                 }
@@ -283,6 +283,23 @@ public:
         return handler;
     }
 
+    // Restarts the timeout of the handler with the specified key, e.g. when the operation it waits
+    // for has been postponed. Returns false if there's no such handler
+    bool restartTimeout(const KeyT& key) {
+        bool found = false;
+        timeoutTicks_ = MAX_TIMEOUT;
+        for (Handler& h: handlers_) {
+            if (h.key == key) {
+                h.ticks = ticks_ + h.timeout;
+                found = true;
+            }
+            if (h.ticks < timeoutTicks_) {
+                timeoutTicks_ = h.ticks;
+            }
+        }
+        return found;
+    }
+
     bool hasHandler(const KeyT& key) const {
         for (const Handler& h: handlers_) {
             if (h.key == key) {
@@ -363,11 +380,13 @@ private:
         KeyT key;
         CompletionHandler handler;
         system_tick_t ticks; // Expiration time
+        system_tick_t timeout;
 
-        Handler(KeyT key, CompletionHandler handler, system_tick_t ticks) :
+        Handler(KeyT key, CompletionHandler handler, system_tick_t ticks, system_tick_t timeout) :
                 key(std::move(key)),
                 handler(std::move(handler)),
-                ticks(ticks) {
+                ticks(ticks),
+                timeout(timeout) {
         }
     };
 
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Update the state of a CRC-32 (IEEE 802.3) computation.
+ *
+ * This is the raw shift register of the computation: the initial state is usually 0xffffffff, and
+ * the final CRC is the bitwise complement of the final state.
+ *
+ * @param state Current state.
+ * @param data Data.
+ * @param size Data size.
+ * @return Updated state.
+ */
+uint32_t crc32_update_state(uint32_t state, const void* data, size_t size);
+
+/**
+ * Compute the CRC-32 (IEEE 802.3) of a block of data.
+ *
+ * The computation can be split across several calls by passing the CRC returned by the previous
+ * call as the `crc` argument. For the first block, `crc` should be 0.
+ *
+ * @param crc CRC of the preceding data.
+ * @param data Data.
+ * @param size Data size.
+ * @return CRC of the preceding data followed by the given data.
+ */
+static inline uint32_t crc32_update(uint32_t crc, const void* data, size_t size) {
+    return ~crc32_update_state(~crc, data, size);
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
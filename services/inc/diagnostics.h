@@ -44,6 +44,8 @@
 #define DIAG_NAME_NETWORK_SIGNAL_QUALITY "net:sigqual"
 #define DIAG_NAME_NETWORK_SIGNAL_QUALITY_VALUE "net:sigqualv"
 #define DIAG_NAME_NETWORK_ACCESS_TECNHOLOGY "net:at"
+#define DIAG_NAME_NETWORK_DNS_CACHE_HITS "net:dnshit"
+#define DIAG_NAME_NETWORK_DNS_CACHE_MISSES "net:dnsmiss"
 #define DIAG_NAME_CLOUD_CONNECTION_STATUS "cloud:stat"
 #define DIAG_NAME_CLOUD_CONNECTION_ERROR_CODE "cloud:err"
 #define DIAG_NAME_CLOUD_DISCONNECTS "cloud:dconn"
@@ -52,6 +54,13 @@
 #define DIAG_NAME_CLOUD_REPEATED_MESSAGES "coap:resend"
 #define DIAG_NAME_CLOUD_UNACKNOWLEDGED_MESSAGES "coap:unack"
 #define DIAG_NAME_CLOUD_RATE_LIMITED_EVENTS "pub:limit"
+#define DIAG_NAME_CLOUD_QUEUED_EVENTS "pub:queue"
+#define DIAG_NAME_CLOUD_DELAYED_EVENTS "pub:delay"
+#define DIAG_NAME_CLOUD_PUBLISH_QUEUE_WAIT "pub:wait"
+#define DIAG_NAME_CLOUD_ROUND_TRIP_TIME "coap:rtt"
+#define DIAG_NAME_SYSTEM_APPLICATION_LOOP_DURATION "app:looptm"
+#define DIAG_NAME_CLOUD_STORED_EVENTS_SIZE "pub:store"
+#define DIAG_NAME_CLOUD_DROPPED_STORED_EVENTS "pub:storedrop"
 #define DIAG_NAME_SYSTEM_TOTAL_RAM "sys:tram"
 #define DIAG_NAME_SYSTEM_USED_RAM "sys:uram"
 
@@ -85,6 +94,8 @@ typedef enum diag_id {
     DIAG_ID_NETWORK_SIGNAL_QUALITY = 34, // net:sigqual
     DIAG_ID_NETWORK_SIGNAL_QUALITY_VALUE = 35, // net:sigqualv
     DIAG_ID_NETWORK_ACCESS_TECNHOLOGY = 36, // net:at
+    DIAG_ID_NETWORK_DNS_CACHE_HITS = 40, // net:dnshit
+    DIAG_ID_NETWORK_DNS_CACHE_MISSES = 41, // net:dnsmiss
     DIAG_ID_CLOUD_CONNECTION_STATUS = 10, // cloud:stat
     DIAG_ID_CLOUD_CONNECTION_ERROR_CODE = 13, // cloud:err
     DIAG_ID_CLOUD_DISCONNECTS = 14, // cloud:dconn
@@ -93,6 +104,13 @@ typedef enum diag_id {
     DIAG_ID_CLOUD_REPEATED_MESSAGES = 21, // coap:resend
     DIAG_ID_CLOUD_UNACKNOWLEDGED_MESSAGES = 22, // coap:unack
     DIAG_ID_CLOUD_RATE_LIMITED_EVENTS = 20, // pub:throttle
+    DIAG_ID_CLOUD_QUEUED_EVENTS = 38, // pub:queue
+    DIAG_ID_CLOUD_DELAYED_EVENTS = 39, // pub:delay
+    DIAG_ID_CLOUD_PUBLISH_QUEUE_WAIT = 42, // pub:wait (histogram, milliseconds)
+    DIAG_ID_CLOUD_ROUND_TRIP_TIME = 43, // coap:rtt (histogram, milliseconds)
+    DIAG_ID_SYSTEM_APPLICATION_LOOP_DURATION = 44, // app:looptm (histogram, microseconds)
+    DIAG_ID_CLOUD_STORED_EVENTS_SIZE = 45, // pub:store (bytes)
+    DIAG_ID_CLOUD_DROPPED_STORED_EVENTS = 46, // pub:storedrop
     DIAG_ID_SYSTEM_TOTAL_RAM = 25, // sys:tram
     DIAG_ID_SYSTEM_USED_RAM = 26, // sys:uram
     DIAG_ID_USER = 32768 // Base value for application-specific source IDs
@@ -100,9 +118,19 @@ typedef enum diag_id {
 
 // Data types
 typedef enum diag_type {
-    DIAG_TYPE_INT = 1 // 32-bit integer
+    DIAG_TYPE_INT = 1, // 32-bit integer
+    DIAG_TYPE_HISTOGRAM = 2, // Distribution of unsigned 32-bit samples (diag_histogram_data)
+    DIAG_TYPE_TIME_SERIES = 3 // Sums of 32-bit integers over fixed time windows (diag_time_series_data)
 } diag_type;
 
+// Number of histogram buckets. Bucket 0 counts zero samples, bucket 1 counts samples equal to 1.
+// Every next power of two range is split into two buckets: [2^n, 1.5 * 2^n) and [1.5 * 2^n, 2^(n+1)).
+// The last bucket also counts all samples that are greater than its upper bound
+#define DIAG_HISTOGRAM_BUCKET_COUNT 40
+
+// Maximum number of windows in a time series
+#define DIAG_TIME_SERIES_MAX_COUNT 32
+
 // Data source commands
 typedef enum diag_source_cmd {
     DIAG_SOURCE_CMD_GET = 1 // Get current data
@@ -129,6 +157,25 @@ struct diag_source {
     diag_source_cmd_callback callback; // Source callback
 };
 
+// Data of a DIAG_TYPE_HISTOGRAM source
+typedef struct diag_histogram_data {
+    uint32_t count; // Number of samples
+    uint32_t sum; // Sum of all samples (wraps around on overflow)
+    uint32_t min; // Minimum sample value (0 if there are no samples)
+    uint32_t max; // Maximum sample value
+    uint32_t buckets[DIAG_HISTOGRAM_BUCKET_COUNT]; // Sample counts
+} diag_histogram_data;
+
+// Data of a DIAG_TYPE_TIME_SERIES source. Only the first `count` elements of the `values` array are
+// returned by a source
+typedef struct diag_time_series_data {
+    uint32_t window; // Window duration in milliseconds
+    uint16_t count; // Number of windows
+    uint16_t reserved; // Reserved (should be set to 0)
+    int32_t values[DIAG_TIME_SERIES_MAX_COUNT]; // Values for each window, starting from the oldest one. The
+                                                // last value is for the current, incomplete window
+} diag_time_series_data;
+
 typedef struct diag_source_get_cmd_data {
     uint16_t size; // Size of this structure
     uint16_t reserved; // Reserved (should be set to 0)
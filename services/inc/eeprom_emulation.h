@@ -24,6 +24,7 @@
 #include <memory>
 #include <vector>
 #include <limits>
+#include <algorithm>
 
 /* EEPROM Emulation using Flash memory
  *
@@ -89,9 +90,19 @@
  * not call performPendingErase() before the next page swap, the
  * alternate page will be erased just before the page swap.
  *
+ * Optionally (RamShadow template argument), a RAM copy of the latest
+ * value of every byte and the address of the first empty record are
+ * built at init() and kept up to date on writes. Reads then don't need
+ * to walk the record log, and neither do writes unless a page swap is
+ * required. The shadow uses capacity() bytes of RAM.
+ *
+ * The changed bytes of a multi-byte write are programmed in batches of
+ * contiguous records instead of one record at a time. The record at the
+ * lowest address is programmed last so the write stays atomic.
+ *
  */
 
-template <typename Store, uintptr_t PageBase1, size_t PageSize1, uintptr_t PageBase2, size_t PageSize2>
+template <typename Store, uintptr_t PageBase1, size_t PageSize1, uintptr_t PageBase2, size_t PageSize2, bool RamShadow = false>
 class EEPROMEmulation
 {
 public:
@@ -167,6 +178,11 @@ public:
         }
     };
 
+    static constexpr size_t Capacity = SmallestPageSize / sizeof(Record) / 2;
+
+    // Maximum number of records programmed in one write operation
+    static const uint16_t WriteBatchSize = 16;
+
     /* Public API */
 
     // Initialize the EEPROM pages
@@ -179,6 +195,10 @@ public:
         {
             clear();
         }
+        else
+        {
+            loadShadow();
+        }
     }
 
     // Read the latest value of a byte of EEPROM in data or 0xFF if the
@@ -222,13 +242,14 @@ public:
         writePageStatus(LogicalPage::Page1, PageHeader::ACTIVE);
 
         updateActivePage();
+        loadShadow();
     }
 
     // Returns number of bytes that can be stored in EEPROM
     // The actual capacity is set to 50% of the records that fit in the smallest page
     static constexpr size_t capacity()
     {
-        return SmallestPageSize / sizeof(Record) / 2;
+        return Capacity;
     }
 
     // Check if the old page needs to be erased
@@ -334,11 +355,29 @@ public:
         return store.write(getPageBegin(page), &header, sizeof(header)) == 0;
     }
 
+    // Rebuild the RAM shadow from the active page
+    void loadShadow()
+    {
+        if(RamShadow)
+        {
+            shadowWritable = readRangeAndFindEmpty(getActivePage(), shadow, 0, Capacity, shadowEmptyAddress);
+        }
+    }
+
     // Iterate through a page to extract the latest value of each address
     void readRange(Index indexBegin, Data *data, uint16_t length)
     {
         std::memset(data, FLASH_ERASED, length);
 
+        if(RamShadow)
+        {
+            if(indexBegin < Capacity)
+            {
+                std::memcpy(data, &shadow[indexBegin], std::min<size_t>(length, Capacity - indexBegin));
+            }
+            return;
+        }
+
         Index indexEnd = indexBegin + length;
         forEachValidRecord(getActivePage(), [=](Address address, const Record &record)
         {
@@ -359,23 +398,38 @@ public:
             return;
         }
 
-        // Read existing values for range
-        std::unique_ptr<Data[]> existingData(new Data[length]);
-        // don't write anything if memory is full
-        if(!existingData)
+        std::unique_ptr<Data[]> existingBuffer;
+        const Data *existingData = nullptr;
+        Address writeAddressBegin;
+        bool success = false;
+
+        if(RamShadow)
         {
-            return;
+            existingData = &shadow[indexBegin];
+            writeAddressBegin = shadowEmptyAddress;
+            success = shadowWritable;
         }
+        else
+        {
+            // Read existing values for range
+            existingBuffer.reset(new Data[length]);
+            // don't write anything if memory is full
+            if(!existingBuffer)
+            {
+                return;
+            }
 
-        Address writeAddressBegin;
+            // Read the data and make sure there are no previous invalid
+            // records before starting to write
+            success = readRangeAndFindEmpty(getActivePage(),
+                    existingBuffer.get(), indexBegin, length, writeAddressBegin);
+            existingData = existingBuffer.get();
+        }
 
-        // Read the data and make sure there are no previous invalid
-        // records before starting to write
-        bool success = readRangeAndFindEmpty(getActivePage(),
-                existingData.get(), indexBegin, length, writeAddressBegin);
+        const uint16_t changedCount = countChanged(data, existingData, length);
 
         // Write records for all new values
-        success = success && writeRangeChanged(writeAddressBegin, indexBegin, data, existingData.get(), length);
+        success = success && writeRangeChanged(writeAddressBegin, indexBegin, data, existingData, length);
 
         // If any writes failed because the page was full or a marginal
         // write error occured, do a page swap then write all the
@@ -383,7 +437,27 @@ public:
         if(!success)
         {
             swapPagesAndWrite(indexBegin, data, length);
+            loadShadow();
+        }
+        else if(RamShadow)
+        {
+            shadowEmptyAddress += changedCount * sizeof(Record);
+            std::memcpy(&shadow[indexBegin], data, length);
+        }
+    }
+
+    // Number of values in the range that differ from the existing ones
+    static uint16_t countChanged(const Data *data, const Data *existingData, uint16_t length)
+    {
+        uint16_t changedCount = 0;
+        for(uint16_t i = 0; i < length; i++)
+        {
+            if(existingData[i] != data[i])
+            {
+                changedCount++;
+            }
         }
+        return changedCount;
     }
 
     // Read values and find the address where to write new records
@@ -425,50 +499,76 @@ public:
     }
 
 
-    // Write new records backwards in Flash. This ensures data
-    // consistency if writeRange is interrupted by a reset since reads
-    // stop at the first non-valid record.
+    // Write the records of the changed values so that the record at
+    // the lowest address is written last. This ensures data consistency
+    // if writeRange is interrupted by a reset since reads stop at the
+    // first non-valid record.
+    //
+    // The record of the first changed value is stored at the highest
+    // address. The other records are written in batches of contiguous
+    // records before the record at the lowest address.
     bool writeRangeChanged(Address writeAddressBegin, Index indexBegin, const uint8_t *data, const uint8_t *existingData, uint16_t length)
     {
         bool success = true;
 
-        // Count changed values
-        uint16_t changedCount = 0;
-        for(uint16_t i = 0; i < length && success; i++)
-        {
-            if(existingData[i] != data[i])
-            {
-                changedCount++;
-            }
-        }
+        uint16_t changedCount = countChanged(data, existingData, length);
 
-        // Write all changed values, backwards from the end
         if(changedCount > 0)
         {
-            Address writeAddress = writeAddressBegin + changedCount * sizeof(Record);
+            Address writeAddressEnd = writeAddressBegin + changedCount * sizeof(Record);
             Address endAddress = getPageEnd(getActivePage());
 
+            // No more room for the records
+            if(writeAddressEnd > endAddress)
+            {
+                return false;
+            }
+
             // There must be an empty record after the position where the
             // last record will be written to act as a separator for the
             // valid record detection algorithm to work well
-            if(writeAddress < endAddress)
+            if(writeAddressEnd < endAddress)
             {
                 Record separatorRecord;
-                store.read(writeAddress, &separatorRecord, sizeof(separatorRecord));
+                store.read(writeAddressEnd, &separatorRecord, sizeof(separatorRecord));
 
                 success = separatorRecord.empty();
             }
 
-            for(uint16_t i = 0; i < length && success; i++)
+            Record firstRecord;
+            Record batch[WriteBatchSize];
+            uint16_t batchCount = 0;
+            Address batchAddress = writeAddressBegin + sizeof(Record);
+            bool isFirst = true;
+
+            // Walk the values backwards to produce the records in
+            // ascending address order
+            for(uint16_t i = length; i-- > 0 && success;)
             {
-                if(existingData[i] != data[i])
+                if(existingData[i] == data[i])
                 {
-                    Index index = indexBegin + i;
-                    writeAddress -= sizeof(Record);
-                    success = success && writeRecord(
-                            writeAddress, endAddress, Record(index, data[i]));
+                    continue;
+                }
+
+                Record record(indexBegin + i, data[i]);
+                if(isFirst)
+                {
+                    firstRecord = record;
+                    isFirst = false;
+                    continue;
+                }
+
+                batch[batchCount++] = record;
+                if(batchCount == WriteBatchSize)
+                {
+                    success = writeRecords(batchAddress, endAddress, batch, batchCount);
+                    batchAddress += batchCount * sizeof(Record);
+                    batchCount = 0;
                 }
             }
+
+            success = success && (batchCount == 0 || writeRecords(batchAddress, endAddress, batch, batchCount));
+            success = success && writeRecord(writeAddressBegin, endAddress, firstRecord);
         }
 
         return success;
@@ -482,14 +582,23 @@ public:
             Address endAddress,
             const Record &record)
     {
-        // No more room for record
-        if(writeAddress + sizeof(Record) > endAddress)
+        return writeRecords(writeAddress, endAddress, &record, 1);
+    }
+
+    // Write contiguous records in one operation
+    bool writeRecords(Address writeAddress,
+            Address endAddress,
+            const Record *records,
+            uint16_t count)
+    {
+        // No more room for records
+        if(writeAddress + count * sizeof(Record) > endAddress)
         {
             return false;
         }
 
-        // Write record and return true when write is verified successfully
-        return (store.write(writeAddress, &record, sizeof(record)) >= 0);
+        // Write records and return true when write is verified successfully
+        return (store.write(writeAddress, records, count * sizeof(Record)) >= 0);
     }
 
     // Iterate through a page and yield each record, including valid
@@ -700,6 +809,23 @@ public:
     {
         bool success = true;
         Address endAddress = getPageEnd(destinationPage);
+
+        // The shadow holds the latest values of the source page, which
+        // is always the active page
+        if(RamShadow)
+        {
+            for(Index index = 0; index < Capacity && success; index++)
+            {
+                if(!(index >= exceptIndexBegin && index < exceptIndexEnd) &&
+                    shadow[index] != FLASH_ERASED)
+                {
+                    success = writeRecord(writeAddress, endAddress, Record(index, shadow[index]));
+                    writeAddress += sizeof(Record);
+                }
+            }
+            return success;
+        }
+
         forEachUniqueValidRecord(sourcePage, [&](Address address, const Record &record)
         {
             // Don't copy the records that are being replaced or records that are 0xFF
@@ -758,4 +884,11 @@ public:
 protected:
     LogicalPage activePage;
     LogicalPage alternatePage;
+
+    // Latest value of each byte, only used if RamShadow is true
+    Data shadow[RamShadow ? Capacity : 1];
+    // Address of the first empty record in the active page
+    Address shadowEmptyAddress;
+    // False if the active page contains invalid records
+    bool shadowWritable;
 };
@@ -22,6 +22,9 @@
 #if (defined(HAL_PLATFORM_FILESYSTEM) && HAL_PLATFORM_FILESYSTEM == 1)
 
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
 #include "service_debug.h"
 #include "system_error.h"
 #include "filesystem.h"
@@ -225,6 +228,490 @@ private:
     const char* path_;
 };
 
+/**
+ * Implements a queue on top of a set of fixed-size segment files.
+ *
+ * Entries are appended to the tail segment and read from the head segment. The position of
+ * the front entry is kept in a small cursor file, so popping an entry never rewrites the segment
+ * containing it, and a segment is deleted as soon as all its entries have been popped. The files
+ * are kept open between operations, which makes the cost of pushBack() and popFront() independent
+ * of the queue depth and history.
+ *
+ * The files are stored in the directory specified by the path. The entries have the same format
+ * as the entries of FileQueue.
+ *
+ * Each open file has a cache allocated by littlefs on the heap (FILESYSTEM_PROG_SIZE bytes), so a
+ * queue in use holds about 768 bytes of heap for its read, write and cursor files. close() releases
+ * them until the next operation.
+ */
+class SegmentedFileQueue {
+
+public:
+
+    typedef FileQueue::QueueEntry QueueEntry;
+
+    // Default segment size in bytes. A segment is closed once its size reaches this value, so it
+    // can be exceeded by the size of the last entry
+    static const size_t DEFAULT_SEGMENT_SIZE = 4096;
+
+    explicit SegmentedFileQueue(const char* path, size_t segmentSize = DEFAULT_SEGMENT_SIZE) :
+            path_(path),
+            segmentSize_(segmentSize) {
+    }
+
+    ~SegmentedFileQueue() {
+        if (fs_) {
+            close();
+        }
+    }
+
+    /**
+     * Add an entry to the back of the queue.
+     */
+    int pushBack(const void* item, uint16_t size) {
+        FsLock lk(fs());
+        int ret = load();
+        if (ret < 0) {
+            return ret;
+        }
+        bool newSegment = false;
+        if (tailSize_ >= segmentSize_) {
+            closeFile(&writeFile_, &writeOpen_);
+            ++tailSegment_;
+            tailSize_ = 0;
+            newSegment = true;
+        }
+        if (!writeOpen_) {
+            ret = openSegment(&writeFile_, tailSegment_, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND);
+            if (ret < 0) {
+                reset();
+                return ret;
+            }
+            writeOpen_ = true;
+        }
+        QueueEntry entry = { .size = uint16_t(size + sizeof(QueueEntry)), .flags = QueueEntry::ACTIVE };
+        ret = fileWrite(&writeFile_, &entry, sizeof(entry));
+        if (ret >= 0) {
+            ret = fileWrite(&writeFile_, item, size);
+        }
+        if (ret >= 0) {
+            // The entry becomes visible atomically when the file is synced
+            ret = lfs_file_sync(lfs(), &writeFile_);
+        }
+        if (ret >= 0 && newSegment) {
+            ret = saveCursor();
+        }
+        if (ret < 0) {
+            LOG(ERROR, "Unable to add item to file queue %s, size %d, error %d", path_, size, ret);
+            // Discard the cached state, it will be reloaded from the filesystem
+            reset();
+            return ret;
+        }
+        tailSize_ += entry.size;
+        size_ += entry.size;
+        if (headSegment_ == tailSegment_) {
+            // The read handle doesn't see the appended data, and its blocks may have been
+            // released by the write
+            closeFile(&readFile_, &readOpen_);
+        }
+        return 0;
+    }
+
+    /**
+     * Retrieve the front queue entry.
+     *
+     * @param entry The entry to populate
+     * @param buffer The buffer to fill with the contents of the entry.
+     * @param length The length of the buffer.
+     * @return SYSTEM_ERROR_NOT_FOUND when the queue is empty.
+     */
+    int front(QueueEntry& entry, void* buffer, uint16_t length) {
+        FsLock lk(fs());
+        int ret = readFront(entry);
+        if (ret < 0) {
+            return ret;
+        }
+        const int remaining = entry.size - sizeof(entry);
+        if (remaining > length) {
+            LOG(ERROR, "Buffer length %d is too small. Need at least %d", length, remaining);
+            return LFS_ERR_INVAL;
+        }
+        ret = lfs_file_read(lfs(), &readFile_, buffer, remaining);
+        if (ret != remaining) {
+            LOG(ERROR, "Incomplete queue record. Expected length %d but read %d", remaining, ret);
+            clearLocked();
+            return LFS_ERR_IO;
+        }
+        return 0;
+    }
+
+    /**
+     * Remove the front entry of the queue.
+     */
+    int popFront() {
+        FsLock lk(fs());
+        QueueEntry entry;
+        int ret = readFront(entry);
+        if (ret < 0) {
+            return ret;
+        }
+        headOffset_ += entry.size;
+        size_ -= entry.size;
+        const uint32_t segment = headSegment_;
+        const bool drained = (headOffset_ >= headEnd());
+        if (drained) {
+            closeFile(&readFile_, &readOpen_);
+            if (headSegment_ == tailSegment_) {
+                closeFile(&writeFile_, &writeOpen_);
+                ++tailSegment_;
+                tailSize_ = 0;
+            }
+            ++headSegment_;
+            headOffset_ = 0;
+        }
+        ret = saveCursor();
+        if (ret < 0) {
+            reset();
+            return ret;
+        }
+        if (drained) {
+            // If this fails, the segment is removed when the queue is loaded next time
+            ret = removeSegment(segment);
+            if (ret < 0) {
+                LOG(WARN, "Unable to remove segment %u of file queue %s: %d", (unsigned)segment, path_, ret);
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * Remove all entries from the queue.
+     */
+    int clear() {
+        FsLock lk(fs());
+        return clearLocked();
+    }
+
+    /**
+     * Get the total size of the queued entries, including the entry headers.
+     *
+     * @return Size in bytes or a negative error code.
+     */
+    int size() {
+        FsLock lk(fs());
+        const int ret = load();
+        if (ret < 0) {
+            return ret;
+        }
+        return size_;
+    }
+
+    /**
+     * Check if the queue directory exists. Unlike the other methods, this doesn't create it.
+     */
+    bool exists() {
+        FsLock lk(fs());
+        if (loaded_) {
+            return true;
+        }
+        SPARK_ASSERT(!filesystem_mount(fs_));
+        lfs_info info = {};
+        return lfs_stat(lfs(), path_, &info) == 0;
+    }
+
+    /**
+     * Close the open files. They are reopened by the next operation.
+     */
+    void close() {
+        FsLock lk(fs());
+        reset();
+    }
+
+private:
+
+    struct __attribute__((__packed__)) Cursor {
+        uint32_t headSegment;
+        uint32_t headOffset;
+        uint32_t tailSegment;
+    };
+
+    // Maximum length of a file path
+    static const size_t MAX_PATH_LENGTH = 63;
+
+    // Name of the cursor file. The segment files are named by their decimal numbers
+    static const char* cursorFileName() {
+        return "head";
+    }
+
+    int load() {
+        if (loaded_) {
+            return 0;
+        }
+        SPARK_ASSERT(!filesystem_mount(fs_));
+        int ret = lfs_mkdir(lfs(), path_);
+        if (ret < 0 && ret != LFS_ERR_EXIST) {
+            return ret;
+        }
+        char path[MAX_PATH_LENGTH + 1];
+        cursorPath(path, sizeof(path));
+        ret = lfs_file_open(lfs(), &cursorFile_, path, LFS_O_RDWR | LFS_O_CREAT);
+        if (ret < 0) {
+            return ret;
+        }
+        cursorOpen_ = true;
+        Cursor cursor = {};
+        ret = lfs_file_read(lfs(), &cursorFile_, &cursor, sizeof(cursor));
+        if (ret < 0) {
+            reset();
+            return ret;
+        }
+        if (ret != sizeof(cursor) || cursor.headSegment > cursor.tailSegment) {
+            // A new queue or a queue that was being cleared
+            if (ret != 0) {
+                LOG(WARN, "Invalid cursor of file queue %s, clearing the queue", path_);
+            }
+            ret = removeSegments();
+            if (ret < 0) {
+                reset();
+                return ret;
+            }
+            cursor = {};
+        }
+        headSegment_ = cursor.headSegment;
+        headOffset_ = cursor.headOffset;
+        tailSegment_ = cursor.tailSegment;
+        tailSize_ = 0;
+        if (cursor.headSegment == 0 && cursor.headOffset == 0 && cursor.tailSegment == 0) {
+            ret = saveCursor();
+            if (ret < 0) {
+                reset();
+                return ret;
+            }
+        }
+        // Remove the segment that was drained but not removed before a reset
+        if (headSegment_ > 0) {
+            ret = removeSegment(headSegment_ - 1);
+            if (ret < 0 && ret != LFS_ERR_NOENT) {
+                reset();
+                return ret;
+            }
+        }
+        // Find the tail segment. The cursor can lag behind by a segment that was started right
+        // before a reset
+        for (;;) {
+            lfs_info info = {};
+            segmentPath(path, sizeof(path), tailSegment_);
+            ret = lfs_stat(lfs(), path, &info);
+            if (ret == 0) {
+                tailSize_ = info.size;
+            } else if (ret != LFS_ERR_NOENT) {
+                reset();
+                return ret;
+            }
+            segmentPath(path, sizeof(path), tailSegment_ + 1);
+            ret = lfs_stat(lfs(), path, &info);
+            if (ret == LFS_ERR_NOENT) {
+                break;
+            } else if (ret < 0) {
+                reset();
+                return ret;
+            }
+            ++tailSegment_;
+        }
+        size_ = tailSize_;
+        for (uint32_t segment = headSegment_; segment != tailSegment_; ++segment) {
+            lfs_info info = {};
+            segmentPath(path, sizeof(path), segment);
+            ret = lfs_stat(lfs(), path, &info);
+            if (ret < 0) {
+                reset();
+                return ret;
+            }
+            size_ += info.size;
+        }
+        size_ -= std::min(headOffset_, size_);
+        loaded_ = true;
+        return 0;
+    }
+
+    /**
+     * Read the header of the front entry and leave the read handle positioned at the entry data.
+     */
+    int readFront(QueueEntry& entry) {
+        int ret = load();
+        if (ret < 0) {
+            return ret;
+        }
+        if (headSegment_ == tailSegment_ && headOffset_ >= tailSize_) {
+            return SYSTEM_ERROR_NOT_FOUND;
+        }
+        if (!readOpen_) {
+            ret = openSegment(&readFile_, headSegment_, LFS_O_RDONLY);
+            if (ret < 0) {
+                LOG(ERROR, "Unable to open segment %u of file queue %s: %d", (unsigned)headSegment_, path_, ret);
+                clearLocked();
+                return ret;
+            }
+            readOpen_ = true;
+            headSize_ = lfs_file_size(lfs(), &readFile_);
+        }
+        ret = lfs_file_seek(lfs(), &readFile_, headOffset_, LFS_SEEK_SET);
+        if (ret >= 0) {
+            ret = lfs_file_read(lfs(), &readFile_, &entry, sizeof(entry));
+            if (ret == sizeof(entry) && entry.size >= sizeof(entry) && headOffset_ + entry.size <= headEnd()) {
+                return 0;
+            }
+            LOG(ERROR, "Invalid entry in file queue %s at %u:%u", path_, (unsigned)headSegment_, (unsigned)headOffset_);
+            ret = LFS_ERR_CORRUPT;
+        }
+        clearLocked();
+        return ret;
+    }
+
+    int saveCursor() {
+        const Cursor cursor = { .headSegment = headSegment_, .headOffset = headOffset_, .tailSegment = tailSegment_ };
+        int ret = lfs_file_seek(lfs(), &cursorFile_, 0, LFS_SEEK_SET);
+        if (ret >= 0) {
+            ret = fileWrite(&cursorFile_, &cursor, sizeof(cursor));
+        }
+        if (ret >= 0) {
+            ret = lfs_file_sync(lfs(), &cursorFile_);
+        }
+        return ret;
+    }
+
+    int clearLocked() {
+        reset();
+        SPARK_ASSERT(!filesystem_mount(fs_));
+        // Remove the cursor first so that an interrupted clear is completed on the next load
+        char path[MAX_PATH_LENGTH + 1];
+        cursorPath(path, sizeof(path));
+        int ret = lfs_remove(lfs(), path);
+        if (ret < 0 && ret != LFS_ERR_NOENT) {
+            return ret;
+        }
+        ret = removeSegments();
+        if (ret < 0) {
+            return ret;
+        }
+        ret = lfs_remove(lfs(), path_);
+        return (ret == LFS_ERR_NOENT) ? 0 : ret;
+    }
+
+    /**
+     * Remove all files in the queue directory except the cursor file.
+     */
+    int removeSegments() {
+        char path[MAX_PATH_LENGTH + 1];
+        for (;;) {
+            // Removing a file invalidates the directory iterator
+            lfs_dir_t dir = {};
+            int ret = lfs_dir_open(lfs(), &dir, path_);
+            if (ret < 0) {
+                return (ret == LFS_ERR_NOENT) ? 0 : ret;
+            }
+            lfs_info info = {};
+            while ((ret = lfs_dir_read(lfs(), &dir, &info)) > 0) {
+                if (info.type == LFS_TYPE_REG && strcmp(info.name, cursorFileName()) != 0) {
+                    break;
+                }
+            }
+            lfs_dir_close(lfs(), &dir);
+            if (ret <= 0) {
+                return ret;
+            }
+            filePath(path, sizeof(path), info.name);
+            ret = lfs_remove(lfs(), path);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    }
+
+    int removeSegment(uint32_t segment) {
+        char path[MAX_PATH_LENGTH + 1];
+        segmentPath(path, sizeof(path), segment);
+        return lfs_remove(lfs(), path);
+    }
+
+    int openSegment(lfs_file_t* file, uint32_t segment, int flags) {
+        char path[MAX_PATH_LENGTH + 1];
+        segmentPath(path, sizeof(path), segment);
+        return lfs_file_open(lfs(), file, path, flags);
+    }
+
+    void closeFile(lfs_file_t* file, bool* open) {
+        if (*open) {
+            lfs_file_close(lfs(), file);
+            *open = false;
+        }
+    }
+
+    void reset() {
+        closeFile(&readFile_, &readOpen_);
+        closeFile(&writeFile_, &writeOpen_);
+        closeFile(&cursorFile_, &cursorOpen_);
+        loaded_ = false;
+    }
+
+    // Size of the head segment
+    uint32_t headEnd() const {
+        return (headSegment_ == tailSegment_) ? tailSize_ : headSize_;
+    }
+
+    void filePath(char* buf, size_t size, const char* name) const {
+        const int n = snprintf(buf, size, "%s/%s", path_, name);
+        SPARK_ASSERT(n > 0 && (size_t)n < size);
+    }
+
+    void segmentPath(char* buf, size_t size, uint32_t segment) const {
+        char name[11];
+        snprintf(name, sizeof(name), "%u", (unsigned)segment);
+        filePath(buf, size, name);
+    }
+
+    void cursorPath(char* buf, size_t size) const {
+        filePath(buf, size, cursorFileName());
+    }
+
+    int fileWrite(lfs_file_t* file, const void* data, size_t size) {
+        const int ret = lfs_file_write(lfs(), file, data, size);
+        if (ret < 0) {
+            return ret;
+        }
+        return (ret == (int)size) ? 0 : LFS_ERR_IO;
+    }
+
+    filesystem_t* fs() {
+        if (!fs_) {
+            fs_ = filesystem_get_instance(nullptr);
+            SPARK_ASSERT(fs_);
+        }
+        return fs_;
+    }
+
+    lfs_t* lfs() {
+        return &fs_->instance;
+    }
+
+    filesystem_t* fs_ = nullptr;
+    const char* path_;
+    size_t segmentSize_;
+    lfs_file_t readFile_ = {};
+    lfs_file_t writeFile_ = {};
+    lfs_file_t cursorFile_ = {};
+    uint32_t headSegment_ = 0;
+    uint32_t headOffset_ = 0;
+    uint32_t headSize_ = 0;
+    uint32_t tailSegment_ = 0;
+    uint32_t tailSize_ = 0;
+    uint32_t size_ = 0;
+    bool readOpen_ = false;
+    bool writeOpen_ = false;
+    bool cursorOpen_ = false;
+    bool loaded_ = false;
+};
+
 } // fs
 } // particle
 
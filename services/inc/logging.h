@@ -183,6 +183,14 @@ typedef struct LogAttributes {
     char end[0]; // Keep this field at the end of the structure
 } LogAttributes;
 
+// Cached logging level of a category, stored at the call site of a logging macro
+typedef struct LogCategoryCache {
+    uintptr_t key; // Category pointer plus one, or 0 if the cached level is not valid
+    int level; // Minimum enabled level for the category
+    struct LogCategoryCache *next; // Next registered cache
+    int registered;
+} LogCategoryCache;
+
 // Callback for message-based logging (used by log_message())
 typedef void (*log_message_callback_type)(const char *msg, int level, const char *category, const LogAttributes *attr,
         void *reserved);
@@ -222,6 +230,18 @@ const char* log_level_name(int level, void *reserved);
 void log_set_callbacks(log_message_callback_type log_msg, log_write_callback_type log_write,
         log_enabled_callback_type log_enabled, void *reserved);
 
+// Returns minimum logging level enabled for specified category and stores it in the cache. Cached levels
+// are invalidated when the logger callbacks are set
+int log_category_level(const char *category, LogCategoryCache *cache, void *reserved);
+
+// Enables or disables asynchronous logging. In asynchronous mode, messages are formatted by the
+// calling thread into a lock-free queue and passed to the logger callbacks by a low-priority thread.
+// Messages that don't fit in the queue are dropped
+int log_set_async(int enabled, void *reserved);
+
+// Returns number of log messages dropped in asynchronous mode
+uint32_t log_dropped_count(void *reserved);
+
 extern void HAL_Delay_Microseconds(uint32_t delay);
 
 #ifdef __cplusplus
@@ -327,6 +347,14 @@ static const char* const _log_category = NULL;
         _name.flags = 0; \
         _LOG_ATTR_SET_SOURCE_INFO(_name)
 
+// Checks the logging level against the level of the category cached at the call site. Disabled
+// messages are discarded without calling into the logging backend
+#define _LOG_CATEGORY_ENABLED(_level, _category) \
+        static LogCategoryCache _cache; \
+        const char* const _cat = _category; \
+        if (LOG_LEVEL_##_level >= (_cache.key == (uintptr_t)_cat + 1 ? _cache.level : \
+                log_category_level(_cat, &_cache, NULL)))
+
 // Generator macro for PP_FOR_EACH()
 #define _LOG_ATTR_SET(_attr, _expr) \
         (_attr)._expr; /* attr.file = "logging.h"; */ \
@@ -336,46 +364,58 @@ static const char* const _log_category = NULL;
 #define LOG_C(_level, _category, _fmt, ...) \
         do { \
             if (LOG_LEVEL_##_level >= LOG_COMPILE_TIME_LEVEL) { \
-                _LOG_ATTR_INIT(_attr); \
-                log_message(LOG_LEVEL_##_level, _category, &_attr, NULL, _fmt, ##__VA_ARGS__); \
+                _LOG_CATEGORY_ENABLED(_level, _category) { \
+                    _LOG_ATTR_INIT(_attr); \
+                    log_message(LOG_LEVEL_##_level, _cat, &_attr, NULL, _fmt, ##__VA_ARGS__); \
+                } \
             } \
         } while (0)
 
 #define LOG_ATTR_C(_level, _category, _attrs, _fmt, ...) \
         do { \
             if (LOG_LEVEL_##_level >= LOG_COMPILE_TIME_LEVEL) { \
-                _LOG_ATTR_INIT(_attr); \
-                PP_FOR_EACH(_LOG_ATTR_SET, _attr, PP_ARGS(_attrs)); \
-                log_message(LOG_LEVEL_##_level, _category, &_attr, NULL, _fmt, ##__VA_ARGS__); \
+                _LOG_CATEGORY_ENABLED(_level, _category) { \
+                    _LOG_ATTR_INIT(_attr); \
+                    PP_FOR_EACH(_LOG_ATTR_SET, _attr, PP_ARGS(_attrs)); \
+                    log_message(LOG_LEVEL_##_level, _cat, &_attr, NULL, _fmt, ##__VA_ARGS__); \
+                } \
             } \
         } while (0)
 
 #define LOG_WRITE_C(_level, _category, _data, _size) \
         do { \
             if (LOG_LEVEL_##_level >= LOG_COMPILE_TIME_LEVEL) { \
-                log_write(LOG_LEVEL_##_level, _category, _data, _size, NULL); \
+                _LOG_CATEGORY_ENABLED(_level, _category) { \
+                    log_write(LOG_LEVEL_##_level, _cat, _data, _size, NULL); \
+                } \
             } \
         } while (0)
 
 #define LOG_PRINT_C(_level, _category, _str) \
         do { \
             if (LOG_LEVEL_##_level >= LOG_COMPILE_TIME_LEVEL) { \
-                const char* const _s = _str; \
-                log_write(LOG_LEVEL_##_level, _category, _s, strlen(_s), NULL); \
+                _LOG_CATEGORY_ENABLED(_level, _category) { \
+                    const char* const _s = _str; \
+                    log_write(LOG_LEVEL_##_level, _cat, _s, strlen(_s), NULL); \
+                } \
             } \
         } while (0)
 
 #define LOG_PRINTF_C(_level, _category, _fmt, ...) \
         do { \
             if (LOG_LEVEL_##_level >= LOG_COMPILE_TIME_LEVEL) { \
-                log_printf(LOG_LEVEL_##_level, _category, NULL, _fmt, ##__VA_ARGS__); \
+                _LOG_CATEGORY_ENABLED(_level, _category) { \
+                    log_printf(LOG_LEVEL_##_level, _cat, NULL, _fmt, ##__VA_ARGS__); \
+                } \
             } \
         } while (0)
 
 #define LOG_DUMP_C(_level, _category, _data, _size) \
         do { \
             if (LOG_LEVEL_##_level >= LOG_COMPILE_TIME_LEVEL) { \
-                log_dump(LOG_LEVEL_##_level, _category, _data, _size, 0, NULL); \
+                _LOG_CATEGORY_ENABLED(_level, _category) { \
+                    log_dump(LOG_LEVEL_##_level, _cat, _data, _size, 0, NULL); \
+                } \
             } \
         } while (0)
 
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <new>
+#include <cstddef>
+
+namespace particle {
+
+namespace services {
+
+/**
+ * Bounded lock-free queue for multiple producers and a single consumer.
+ *
+ * Every slot carries a sequence number that tells whether the slot is free for the producer
+ * that claimed its position or holds an item ready for the consumer. Producers claim positions
+ * with a CAS on the head index and never wait for each other: an item can be filled in while
+ * other producers fill in theirs. The number of slots must be a power of two.
+ *
+ * Items are filled in and read in place:
+ *
+ *     T* item = ring.beginPush(); // nullptr if the ring is full
+ *     ...
+ *     ring.endPush(item);
+ *
+ *     T* item = ring.beginPop(); // nullptr if the ring is empty
+ *     ...
+ *     ring.endPop();
+ */
+template<typename T>
+class MpscRingBuffer {
+public:
+    MpscRingBuffer();
+    ~MpscRingBuffer();
+
+    MpscRingBuffer(const MpscRingBuffer&) = delete;
+    MpscRingBuffer& operator=(const MpscRingBuffer&) = delete;
+
+    bool init(size_t capacity);
+    void destroy();
+
+    T* beginPush();
+    void endPush(T* item);
+
+    T* beginPop();
+    void endPop();
+
+    size_t capacity() const;
+
+private:
+    // The item goes first so that a pointer to it can be converted back to its slot
+    struct Slot {
+        T item;
+        std::atomic<size_t> seq;
+    };
+
+    Slot* slots_;
+    size_t mask_;
+    std::atomic<size_t> head_;
+    size_t tail_;
+};
+
+template<typename T>
+inline MpscRingBuffer<T>::MpscRingBuffer()
+        : slots_(nullptr),
+          mask_(0),
+          head_(0),
+          tail_(0) {
+}
+
+template<typename T>
+inline MpscRingBuffer<T>::~MpscRingBuffer() {
+    destroy();
+}
+
+template<typename T>
+inline bool MpscRingBuffer<T>::init(size_t capacity) {
+    destroy();
+    if (!capacity || (capacity & (capacity - 1))) {
+        return false;
+    }
+    slots_ = new(std::nothrow) Slot[capacity];
+    if (!slots_) {
+        return false;
+    }
+    for (size_t i = 0; i < capacity; ++i) {
+        slots_[i].seq.store(i, std::memory_order_relaxed);
+    }
+    mask_ = capacity - 1;
+    head_.store(0, std::memory_order_relaxed);
+    tail_ = 0;
+    return true;
+}
+
+template<typename T>
+inline void MpscRingBuffer<T>::destroy() {
+    delete[] slots_;
+    slots_ = nullptr;
+    mask_ = 0;
+}
+
+template<typename T>
+inline T* MpscRingBuffer<T>::beginPush() {
+    if (!slots_) {
+        return nullptr;
+    }
+    size_t pos = head_.load(std::memory_order_relaxed);
+    for (;;) {
+        Slot* const slot = &slots_[pos & mask_];
+        const size_t seq = slot->seq.load(std::memory_order_acquire);
+        const ptrdiff_t diff = (ptrdiff_t)seq - (ptrdiff_t)pos;
+        if (diff == 0) {
+            if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                return &slot->item;
+            }
+            // pos has been reloaded by the failed CAS
+        } else if (diff < 0) {
+            return nullptr; // The consumer hasn't released this slot yet
+        } else {
+            pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template<typename T>
+inline void MpscRingBuffer<T>::endPush(T* item) {
+    Slot* const slot = reinterpret_cast<Slot*>(item);
+    // The slot was claimed at position seq, publish it as position seq + 1
+    slot->seq.store(slot->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template<typename T>
+inline T* MpscRingBuffer<T>::beginPop() {
+    if (!slots_) {
+        return nullptr;
+    }
+    Slot* const slot = &slots_[tail_ & mask_];
+    if (slot->seq.load(std::memory_order_acquire) != tail_ + 1) {
+        return nullptr; // Empty, or the producer hasn't finished writing the item yet
+    }
+    return &slot->item;
+}
+
+template<typename T>
+inline void MpscRingBuffer<T>::endPop() {
+    Slot* const slot = &slots_[tail_ & mask_];
+    slot->seq.store(tail_ + mask_ + 1, std::memory_order_release);
+    ++tail_;
+}
+
+template<typename T>
+inline size_t MpscRingBuffer<T>::capacity() const {
+    return slots_ ? mask_ + 1 : 0;
+}
+
+} // namespace services
+
+} // namespace particle
@@ -110,6 +110,12 @@ DYNALIB_FN(55, services, pb_encode_varint, bool(pb_ostream_t*, pb_uint64_t))
 # define BASE_IDX 40
 #endif
 
+DYNALIB_FN(BASE_IDX + 0, services, log_set_async, int(int, void*))
+DYNALIB_FN(BASE_IDX + 1, services, log_dropped_count, uint32_t(void*))
+DYNALIB_FN(BASE_IDX + 2, services, log_category_level, int(const char*, LogCategoryCache*, void*))
+
 DYNALIB_END(services)
 
+#undef BASE_IDX
+
 #endif	/* SERVICES_DYNALIB_H */
@@ -19,6 +19,7 @@
 #define SERVICES_TLV_FILE_H
 
 #include "filesystem.h"
+#include "spark_wiring_vector.h"
 #include <stdio.h>
 
 namespace particle { namespace services { namespace settings {
@@ -45,6 +46,7 @@ public:
     ssize_t get(uint16_t key, uint8_t* value, uint16_t length, int index = 0);
     int set(uint16_t key, const uint8_t* value, uint16_t length, int index = -1);
     int add(uint16_t key, const uint8_t* value, uint16_t length);
+    /* Returns the number of deleted entries */
     int del(uint16_t key, int index = -1);
 
 private:
@@ -65,6 +67,16 @@ private:
     } __attribute__((__packed__));
     static_assert(sizeof(TlvHeader) == sizeof(uint32_t) * 2, "sizeof(TlvHeader) != 8");
 
+    /* In-memory directory entry, kept in the order of the entries in the file */
+    struct Entry {
+        uint32_t offset;
+        uint16_t key;
+        uint16_t length;
+    };
+
+    static constexpr uint32_t REMOVED_ENTRY = 0xffffffff;
+    static constexpr size_t COPY_BUFFER_SIZE = 128;
+
 private:
     lfs_t* lfs();
 
@@ -74,7 +86,11 @@ private:
 
     int mkdir(char* dir);
 
-    ssize_t find(uint16_t key, int index, uint16_t* dataSize);
+    int buildIndex();
+    int checkIndex();
+    int find(uint16_t key, int index);
+    int compact();
+    int move(lfs_file_t* src, uint32_t dstPos, uint32_t srcPos, size_t size);
     int readFooter(FileFooter& footer);
 
     ssize_t seek(ssize_t offset, int whence = SEEK_SET);
@@ -87,6 +103,10 @@ private:
     bool open_ = false;
     filesystem_t* fs_ = nullptr;
     lfs_file_t file_ = {};
+
+    spark::Vector<Entry> entries_;
+    FileFooter footer_ = {};
+    bool indexValid_ = false;
 };
 
 } } } /* namespace particle::services::settings */
@@ -22,6 +22,16 @@
 #include "timer_hal.h"
 #include "service_debug.h"
 #include "static_assert.h"
+#include "system_error.h"
+#include "interrupts_hal.h"
+#include <atomic>
+
+#if PLATFORM_THREADING
+#include "mpsc_ring_buffer.h"
+#include "concurrent_hal.h"
+#include "delay_hal.h"
+#include <cstring>
+#endif
 
 #define STATIC_ASSERT_FIELD_SIZE(struct, field, size) \
         STATIC_ASSERT(field_size_changed_##struct##_##field, sizeof(struct::field) == size);
@@ -68,13 +78,292 @@ volatile log_message_callback_type log_msg_callback = 0;
 volatile log_write_callback_type log_write_callback = 0;
 volatile log_enabled_callback_type log_enabled_callback = 0;
 
+// Caches registered by log_category_level()
+std::atomic<LogCategoryCache*> g_categoryCaches(nullptr);
+// Incremented every time the cached levels are invalidated
+std::atomic<unsigned> g_categoryCacheGen(0);
+
+void invalidateCategoryCaches() {
+    ++g_categoryCacheGen;
+    for (LogCategoryCache* c = g_categoryCaches.load(); c; c = c->next) {
+        __atomic_store_n(&c->key, 0, __ATOMIC_RELEASE);
+    }
+}
+
+void registerCategoryCache(LogCategoryCache* cache) {
+    if (__atomic_exchange_n(&cache->registered, 1, __ATOMIC_ACQ_REL)) {
+        return;
+    }
+    LogCategoryCache* head = g_categoryCaches.load();
+    do {
+        cache->next = head;
+    } while (!g_categoryCaches.compare_exchange_weak(head, cache));
+}
+
+#if PLATFORM_THREADING
+
+// Number of records that can be queued in asynchronous mode
+#ifndef LOG_ASYNC_QUEUE_SIZE
+#define LOG_ASYNC_QUEUE_SIZE 8
+#endif
+
+#ifndef LOG_ASYNC_THREAD_STACK_SIZE
+#define LOG_ASYNC_THREAD_STACK_SIZE 2048
+#endif
+
+#ifndef LOG_ASYNC_THREAD_PRIORITY
+#define LOG_ASYNC_THREAD_PRIORITY (OS_THREAD_PRIORITY_DEFAULT - 1)
+#endif
+
+// Maximum length of a category name copied to a queued record
+#ifndef LOG_ASYNC_MAX_CATEGORY_LENGTH
+#define LOG_ASYNC_MAX_CATEGORY_LENGTH 32
+#endif
+
+// Time log_set_async() waits for the queued records to be written when the asynchronous mode is disabled
+const system_tick_t LOG_ASYNC_FLUSH_TIMEOUT = 1000;
+
+enum class LogRecordType: uint8_t {
+    MESSAGE,
+    WRITE
+};
+
+struct LogRecord {
+    LogRecordType type;
+    bool hasCategory;
+    int level;
+    LogAttributes attr;
+    size_t size;
+    char category[LOG_ASYNC_MAX_CATEGORY_LENGTH + 1];
+    // Formatted message or raw data, followed by a copy of the message details if they fit
+    char data[LOG_MAX_STRING_LENGTH];
+};
+
+particle::services::MpscRingBuffer<LogRecord> g_logQueue;
+os_thread_t g_logThread = nullptr;
+os_semaphore_t g_logSem = nullptr;
+std::atomic<bool> g_logAsync(false);
+std::atomic<unsigned> g_logQueued(0);
+std::atomic<uint32_t> g_logDropped(0);
+
+const char* recordCategory(const LogRecord* rec) {
+    return rec->hasCategory ? rec->category : nullptr;
+}
+
+void processLogRecord(const LogRecord* rec) {
+    if (rec->type == LogRecordType::MESSAGE) {
+        const log_message_callback_type msg_callback = log_msg_callback;
+        if (msg_callback) {
+            msg_callback(rec->data, rec->level, recordCategory(rec), &rec->attr, 0);
+        }
+    } else {
+        const log_write_callback_type write_callback = log_write_callback;
+        if (write_callback) {
+            write_callback(rec->data, rec->size, rec->level, recordCategory(rec), 0);
+        }
+    }
+}
+
+void reportDroppedRecords(uint32_t* reported) {
+    const uint32_t dropped = g_logDropped.load(std::memory_order_relaxed);
+    const log_message_callback_type msg_callback = log_msg_callback;
+    if (dropped == *reported || !msg_callback) {
+        return;
+    }
+    char buf[48];
+    snprintf(buf, sizeof(buf), "%u log messages dropped", (unsigned)(dropped - *reported));
+    *reported = dropped;
+    LogAttributes attr = {};
+    attr.size = sizeof(LogAttributes);
+    LOG_ATTR_SET(attr, time, HAL_Timer_Get_Milli_Seconds());
+    msg_callback(buf, LOG_LEVEL_WARN, "log", &attr, 0);
+}
+
+void logThread(void* arg) {
+    uint32_t reported = 0;
+    for (;;) {
+        os_semaphore_take(g_logSem, CONCURRENT_WAIT_FOREVER, false);
+        LogRecord* rec = nullptr;
+        while ((rec = g_logQueue.beginPop())) {
+            processLogRecord(rec);
+            g_logQueue.endPop();
+            --g_logQueued;
+        }
+        reportDroppedRecords(&reported);
+    }
+}
+
+// Handlers are not called in an ISR anyway, and the logger thread logs synchronously to not feed itself
+bool isLogAsync() {
+    return g_logAsync.load(std::memory_order_acquire) && !HAL_IsISR() && !os_thread_is_current(g_logThread);
+}
+
+LogRecord* beginLogRecord(LogRecordType type, int level, const char* category) {
+    LogRecord* const rec = g_logQueue.beginPush();
+    if (!rec) {
+        ++g_logDropped;
+        return nullptr;
+    }
+    rec->type = type;
+    rec->level = level;
+    rec->hasCategory = (category != nullptr);
+    if (category) {
+        const size_t n = strnlen(category, LOG_ASYNC_MAX_CATEGORY_LENGTH);
+        memcpy(rec->category, category, n);
+        rec->category[n] = '\0';
+    }
+    return rec;
+}
+
+void endLogRecord(LogRecord* rec) {
+    ++g_logQueued;
+    g_logQueue.endPush(rec);
+    os_semaphore_give(g_logSem, false);
+}
+
+// Returns true if the message has been queued or dropped
+bool logMessageAsync(int level, const char *category, LogAttributes *attr, const char *fmt, va_list args) {
+    if (!isLogAsync()) {
+        return false;
+    }
+    LogRecord* const rec = beginLogRecord(LogRecordType::MESSAGE, level, category);
+    if (!rec) {
+        return true;
+    }
+    const size_t attrSize = std::min(attr->size, sizeof(LogAttributes));
+    memset(&rec->attr, 0, sizeof(LogAttributes));
+    memcpy(&rec->attr, attr, attrSize);
+    rec->attr.size = sizeof(LogAttributes);
+    const int n = vsnprintf(rec->data, sizeof(rec->data), fmt, args);
+    if (n > (int)sizeof(rec->data) - 1) {
+        rec->data[sizeof(rec->data) - 2] = '~';
+    }
+    rec->size = std::min<size_t>(std::max(n, 0), sizeof(rec->data) - 1);
+    if (rec->attr.has_details) {
+        // The details string may not outlive the call, copy it after the message
+        const size_t offs = rec->size + 1;
+        const size_t len = rec->attr.details ? strlen(rec->attr.details) : 0;
+        if (offs + len < sizeof(rec->data)) {
+            memcpy(rec->data + offs, rec->attr.details, len);
+            rec->data[offs + len] = '\0';
+            rec->attr.details = rec->data + offs;
+        } else {
+            rec->attr.has_details = 0;
+        }
+    }
+    endLogRecord(rec);
+    return true;
+}
+
+// Returns true if the data has been queued or dropped
+bool logWriteAsync(int level, const char *category, const char *data, size_t size) {
+    if (!isLogAsync()) {
+        return false;
+    }
+    while (size > 0) {
+        LogRecord* const rec = beginLogRecord(LogRecordType::WRITE, level, category);
+        if (!rec) {
+            break;
+        }
+        const size_t n = std::min(size, sizeof(rec->data));
+        memcpy(rec->data, data, n);
+        rec->size = n;
+        endLogRecord(rec);
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+int startLogThread() {
+    if (g_logThread) {
+        return 0;
+    }
+    if (!g_logQueue.init(LOG_ASYNC_QUEUE_SIZE)) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    if (os_semaphore_create(&g_logSem, 1, 0)) {
+        g_logQueue.destroy();
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    if (os_thread_create(&g_logThread, "log", LOG_ASYNC_THREAD_PRIORITY, logThread, nullptr,
+            LOG_ASYNC_THREAD_STACK_SIZE)) {
+        os_semaphore_destroy(g_logSem);
+        g_logSem = nullptr;
+        g_logQueue.destroy();
+        g_logThread = nullptr;
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    return 0;
+}
+
+#endif // PLATFORM_THREADING
+
 } // namespace
 
+int log_set_async(int enabled, void *reserved) {
+#if PLATFORM_THREADING
+    if (enabled) {
+        const int ret = startLogThread();
+        if (ret < 0) {
+            return ret;
+        }
+        g_logAsync.store(true, std::memory_order_release);
+    } else if (g_logAsync.exchange(false)) {
+        // The thread and the queue are kept for the case the asynchronous mode is enabled again;
+        // wait for the records that are already queued so that they are not reordered with the
+        // ones written synchronously from now on
+        const system_tick_t t = HAL_Timer_Get_Milli_Seconds();
+        while (g_logQueued.load() > 0 && !os_thread_is_current(g_logThread) &&
+                HAL_Timer_Get_Milli_Seconds() - t < LOG_ASYNC_FLUSH_TIMEOUT) {
+            HAL_Delay_Milliseconds(1);
+        }
+    }
+    return 0;
+#else
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t log_dropped_count(void *reserved) {
+#if PLATFORM_THREADING
+    return g_logDropped.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
 void log_set_callbacks(log_message_callback_type log_msg, log_write_callback_type log_write,
         log_enabled_callback_type log_enabled, void *reserved) {
     log_msg_callback = log_msg;
     log_write_callback = log_write;
     log_enabled_callback = log_enabled;
+    invalidateCategoryCaches();
+}
+
+int log_category_level(const char *category, LogCategoryCache *cache, void *reserved) {
+    static const int levels[] = { LOG_LEVEL_TRACE, LOG_LEVEL_INFO, LOG_LEVEL_WARN, LOG_LEVEL_ERROR, LOG_LEVEL_PANIC };
+    const unsigned gen = g_categoryCacheGen.load();
+    int minLevel = LOG_LEVEL_NONE;
+    for (int level: levels) {
+        if (log_enabled(level, category, nullptr)) {
+            minLevel = level;
+            break;
+        }
+    }
+    // The level can be cached only if it's determined by the logger callbacks. The compatibility
+    // callback can be changed without notice, and no handlers are called in an ISR
+    if (!log_enabled_callback || HAL_IsISR()) {
+        return minLevel;
+    }
+    registerCategoryCache(cache);
+    cache->level = minLevel;
+    __atomic_store_n(&cache->key, (uintptr_t)category + 1, __ATOMIC_RELEASE);
+    if (g_categoryCacheGen.load() != gen) {
+        // The callbacks have changed while the level was determined
+        __atomic_store_n(&cache->key, 0, __ATOMIC_RELEASE);
+    }
+    return minLevel;
 }
 
 void log_message_v(int level, const char *category, LogAttributes *attr, void *reserved, const char *fmt, va_list args) {
@@ -86,6 +375,11 @@ void log_message_v(int level, const char *category, LogAttributes *attr, void *r
     if (!attr->has_time) {
         LOG_ATTR_SET(*attr, time, HAL_Timer_Get_Milli_Seconds());
     }
+#if PLATFORM_THREADING
+    if (msg_callback && logMessageAsync(level, category, attr, fmt, args)) {
+        return;
+    }
+#endif
     char buf[LOG_MAX_STRING_LENGTH];
     if (msg_callback) {
         const int n = vsnprintf(buf, sizeof(buf), fmt, args);
@@ -132,6 +426,11 @@ void log_write(int level, const char *category, const char *data, size_t size, v
     }
     const log_write_callback_type write_callback = log_write_callback;
     if (write_callback) {
+#if PLATFORM_THREADING
+        if (logWriteAsync(level, category, data, size)) {
+            return;
+        }
+#endif
         write_callback(data, size, level, category, 0);
     } else if (log_compat_callback && level >= log_compat_level) {
 #if 0
@@ -165,7 +464,7 @@ void log_printf_v(int level, const char *category, void *reserved, const char *f
         n = sizeof(buf) - 1;
     }
     if (write_callback) {
-        write_callback(buf, n, level, category, 0);
+        log_write(level, category, buf, n, nullptr);
     } else {
         log_compat_callback(buf); // Compatibility callback
     }
@@ -193,7 +492,7 @@ void log_dump(int level, const char *category, const void *data, size_t size, in
         buf[offs++] = hex[b & 0x0f];
         if (offs == sizeof(buf) - 1) {
             if (write_callback) {
-                write_callback(buf, sizeof(buf) - 1, level, category, 0);
+                log_write(level, category, buf, sizeof(buf) - 1, nullptr);
             } else {
                 log_compat_callback(buf);
             }
@@ -202,7 +501,7 @@ void log_dump(int level, const char *category, const void *data, size_t size, in
     }
     if (offs) {
         if (write_callback) {
-            write_callback(buf, offs, level, category, 0);
+            log_write(level, category, buf, offs, nullptr);
         } else {
             buf[offs] = 0;
             log_compat_callback(buf);
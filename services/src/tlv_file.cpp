@@ -111,25 +111,28 @@ ssize_t TlvFile::size() {
 ssize_t TlvFile::get(uint16_t key, uint8_t* value, uint16_t length, int index) {
     FsLock lk(fs_);
 
-    if (!open_) {
-        return SYSTEM_ERROR_INVALID_STATE;
+    ssize_t ret = checkIndex();
+    if (ret < 0) {
+        return ret;
     }
 
     if (value == nullptr && length != 0) {
         return SYSTEM_ERROR_INVALID_ARGUMENT;
     }
 
-    uint16_t dataSize;
-    ssize_t ret = SYSTEM_ERROR_NOT_FOUND;
-    ssize_t pos = find(key, index, &dataSize);
-    if (pos >= 0) {
-        /* Found it */
-        const size_t toRead = std::min(length, dataSize);
-        if (toRead) {
-            ret = seek(pos + sizeof(TlvHeader));
-            if (ret >= 0) {
-                ret = read(value, toRead);
-            }
+    const int i = find(key, index);
+    if (i < 0) {
+        return i;
+    }
+
+    /* Found it */
+    ret = SYSTEM_ERROR_NOT_FOUND;
+    const Entry& entry = entries_[i];
+    const size_t toRead = std::min(length, entry.length);
+    if (toRead) {
+        ret = seek(entry.offset + sizeof(TlvHeader));
+        if (ret >= 0) {
+            ret = read(value, toRead);
         }
     }
 
@@ -145,7 +148,7 @@ int TlvFile::set(uint16_t key, const uint8_t* value, uint16_t length, int index)
 
     /* Delete previous entry */
     int ret = del(key, index);
-    if (!(ret == 0 || ret == SYSTEM_ERROR_NOT_FOUND)) {
+    if (ret < 0 && ret != SYSTEM_ERROR_NOT_FOUND) {
         return ret;
     }
 
@@ -155,137 +158,97 @@ int TlvFile::set(uint16_t key, const uint8_t* value, uint16_t length, int index)
 int TlvFile::add(uint16_t key, const uint8_t* value, uint16_t length) {
     FsLock lk(fs_);
 
-    if (!open_) {
-        return SYSTEM_ERROR_INVALID_STATE;
-    }
-
-    FileFooter footer;
-    int ret = readFooter(footer);
+    int ret = checkIndex();
     if (ret < 0) {
         return ret;
     }
-    ssize_t pos = footer.size;
 
-    if (pos < 0) {
-        return pos;
+    if (!entries_.reserve(entries_.size() + 1)) {
+        return SYSTEM_ERROR_NO_MEMORY;
     }
 
-    ret = seek(pos);
-    if (ret < 0) {
-        return ret;
-    }
+    const Entry entry = { footer_.size, key, length };
 
     TlvHeader header = {};
     header.magick = TLV_HEADER_MAGICK;
     header.key = key;
     header.length = length;
 
-    /* Write entry header */
-    ret = write((const uint8_t*)&header, sizeof(header));
-    if (ret < 0) {
-        return ret;
-    }
-    /* Write data */
-    ret = write((const uint8_t*)value, length);
-    if (ret < 0) {
-        return ret;
-    }
-    /* Write file footer */
+    FileFooter footer = footer_;
     footer.magick = TLV_FILE_MAGICK;
     footer.size += sizeof(header) + length;
-    ret = write((const uint8_t*)&footer, sizeof(footer));
+
+    for (;;) {
+        ret = seek(entry.offset);
+        if (ret < 0) {
+            break;
+        }
+        /* Write entry header */
+        ret = write((const uint8_t*)&header, sizeof(header));
+        if (ret < 0) {
+            break;
+        }
+        /* Write data */
+        ret = write((const uint8_t*)value, length);
+        if (ret < 0) {
+            break;
+        }
+        /* Write file footer */
+        ret = write((const uint8_t*)&footer, sizeof(footer));
+        if (ret < 0) {
+            break;
+        }
+        ret = sync();
+        break;
+    }
+
     if (ret < 0) {
+        /* The file may have been reopened, rebuild the index on next access */
+        indexValid_ = false;
         return ret;
     }
 
-    return sync();
+    footer_ = footer;
+    entries_.append(entry);
+
+    return 0;
 }
 
 int TlvFile::del(uint16_t key, int index) {
     FsLock lk(fs_);
 
-    if (!open_) {
-        return SYSTEM_ERROR_INVALID_STATE;
+    int ret = checkIndex();
+    if (ret < 0) {
+        return ret;
     }
 
-    int ret = 0;
-
-    for (;;) {
-        uint16_t dataSize = 0;
-        ssize_t pos = find(key, index, &dataSize);
-        if (pos < 0) {
-            return pos;
+    int count = 0;
+    if (index >= 0) {
+        const int i = find(key, index);
+        if (i < 0) {
+            return i;
         }
-
-        /* FIXME: this will only work on LittleFS. Provide a different implementation later
-         * when filesystem API is finalized and TlvFile implementation is refactored not to use
-         * LittleFS API.
-         */
-        const ssize_t fileSize = size();
-
-        FileFooter footer;
-        ret = readFooter(footer);
-
-        while (ret == 0) {
-            lfs_file_t f;
-            ret = lfs_file_open(lfs(), &f, path_, LFS_O_RDONLY);
-            if (ret) {
-                break;
-            }
-
-            size_t wpos = pos;
-            size_t rpos = wpos + sizeof(TlvHeader) + dataSize;
-
-            ret = seek(wpos);
-            if (ret < 0) {
-                break;
-            }
-
-            ret = lfs_file_seek(lfs(), &f, rpos, LFS_SEEK_SET);
-            if (ret < 0) {
-                break;
+        entries_[i].offset = REMOVED_ENTRY;
+        count = 1;
+    } else {
+        /* Delete all entries with this key */
+        for (Entry& entry: entries_) {
+            if (entry.key == key) {
+                entry.offset = REMOVED_ENTRY;
+                ++count;
             }
-
-            for (; rpos < footer.size && ret > 0; ++wpos, ++rpos) {
-                uint8_t tmp;
-                ret = lfs_file_read(lfs(), &f, &tmp, sizeof(tmp));
-                if (ret < 0) {
-                    break;
-                }
-
-                ret = write(&tmp, sizeof(tmp));
-                if (ret < 0) {
-                    break;
-                }
-            }
-
-            if (ret > 0) {
-                /* Write footer */
-                footer.size -= sizeof(TlvHeader) + dataSize;
-                ret = write((const uint8_t*)&footer, sizeof(footer));
-                if (ret < 0) {
-                    break;
-                }
-                /* Truncate */
-                ret = lfs_file_truncate(lfs(), &file_, fileSize - (sizeof(TlvHeader) + dataSize));
-                if (ret < 0) {
-                    break;
-                }
-                ret = sync();
-            }
-
-            lfs_file_close(lfs(), &f);
-
-            break;
         }
-
-
-        if (ret || index >= 0) {
-            break;
+        if (!count) {
+            return SYSTEM_ERROR_NOT_FOUND;
         }
     }
 
-    return ret;
+    ret = compact();
+    if (ret < 0) {
+        return ret;
+    }
+
+    return count;
 }
 
 lfs_t* TlvFile::lfs() {
@@ -338,6 +301,9 @@ open_done:
     if (r) {
         lfs_file_close(lfs(), &file_);
         open_ = false;
+    } else {
+        /* If this fails, the index is rebuilt on next access */
+        buildIndex();
     }
     return r;
 }
@@ -364,6 +330,8 @@ int TlvFile::close() {
     /* Close */
 
     open_ = false;
+    indexValid_ = false;
+    entries_.clear();
 
     return lfs_file_close(lfs(), &file_);
 }
@@ -441,19 +409,18 @@ int TlvFile::readFooter(FileFooter& footer) {
     return SYSTEM_ERROR_BAD_DATA;
 }
 
-ssize_t TlvFile::find(uint16_t key, int index, uint16_t* dataSize) {
+int TlvFile::buildIndex() {
+    entries_.clear();
+    indexValid_ = false;
+
     FileFooter footer;
     int r = readFooter(footer);
     if (r) {
         return r;
     }
 
-    ssize_t candidatePos = -1;
-    int candidateIdx = -1;
-    uint16_t candidateSize = 0;
-
     TlvHeader header;
-    for (ssize_t pos = 0; pos >= 0 && (pos + sizeof(TlvHeader)) <= footer.size;) {
+    for (size_t pos = 0; (pos + sizeof(TlvHeader)) <= footer.size;) {
         r = seek(pos);
         if (r < 0) {
             return r;
@@ -470,26 +437,175 @@ ssize_t TlvFile::find(uint16_t key, int index, uint16_t* dataSize) {
             continue;
         }
 
-        if (header.key == key) {
-            candidatePos = pos;
+        if (pos + sizeof(TlvHeader) + header.length > footer.size) {
+            /* Truncated entry */
+            break;
+        }
+
+        const Entry entry = { (uint32_t)pos, header.key, header.length };
+        if (!entries_.append(entry)) {
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+
+        pos += sizeof(TlvHeader) + header.length;
+    }
+
+    footer_ = footer;
+    indexValid_ = true;
+
+    return 0;
+}
+
+int TlvFile::checkIndex() {
+    if (!open_) {
+        return SYSTEM_ERROR_INVALID_STATE;
+    }
+
+    if (!indexValid_) {
+        return buildIndex();
+    }
+
+    return 0;
+}
+
+int TlvFile::find(uint16_t key, int index) {
+    int candidate = -1;
+    int candidateIdx = -1;
+
+    for (int i = 0; i < entries_.size(); ++i) {
+        if (entries_[i].key == key) {
+            candidate = i;
             ++candidateIdx;
-            candidateSize = header.length;
             if (index >= 0 && candidateIdx >= index) {
                 break;
             }
         }
-
-        pos += sizeof(TlvHeader) + header.length;
     }
 
     if ((index >= 0 && candidateIdx == index) || (index < 0 && candidateIdx >= 0)) {
-        if (dataSize) {
-            *dataSize = candidateSize;
-        }
-        return candidatePos;
+        return candidate;
     }
 
     return SYSTEM_ERROR_NOT_FOUND;
 }
 
+int TlvFile::compact() {
+    /* FIXME: this will only work on LittleFS. Provide a different implementation later
+     * when filesystem API is finalized and TlvFile implementation is refactored not to use
+     * LittleFS API.
+     */
+    lfs_file_t f;
+    int ret = lfs_file_open(lfs(), &f, path_, LFS_O_RDONLY);
+    if (ret) {
+        indexValid_ = false;
+        return ret;
+    }
+
+    /* Entries that follow each other in the file are moved together */
+    uint32_t wpos = 0;
+    uint32_t runSrc = 0;
+    uint32_t runDst = 0;
+    size_t runSize = 0;
+    int count = 0;
+
+    for (int i = 0; i < entries_.size(); ++i) {
+        Entry entry = entries_[i];
+        if (entry.offset == REMOVED_ENTRY) {
+            continue;
+        }
+
+        const size_t entrySize = sizeof(TlvHeader) + entry.length;
+        if (entry.offset != wpos) {
+            if (runSize && entry.offset != runSrc + runSize) {
+                ret = move(&f, runDst, runSrc, runSize);
+                if (ret < 0) {
+                    break;
+                }
+                runSize = 0;
+            }
+            if (!runSize) {
+                runSrc = entry.offset;
+                runDst = wpos;
+            }
+            runSize += entrySize;
+        }
+
+        entry.offset = wpos;
+        entries_[count++] = entry;
+        wpos += entrySize;
+    }
+
+    if (ret >= 0 && runSize) {
+        ret = move(&f, runDst, runSrc, runSize);
+    }
+
+    if (ret >= 0) {
+        FileFooter footer = footer_;
+        footer.magick = TLV_FILE_MAGICK;
+        footer.size = wpos;
+
+        for (;;) {
+            /* Write footer */
+            ret = seek(wpos);
+            if (ret < 0) {
+                break;
+            }
+            ret = write((const uint8_t*)&footer, sizeof(footer));
+            if (ret < 0) {
+                break;
+            }
+            /* Truncate */
+            ret = lfs_file_truncate(lfs(), &file_, wpos + sizeof(footer));
+            if (ret < 0) {
+                break;
+            }
+            ret = sync();
+            if (ret == 0) {
+                footer_ = footer;
+                entries_.resize(count);
+            }
+            break;
+        }
+    }
+
+    lfs_file_close(lfs(), &f);
+
+    if (ret < 0) {
+        indexValid_ = false;
+        return ret;
+    }
+
+    return 0;
+}
+
+int TlvFile::move(lfs_file_t* src, uint32_t dstPos, uint32_t srcPos, size_t size) {
+    /* Only moves data towards the beginning of the file */
+    SPARK_ASSERT(dstPos < srcPos);
+
+    int ret = seek(dstPos);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = lfs_file_seek(lfs(), src, srcPos, LFS_SEEK_SET);
+    if (ret < 0) {
+        return ret;
+    }
+
+    uint8_t buf[COPY_BUFFER_SIZE];
+    while (size > 0) {
+        const size_t n = std::min(size, sizeof(buf));
+        ret = lfs_file_read(lfs(), src, buf, n);
+        if (ret != (int)n) {
+            return (ret < 0) ? ret : SYSTEM_ERROR_BAD_DATA;
+        }
+        ret = write(buf, n);
+        if (ret < 0) {
+            return ret;
+        }
+        size -= n;
+    }
+
+    return 0;
+}
+
 #endif /* HAL_PLATFORM_FILESYSTEM == 1 */
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tests of SegmentedFileQueue. The queue runs on the Gen 3 filesystem over a RAM image of
+ * the external flash, see hal/tests/littlefs. A reset of the device is simulated by closing the
+ * queue's files and remounting the filesystem.
+ */
+
+#include "file_queue.h"
+#include "exflash_host.h"
+
+// Defined by service_debug.h
+#undef INFO
+#undef WARN
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace particle::fs;
+using namespace particle::test;
+
+namespace {
+
+const char* const QUEUE_PATH = "queue";
+// Each entry takes 44 bytes with the entry header, so a segment holds 3 entries
+const size_t SEGMENT_SIZE = 128;
+const size_t ENTRY_SIZE = 40;
+
+struct __attribute__((__packed__)) Cursor {
+    uint32_t headSegment;
+    uint32_t headOffset;
+    uint32_t tailSegment;
+};
+
+filesystem_t* fs() {
+    return filesystem_get_instance(nullptr);
+}
+
+// Mounts the filesystem on a blank flash image
+struct Filesystem {
+    Filesystem() {
+        filesystem_unmount(fs());
+        exflash_fail_after(-1);
+        exflash_clear();
+        REQUIRE(filesystem_mount(fs()) == 0);
+    }
+
+    ~Filesystem() {
+        exflash_fail_after(-1);
+        filesystem_unmount(fs());
+    }
+};
+
+// Simulates a reset of the device
+void reset(SegmentedFileQueue* queue) {
+    queue->close();
+    REQUIRE(filesystem_unmount(fs()) == 0);
+    REQUIRE(filesystem_mount(fs()) == 0);
+}
+
+std::string entryData(unsigned i) {
+    std::string data(ENTRY_SIZE, 'a' + i % 26);
+    data[0] = i;
+    return data;
+}
+
+void push(SegmentedFileQueue* queue, unsigned first, unsigned count) {
+    for (unsigned i = first; i < first + count; ++i) {
+        const auto data = entryData(i);
+        REQUIRE(queue->pushBack(data.data(), data.size()) == 0);
+    }
+}
+
+// Pops the specified number of entries and checks their contents
+void pop(SegmentedFileQueue* queue, unsigned first, unsigned count) {
+    for (unsigned i = first; i < first + count; ++i) {
+        SegmentedFileQueue::QueueEntry entry = {};
+        char buf[ENTRY_SIZE] = {};
+        REQUIRE(queue->front(entry, buf, sizeof(buf)) == 0);
+        REQUIRE(entry.size == ENTRY_SIZE + sizeof(entry));
+        REQUIRE(std::string(buf, sizeof(buf)) == entryData(i));
+        REQUIRE(queue->popFront() == 0);
+    }
+}
+
+bool isEmpty(SegmentedFileQueue* queue) {
+    SegmentedFileQueue::QueueEntry entry = {};
+    char buf[ENTRY_SIZE] = {};
+    return queue->front(entry, buf, sizeof(buf)) == SYSTEM_ERROR_NOT_FOUND && queue->size() == 0;
+}
+
+std::string filePath(const char* name) {
+    return std::string(QUEUE_PATH) + '/' + name;
+}
+
+bool fileExists(const std::string& path) {
+    FsLock lk(fs());
+    lfs_info info = {};
+    return lfs_stat(&fs()->instance, path.c_str(), &info) == 0;
+}
+
+int writeFile(const std::string& path, const void* data, size_t size) {
+    FsLock lk(fs());
+    lfs_file_t file = {};
+    int r = lfs_file_open(&fs()->instance, &file, path.c_str(), LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+    if (r < 0) {
+        return r;
+    }
+    const lfs_ssize_t n = lfs_file_write(&fs()->instance, &file, data, size);
+    r = lfs_file_close(&fs()->instance, &file);
+    if (n < 0) {
+        return n;
+    }
+    return r;
+}
+
+Cursor readCursor() {
+    FsLock lk(fs());
+    lfs_file_t file = {};
+    Cursor cursor = {};
+    REQUIRE(lfs_file_open(&fs()->instance, &file, filePath("head").c_str(), LFS_O_RDONLY) == 0);
+    const lfs_ssize_t n = lfs_file_read(&fs()->instance, &file, &cursor, sizeof(cursor));
+    lfs_file_close(&fs()->instance, &file);
+    REQUIRE(n == sizeof(cursor));
+    return cursor;
+}
+
+} // namespace
+
+TEST_CASE("SegmentedFileQueue") {
+    Filesystem f;
+    SegmentedFileQueue queue(QUEUE_PATH, SEGMENT_SIZE);
+
+    SECTION("doesn't create any files until it's used") {
+        CHECK_FALSE(queue.exists());
+        CHECK_FALSE(fileExists(QUEUE_PATH));
+        push(&queue, 0, 1);
+        CHECK(queue.exists());
+        CHECK(fileExists(filePath("head")));
+        CHECK(fileExists(filePath("0")));
+    }
+
+    SECTION("returns the entries in the order in which they were added") {
+        CHECK(isEmpty(&queue));
+        push(&queue, 0, 10);
+        CHECK(queue.size() == 10 * (ENTRY_SIZE + sizeof(SegmentedFileQueue::QueueEntry)));
+        pop(&queue, 0, 4);
+        push(&queue, 10, 5);
+        pop(&queue, 4, 11);
+        CHECK(isEmpty(&queue));
+        CHECK(queue.popFront() == SYSTEM_ERROR_NOT_FOUND);
+    }
+
+    SECTION("removes a segment once all its entries have been popped") {
+        push(&queue, 0, 7);
+        CHECK(fileExists(filePath("0")));
+        CHECK(fileExists(filePath("1")));
+        CHECK(fileExists(filePath("2")));
+        pop(&queue, 0, 3);
+        CHECK_FALSE(fileExists(filePath("0")));
+        CHECK(fileExists(filePath("1")));
+        pop(&queue, 3, 4);
+        CHECK_FALSE(fileExists(filePath("1")));
+        CHECK_FALSE(fileExists(filePath("2")));
+        CHECK(isEmpty(&queue));
+    }
+
+    SECTION("fails to read an entry into a buffer that is too small") {
+        push(&queue, 0, 1);
+        SegmentedFileQueue::QueueEntry entry = {};
+        char buf[ENTRY_SIZE - 1] = {};
+        CHECK(queue.front(entry, buf, sizeof(buf)) == LFS_ERR_INVAL);
+        pop(&queue, 0, 1);
+    }
+
+    SECTION("removes all entries and files when cleared") {
+        push(&queue, 0, 7);
+        pop(&queue, 0, 1);
+        REQUIRE(queue.clear() == 0);
+        CHECK(isEmpty(&queue));
+        CHECK_FALSE(fileExists(filePath("0")));
+        CHECK_FALSE(fileExists(filePath("2")));
+        // The queue can be used after it's been cleared
+        push(&queue, 100, 2);
+        pop(&queue, 100, 2);
+        CHECK(isEmpty(&queue));
+    }
+
+    SECTION("keeps the entries across a reset") {
+        push(&queue, 0, 8);
+        pop(&queue, 0, 2);
+        reset(&queue);
+        SegmentedFileQueue q(QUEUE_PATH, SEGMENT_SIZE);
+        CHECK(q.exists());
+        CHECK(q.size() == 6 * (ENTRY_SIZE + sizeof(SegmentedFileQueue::QueueEntry)));
+        push(&q, 8, 2);
+        pop(&q, 2, 8);
+        CHECK(isEmpty(&q));
+    }
+
+    SECTION("removes a drained segment that was left from before a reset") {
+        push(&queue, 0, 5);
+        pop(&queue, 0, 3);
+        REQUIRE(readCursor().headSegment == 1);
+        reset(&queue);
+        // The segment was drained but not removed
+        const auto data = entryData(0);
+        REQUIRE(writeFile(filePath("0"), data.data(), data.size()) == 0);
+        SegmentedFileQueue q(QUEUE_PATH, SEGMENT_SIZE);
+        CHECK(q.size() == 2 * (ENTRY_SIZE + sizeof(SegmentedFileQueue::QueueEntry)));
+        CHECK_FALSE(fileExists(filePath("0")));
+        pop(&q, 3, 2);
+        CHECK(isEmpty(&q));
+    }
+
+    SECTION("finds the tail segment if the cursor lags behind") {
+        push(&queue, 0, 7);
+        const Cursor cursor = readCursor();
+        REQUIRE(cursor.tailSegment == 2);
+        reset(&queue);
+        // A segment was started right before a reset, but the cursor wasn't updated
+        const Cursor lagging = { cursor.headSegment, cursor.headOffset, 1 };
+        REQUIRE(writeFile(filePath("head"), &lagging, sizeof(lagging)) == 0);
+        SegmentedFileQueue q(QUEUE_PATH, SEGMENT_SIZE);
+        CHECK(q.size() == 7 * (ENTRY_SIZE + sizeof(SegmentedFileQueue::QueueEntry)));
+        push(&q, 7, 1);
+        pop(&q, 0, 8);
+        CHECK(isEmpty(&q));
+    }
+
+    SECTION("clears the queue if the cursor is invalid") {
+        push(&queue, 0, 7);
+        reset(&queue);
+        SECTION("truncated cursor") {
+            const uint32_t headSegment = 0;
+            REQUIRE(writeFile(filePath("head"), &headSegment, sizeof(headSegment)) == 0);
+        }
+        SECTION("head segment past the tail segment") {
+            const Cursor cursor = { 3, 0, 2 };
+            REQUIRE(writeFile(filePath("head"), &cursor, sizeof(cursor)) == 0);
+        }
+        SegmentedFileQueue q(QUEUE_PATH, SEGMENT_SIZE);
+        CHECK(isEmpty(&q));
+        CHECK_FALSE(fileExists(filePath("1")));
+        CHECK_FALSE(fileExists(filePath("2")));
+        push(&q, 100, 4);
+        pop(&q, 100, 4);
+        CHECK(isEmpty(&q));
+    }
+
+    SECTION("reloads its state from the filesystem after a failed write") {
+        push(&queue, 0, 2);
+        exflash_fail_after(0);
+        const auto data = entryData(2);
+        CHECK(queue.pushBack(data.data(), data.size()) < 0);
+        exflash_fail_after(-1);
+        reset(&queue);
+        SegmentedFileQueue q(QUEUE_PATH, SEGMENT_SIZE);
+        pop(&q, 0, 2);
+        CHECK(isEmpty(&q));
+    }
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Push/pop throughput of FileQueue and SegmentedFileQueue versus queue depth.
+ *
+ * The queue is filled up to the given depth, after which entries are pushed to and popped from
+ * it in the steady state. The number of flash operations per push/pop pair is reported along
+ * with the time spent on the host.
+ *
+ * The queues run on the Gen 3 filesystem over a RAM image of the external flash, see
+ * hal/tests/littlefs. Flash reads go through the same block cache as on the device. Build with
+ * CACHE_PAGES=0 to compare against uncached reads.
+ */
+
+#include "file_queue.h"
+#include "exflash_host.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using namespace particle::fs;
+using namespace particle::test;
+
+namespace {
+
+const size_t ENTRY_SIZE = 64;
+const unsigned OPS = 256;
+const unsigned DEPTHS[] = { 1, 16, 64, 256, 1024 };
+
+filesystem_t* fs() {
+    return filesystem_get_instance(nullptr);
+}
+
+// Mounts the filesystem on a blank flash image
+void formatFilesystem() {
+    filesystem_unmount(fs());
+    exflash_clear();
+    if (filesystem_mount(fs()) != 0) {
+        fprintf(stderr, "Unable to format the filesystem\n");
+        exit(1);
+    }
+}
+
+filesystem_cache_stats cacheStats() {
+    filesystem_cache_stats stats = {};
+    filesystem_get_cache_stats(fs(), &stats); // Fails if the cache is disabled
+    return stats;
+}
+
+struct Result {
+    double pushOps; // Flash operations per pushBack()
+    double popOps; // Flash operations per front() and popFront()
+    double reads; // Flash reads per push/pop pair
+    double hitRate; // Fraction of the pages read from the cache
+    double usec; // Host time per push/pop pair
+};
+
+uint64_t flashOps() {
+    return exflash_stats().progs + exflash_stats().erases;
+}
+
+template<typename QueueT>
+Result run(unsigned depth) {
+    formatFilesystem();
+    QueueT queue("queue");
+    uint8_t entry[ENTRY_SIZE] = {};
+    for (unsigned i = 0; i < depth; ++i) {
+        memcpy(entry, &i, sizeof(i));
+        if (queue.pushBack(entry, sizeof(entry)) < 0) {
+            fprintf(stderr, "pushBack() failed\n");
+            exit(1);
+        }
+    }
+    uint64_t pushOps = 0;
+    uint64_t popOps = 0;
+    const uint64_t reads = exflash_stats().reads;
+    const auto cache = cacheStats();
+    const auto t1 = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < OPS; ++i) {
+        const unsigned n = depth + i;
+        memcpy(entry, &n, sizeof(n));
+        uint64_t ops = flashOps();
+        if (queue.pushBack(entry, sizeof(entry)) < 0) {
+            fprintf(stderr, "pushBack() failed\n");
+            exit(1);
+        }
+        pushOps += flashOps() - ops;
+        ops = flashOps();
+        typename QueueT::QueueEntry e = {};
+        if (queue.front(e, entry, sizeof(entry)) < 0 || queue.popFront() < 0) {
+            fprintf(stderr, "front() or popFront() failed\n");
+            exit(1);
+        }
+        popOps += flashOps() - ops;
+        unsigned v = 0;
+        memcpy(&v, entry, sizeof(v));
+        if (v != i) {
+            fprintf(stderr, "Unexpected entry: %u, expected: %u\n", v, i);
+            exit(1);
+        }
+    }
+    const auto t2 = std::chrono::steady_clock::now();
+    Result r = {};
+    r.pushOps = (double)pushOps / OPS;
+    r.popOps = (double)popOps / OPS;
+    r.reads = (double)(exflash_stats().reads - reads) / OPS;
+    const auto cs = cacheStats();
+    const uint32_t hits = cs.hits - cache.hits;
+    const uint32_t misses = cs.misses - cache.misses;
+    if (hits + misses > 0) {
+        r.hitRate = (double)hits / (hits + misses);
+    }
+    r.usec = std::chrono::duration<double, std::micro>(t2 - t1).count() / OPS;
+    return r;
+}
+
+void print(const char* name, unsigned depth, const Result& r) {
+    printf("%-18s %6u %10.1f %10.1f %10.1f %6.1f %12.1f\n", name, depth, r.pushOps, r.popOps, r.reads,
+            r.hitRate * 100, r.usec);
+}
+
+} // namespace
+
+int main() {
+    printf("Entry size: %u bytes, block size: %u bytes, cache: %u pages, read-ahead: %u pages\n\n",
+            (unsigned)ENTRY_SIZE, (unsigned)FILESYSTEM_BLOCK_SIZE, (unsigned)FILESYSTEM_CACHE_PAGES,
+            (unsigned)FILESYSTEM_CACHE_READ_AHEAD);
+    printf("%-18s %6s %10s %10s %10s %6s %12s\n", "Queue", "Depth", "Push ops", "Pop ops", "Reads", "Hit %",
+            "Pair (us)");
+    for (unsigned depth: DEPTHS) {
+        print("FileQueue", depth, run<FileQueue>(depth));
+        print("SegmentedFileQueue", depth, run<SegmentedFileQueue>(depth));
+    }
+    return 0;
+}
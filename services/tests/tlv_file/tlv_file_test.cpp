@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tests of TlvFile. The file is stored on the Gen 3 filesystem over a RAM image of the
+ * external flash, see hal/tests/littlefs. A reset of the device is simulated by closing the file
+ * and remounting the filesystem.
+ */
+
+#include "tlv_file.h"
+#include "exflash_host.h"
+#include "system_error.h"
+
+// Defined by service_debug.h
+#undef INFO
+#undef WARN
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace particle::fs;
+using namespace particle::services::settings;
+using namespace particle::test;
+
+namespace {
+
+const char* const FILE_PATH = "/sys/tlv_test.dat";
+
+// Sizes of the entry header and the file footer
+const size_t HEADER_SIZE = 8;
+const size_t FOOTER_SIZE = 16;
+
+filesystem_t* fs() {
+    return filesystem_get_instance(nullptr);
+}
+
+// Mounts the filesystem on a blank flash image
+struct Filesystem {
+    Filesystem() {
+        filesystem_unmount(fs());
+        exflash_fail_after(-1);
+        exflash_clear();
+        REQUIRE(filesystem_mount(fs()) == 0);
+    }
+
+    ~Filesystem() {
+        exflash_fail_after(-1);
+        filesystem_unmount(fs());
+    }
+};
+
+std::unique_ptr<TlvFile> openFile() {
+    std::unique_ptr<TlvFile> file(new TlvFile(FILE_PATH));
+    REQUIRE(file->init() == 0);
+    return file;
+}
+
+// Simulates a reset of the device
+std::unique_ptr<TlvFile> reopen(std::unique_ptr<TlvFile> file) {
+    REQUIRE(file->deInit() == 0);
+    file.reset();
+    REQUIRE(filesystem_unmount(fs()) == 0);
+    REQUIRE(filesystem_mount(fs()) == 0);
+    return openFile();
+}
+
+std::string value(unsigned key, unsigned i, size_t size = 24) {
+    std::string v(size, 'a' + (key + i) % 26);
+    v[0] = key;
+    if (size > 1) {
+        v[1] = i;
+    }
+    return v;
+}
+
+int add(TlvFile* file, uint16_t key, const std::string& v) {
+    return file->add(key, (const uint8_t*)v.data(), v.size());
+}
+
+// Returns the value of an entry, or an empty string if the entry can't be read
+std::string get(TlvFile* file, uint16_t key, int index = 0) {
+    uint8_t buf[1024] = {};
+    const ssize_t n = file->get(key, buf, sizeof(buf), index);
+    if (n < 0) {
+        return std::string();
+    }
+    return std::string((const char*)buf, n);
+}
+
+int writeFile(const char* path, const void* data, size_t size) {
+    FsLock lk(fs());
+    lfs_file_t file = {};
+    int r = lfs_file_open(&fs()->instance, &file, path, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+    if (r < 0) {
+        return r;
+    }
+    const lfs_ssize_t n = lfs_file_write(&fs()->instance, &file, data, size);
+    r = lfs_file_close(&fs()->instance, &file);
+    if (n < 0) {
+        return n;
+    }
+    return r;
+}
+
+} // namespace
+
+TEST_CASE("TlvFile") {
+    Filesystem fsys;
+    auto file = openFile();
+
+    SECTION("creates an empty file") {
+        CHECK(file->size() == FOOTER_SIZE);
+        uint8_t buf[8] = {};
+        CHECK(file->get(1, buf, sizeof(buf)) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(file->del(1) == SYSTEM_ERROR_NOT_FOUND);
+    }
+
+    SECTION("returns the entries of a key in the order in which they were added") {
+        for (unsigned i = 0; i < 3; ++i) {
+            REQUIRE(add(file.get(), 1, value(1, i)) == 0);
+            REQUIRE(add(file.get(), 2, value(2, i)) == 0);
+        }
+        for (unsigned i = 0; i < 3; ++i) {
+            CHECK(get(file.get(), 1, i) == value(1, i));
+            CHECK(get(file.get(), 2, i) == value(2, i));
+        }
+        uint8_t buf[8] = {};
+        CHECK(file->get(1, buf, sizeof(buf), 3) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(file->get(3, buf, sizeof(buf)) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(file->size() == (ssize_t)(6 * (HEADER_SIZE + 24) + FOOTER_SIZE));
+    }
+
+    SECTION("reads no more than the size of the buffer") {
+        REQUIRE(add(file.get(), 1, value(1, 0, 100)) == 0);
+        uint8_t buf[10] = {};
+        CHECK(file->get(1, buf, sizeof(buf)) == sizeof(buf));
+        CHECK(std::string((const char*)buf, sizeof(buf)) == value(1, 0, 100).substr(0, sizeof(buf)));
+        CHECK(file->get(1, nullptr, 10) == SYSTEM_ERROR_INVALID_ARGUMENT);
+    }
+
+    SECTION("deletes an entry by its index") {
+        for (unsigned i = 0; i < 3; ++i) {
+            REQUIRE(add(file.get(), 1, value(1, i)) == 0);
+            REQUIRE(add(file.get(), 2, value(2, i)) == 0);
+        }
+        CHECK(file->del(1, 1) == 1);
+        CHECK(get(file.get(), 1, 0) == value(1, 0));
+        CHECK(get(file.get(), 1, 1) == value(1, 2));
+        CHECK(get(file.get(), 1, 2).empty());
+        CHECK(file->del(1, 2) == SYSTEM_ERROR_NOT_FOUND);
+        for (unsigned i = 0; i < 3; ++i) {
+            CHECK(get(file.get(), 2, i) == value(2, i));
+        }
+        CHECK(file->size() == (ssize_t)(5 * (HEADER_SIZE + 24) + FOOTER_SIZE));
+    }
+
+    SECTION("deletes all entries of a key and returns their number") {
+        for (unsigned i = 0; i < 4; ++i) {
+            REQUIRE(add(file.get(), 1, value(1, i)) == 0);
+            REQUIRE(add(file.get(), 2, value(2, i)) == 0);
+        }
+        CHECK(file->del(1) == 4);
+        CHECK(get(file.get(), 1).empty());
+        for (unsigned i = 0; i < 4; ++i) {
+            CHECK(get(file.get(), 2, i) == value(2, i));
+        }
+        CHECK(file->del(1) == SYSTEM_ERROR_NOT_FOUND);
+        CHECK(file->del(2, -1) == 4);
+        CHECK(file->size() == FOOTER_SIZE);
+    }
+
+    SECTION("moves entries larger than the copy buffer when compacting the file") {
+        REQUIRE(add(file.get(), 1, value(1, 0, 10)) == 0);
+        REQUIRE(add(file.get(), 2, value(2, 0, 300)) == 0);
+        REQUIRE(add(file.get(), 1, value(1, 1, 10)) == 0);
+        REQUIRE(add(file.get(), 3, value(3, 0, 500)) == 0);
+        REQUIRE(add(file.get(), 4, value(4, 0, 200)) == 0);
+        CHECK(file->del(1) == 2);
+        CHECK(get(file.get(), 2) == value(2, 0, 300));
+        CHECK(get(file.get(), 3) == value(3, 0, 500));
+        CHECK(get(file.get(), 4) == value(4, 0, 200));
+        file = reopen(std::move(file));
+        CHECK(get(file.get(), 2) == value(2, 0, 300));
+        CHECK(get(file.get(), 3) == value(3, 0, 500));
+        CHECK(get(file.get(), 4) == value(4, 0, 200));
+    }
+
+    SECTION("replaces all entries of a key when setting its value") {
+        REQUIRE(add(file.get(), 1, value(1, 0)) == 0);
+        REQUIRE(add(file.get(), 2, value(2, 0)) == 0);
+        REQUIRE(add(file.get(), 1, value(1, 1)) == 0);
+        const auto v = value(1, 5, 40);
+        CHECK(file->set(1, (const uint8_t*)v.data(), v.size()) == 0);
+        CHECK(get(file.get(), 1, 0) == v);
+        CHECK(get(file.get(), 1, 1).empty());
+        CHECK(get(file.get(), 2) == value(2, 0));
+        // Setting a new key adds it
+        CHECK(file->set(3, (const uint8_t*)v.data(), v.size()) == 0);
+        CHECK(get(file.get(), 3) == v);
+    }
+
+    SECTION("keeps the entries across a reset") {
+        for (unsigned i = 0; i < 10; ++i) {
+            REQUIRE(add(file.get(), i % 3, value(i % 3, i / 3)) == 0);
+        }
+        REQUIRE(file->del(1, 0) == 1);
+        file = reopen(std::move(file));
+        CHECK(get(file.get(), 0, 3) == value(0, 3));
+        CHECK(get(file.get(), 1, 0) == value(1, 1));
+        CHECK(get(file.get(), 1, 2).empty());
+        CHECK(get(file.get(), 2, 2) == value(2, 2));
+        CHECK(file->del(0) == 4);
+    }
+
+    SECTION("creates the file anew if it's corrupted") {
+        REQUIRE(add(file.get(), 1, value(1, 0)) == 0);
+        REQUIRE(file->deInit() == 0);
+        const std::string garbage(64, 'x');
+        REQUIRE(writeFile(FILE_PATH, garbage.data(), garbage.size()) == 0);
+        REQUIRE(file->init() == 0);
+        CHECK(file->size() == FOOTER_SIZE);
+        CHECK(get(file.get(), 1).empty());
+    }
+
+    SECTION("removes the file when purged") {
+        REQUIRE(add(file.get(), 1, value(1, 0)) == 0);
+        CHECK(file->purge() == 0);
+        CHECK(file->size() == SYSTEM_ERROR_INVALID_STATE);
+        REQUIRE(file->init() == 0);
+        CHECK(get(file.get(), 1).empty());
+    }
+
+    SECTION("reloads its index from the file after a failed write") {
+        for (unsigned i = 0; i < 4; ++i) {
+            REQUIRE(add(file.get(), 1, value(1, i)) == 0);
+        }
+        exflash_fail_after(0);
+        CHECK(add(file.get(), 2, value(2, 0)) < 0);
+        CHECK(file->del(1, 0) < 0);
+        exflash_fail_after(-1);
+        // The entries that are in the file are returned
+        for (unsigned i = 0; i < 4; ++i) {
+            CHECK(get(file.get(), 1, i) == value(1, i));
+        }
+        CHECK(add(file.get(), 2, value(2, 0)) == 0);
+        CHECK(file->del(1) == 4);
+        file = reopen(std::move(file));
+        CHECK(get(file.get(), 1).empty());
+        CHECK(get(file.get(), 2) == value(2, 0));
+    }
+
+    file->deInit();
+}
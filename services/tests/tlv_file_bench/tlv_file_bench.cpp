@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Cost of TlvFile operations versus the number of entries in the file.
+ *
+ * The file is filled with entries that have distinct keys, after which the entries are read and
+ * replaced in random order. Replacing an entry deletes it, which compacts the file, and appends
+ * the new value. The number of flash operations per call is reported along with the time spent
+ * on the host.
+ *
+ * The file is stored on the Gen 3 filesystem over a RAM image of the external flash, see
+ * hal/tests/littlefs. Flash reads go through the same block cache as on the device. Build with
+ * CACHE_PAGES=0 to compare against uncached reads.
+ */
+
+#include "tlv_file.h"
+#include "exflash_host.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+using namespace particle::fs;
+using namespace particle::services::settings;
+using namespace particle::test;
+
+namespace {
+
+const char* const FILE_PATH = "/sys/tlv_bench.dat";
+const size_t VALUE_SIZE = 24;
+const unsigned OPS = 64;
+const unsigned ENTRIES[] = { 16, 64, 256 };
+
+filesystem_t* fs() {
+    return filesystem_get_instance(nullptr);
+}
+
+// Mounts the filesystem on a blank flash image
+void formatFilesystem() {
+    filesystem_unmount(fs());
+    exflash_clear();
+    if (filesystem_mount(fs()) != 0) {
+        fprintf(stderr, "Unable to format the filesystem\n");
+        exit(1);
+    }
+}
+
+struct Ops {
+    double reads; // Flash reads per call
+    double writes; // Flash programs and erases per call
+    double usec; // Host time per call
+};
+
+struct Result {
+    Ops get;
+    Ops set;
+};
+
+class Counter {
+public:
+    Counter() :
+            reads_(exflash_stats().reads),
+            writes_(exflash_stats().progs + exflash_stats().erases),
+            t_(std::chrono::steady_clock::now()) {
+    }
+
+    Ops result(unsigned count) const {
+        const auto t = std::chrono::steady_clock::now();
+        Ops ops = {};
+        ops.reads = (double)(exflash_stats().reads - reads_) / count;
+        ops.writes = (double)(exflash_stats().progs + exflash_stats().erases - writes_) / count;
+        ops.usec = std::chrono::duration<double, std::micro>(t - t_).count() / count;
+        return ops;
+    }
+
+private:
+    uint64_t reads_;
+    uint64_t writes_;
+    std::chrono::steady_clock::time_point t_;
+};
+
+Result run(unsigned entries) {
+    formatFilesystem();
+    TlvFile file(FILE_PATH);
+    if (file.init() != 0) {
+        fprintf(stderr, "init() failed\n");
+        exit(1);
+    }
+    uint8_t value[VALUE_SIZE] = {};
+    for (unsigned i = 0; i < entries; ++i) {
+        memcpy(value, &i, sizeof(i));
+        if (file.add(i, value, sizeof(value)) < 0) {
+            fprintf(stderr, "add() failed\n");
+            exit(1);
+        }
+    }
+    std::mt19937 rand(entries);
+    Result r = {};
+    {
+        Counter c;
+        for (unsigned i = 0; i < OPS; ++i) {
+            const unsigned key = rand() % entries;
+            unsigned v = 0;
+            if (file.get(key, value, sizeof(value)) != sizeof(value) || (memcpy(&v, value, sizeof(v)), v != key)) {
+                fprintf(stderr, "get() failed\n");
+                exit(1);
+            }
+        }
+        r.get = c.result(OPS);
+    }
+    {
+        Counter c;
+        for (unsigned i = 0; i < OPS; ++i) {
+            const unsigned key = rand() % entries;
+            memcpy(value, &key, sizeof(key));
+            if (file.set(key, value, sizeof(value)) != 0) {
+                fprintf(stderr, "set() failed\n");
+                exit(1);
+            }
+        }
+        r.set = c.result(OPS);
+    }
+    file.deInit();
+    return r;
+}
+
+} // namespace
+
+int main() {
+    printf("Value size: %u bytes, block size: %u bytes, cache: %u pages\n\n", (unsigned)VALUE_SIZE,
+            (unsigned)FILESYSTEM_BLOCK_SIZE, (unsigned)FILESYSTEM_CACHE_PAGES);
+    printf("%8s %10s %10s %10s %10s %10s\n", "Entries", "Get reads", "Get (us)", "Set reads", "Set writes",
+            "Set (us)");
+    for (unsigned entries: ENTRIES) {
+        const auto r = run(entries);
+        printf("%8u %10.1f %10.1f %10.1f %10.1f %10.1f\n", entries, r.get.reads, r.get.usec, r.set.reads,
+                r.set.writes, r.set.usec);
+    }
+    return 0;
+}
@@ -20,6 +20,7 @@
 #pragma once
 
 #include <cstddef>
+#include <atomic>
 
 #if PLATFORM_THREADING
 
@@ -363,12 +364,22 @@ public:
 class ActiveObjectQueue : public ActiveObjectBase
 {
     os_queue_t  queue;
+    std::atomic_flag wakeup_pending = ATOMIC_FLAG_INIT;
 
 protected:
 
     virtual bool take(Item& result)
     {
-        return !os_queue_take(queue, &result, configuration.take_wait, nullptr);
+        return take(result, configuration.take_wait);
+    }
+
+    bool take(Item& result, unsigned timeout)
+    {
+        if (os_queue_take(queue, &result, timeout, nullptr))
+            return false;
+        if (!result)
+            wakeup_pending.clear();
+        return true;
     }
 
     virtual bool put(Item& item)
@@ -389,6 +400,37 @@ public:
     {
         createQueue();
     }
+
+    using ActiveObjectBase::process;
+
+    /**
+     * Waits for a message and processes it.
+     *
+     * @param timeout Maximum time to wait in milliseconds.
+     * @return `true` if a message was processed.
+     */
+    bool process(unsigned timeout)
+    {
+        Item item = nullptr;
+        if (!queue || !take(item, timeout) || !item)
+            return false;
+        Message& msg = *item;
+        msg();
+        return true;
+    }
+
+    /**
+     * Wakes up the thread waiting for messages without posting a message. The background task runs
+     * as if the take timeout expired. This method can be called from an ISR.
+     */
+    void wakeup()
+    {
+        if (!queue || wakeup_pending.test_and_set())
+            return; // A wakeup is already queued
+        Item item = nullptr;
+        if (os_queue_put(queue, &item, 0, nullptr))
+            wakeup_pending.clear();
+    }
 };
 
 
@@ -414,6 +456,11 @@ public:
     {
         ActiveObjectQueue::process();
     }
+
+    bool process(unsigned timeout)
+    {
+        return ActiveObjectQueue::process(timeout);
+    }
 };
 
 
@@ -454,9 +501,18 @@ public:
         Task* next; // Next element in the queue
     };
 
-    ISRTaskQueue() :
+    typedef void(*WakeupFunc)();
+
+    /**
+     * Constructor.
+     *
+     * @param wakeup Function that is called after a task is enqueued to wake up the event loop
+     *        processing the queue (optional). The function is called from an ISR.
+     */
+    explicit ISRTaskQueue(WakeupFunc wakeup = nullptr) :
             firstTask_(nullptr),
-            lastTask_(nullptr) {
+            lastTask_(nullptr),
+            wakeup_(wakeup) {
     }
 
     void enqueue(Task* task);
@@ -465,4 +521,5 @@ public:
 private:
     Task* volatile firstTask_;
     Task* lastTask_;
+    WakeupFunc wakeup_;
 };
@@ -115,6 +115,9 @@ const uint32_t PUBLISH_EVENT_FLAG_PUBLIC = 0x0;
 const uint32_t PUBLISH_EVENT_FLAG_PRIVATE = 0x1;
 const uint32_t PUBLISH_EVENT_FLAG_NO_ACK = 0x2;
 const uint32_t PUBLISH_EVENT_FLAG_WITH_ACK = 0x8;
+// Store the event in the persistent publish queue if it can't be sent right away. Requires a
+// platform with a filesystem
+const uint32_t PUBLISH_EVENT_FLAG_STORE_FORWARD = 0x10;
 
 PARTICLE_STATIC_ASSERT(publish_no_ack_flag_matches, PUBLISH_EVENT_FLAG_NO_ACK==EventType::NO_ACK);
 
@@ -178,6 +181,25 @@ typedef struct {
 } spark_send_event_data;
 
 bool spark_send_event(const char* name, const char* data, int ttl, uint32_t flags, void* reserved);
+
+// Configuration of the persistent publish queue
+typedef struct {
+    uint16_t size; // Size of this structure
+    uint16_t reserved;
+    uint32_t max_size; // Maximum total size of the stored events in bytes
+    uint32_t max_age; // Maximum age of a stored event in seconds (0 - no limit)
+    uint32_t min_interval; // Minimum interval in milliseconds between sending of the stored events
+} spark_publish_queue_config;
+
+/**
+ * Configure the persistent publish queue.
+ *
+ * Events published with PUBLISH_EVENT_FLAG_STORE_FORWARD while the device is not connected to the
+ * cloud, or while older stored events are still pending, are written to the queue, and are sent in
+ * order once the device connects. An event is removed from the queue when it has been sent
+ * successfully, or when it's older than `max_age`. New events are rejected while the queue is full.
+ */
+int spark_set_publish_queue_config(const spark_publish_queue_config* conf, void* reserved);
 bool spark_subscribe(const char *eventName, EventHandler handler, void* handler_data,
         Spark_Subscription_Scope_TypeDef scope, const char* deviceID, void* reserved);
 void spark_unsubscribe(void *reserved);
@@ -210,6 +232,17 @@ int spark_set_connection_property(unsigned property_id, unsigned data, particle:
 
 int spark_set_random_seed_from_cloud_handler(void (*handler)(unsigned int), void* reserved);
 
+/**
+ * Configures the rate limit for user events whose name starts with `prefix`.
+ * See spark_protocol_set_event_rate_limit().
+ */
+int spark_set_event_rate_limit(const char* prefix, uint16_t burst, system_tick_t interval, uint8_t priority, void* reserved);
+
+/**
+ * Retrieves the counters of the rate limit configured for `prefix`.
+ */
+int spark_get_event_rate_limit_stats(const char* prefix, spark_protocol_event_rate_limit_stats* stats, void* reserved);
+
 extern const unsigned char backup_udp_public_server_key[];
 extern const size_t backup_udp_public_server_key_size;
 
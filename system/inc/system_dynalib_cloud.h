@@ -49,6 +49,9 @@ DYNALIB_FN(12, system_cloud, spark_sync_time_pending, bool(void*))
 DYNALIB_FN(13, system_cloud, spark_sync_time_last, system_tick_t(time_t*, void*))
 DYNALIB_FN(14, system_cloud, spark_set_connection_property, int(unsigned, unsigned, particle::protocol::connection_properties_t*, void*))
 DYNALIB_FN(15, system_cloud, spark_set_random_seed_from_cloud_handler, int(void (*handler)(unsigned int), void*))
+DYNALIB_FN(16, system_cloud, spark_set_publish_queue_config, int(const spark_publish_queue_config*, void*))
+DYNALIB_FN(17, system_cloud, spark_set_event_rate_limit, int(const char*, uint16_t, system_tick_t, uint8_t, void*))
+DYNALIB_FN(18, system_cloud, spark_get_event_rate_limit_stats, int(const char*, spark_protocol_event_rate_limit_stats*, void*))
 
 DYNALIB_END(system_cloud)
 
@@ -70,6 +70,13 @@ extern volatile system_tick_t spark_loop_total_millis;
 
 void system_delay_ms(unsigned long ms, bool no_background_loop);
 
+/**
+ * Wakes up the system loop so that it runs the background processing without waiting for its
+ * next scheduled run. This function is called by the event sources of the loop, such as the
+ * network manager and the ISR task queue, and can be called from an ISR.
+ */
+void system_loop_wakeup();
+
 /**
  * Determines the backoff period after a number of failed connections.
  */
@@ -149,6 +149,15 @@ void system_pending_shutdown();
 int system_set_flag(system_flag_t flag, uint8_t value, void* reserved);
 int system_get_flag(system_flag_t flag, uint8_t* value,void* reserved);
 
+/**
+ * Flags supported by `system_format_diag_data()`.
+ */
+typedef enum system_format_diag_flag {
+    SYSTEM_FORMAT_DIAG_FLAG_BINARY = 0x01, ///< Binary format (JSON is used by default).
+    SYSTEM_FORMAT_DIAG_FLAG_COMPACT = 0x02 ///< Varint-encoded binary format with support for aggregate data types
+                                           ///< (requires `SYSTEM_FORMAT_DIAG_FLAG_BINARY`).
+} system_format_diag_flag;
+
 /**
  * Formats the diagnostic data using an appender function.
  *
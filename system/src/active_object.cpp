@@ -93,6 +93,9 @@ void ISRTaskQueue::enqueue(Task* task) {
         task->next = nullptr;
         lastTask_ = task;
     }
+    if (wakeup_) {
+        wakeup_();
+    }
 }
 
 bool ISRTaskQueue::process() {
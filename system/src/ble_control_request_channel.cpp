@@ -27,13 +27,15 @@ LOG_SOURCE_CATEGORY("system.ctrl.ble")
 
 #include "timer_hal.h"
 #include "deviceid_hal.h"
+#include "system_threading.h"
 
 #include "scope_guard.h"
 #include "endian_util.h"
+#include "aes_ccm.h"
 #include "debug.h"
 
 #include "mbedtls/ecjpake.h"
-#include "mbedtls/ccm.h"
+#include "mbedtls/aes.h"
 #include "mbedtls/md.h"
 
 #include "mbedtls_util.h"
@@ -128,6 +130,16 @@ const unsigned RECV_CHAR_UUID = 0x0004;
 // Size of the buffer pool
 const size_t BUFFER_POOL_SIZE = 1024;
 
+// Stack size of the processing thread. The deepest path is the verification of a J-PAKE round:
+// mbedtls_ecjpake_read_round_*() -> ecjpake_zkp_read() -> mbedtls_ecp_muladd(), with the hash
+// buffer of ecjpake_hash() (~420 bytes) and the comb tables of ecp_mul_comb() (~400 bytes) on the
+// stack. The J-PAKE context and the handshake buffers are allocated on the heap. Debug builds log
+// the amount of stack that has remained free after each handshake
+const size_t THREAD_STACK_SIZE = 5 * 1024;
+
+// Interval at which the processing thread checks for timeouts while a client is connected
+const system_tick_t THREAD_WAKEUP_INTERVAL = 1000;
+
 // Size of the message header
 const size_t MESSAGE_HEADER_SIZE = sizeof(MessageHeader);
 
@@ -304,6 +316,32 @@ private:
     mbedtls_md_context_t ctx_;
 };
 
+// AES block cipher used by the AES-CCM cipher
+class AesBlockCipher {
+public:
+    AesBlockCipher() :
+            ctx_() {
+        mbedtls_aes_init(&ctx_);
+    }
+
+    ~AesBlockCipher() {
+        mbedtls_aes_free(&ctx_);
+    }
+
+    int setKey(const char* key, size_t size) {
+        CHECK_MBEDTLS(mbedtls_aes_setkey_enc(&ctx_, (const uint8_t*)key, size * 8));
+        return 0;
+    }
+
+    int encrypt(const uint8_t* in, uint8_t* out) {
+        CHECK_MBEDTLS(mbedtls_aes_crypt_ecb(&ctx_, MBEDTLS_AES_ENCRYPT, in, out));
+        return 0;
+    }
+
+private:
+    mbedtls_aes_context ctx_;
+};
+
 } // particle::system::
 
 class BleControlRequestChannel::HandshakeHandler {
@@ -432,6 +470,43 @@ public:
     }
 
     virtual int run() override {
+        // Keep going while the handshake makes progress without waiting for more data
+        for (;;) {
+            const auto prevState = state_;
+            const int ret = step();
+            if (ret != Result::RUNNING || state_ == prevState) {
+                return ret;
+            }
+        }
+    }
+
+    const char* secret() const {
+        if (state_ != State::DONE) {
+            return nullptr;
+        }
+        return secret_;
+    }
+
+private:
+    enum class State {
+        NEW,
+        READ_ROUND1,
+        WRITE_ROUND1,
+        READ_ROUND2,
+        WRITE_ROUND2,
+        READ_CONFIRM,
+        WRITE_CONFIRM,
+        DONE,
+        FAILED
+    };
+
+    Sha256 hash_;
+    mbedtls_ecjpake_context ctx_;
+    char secret_[JPAKE_SHARED_SECRET_SIZE];
+    char confirmKey_[Sha256::SIZE];
+    State state_;
+
+    int step() {
         int ret = 0;
         switch (state_) {
         case State::READ_ROUND1:
@@ -463,32 +538,6 @@ public:
         return ret;
     }
 
-    const char* secret() const {
-        if (state_ != State::DONE) {
-            return nullptr;
-        }
-        return secret_;
-    }
-
-private:
-    enum class State {
-        NEW,
-        READ_ROUND1,
-        WRITE_ROUND1,
-        READ_ROUND2,
-        WRITE_ROUND2,
-        READ_CONFIRM,
-        WRITE_CONFIRM,
-        DONE,
-        FAILED
-    };
-
-    Sha256 hash_;
-    mbedtls_ecjpake_context ctx_;
-    char secret_[JPAKE_SHARED_SECRET_SIZE];
-    char confirmKey_[Sha256::SIZE];
-    State state_;
-
     int readRound1() {
         const char* data = nullptr;
         size_t size = 0;
@@ -606,56 +655,62 @@ private:
     }
 };
 
+// AES-CCM cipher (RFC 3610). Request data is decrypted incrementally, as it arrives in BLE packets
 class BleControlRequestChannel::AesCcmCipher {
 public:
     AesCcmCipher() :
-            ctx_(),
             reqCount_(0),
             repCount_(0) {
     }
 
     ~AesCcmCipher() {
-        mbedtls_ccm_free(&ctx_);
         memset(reqNonce_, 0, AES_CCM_FIXED_NONCE_SIZE);
         memset(repNonce_, 0, AES_CCM_FIXED_NONCE_SIZE);
     }
 
     int init(const char* key, const char* clientNonce, const char* serverNonce) {
-        mbedtls_ccm_init(&ctx_);
-        CHECK_MBEDTLS(mbedtls_ccm_setkey(&ctx_, MBEDTLS_CIPHER_ID_AES, (const uint8_t*)key, AES_CCM_KEY_SIZE * 8));
+        CHECK(ccm_.cipher().setKey(key, AES_CCM_KEY_SIZE));
         memcpy(reqNonce_, clientNonce, AES_CCM_FIXED_NONCE_SIZE);
         memcpy(repNonce_, serverNonce, AES_CCM_FIXED_NONCE_SIZE);
         return 0;
     }
 
-    int decryptRequestData(char* buf, size_t payloadSize) {
+    // Starts decryption of a request message. `header` is the message header and `size` is the
+    // size of the encrypted data that follows it
+    int startRequest(const char* header, size_t size) {
         char nonce[AES_CCM_NONCE_SIZE] = {};
         genRequestNonce(nonce);
-        CHECK_MBEDTLS(mbedtls_ccm_auth_decrypt(&ctx_,
-                payloadSize + REQUEST_HEADER_SIZE, // Size of the input data
-                (const uint8_t*)nonce, AES_CCM_NONCE_SIZE, // Nonce
-                (const uint8_t*)buf, MESSAGE_HEADER_SIZE, // Additional data
-                (const uint8_t*)buf + MESSAGE_HEADER_SIZE, // Input buffer
-                (uint8_t*)buf + MESSAGE_HEADER_SIZE, // Output buffer
-                (const uint8_t*)buf + payloadSize + MESSAGE_HEADER_SIZE + REQUEST_HEADER_SIZE, AES_CCM_TAG_SIZE)); // Authentication tag
-        return 0;
+        return ccm_.start(nonce, header, MESSAGE_HEADER_SIZE, size);
+    }
+
+    // Decrypts a fragment of the request data. The input and output buffers can be the same
+    int decrypt(const char* in, char* out, size_t size) {
+        return ccm_.decrypt(in, out, size);
     }
 
-    int encryptReplyData(char* buf, size_t payloadSize) {
+    // Verifies the authentication tag of the request message
+    int finishRequest(const char* tag) {
+        const int ret = ccm_.verify(tag);
+        if (ret == SYSTEM_ERROR_BAD_DATA) {
+            LOG_DEBUG(ERROR, "Invalid authentication tag");
+        }
+        return ret;
+    }
+
+    // Encrypts reply data in place. `buf` contains the message header, the data and the space for
+    // the authentication tag
+    int encryptReply(char* buf, size_t size) {
         char nonce[AES_CCM_NONCE_SIZE] = {};
         genReplyNonce(nonce);
-        CHECK_MBEDTLS(mbedtls_ccm_encrypt_and_tag(&ctx_,
-                payloadSize + REPLY_HEADER_SIZE, // Size of the input data
-                (const uint8_t*)nonce, AES_CCM_NONCE_SIZE, // Nonce
-                (const uint8_t*)buf, MESSAGE_HEADER_SIZE, // Additional data
-                (const uint8_t*)buf + MESSAGE_HEADER_SIZE, // Input buffer
-                (uint8_t*)buf + MESSAGE_HEADER_SIZE, // Output buffer
-                (uint8_t*)buf + payloadSize + MESSAGE_HEADER_SIZE + REPLY_HEADER_SIZE, AES_CCM_TAG_SIZE)); // Authentication tag
+        CHECK(ccm_.start(nonce, buf, MESSAGE_HEADER_SIZE, size));
+        char* p = buf + MESSAGE_HEADER_SIZE;
+        CHECK(ccm_.encrypt(p, p, size));
+        CHECK(ccm_.finish(p + size));
         return 0;
     }
 
 private:
-    mbedtls_ccm_context ctx_;
+    AesCcm<AesBlockCipher, AES_CCM_NONCE_SIZE, AES_CCM_TAG_SIZE> ccm_;
     char reqNonce_[AES_CCM_FIXED_NONCE_SIZE];
     char repNonce_[AES_CCM_FIXED_NONCE_SIZE];
     uint32_t reqCount_;
@@ -674,6 +729,102 @@ private:
     }
 };
 
+// Pool of fixed-size buffers for received packets. The buffers are sized to the negotiated packet
+// size, so that a packet normally takes a single buffer. The pool is repartitioned when the packet
+// size changes and none of the buffers are in use
+class BleControlRequestChannel::PacketPool: public SimpleAllocator {
+public:
+    PacketPool() :
+            free_(nullptr),
+            size_(0),
+            slotSize_(0),
+            newSlotSize_(slotSize(BLE_MIN_ATTR_VALUE_PACKET_SIZE)),
+            usedCount_(0) {
+    }
+
+    int init(size_t size) {
+        mem_.reset(new(std::nothrow) char[size]);
+        if (!mem_) {
+            return SYSTEM_ERROR_NO_MEMORY;
+        }
+        size_ = size;
+        partition();
+        return 0;
+    }
+
+    void setDataSize(size_t size) {
+        ATOMIC_BLOCK() {
+            newSlotSize_ = slotSize(size);
+            partitionIfUnused();
+        }
+    }
+
+    // Returns the maximum size of the data that fits in a single buffer
+    size_t dataSize() {
+        size_t size = 0;
+        ATOMIC_BLOCK() {
+            partitionIfUnused();
+            size = slotSize_ - HEADER_SIZE;
+        }
+        return size;
+    }
+
+    virtual void* alloc(size_t size) override {
+        Slot* s = nullptr;
+        ATOMIC_BLOCK() {
+            if (size <= slotSize_ && free_) {
+                s = free_;
+                free_ = s->next;
+                ++usedCount_;
+            }
+        }
+        return s;
+    }
+
+    virtual void free(void* ptr) override {
+        ATOMIC_BLOCK() {
+            const auto s = (Slot*)ptr;
+            s->next = free_;
+            free_ = s;
+            --usedCount_;
+        }
+    }
+
+private:
+    struct Slot {
+        Slot* next;
+    };
+
+    static constexpr size_t HEADER_SIZE = detail::alignedSize(sizeof(Buffer));
+
+    std::unique_ptr<char[]> mem_;
+    Slot* free_;
+    size_t size_;
+    size_t slotSize_;
+    size_t newSlotSize_;
+    size_t usedCount_;
+
+    void partitionIfUnused() {
+        if (usedCount_ == 0 && slotSize_ != newSlotSize_) {
+            partition();
+        }
+    }
+
+    void partition() {
+        slotSize_ = newSlotSize_;
+        free_ = nullptr;
+        for (size_t offs = (size_ / slotSize_) * slotSize_; offs > 0; offs -= slotSize_) {
+            const auto s = (Slot*)(mem_.get() + offs - slotSize_);
+            s->next = free_;
+            free_ = s;
+        }
+    }
+
+    static constexpr size_t slotSize(size_t dataSize) {
+        return detail::alignedSize(HEADER_SIZE + dataSize);
+    }
+};
+
 BleControlRequestChannel::BleControlRequestChannel(ControlRequestHandler* handler) :
         ControlRequestChannel(handler),
 #if BLE_CHANNEL_DEBUG_ENABLED
@@ -686,6 +837,8 @@ BleControlRequestChannel::BleControlRequestChannel(ControlRequestHandler* handle
         reqBufSize_(0),
         reqBufOffs_(0),
         packetSize_(0),
+        thread_(nullptr),
+        sem_(nullptr),
         connHandle_(BLE_INVALID_CONN_HANDLE),
         curConnHandle_(BLE_INVALID_CONN_HANDLE),
         connId_(0),
@@ -706,16 +859,28 @@ int BleControlRequestChannel::init() {
     // Make sure we have a copy of the device secret in the DCT, so that it can be easily extracted
     // via dfu-util for testing purposes
     hal_get_device_secret(nullptr, 0, nullptr);
-    // Initialize the BLE profile
-    int ret = initProfile();
+    // TODO: Initialize the buffer pool when a BLE connection is accepted
+    pool_.reset(new(std::nothrow) PacketPool());
+    int ret = pool_ ? pool_->init(BUFFER_POOL_SIZE) : SYSTEM_ERROR_NO_MEMORY;
     if (ret != 0) {
         goto error;
     }
-    // TODO: Initialize this allocator when a BLE connection is accepted
-    ret = pool_.init(BUFFER_POOL_SIZE);
+    if (os_semaphore_create(&sem_, 1, 0) != 0) {
+        sem_ = nullptr;
+        ret = SYSTEM_ERROR_NO_MEMORY;
+        goto error;
+    }
+    // Initialize the BLE profile
+    ret = initProfile();
     if (ret != 0) {
         goto error;
     }
+    // Start the processing thread
+    if (os_thread_create(&thread_, "ble_ctrl", OS_THREAD_PRIORITY_DEFAULT, threadLoop, this, THREAD_STACK_SIZE) != 0) {
+        thread_ = nullptr;
+        ret = SYSTEM_ERROR_NO_MEMORY;
+        goto error;
+    }
     return 0;
 error:
     destroy();
@@ -723,7 +888,15 @@ error:
 }
 
 void BleControlRequestChannel::destroy() {
-    // TODO: There doesn't seem to be a straightforward way to uninitialize the profile
+    // TODO: There doesn't seem to be a straightforward way to uninitialize the profile. The processing
+    // thread keeps running for as long as the profile is registered
+    if (!thread_) {
+        if (sem_) {
+            os_semaphore_destroy(sem_);
+            sem_ = nullptr;
+        }
+        pool_.reset();
+    }
 }
 
 void BleControlRequestChannel::run() {
@@ -731,7 +904,8 @@ void BleControlRequestChannel::run() {
     const auto connId = curConnId_.load(std::memory_order_acquire);
     if (connId_ != connId) {
         const auto prevConnHandle = connHandle_;
-        connHandle_ = curConnHandle_;
+        // The handle is published by the connection state counter
+        connHandle_ = curConnHandle_.load(std::memory_order_relaxed);
         connId_ = connId;
         // Reset channel state
         resetChannel();
@@ -761,15 +935,18 @@ void BleControlRequestChannel::run() {
                 }
                 jpake_.reset();
                 LOG(TRACE, "Handshake done");
+                LOG_DEBUG(TRACE, "Stack high-water mark: %d bytes free of %u", os_thread_stack_high_water_mark(thread_),
+                        (unsigned)THREAD_STACK_SIZE);
             }
-        } else {
+        }
+        if (!jpake_) {
 #endif
-            // Serialize next reply and enqueue it for sending
+            // Serialize completed replies and enqueue them for sending
             ret = sendReply();
             if (ret != 0) {
                 goto error;
             }
-            // Receive next request
+            // Receive requests
             ret = receiveRequest();
             if (ret != 0) {
                 goto error;
@@ -777,7 +954,7 @@ void BleControlRequestChannel::run() {
 #if BLE_CHANNEL_SECURITY_ENABLED
         }
 #endif
-        // Send BLE notification packet
+        // Send BLE notification packets
         ret = sendPacket();
         if (ret != 0) {
             goto error;
@@ -819,8 +996,16 @@ void BleControlRequestChannel::setResult(ctrl_request* ctrlReq, int result, ctrl
     req->result = result;
     req->handler = handler;
     req->handlerData = data;
-    const std::lock_guard<Mutex> lock(readyReqsLock_);
-    readyReqs_.pushBack(req);
+    {
+        const std::lock_guard<Mutex> lock(readyReqsLock_);
+        readyReqs_.pushBack(req);
+    }
+    wakeup();
+}
+
+// Note: This method can be called from an ISR
+void BleControlRequestChannel::wakeup() {
+    os_semaphore_give(sem_, false);
 }
 
 int BleControlRequestChannel::initChannel() {
@@ -863,137 +1048,179 @@ void BleControlRequestChannel::resetChannel() {
 }
 
 int BleControlRequestChannel::receiveRequest() {
-    if (!curReq_) {
-        // Read message header
-        MessageHeader mh = {};
-        if (!readAll((char*)&mh, MESSAGE_HEADER_SIZE)) {
-            return 0; // Wait for more data
+    for (;;) {
+        if (!curReq_) {
+            // Read message header
+            MessageHeader mh = {};
+            if (!readAll((char*)&mh, MESSAGE_HEADER_SIZE)) {
+                return 0; // Wait for more data
+            }
+            // Allocate a request object
+            const size_t payloadSize = littleEndianToNative(mh.size);
+            CHECK(allocRequest(payloadSize, &curReq_));
+            memcpy(curReq_->reqBuf, &mh, MESSAGE_HEADER_SIZE);
+            reqBufSize_ = payloadSize + MESSAGE_HEADER_SIZE + REQUEST_HEADER_SIZE + MESSAGE_FOOTER_SIZE; // Total size of the request data
+            reqBufOffs_ = MESSAGE_HEADER_SIZE;
+#if BLE_CHANNEL_SECURITY_ENABLED
+            SPARK_ASSERT(aesCcm_);
+            CHECK(aesCcm_->startRequest((const char*)&mh, payloadSize + REQUEST_HEADER_SIZE));
+#endif
         }
-        // Allocate a request object
-        const size_t payloadSize = littleEndianToNative(mh.size);
-        CHECK(allocRequest(payloadSize, &curReq_));
-        memcpy(curReq_->reqBuf, &mh, MESSAGE_HEADER_SIZE);
-        reqBufSize_ = payloadSize + MESSAGE_HEADER_SIZE + REQUEST_HEADER_SIZE + MESSAGE_FOOTER_SIZE; // Total size of the request data
-        reqBufOffs_ = MESSAGE_HEADER_SIZE;
-    }
-    // Read remaining request data
-    const auto p = curReq_->reqBuf;
-    const size_t n = readSome(p + reqBufOffs_, reqBufSize_ - reqBufOffs_);
-    reqBufOffs_ += n;
-    if (reqBufOffs_ < reqBufSize_) {
-        return 0; // Wait for more data
-    }
+        // Read remaining request data. The data is decrypted while it's being copied from the input
+        // buffers
+        const auto p = curReq_->reqBuf;
+        const size_t footerOffs = reqBufSize_ - MESSAGE_FOOTER_SIZE;
+        while (reqBufOffs_ < reqBufSize_) {
+            size_t n = 0;
+            const auto d = peekInput(&n);
+            if (!d) {
+                return 0; // Wait for more data
+            }
+            if (reqBufOffs_ < footerOffs) {
+                n = std::min(n, footerOffs - reqBufOffs_);
 #if BLE_CHANNEL_SECURITY_ENABLED
-    // Decrypt request data
-    SPARK_ASSERT(aesCcm_);
-    CHECK(aesCcm_->decryptRequestData(p, curReq_->request_size));
+                CHECK(aesCcm_->decrypt(d, p + reqBufOffs_, n));
+#else
+                memcpy(p + reqBufOffs_, d, n);
 #endif
-    // Parse request header
-    RequestHeader rh = {};
-    memcpy(&rh, p + MESSAGE_HEADER_SIZE, REQUEST_HEADER_SIZE);
-    curReq_->id = littleEndianToNative(rh.id); // Request ID
-    curReq_->type = littleEndianToNative(rh.type); // Request type
-    LOG(TRACE, "Received a request message; type: %u, ID: %u", (unsigned)curReq_->type, (unsigned)curReq_->id);
-    // Process request
-    handler()->processRequest(curReq_, this);
-    curReq_ = nullptr;
-    reqBufSize_ = 0;
-    reqBufOffs_ = 0;
-    return 0;
+            } else {
+                n = std::min(n, reqBufSize_ - reqBufOffs_);
+                memcpy(p + reqBufOffs_, d, n);
+            }
+            skipInput(n);
+            reqBufOffs_ += n;
+        }
+#if BLE_CHANNEL_SECURITY_ENABLED
+        // Verify the authentication tag
+        CHECK(aesCcm_->finishRequest(p + footerOffs));
+#endif
+        // Parse request header
+        RequestHeader rh = {};
+        memcpy(&rh, p + MESSAGE_HEADER_SIZE, REQUEST_HEADER_SIZE);
+        curReq_->id = littleEndianToNative(rh.id); // Request ID
+        curReq_->type = littleEndianToNative(rh.type); // Request type
+        LOG(TRACE, "Received a request message; type: %u, ID: %u", (unsigned)curReq_->type, (unsigned)curReq_->id);
+        // Pass the request to the system thread for processing
+        curReq_->task.func = invokeRequestHandler;
+        curReq_->task.req = curReq_;
+        SystemISRTaskQueue.enqueue(&curReq_->task);
+        curReq_ = nullptr;
+        reqBufSize_ = 0;
+        reqBufOffs_ = 0;
+    }
 }
 
 int BleControlRequestChannel::sendReply() {
-    std::unique_lock<Mutex> lock(readyReqsLock_);
-    Request* req = nullptr;
-    while ((req = readyReqs_.popFront())) {
-        if (req->connId == connId_) {
-            break;
+    for (;;) {
+        std::unique_lock<Mutex> lock(readyReqsLock_);
+        Request* req = nullptr;
+        while ((req = readyReqs_.popFront())) {
+            if (req->connId == connId_) {
+                break;
+            }
+            freeRequest(req);
         }
-        freeRequest(req);
-    }
-    lock.unlock();
-    if (!req) {
-        return 0; // Nothing to send
-    }
-    NAMED_SCOPE_GUARD(reqGuard, {
-        freeRequest(req);
-    });
-    // Make sure we have a buffer to serialize the reply
-    if (!req->repBuf) {
-        CHECK(reallocBuffer(MESSAGE_HEADER_SIZE + REPLY_HEADER_SIZE + MESSAGE_FOOTER_SIZE, &req->repBuf));
-    }
-    const auto p = req->repBuf->data;
-    // Serialize message header
-    MessageHeader mh = {};
-    mh.size = nativeToLittleEndian(req->reply_size);
-    memcpy(p, &mh, MESSAGE_HEADER_SIZE);
-    // Serialize reply header
-    ReplyHeader rh = {};
-    rh.id = nativeToLittleEndian(req->id);
-    rh.result = nativeToLittleEndian(req->result);
-    memcpy(p + MESSAGE_HEADER_SIZE, &rh, REPLY_HEADER_SIZE);
+        lock.unlock();
+        if (!req) {
+            return 0; // Nothing to send
+        }
+        NAMED_SCOPE_GUARD(reqGuard, {
+            freeRequest(req);
+        });
+        // Make sure we have a buffer to serialize the reply
+        if (!req->repBuf) {
+            CHECK(reallocBuffer(MESSAGE_HEADER_SIZE + REPLY_HEADER_SIZE + MESSAGE_FOOTER_SIZE, &req->repBuf));
+        }
+        const auto p = req->repBuf->data;
+        // Serialize message header
+        MessageHeader mh = {};
+        mh.size = nativeToLittleEndian(req->reply_size);
+        memcpy(p, &mh, MESSAGE_HEADER_SIZE);
+        // Serialize reply header
+        ReplyHeader rh = {};
+        rh.id = nativeToLittleEndian(req->id);
+        rh.result = nativeToLittleEndian(req->result);
+        memcpy(p + MESSAGE_HEADER_SIZE, &rh, REPLY_HEADER_SIZE);
 #if BLE_CHANNEL_SECURITY_ENABLED
-    // Encrypt reply data
-    SPARK_ASSERT(aesCcm_);
-    CHECK(aesCcm_->encryptReplyData(p, req->reply_size));
+        // Encrypt reply data
+        SPARK_ASSERT(aesCcm_);
+        CHECK(aesCcm_->encryptReply(p, req->reply_size + REPLY_HEADER_SIZE));
 #endif
-    // Enqueue the reply buffer for sending
-    outBufs_.pushBack(req->repBuf);
-    req->repBuf = nullptr;
-    LOG(TRACE, "Enqueued a reply message for sending; ID: %u", (unsigned)req->id);
-    if (req->handler) {
-        pendingReps_.pushBack(req);
-        reqGuard.dismiss();
+        // Enqueue the reply buffer for sending
+        outBufs_.pushBack(req->repBuf);
+        req->repBuf = nullptr;
+        LOG(TRACE, "Enqueued a reply message for sending; ID: %u", (unsigned)req->id);
+        if (req->handler) {
+            pendingReps_.pushBack(req);
+            reqGuard.dismiss();
+        }
     }
-    return 0;
 }
 
 int BleControlRequestChannel::sendPacket() {
     if (!writable_) {
         return 0; // Can't send now
     }
-    // Prepare a BLE packet
-    SPARK_ASSERT(packetBuf_);
     const size_t maxSize = maxPacketSize_;
-    Buffer* buf = nullptr;
-    while (packetSize_ < maxSize && (buf = outBufs_.front())) {
-        const size_t n = std::min(maxSize - packetSize_, buf->size);
-        memcpy(packetBuf_.get() + packetSize_, buf->data, n);
-        buf->data += n;
-        buf->size -= n;
-        if (buf->size == 0) {
-            outBufs_.popFront();
-            freeBuffer(buf);
+    for (;;) {
+        const char* data = nullptr;
+        size_t size = 0;
+        Buffer* buf = outBufs_.front();
+        if (packetSize_ == 0 && buf && (buf->size >= maxSize || !buf->next)) {
+            // Send the packet directly from the output buffer
+            data = buf->data;
+            size = std::min(buf->size, maxSize);
+        } else {
+            // Gather the packet data from several output buffers
+            SPARK_ASSERT(packetBuf_);
+            while (packetSize_ < maxSize && (buf = outBufs_.front())) {
+                const size_t n = std::min(maxSize - packetSize_, buf->size);
+                memcpy(packetBuf_.get() + packetSize_, buf->data, n);
+                buf->data += n;
+                buf->size -= n;
+                if (buf->size == 0) {
+                    outBufs_.popFront();
+                    freeBuffer(buf);
+                }
+                packetSize_ += n;
+            }
+            data = packetBuf_.get();
+            size = packetSize_;
+            buf = nullptr;
         }
-        packetSize_ += n;
-    }
-    if (packetSize_ == 0) {
-        if (packetCount_ == 0) {
-            // Invoke completion handlers
-            while (Request* req = pendingReps_.popFront()) {
-                req->handler(SYSTEM_ERROR_NONE, req->handlerData);
-                req->handler = nullptr;
-                freeRequest(req);
+        if (size == 0) {
+            if (packetCount_ == 0) {
+                // Invoke completion handlers
+                while (Request* req = pendingReps_.popFront()) {
+                    finishRequest(req, SYSTEM_ERROR_NONE);
+                }
             }
+            return 0; // Nothing to send
+        }
+        // Send packet
+        const int ret = ble_set_char_value(connHandle_, sendCharHandle_, data, size, BLE_SET_CHAR_VALUE_FLAG_NOTIFY, nullptr);
+        if (ret == BLE_ERROR_BUSY) {
+            writable_ = false; // Retry later
+            return 0;
+        }
+        if (ret != (int)size) {
+            LOG(ERROR, "ble_set_char_value() failed: %d", ret);
+            return ret;
+        }
+        ++packetCount_;
+        DEBUG("Sent BLE packet");
+        DEBUG_DUMP(data, size);
+        if (buf) {
+            buf->data += size;
+            buf->size -= size;
+            if (buf->size == 0) {
+                outBufs_.popFront();
+                freeBuffer(buf);
+            }
+        } else {
+            packetSize_ = 0;
         }
-        return 0; // Nothing to send
-    }
-    // Send packet
-    const int ret = ble_set_char_value(connHandle_, sendCharHandle_, packetBuf_.get(), packetSize_,
-            BLE_SET_CHAR_VALUE_FLAG_NOTIFY, nullptr);
-    if (ret == BLE_ERROR_BUSY) {
-        writable_ = false; // Retry later
-        return 0;
-    }
-    if (ret != (int)packetSize_) {
-        LOG(ERROR, "ble_set_char_value() failed: %d", ret);
-        return ret;
     }
-    ++packetCount_;
-    DEBUG("Sent BLE packet");
-    DEBUG_DUMP(packetBuf_.get(), packetSize_);
-    packetSize_ = 0;
-    return 0;
 }
 
 bool BleControlRequestChannel::readAll(char* data, size_t size) {
@@ -1010,21 +1237,14 @@ bool BleControlRequestChannel::readAll(char* data, size_t size) {
     DEBUG("Reading %u bytes", (unsigned)size);
     size_t offs = 0;
     while (offs < size) {
-        buf = readInBufs_.front();
-        SPARK_ASSERT(buf);
-        const size_t n = std::min(size - offs, buf->size);
-        memcpy(data + offs, buf->data, n);
-        buf->size -= n;
-        if (buf->size == 0) {
-            // Free the drained buffer
-            readInBufs_.popFront();
-            freePooledBuffer(buf);
-        } else {
-            buf->data += n;
-        }
+        size_t n = 0;
+        const auto d = peekInput(&n);
+        SPARK_ASSERT(d);
+        n = std::min(size - offs, n);
+        memcpy(data + offs, d, n);
+        skipInput(n);
         offs += n;
     }
-    inBufSize_ -= size;
     DEBUG_DUMP(data, size);
     return true;
 }
@@ -1045,18 +1265,49 @@ size_t BleControlRequestChannel::readSome(char* data, size_t size) {
     return size;
 }
 
+// Returns the contiguous input data available in the next input buffer
+const char* BleControlRequestChannel::peekInput(size_t* size) {
+    Buffer* buf = readInBufs_.front();
+    if (!buf) {
+        buf = inBufs_.popFront();
+        if (!buf) {
+            return nullptr;
+        }
+        readInBufs_.pushBack(buf);
+        inBufSize_ += buf->size;
+    }
+    *size = buf->size;
+    return buf->data;
+}
+
+void BleControlRequestChannel::skipInput(size_t size) {
+    Buffer* buf = readInBufs_.front();
+    SPARK_ASSERT(buf && buf->size >= size);
+    buf->size -= size;
+    if (buf->size == 0) {
+        // Free the drained buffer
+        readInBufs_.popFront();
+        freePooledBuffer(buf);
+    } else {
+        buf->data += size;
+    }
+    inBufSize_ -= size;
+}
+
 int BleControlRequestChannel::connected(const ble_connected_event_data& event) {
-    curConnHandle_ = event.conn_handle;
+    const auto connHandle = event.conn_handle;
+    curConnHandle_.store(connHandle, std::memory_order_relaxed);
     // Get initial connection parameters
     ble_conn_param connParam = { .version = BLE_API_VERSION };
-    int ret = ble_get_conn_param(curConnHandle_, &connParam, nullptr);
+    int ret = ble_get_conn_param(connHandle, &connParam, nullptr);
     if (ret == 0) {
         maxPacketSize_ = connParam.att_mtu_size - BLE_ATT_OPCODE_SIZE - BLE_ATT_HANDLE_SIZE;
     } else {
         maxPacketSize_ = BLE_MIN_ATTR_VALUE_PACKET_SIZE;
     }
+    pool_->setDataSize(maxPacketSize_);
     ble_char_param charParam = { .version = BLE_API_VERSION };
-    ret = ble_get_char_param(curConnHandle_, sendCharHandle_, &charParam, nullptr);
+    ret = ble_get_char_param(connHandle, sendCharHandle_, &charParam, nullptr);
     if (ret == 0) {
         subscribed_ = charParam.notif_enabled;
     } else {
@@ -1075,7 +1326,7 @@ int BleControlRequestChannel::disconnected(const ble_disconnected_event_data& ev
         freePooledBuffer(buf);
     }
     // Reset connection parameters
-    curConnHandle_ = BLE_INVALID_CONN_HANDLE;
+    curConnHandle_.store(BLE_INVALID_CONN_HANDLE, std::memory_order_relaxed);
     writable_ = false;
     // Update connection state counter
     curConnId_.fetch_add(1, std::memory_order_release);
@@ -1084,15 +1335,16 @@ int BleControlRequestChannel::disconnected(const ble_disconnected_event_data& ev
 
 int BleControlRequestChannel::connParamChanged(const ble_conn_param_changed_event_data& event) {
     ble_conn_param param = { .version = BLE_API_VERSION };
-    CHECK(ble_get_conn_param(curConnHandle_, &param, nullptr));
+    CHECK(ble_get_conn_param(curConnHandle_.load(std::memory_order_relaxed), &param, nullptr));
     maxPacketSize_ = param.att_mtu_size - BLE_ATT_OPCODE_SIZE - BLE_ATT_HANDLE_SIZE;
+    pool_->setDataSize(maxPacketSize_);
     return 0;
 }
 
 int BleControlRequestChannel::charParamChanged(const ble_char_param_changed_event_data& event) {
     if (event.char_handle == sendCharHandle_) {
         ble_char_param param = { .version = BLE_API_VERSION };
-        CHECK(ble_get_char_param(curConnHandle_, sendCharHandle_, &param, nullptr));
+        CHECK(ble_get_char_param(curConnHandle_.load(std::memory_order_relaxed), sendCharHandle_, &param, nullptr));
         subscribed_ = param.notif_enabled;
         writable_ = subscribed_;
     }
@@ -1111,10 +1363,28 @@ int BleControlRequestChannel::dataReceived(const ble_data_received_event_data& e
     if (event.char_handle == recvCharHandle_) {
         DEBUG("Received BLE packet");
         DEBUG_DUMP(event.data, event.size);
-        Buffer* buf = nullptr;
-        CHECK(allocPooledBuffer(event.size, &buf));
-        memcpy(buf->data, event.data, event.size);
-        inBufs_.pushBack(buf);
+        // A packet that was received before the pool was repartitioned for a larger packet size
+        // may need to be stored in several buffers
+        IntrusiveQueue<Buffer> bufs;
+        NAMED_SCOPE_GUARD(bufsGuard, {
+            while (Buffer* buf = bufs.popFront()) {
+                freePooledBuffer(buf);
+            }
+        });
+        const size_t maxSize = pool_->dataSize();
+        size_t offs = 0;
+        while (offs < event.size) {
+            const size_t n = std::min(event.size - offs, maxSize);
+            Buffer* buf = nullptr;
+            CHECK(allocPooledBuffer(n, &buf));
+            memcpy(buf->data, (const char*)event.data + offs, n);
+            bufs.pushBack(buf);
+            offs += n;
+        }
+        bufsGuard.dismiss();
+        while (Buffer* buf = bufs.popFront()) {
+            inBufs_.pushBack(buf);
+        }
     }
     return 0;
 }
@@ -1231,21 +1501,30 @@ int BleControlRequestChannel::allocRequest(size_t size, Request** req) {
 }
 
 void BleControlRequestChannel::freeRequest(Request* req) {
+    finishRequest(req, SYSTEM_ERROR_UNKNOWN);
+}
+
+void BleControlRequestChannel::finishRequest(Request* req, int result) {
     if (!req) {
         return;
     }
-    const auto handler = req->handler;
-    const auto handlerData = req->handlerData;
     freeBuffer(req->repBuf);
+    req->repBuf = nullptr;
     delete[] req->reqBuf;
+    req->reqBuf = nullptr;
+    if (req->handler) {
+        // Completion handlers are invoked in the system thread, same as the request handlers
+        req->result = result;
+        req->task.func = invokeCompletionHandler;
+        req->task.req = req;
+        SystemISRTaskQueue.enqueue(&req->task);
+        return;
+    }
     delete req;
 #if BLE_CHANNEL_DEBUG_ENABLED
     const auto count = --allocReqCount_;
     DEBUG("Freed a request object (count: %u)", (unsigned)count);
 #endif
-    if (handler) {
-        handler(SYSTEM_ERROR_UNKNOWN, handlerData);
-    }
 }
 
 int BleControlRequestChannel::reallocBuffer(size_t size, Buffer** buf) {
@@ -1276,7 +1555,7 @@ void BleControlRequestChannel::freeBuffer(Buffer* buf) {
 }
 
 int BleControlRequestChannel::allocPooledBuffer(size_t size, Buffer** buf) {
-    const auto b = allocLinkedBuffer<Buffer>(size, &pool_);
+    const auto b = allocLinkedBuffer<Buffer>(size, pool_.get());
     if (!b) {
         return SYSTEM_ERROR_NO_MEMORY;
     }
@@ -1292,7 +1571,7 @@ int BleControlRequestChannel::allocPooledBuffer(size_t size, Buffer** buf) {
 
 void BleControlRequestChannel::freePooledBuffer(Buffer* buf) {
     if (buf) {
-        freeLinkedBuffer(buf, &pool_);
+        freeLinkedBuffer(buf, pool_.get());
 #if BLE_CHANNEL_DEBUG_ENABLED
         const auto count = --poolBufCount_;
         DEBUG("Freed a pooled buffer (count: %u)", (unsigned)count);
@@ -1340,10 +1619,42 @@ void BleControlRequestChannel::processBleEvent(int event, const void* eventData,
     }
     if (ret != 0) {
         LOG(ERROR, "Failed to process BLE event: %d (error: %d)", event, ret);
-        if (ch->curConnHandle_ != BLE_INVALID_CONN_HANDLE) {
-            ble_disconnect(ch->curConnHandle_, nullptr);
+        const auto connHandle = ch->curConnHandle_.load(std::memory_order_relaxed);
+        if (connHandle != BLE_INVALID_CONN_HANDLE) {
+            ble_disconnect(connHandle, nullptr);
         }
     }
+    ch->wakeup();
+}
+
+void BleControlRequestChannel::threadLoop(void* arg) {
+    const auto ch = (BleControlRequestChannel*)arg;
+    for (;;) {
+        // Wake up periodically while a client is connected, so that the handshake can time out
+        const system_tick_t timeout = (ch->connHandle_ != BLE_INVALID_CONN_HANDLE) ? THREAD_WAKEUP_INTERVAL :
+                CONCURRENT_WAIT_FOREVER;
+        os_semaphore_take(ch->sem_, timeout, false);
+        ch->run();
+    }
+}
+
+// Note: This method is called from the system thread
+void BleControlRequestChannel::invokeRequestHandler(ISRTaskQueue::Task* task) {
+    const auto req = static_cast<RequestTask*>(task)->req;
+    const auto ch = static_cast<BleControlRequestChannel*>(req->channel);
+    ch->handler()->processRequest(req, ch);
+}
+
+// Note: This method is called from the system thread
+void BleControlRequestChannel::invokeCompletionHandler(ISRTaskQueue::Task* task) {
+    const auto req = static_cast<RequestTask*>(task)->req;
+    req->handler(req->result, req->handlerData);
+#if BLE_CHANNEL_DEBUG_ENABLED
+    const auto ch = static_cast<BleControlRequestChannel*>(req->channel);
+    const auto count = --ch->allocReqCount_;
+    DEBUG("Freed a request object (count: %u)", (unsigned)count);
+#endif
+    delete req;
 }
 
 } // particle::system
@@ -22,12 +22,13 @@
 #if SYSTEM_CONTROL_ENABLED && HAL_PLATFORM_BLE
 
 #include "control_request_handler.h"
-#include "simple_pool_allocator.h"
+#include "active_object.h"
 
 #include "intrusive_queue.h"
 #include "linked_buffer.h"
 
 #include "ble_hal.h"
+#include "concurrent_hal.h"
 
 #include "spark_wiring_thread.h"
 
@@ -59,8 +60,6 @@ public:
     int init();
     void destroy();
 
-    void run();
-
     // Reimplemented from `ControlRequestChannel`
     virtual int allocReplyData(ctrl_request* ctrlReq, size_t size) override;
     virtual void freeRequestData(ctrl_request* ctrlReq) override;
@@ -70,14 +69,22 @@ private:
     class HandshakeHandler;
     class JpakeHandler;
     class AesCcmCipher;
+    class PacketPool;
 
     struct Buffer: LinkedBuffer<> {
         char* data;
         size_t size;
     };
 
+    struct Request;
+
+    struct RequestTask: ISRTaskQueue::Task {
+        Request* req;
+    };
+
     // Request data
     struct Request: ctrl_request {
+        RequestTask task; // System thread task data
         Request* next; // Next request
         char* reqBuf; // Request buffer (assembled from multiple input buffers)
         Buffer* repBuf; // Reply buffer (allocated as a single output buffer)
@@ -106,16 +113,19 @@ private:
     size_t reqBufSize_; // Size of the request buffer
     size_t reqBufOffs_; // Offset in the request buffer
 
-    std::unique_ptr<char[]> packetBuf_; // Intermediate buffer for BLE packet data
+    std::unique_ptr<char[]> packetBuf_; // Intermediate buffer for BLE packets spanning several output buffers
     size_t packetSize_; // Size of the pending BLE packet
 #if BLE_CHANNEL_SECURITY_ENABLED
     std::unique_ptr<AesCcmCipher> aesCcm_; // AES cipher
     std::unique_ptr<JpakeHandler> jpake_; // J-PAKE handshake handler
 #endif
-    AtomicAllocedPool pool_; // Pool allocator
+    std::unique_ptr<PacketPool> pool_; // Buffers for received packets
+
+    os_thread_t thread_; // Processing thread
+    os_semaphore_t sem_; // Signaled when the processing thread has work to do
 
     uint16_t connHandle_; // Connection handle used by the processing thread
-    volatile uint16_t curConnHandle_; // Current connection handle
+    std::atomic<uint16_t> curConnHandle_; // Current connection handle
 
     unsigned connId_; // Last connection ID known to the processing thread
     std::atomic<unsigned> curConnId_; // Current connection ID
@@ -128,6 +138,9 @@ private:
     uint16_t sendCharHandle_; // TX characteristic handle
     uint16_t recvCharHandle_; // RX characteristic handle
 
+    void run();
+    void wakeup();
+
     int initChannel();
     void resetChannel();
 
@@ -137,6 +150,8 @@ private:
 
     bool readAll(char* data, size_t size);
     size_t readSome(char* data, size_t size);
+    const char* peekInput(size_t* size);
+    void skipInput(size_t size);
     void sendBuffer(Buffer* buf);
 
     int connected(const ble_connected_event_data& event);
@@ -153,6 +168,7 @@ private:
 #endif
     int allocRequest(size_t size, Request** req);
     void freeRequest(Request* req);
+    void finishRequest(Request* req, int result);
 
     int reallocBuffer(size_t size, Buffer** buf);
     void freeBuffer(Buffer* buf);
@@ -161,6 +177,9 @@ private:
     void freePooledBuffer(Buffer* buf);
 
     static void processBleEvent(int event, const void* eventData, void* userData);
+    static void threadLoop(void* arg);
+    static void invokeRequestHandler(ISRTaskQueue::Task* task);
+    static void invokeCompletionHandler(ISRTaskQueue::Task* task);
 };
 
 inline void BleControlRequestChannel::sendBuffer(Buffer* buf) {
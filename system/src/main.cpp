@@ -453,6 +453,14 @@ bool semi_automatic_connecting(bool threaded) {
     return system_mode() == SEMI_AUTOMATIC && !threaded && spark_cloud_flag_auto_connect() && !spark_cloud_flag_connected();
 }
 
+namespace {
+
+// Duration of loop() and the processing that follows it, in microseconds
+HistogramDiagnosticData g_appLoopDurationDiagData(DIAG_ID_SYSTEM_APPLICATION_LOOP_DURATION,
+        DIAG_NAME_SYSTEM_APPLICATION_LOOP_DURATION);
+
+} // namespace
+
 void app_loop(bool threaded)
 {
     DECLARE_SYS_HEALTH(ENTERED_WLAN_Loop);
@@ -493,11 +501,13 @@ void app_loop(bool threaded)
             //Execute user application loop
             DECLARE_SYS_HEALTH(ENTERED_Loop);
             if (system_mode()!=SAFE_MODE) {
+                const system_tick_t loopStart = HAL_Timer_Get_Micro_Seconds();
                 loop();
                 DECLARE_SYS_HEALTH(RAN_Loop);
 #if !(defined(MODULAR_FIRMWARE) && MODULAR_FIRMWARE)
                 _post_loop();
 #endif
+                g_appLoopDurationDiagData.add(HAL_Timer_Get_Micro_Seconds() - loopStart);
             }
         }
     }
@@ -37,6 +37,7 @@
 #include "events.h"
 #include "deviceid_hal.h"
 #include "system_mode.h"
+#include "system_publish_queue.h"
 
 extern void (*random_seed_from_cloud_handler)(unsigned int);
 
@@ -123,6 +124,21 @@ bool spark_send_event(const char* name, const char* data, int ttl, uint32_t flag
         d.handler_data = r->handler_data;
     }
 
+    if (flags & PUBLISH_EVENT_FLAG_STORE_FORWARD) {
+        flags &= ~PUBLISH_EVENT_FLAG_STORE_FORWARD;
+#if HAL_PLATFORM_FILESYSTEM
+        // Send the event right away only if there are no older stored events
+        const auto queue = particle::system::PublishQueue::instance();
+        if (!spark_cloud_flag_connected() || !queue->isEmpty()) {
+            const int ret = queue->push(name, data, ttl, flags);
+            if (d.handler_callback) {
+                d.handler_callback(ret, nullptr, d.handler_data, nullptr);
+            }
+            return (ret == 0);
+        }
+#endif // HAL_PLATFORM_FILESYSTEM
+    }
+
     return spark_protocol_send_event(sp, name, data, ttl, convert(flags), &d);
 }
 
@@ -199,6 +215,18 @@ int spark_set_connection_property(unsigned property_id, unsigned data, particle:
     return spark_protocol_set_connection_property(sp, property_id, data, conn_prop, reserved);
 }
 
+int spark_set_event_rate_limit(const char* prefix, uint16_t burst, system_tick_t interval, uint8_t priority, void* reserved)
+{
+    SYSTEM_THREAD_CONTEXT_SYNC(spark_set_event_rate_limit(prefix, burst, interval, priority, reserved));
+    return spark_protocol_set_event_rate_limit(sp, prefix, burst, interval, priority, reserved);
+}
+
+int spark_get_event_rate_limit_stats(const char* prefix, spark_protocol_event_rate_limit_stats* stats, void* reserved)
+{
+    SYSTEM_THREAD_CONTEXT_SYNC(spark_get_event_rate_limit_stats(prefix, stats, reserved));
+    return spark_protocol_get_event_rate_limit_stats(sp, prefix, stats, reserved);
+}
+
 int spark_set_random_seed_from_cloud_handler(void (*handler)(unsigned int), void* reserved)
 {
 #ifndef SPARK_NO_CLOUD
@@ -207,3 +235,17 @@ int spark_set_random_seed_from_cloud_handler(void (*handler)(unsigned int), void
 
     return 0;
 }
+
+int spark_set_publish_queue_config(const spark_publish_queue_config* conf, void* reserved)
+{
+#if HAL_PLATFORM_FILESYSTEM && !defined(SPARK_NO_CLOUD)
+    SYSTEM_THREAD_CONTEXT_SYNC(spark_set_publish_queue_config(conf, reserved));
+    if (!conf) {
+        return SYSTEM_ERROR_INVALID_ARGUMENT;
+    }
+    particle::system::PublishQueue::instance()->config(*conf);
+    return 0;
+#else
+    return SYSTEM_ERROR_NOT_SUPPORTED;
+#endif
+}
@@ -213,6 +213,32 @@ int Spark_Send_UDP(const unsigned char* buf, uint32_t buflen, void* reserved)
     return system_cloud_send(buf, buflen, 0);
 }
 
+#if HAL_USE_SOCKET_HAL_POSIX
+
+int Spark_Send_UDP_v(const SparkIoVec* iov, size_t iovcnt, void* reserved)
+{
+    if (SPARK_WLAN_RESET || SPARK_WLAN_SLEEP || spark_cloud_socket_closed() || cloud_socket_aborted)
+    {
+        LOG(TRACE, "SPARK_WLAN_RESET || SPARK_WLAN_SLEEP || spark_cloud_socket_closed() || cloud_socket_aborted");
+        //break from any blocking loop
+        return -1;
+    }
+
+    struct iovec v[4];
+    if (iovcnt > sizeof(v) / sizeof(v[0]))
+    {
+        return -1;
+    }
+    for (size_t i = 0; i < iovcnt; ++i)
+    {
+        v[i].iov_base = const_cast<void*>(iov[i].data);
+        v[i].iov_len = iov[i].size;
+    }
+    return system_cloud_sendv(v, iovcnt, 0);
+}
+
+#endif /* HAL_USE_SOCKET_HAL_POSIX */
+
 int Spark_Receive_UDP(unsigned char *buf, uint32_t buflen, void* reserved)
 {
     if (SPARK_WLAN_RESET || SPARK_WLAN_SLEEP || spark_cloud_socket_closed() || cloud_socket_aborted)
@@ -37,6 +37,9 @@ int system_cloud_connect(int protocol, const ServerAddress* address, sockaddr* s
 int system_cloud_disconnect(int flags);
 int system_cloud_send(const uint8_t* buf, size_t buflen, int flags);
 int system_cloud_recv(uint8_t* buf, size_t buflen, int flags);
+#if HAL_USE_SOCKET_HAL_POSIX
+int system_cloud_sendv(const struct iovec* iov, size_t iovcnt, int flags);
+#endif /* HAL_USE_SOCKET_HAL_POSIX */
 int system_cloud_is_connected(void* reserved);
 int system_internet_test(void* reserved);
 int system_multicast_announce_presence(void* reserved);
@@ -61,6 +64,10 @@ int Spark_Receive(unsigned char *buf, uint32_t buflen, void* reserved);
 #if HAL_PLATFORM_CLOUD_UDP
 int Spark_Send_UDP(const unsigned char* buf, uint32_t buflen, void* reserved);
 int Spark_Receive_UDP(unsigned char *buf, uint32_t buflen, void* reserved);
+#if HAL_USE_SOCKET_HAL_POSIX
+struct SparkIoVec;
+int Spark_Send_UDP_v(const SparkIoVec* iov, size_t iovcnt, void* reserved);
+#endif /* HAL_USE_SOCKET_HAL_POSIX */
 #endif /* HAL_PLATFORM_CLOUD_UDP */
 
 /**
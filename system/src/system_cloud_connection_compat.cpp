@@ -22,6 +22,7 @@
 #include "system_cloud_connection.h"
 #include "system_cloud_internal.h"
 #include "system_cloud.h"
+#include "system_task.h"
 #include "socket_hal_compat.h"
 #include "deviceid_hal.h"
 #include "net_hal.h"
@@ -353,6 +354,7 @@ void HAL_NET_notify_socket_closed(sock_handle_t socket)
     if (s_state.socket == socket)
     {
         cloud_disconnect(false, false, CLOUD_DISCONNECT_REASON_ERROR);
+        system_loop_wakeup();
     }
 }
 #else
@@ -272,7 +272,7 @@ bool spark_function_internal(const cloud_function_descriptor* desc, void* reserv
 }
 
 
-void invokeEventHandlerInternal(uint16_t handlerInfoSize, FilteringEventHandler* handlerInfo,
+void invokeEventHandlerInternal(uint16_t handlerInfoSize, const FilteringEventHandler* handlerInfo,
                 const char* event_name, const char* data, void* reserved)
 {
     if(handlerInfo->handler_data)
@@ -286,10 +286,10 @@ void invokeEventHandlerInternal(uint16_t handlerInfoSize, FilteringEventHandler*
     }
 }
 
-void invokeEventHandlerString(uint16_t handlerInfoSize, FilteringEventHandler* handlerInfo,
+void invokeEventHandlerString(uint16_t handlerInfoSize, const FilteringEventHandler& handlerInfo,
                 const String& name, const String& data, void* reserved)
 {
-    invokeEventHandlerInternal(handlerInfoSize, handlerInfo, name.c_str(), data.c_str(), reserved);
+    invokeEventHandlerInternal(handlerInfoSize, &handlerInfo, name.c_str(), data.c_str(), reserved);
 }
 
 
@@ -305,7 +305,10 @@ void invokeEventHandler(uint16_t handlerInfoSize, FilteringEventHandler* handler
         // copy the buffers to dynamically allocated storage.
         String name(event_name);
         String data(event_data);
-        APPLICATION_THREAD_CONTEXT_ASYNC(invokeEventHandlerString(handlerInfoSize, handlerInfo, name, data, reserved));
+        // the subscription may be removed before the handler runs on the application thread
+        const FilteringEventHandler info = *handlerInfo;
+        (void)info; // unused when threading is disabled
+        APPLICATION_THREAD_CONTEXT_ASYNC(invokeEventHandlerString(handlerInfoSize, info, name, data, reserved));
     }
 }
 
@@ -767,6 +770,9 @@ void Spark_Protocol_Init(void)
         if (udp)
         {
             callbacks.send = Spark_Send_UDP;
+#if HAL_USE_SOCKET_HAL_POSIX
+            callbacks.send_v = Spark_Send_UDP_v;
+#endif
             callbacks.receive = Spark_Receive_UDP;
             callbacks.transport_context = &g_system_cloud_session_data;
             callbacks.save = Spark_Save;
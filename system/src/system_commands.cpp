@@ -37,10 +37,15 @@ namespace system {
 namespace {
 
 using particle::fs::FileQueue;
+using particle::fs::SegmentedFileQueue;
 
 const system_tick_t DELAY_BETWEEN_COMMAND_CHECKS = 5000;
 
-FileQueue persistCommands("commands.bin");
+// Queue file used by the previous versions of the system firmware
+const char* const LEGACY_COMMANDS_FILE = "commands.bin";
+
+SegmentedFileQueue g_commandQueue("commands");
+bool g_commandQueueMigrated = false;
 
 system_tick_t nextCommandTime = 0;
 
@@ -51,6 +56,32 @@ void scheduleNextCommand(system_tick_t timeout = 0) {
     nextCommandTime = millis() + timeout;
 }
 
+// Returns the command queue. On first use, the commands persisted by the previous versions of the
+// system firmware are moved to it. If a command cannot be moved, the remaining commands are kept
+// in the legacy file and the migration is retried on the next call
+SegmentedFileQueue& persistCommands() {
+    if (!g_commandQueueMigrated) {
+        FileQueue legacy(LEGACY_COMMANDS_FILE);
+        FileQueue::QueueEntry e;
+        // g_cmd may hold a command that is being executed
+        AllCommands cmd;
+        while (!legacy.front(e, &cmd, sizeof(cmd))) {
+            int ret = g_commandQueue.pushBack(&cmd, e.size - sizeof(e));
+            if (ret >= 0) {
+                ret = legacy.popFront();
+            }
+            if (ret < 0) {
+                LOG(ERROR, "Unable to move persisted command to the command queue: %d", ret);
+                return g_commandQueue;
+            }
+        }
+        // The file is removed with its last entry, anything left in it cannot be read
+        legacy.clear();
+        g_commandQueueMigrated = true;
+    }
+    return g_commandQueue;
+}
+
 inline bool isCoap4xxError(int error) {
     return (error == SYSTEM_ERROR_COAP_4XX);
 }
@@ -58,11 +89,11 @@ inline bool isCoap4xxError(int error) {
 bool handleCommandComplete(int error, void* data = nullptr, size_t size = 0) {
     int r = 0;
     if (data) {
-        FileQueue::QueueEntry e;
-        r = persistCommands.front(e, data, size);
+        SegmentedFileQueue::QueueEntry e;
+        r = persistCommands().front(e, data, size);
     }
     if (!error || isCoap4xxError(error)) {
-        persistCommands.popFront();
+        persistCommands().popFront();
         scheduleNextCommand();
     } else {
         scheduleNextCommand(DELAY_BETWEEN_COMMAND_CHECKS);
@@ -128,10 +159,10 @@ void fetchAndExecuteCommand(system_tick_t currentTime) {
         return;
     }
 
-    FileQueue::QueueEntry entry;
+    SegmentedFileQueue::QueueEntry entry;
 
     // execution is asynchronous. The CallbackHandler is invoked to deliver the asynchronous result.
-    if (spark_cloud_flag_connected() && !persistCommands.front(entry, &g_cmd, sizeof(g_cmd)) && !g_cmd.execute()) {
+    if (spark_cloud_flag_connected() && !persistCommands().front(entry, &g_cmd, sizeof(g_cmd)) && !g_cmd.execute()) {
         g_cmdPending = true;
     } else {
         nextCommandTime = currentTime + DELAY_BETWEEN_COMMAND_CHECKS;
@@ -140,16 +171,16 @@ void fetchAndExecuteCommand(system_tick_t currentTime) {
 
 int system_command_enqueue(SystemCommand& enqueue, uint16_t size) {
 
-	FileQueue::QueueEntry entry;
+	SegmentedFileQueue::QueueEntry entry;
 
-	int error = persistCommands.front(entry, &g_cmd, sizeof(g_cmd));
+	int error = persistCommands().front(entry, &g_cmd, sizeof(g_cmd));
 	// skip enqueuing duplicate commands. Ideally each command itself should be able to filter the queue, but for now this will do.
 	if (!error && !memcmp(&enqueue, &g_cmd, size)) {
 		LOG(INFO, "Command %d size %d skipped because it is a duplicate", enqueue.commandType, size);
 		return 0;
 	}
 
-	int result = persistCommands.pushBack(&enqueue, size);
+	int result = persistCommands().pushBack(&enqueue, size);
 	if (result<0) {
 		LOG(ERROR, "Unable to enqueue command %d size %d to system command queue. Error=%d", enqueue.commandType, size, result);
 	}
@@ -161,7 +192,7 @@ int system_command_enqueue(SystemCommand& enqueue, uint16_t size) {
 
 int system_command_clear() {
 	LOG(INFO, "clearing persistent command queue");
-	return persistCommands.clear();
+	return persistCommands().clear();
 }
 
 int AllCommands::execute() {
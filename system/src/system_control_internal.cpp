@@ -100,12 +100,6 @@ int SystemControl::init() {
     return 0;
 }
 
-void SystemControl::run() {
-#if HAL_PLATFORM_BLE
-    bleChannel_.run();
-#endif
-}
-
 void SystemControl::processRequest(ctrl_request* req, ControlRequestChannel* /* channel */) {
     switch (req->type) {
     case CTRL_REQUEST_DEVICE_ID: {
@@ -0,0 +1,333 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+// Binary formats of the diagnostic data, see system_format_diag_data()
+
+#include "appender.h"
+#include "spark_wiring_diagnostics.h"
+#include "system_error.h"
+
+#include <cstring>
+
+class AppendBase {
+
+    appender_fn fn;
+    void* data;
+
+protected:
+
+    template<typename T> inline bool writeDirect(const T& value) {
+		return fn(data, (const uint8_t*)&value, sizeof(value));
+	}
+
+    inline bool writeBytes(const uint8_t* bytes, size_t size) {
+        return fn(data, bytes, size);
+    }
+
+public:
+
+    AppendBase(appender_fn fn, void* data) {
+        this->fn = fn; this->data = data;
+    }
+
+    bool write(const char* string) const {
+        return fn(data, (const uint8_t*)string, strlen(string));
+    }
+
+    bool write(char* string) const {
+        return fn(data, (const uint8_t*)string, strlen(string));
+    }
+
+    bool write(char c) {
+        return writeDirect(c);
+    }
+};
+
+
+class AppendData : public AppendBase {
+public:
+	AppendData(appender_fn fn, void* data) : AppendBase(fn, data) {}
+
+    bool write(uint16_t value) {
+    		return writeDirect(value);
+    }
+
+    bool write(int32_t value) {
+    		return writeDirect(value);
+    }
+
+    // Writes an unsigned integer in the base 128 varint encoding
+    bool write_varint(uint32_t value) {
+        uint8_t buf[5];
+        size_t n = 0;
+        while (value >= 0x80) {
+            buf[n++] = (value & 0x7f) | 0x80;
+            value >>= 7;
+        }
+        buf[n++] = value;
+        return writeBytes(buf, n);
+    }
+
+    // Writes a signed integer in the zigzag varint encoding
+    bool write_zigzag(int32_t value) {
+        return write_varint(((uint32_t)value << 1) ^ (uint32_t)(value >> 31));
+    }
+
+};
+
+
+namespace particle {
+
+template <typename T>
+class AbstractDiagnosticsFormatter {
+
+
+protected:
+
+	inline T& formatter() {
+		return formatter(this);
+	}
+
+	static inline T& formatter(void* fmt) {
+		return *reinterpret_cast<T*>(fmt);
+	}
+
+	static int formatSourceData(const diag_source* src, void* fmt) {
+		return formatter(fmt).formatSource(src);
+	}
+
+	int formatSource(const diag_source* src) {
+		T& fmt = formatter();
+		if (!fmt.isSourceOk(src)) {
+			return 0;
+		}
+	    switch (src->type) {
+	    case DIAG_TYPE_INT: {
+	        AbstractIntegerDiagnosticData::IntType val = 0;
+	        const int ret = AbstractIntegerDiagnosticData::get(src, val);
+	        if ((ret == 0 && !fmt.formatSourceInt(src, val)) || (ret != 0 && !fmt.formatSourceError(src, ret))) {
+	            return SYSTEM_ERROR_TOO_LARGE;
+	        }
+	        break;
+	    }
+	    case DIAG_TYPE_HISTOGRAM: {
+	        diag_histogram_data data = {};
+	        const int ret = AbstractHistogramDiagnosticData::get(src, data);
+	        if ((ret == 0 && !fmt.formatSourceHistogram(src, data)) || (ret != 0 && !fmt.formatSourceError(src, ret))) {
+	            return SYSTEM_ERROR_TOO_LARGE;
+	        }
+	        break;
+	    }
+	    case DIAG_TYPE_TIME_SERIES: {
+	        diag_time_series_data data = {};
+	        const int ret = AbstractTimeSeriesDiagnosticData::get(src, data);
+	        if ((ret == 0 && !fmt.formatSourceTimeSeries(src, data)) || (ret != 0 && !fmt.formatSourceError(src, ret))) {
+	            return SYSTEM_ERROR_TOO_LARGE;
+	        }
+	        break;
+	    }
+	    default:
+	        return SYSTEM_ERROR_NOT_SUPPORTED;
+	    }
+	    return 0;
+	}
+
+	static int formatSources(T& formatter, const uint16_t* id, size_t count, unsigned flags) {
+	    if (!formatter.openDocument()) {
+			return SYSTEM_ERROR_TOO_LARGE;
+	    }
+		if (id) {
+			// Dump specified data sources
+			for (size_t i = 0; i < count; ++i) {
+				const diag_source* src = nullptr;
+				int ret = diag_get_source(id[i], &src, nullptr);
+				if (ret != 0) {
+					return ret;
+				}
+				ret = formatter.formatSource(src);
+				if (ret != 0) {
+					return ret;
+				}
+			}
+		} else {
+			// Dump all data sources
+			const int ret = diag_enum_sources(formatSourceData, nullptr, &formatter, nullptr);
+			if (ret != 0) {
+				return ret;
+			}
+		}
+		if (!formatter.closeDocument()) {
+			return SYSTEM_ERROR_TOO_LARGE;
+		}
+		return 0;
+	}
+
+public:
+
+	int format(const uint16_t* id, size_t count, unsigned flags) {
+		return formatSources(formatter(this), id, count, flags);
+	}
+};
+
+
+class BinaryDiagnosticsFormatter : public AbstractDiagnosticsFormatter<BinaryDiagnosticsFormatter> {
+
+	AppendData& data;
+
+	using value = AbstractIntegerDiagnosticData::IntType;
+	using id = typeof(diag_source::id);
+
+public:
+	BinaryDiagnosticsFormatter(AppendData& appender_) : data(appender_) {}
+
+
+	inline bool openDocument() {
+		return data.write(uint16_t(sizeof(id))) && data.write(uint16_t(sizeof(value)));
+	}
+
+	inline bool closeDocument() {
+		return true;
+	}
+
+	/**
+	 *
+	 */
+	bool formatSourceError(const diag_source* src, int error) {
+		static_assert(sizeof(src->id)==2, "expected diagnostic id to be 16-bits");
+		return data.write(decltype(src->id)(src->id | 1<<15)) && data.write(int32_t(error));
+	}
+
+	inline bool isSourceOk(const diag_source* src) {
+	    return true;
+	}
+
+	inline bool formatSourceInt(const diag_source* src, AbstractIntegerDiagnosticData::IntType val) {
+		return data.write(src->id) && data.write(val);
+	}
+
+	// This format has no representation for the aggregate types, such sources are skipped
+	inline bool formatSourceHistogram(const diag_source* src, const diag_histogram_data& val) {
+		return true;
+	}
+
+	inline bool formatSourceTimeSeries(const diag_source* src, const diag_time_series_data& val) {
+		return true;
+	}
+
+};
+
+
+/**
+ * Compact binary format.
+ *
+ * The document starts with a 16-bit zero, which distinguishes it from the fixed-size binary format,
+ * followed by a 16-bit version number. Each data source is then encoded as a varint key containing
+ * the difference between its ID and the ID of the previous source (zigzag-encoded, shifted left by 2
+ * bits) and the kind of the record in the lower 2 bits, followed by the record payload:
+ *
+ * - Integer: zigzag-encoded value.
+ * - Error: zigzag-encoded error code.
+ * - Histogram: varint count, min, max - min and sum, followed by the number of non-empty buckets
+ *   and a (bucket index delta, bucket count) varint pair for each of them.
+ * - Time series: varint window duration and number of values, followed by the zigzag-encoded first
+ *   value and the zigzag-encoded differences between the subsequent values.
+ */
+class CompactDiagnosticsFormatter : public AbstractDiagnosticsFormatter<CompactDiagnosticsFormatter> {
+
+	enum RecordKind {
+		RECORD_INT = 0,
+		RECORD_ERROR = 1,
+		RECORD_HISTOGRAM = 2,
+		RECORD_TIME_SERIES = 3
+	};
+
+	static const uint16_t VERSION = 1;
+
+	AppendData& data;
+	int prevId;
+
+	bool writeKey(const diag_source* src, RecordKind kind) {
+		const int32_t delta = (int32_t)src->id - prevId;
+		prevId = src->id;
+		return data.write_varint((((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31)) << 2 | kind);
+	}
+
+public:
+	CompactDiagnosticsFormatter(AppendData& appender_) : data(appender_), prevId(0) {}
+
+	inline bool openDocument() {
+		return data.write(uint16_t(0)) && data.write(VERSION);
+	}
+
+	inline bool closeDocument() {
+		return true;
+	}
+
+	bool formatSourceError(const diag_source* src, int error) {
+		return writeKey(src, RECORD_ERROR) && data.write_zigzag(error);
+	}
+
+	inline bool isSourceOk(const diag_source* src) {
+	    return true;
+	}
+
+	inline bool formatSourceInt(const diag_source* src, AbstractIntegerDiagnosticData::IntType val) {
+		return writeKey(src, RECORD_INT) && data.write_zigzag(val);
+	}
+
+	bool formatSourceHistogram(const diag_source* src, const diag_histogram_data& val) {
+		unsigned buckets = 0;
+		for (unsigned i = 0; i < DIAG_HISTOGRAM_BUCKET_COUNT; ++i) {
+			if (val.buckets[i]) {
+				++buckets;
+			}
+		}
+		if (!writeKey(src, RECORD_HISTOGRAM) || !data.write_varint(val.count) || !data.write_varint(val.min) ||
+				!data.write_varint(val.max - val.min) || !data.write_varint(val.sum) || !data.write_varint(buckets)) {
+			return false;
+		}
+		unsigned prev = 0;
+		for (unsigned i = 0; i < DIAG_HISTOGRAM_BUCKET_COUNT; ++i) {
+			if (val.buckets[i]) {
+				if (!data.write_varint(i - prev) || !data.write_varint(val.buckets[i])) {
+					return false;
+				}
+				prev = i;
+			}
+		}
+		return true;
+	}
+
+	bool formatSourceTimeSeries(const diag_source* src, const diag_time_series_data& val) {
+		if (!writeKey(src, RECORD_TIME_SERIES) || !data.write_varint(val.window) || !data.write_varint(val.count)) {
+			return false;
+		}
+		int32_t prev = 0;
+		for (unsigned i = 0; i < val.count; ++i) {
+			if (!data.write_zigzag((int32_t)((uint32_t)val.values[i] - (uint32_t)prev))) {
+				return false;
+			}
+			prev = val.values[i];
+		}
+		return true;
+	}
+
+};
+
+} // namespace particle
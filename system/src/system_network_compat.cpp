@@ -31,6 +31,7 @@
 #include "system_cloud.h"
 #include "system_event.h"
 #include "system_threading.h"
+#include "system_task.h"
 #include "watchdog_hal.h"
 #include "wlan_hal.h"
 #include "delay_hal.h"
@@ -269,26 +270,31 @@ NetworkRssiDiagnosticData g_networkRssiDiagData;
 void HAL_WLAN_notify_simple_config_done()
 {
     network.notify_listening_complete();
+    system_loop_wakeup();
 }
 
 void HAL_NET_notify_connected()
 {
     network.notify_connected();
+    system_loop_wakeup();
 }
 
 void HAL_NET_notify_disconnected()
 {
     network.notify_disconnected();
+    system_loop_wakeup();
 }
 
 void HAL_NET_notify_can_shutdown()
 {
     network.notify_can_shutdown();
+    system_loop_wakeup();
 }
 
 void HAL_NET_notify_dhcp(bool dhcp)
 {
     network.notify_dhcp(dhcp);
+    system_loop_wakeup();
 }
 
 
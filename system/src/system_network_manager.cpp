@@ -43,6 +43,7 @@ LOG_SOURCE_CATEGORY("system.nm")
 #include "system_cloud.h"
 #include "system_threading.h"
 #include "system_event.h"
+#include "system_task.h"
 
 #define CHECKV(_expr) \
         ({ \
@@ -561,6 +562,7 @@ void NetworkManager::transition(State state) {
     LOG(INFO, "State changed: %s -> %s", stateToName(state_), stateToName(state));
 
     state_ = state;
+    system_loop_wakeup();
 }
 
 void NetworkManager::ifEventHandlerCb(void* arg, if_t iface, const struct if_event* ev) {
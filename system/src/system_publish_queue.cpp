@@ -0,0 +1,241 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "system_publish_queue.h"
+
+#if HAL_PLATFORM_FILESYSTEM && !defined(SPARK_NO_CLOUD)
+
+#include "protocol_defs.h"
+#include "rtc_hal.h"
+#include "timer_hal.h"
+#include "logging.h"
+
+#include "spark_wiring_diagnostics.h"
+
+#include <memory>
+#include <new>
+#include <cstring>
+
+namespace particle {
+
+namespace system {
+
+namespace {
+
+using protocol::MAX_EVENT_NAME_LENGTH;
+using protocol::MAX_EVENT_DATA_LENGTH;
+
+// Maximum number of expired events discarded in one pass of the queue processing
+const unsigned MAX_DISCARDED_EVENTS = 8;
+
+SimpleIntegerDiagnosticData g_storedEventsSize(DIAG_ID_CLOUD_STORED_EVENTS_SIZE, DIAG_NAME_CLOUD_STORED_EVENTS_SIZE);
+SimpleIntegerDiagnosticData g_droppedStoredEvents(DIAG_ID_CLOUD_DROPPED_STORED_EVENTS, DIAG_NAME_CLOUD_DROPPED_STORED_EVENTS);
+
+uint32_t currentTime() {
+    return HAL_RTC_Time_Is_Valid(nullptr) ? HAL_RTC_Get_UnixTime() : 0;
+}
+
+} // particle::system::
+
+PublishQueue::PublishQueue() :
+        queue_("pubqueue"),
+        conf_(),
+        nextSendTime_(0),
+        pending_(false),
+        inFlight_(false),
+        active_(false),
+        checked_(false) {
+    conf_.size = sizeof(conf_);
+    conf_.max_size = DEFAULT_MAX_SIZE;
+    conf_.max_age = 0;
+    conf_.min_interval = DEFAULT_MIN_INTERVAL;
+}
+
+void PublishQueue::config(const spark_publish_queue_config& conf) {
+    conf_.max_size = conf.max_size;
+    conf_.max_age = conf.max_age;
+    conf_.min_interval = conf.min_interval;
+}
+
+int PublishQueue::push(const char* name, const char* data, int ttl, uint32_t flags) {
+    const size_t nameLen = strlen(name);
+    const size_t dataLen = data ? strlen(data) : 0;
+    if (nameLen > MAX_EVENT_NAME_LENGTH || dataLen > MAX_EVENT_DATA_LENGTH) {
+        return SYSTEM_ERROR_TOO_LARGE;
+    }
+    // The name is stored with its terminating null
+    const size_t size = sizeof(StoredEvent) + nameLen + 1 + dataLen;
+    active_ = true;
+    const int queueSize = queue_.size();
+    if (queueSize < 0) {
+        return queueSize;
+    }
+    if (queueSize + size + sizeof(fs::SegmentedFileQueue::QueueEntry) > conf_.max_size) {
+        LOG(WARN, "Publish queue is full, dropping event %s", name);
+        ++g_droppedStoredEvents;
+        return SYSTEM_ERROR_LIMIT_EXCEEDED;
+    }
+    std::unique_ptr<char[]> buf(new(std::nothrow) char[size]);
+    if (!buf) {
+        return SYSTEM_ERROR_NO_MEMORY;
+    }
+    const auto ev = (StoredEvent*)buf.get();
+    ev->time = currentTime();
+    ev->ttl = ttl;
+    ev->flags = flags;
+    ev->nameLength = nameLen;
+    memcpy(buf.get() + sizeof(StoredEvent), name, nameLen + 1);
+    if (dataLen) {
+        memcpy(buf.get() + sizeof(StoredEvent) + nameLen + 1, data, dataLen);
+    }
+    const int ret = queue_.pushBack(buf.get(), size);
+    if (ret < 0) {
+        LOG(ERROR, "Unable to store event %s: %d", name, ret);
+        return ret;
+    }
+    LOG(TRACE, "Stored event %s, %u bytes", name, (unsigned)size);
+    updateDiagnostics();
+    return 0;
+}
+
+bool PublishQueue::isEmpty() {
+    return !isActive() || queue_.size() <= 0;
+}
+
+void PublishQueue::process(system_tick_t now) {
+    if (!isActive() || pending_ || !spark_cloud_flag_connected() || (int)(now - nextSendTime_) < 0 || isEmpty()) {
+        return;
+    }
+    // The data is null-terminated after it's read
+    const size_t maxSize = sizeof(StoredEvent) + MAX_EVENT_NAME_LENGTH + 1 + MAX_EVENT_DATA_LENGTH;
+    std::unique_ptr<char[]> buf(new(std::nothrow) char[maxSize + 1]);
+    if (!buf) {
+        return;
+    }
+    const auto ev = (const StoredEvent*)buf.get();
+    const uint32_t time = currentTime();
+    size_t size = 0;
+    for (unsigned discarded = 0;; ++discarded) {
+        if (discarded == MAX_DISCARDED_EVENTS) {
+            updateDiagnostics();
+            return;
+        }
+        fs::SegmentedFileQueue::QueueEntry entry;
+        const int ret = queue_.front(entry, buf.get(), maxSize);
+        if (ret < 0) {
+            if (ret != SYSTEM_ERROR_NOT_FOUND) {
+                LOG(ERROR, "Unable to read stored event: %d", ret);
+                nextSendTime_ = now + RETRY_DELAY;
+            }
+            updateDiagnostics();
+            return;
+        }
+        size = entry.size - sizeof(entry);
+        if (size <= sizeof(StoredEvent) + ev->nameLength || buf[sizeof(StoredEvent) + ev->nameLength] != '\0') {
+            LOG(ERROR, "Invalid stored event");
+        } else if (isExpired(*ev, time)) {
+            LOG(TRACE, "Stored event %s has expired", buf.get() + sizeof(StoredEvent));
+        } else {
+            break;
+        }
+        queue_.popFront();
+        ++g_droppedStoredEvents;
+    }
+    buf[size] = '\0';
+    const char* name = buf.get() + sizeof(StoredEvent);
+    const char* data = name + ev->nameLength + 1;
+    spark_send_event_data d = { sizeof(spark_send_event_data) };
+    d.handler_callback = sendCompleted;
+    d.handler_data = this;
+    // The event is sent with the remaining part of its TTL
+    int ttl = ev->ttl;
+    if (ttl > 0 && ev->time && time > ev->time) {
+        ttl -= time - ev->time;
+    }
+    // The completion handler is invoked in any case, possibly before spark_send_event() returns
+    pending_ = true;
+    inFlight_ = true;
+    nextSendTime_ = now + conf_.min_interval;
+    spark_send_event(name, data, ttl, ev->flags & ~PUBLISH_EVENT_FLAG_STORE_FORWARD, &d);
+}
+
+int PublishQueue::clear() {
+    const int ret = queue_.clear();
+    // The event being sent is no longer in the queue
+    inFlight_ = false;
+    // Check for the queue files again in case they couldn't be removed
+    active_ = false;
+    checked_ = false;
+    g_storedEventsSize = 0;
+    return ret;
+}
+
+PublishQueue* PublishQueue::instance() {
+    static PublishQueue queue;
+    return &queue;
+}
+
+// The queue files are only created when the first event is stored, or if they were left from before
+// a reset. Until then, the filesystem is checked only once
+bool PublishQueue::isActive() {
+    if (!active_ && !checked_) {
+        checked_ = true;
+        if (queue_.exists()) {
+            active_ = true;
+            // Report the events stored before a reset
+            updateDiagnostics();
+        }
+    }
+    return active_;
+}
+
+// An event expires once its TTL or the maximum age set for the queue has elapsed. The age of an
+// event stored while the time was unknown can't be determined
+bool PublishQueue::isExpired(const StoredEvent& ev, uint32_t time) const {
+    if (!ev.time || time <= ev.time) {
+        return false;
+    }
+    const uint32_t age = time - ev.time;
+    return (ev.ttl > 0 && age > (uint32_t)ev.ttl) || (conf_.max_age && age > conf_.max_age);
+}
+
+void PublishQueue::updateDiagnostics() {
+    const int size = queue_.size();
+    g_storedEventsSize = (size > 0) ? size : 0;
+}
+
+void PublishQueue::sendCompleted(int error, const void* data, void* callbackData, void* reserved) {
+    const auto q = static_cast<PublishQueue*>(callbackData);
+    q->pending_ = false;
+    if (!q->inFlight_) {
+        return; // The queue has been cleared while the event was being sent
+    }
+    q->inFlight_ = false;
+    if (error != SYSTEM_ERROR_NONE) {
+        LOG(WARN, "Unable to send stored event: %d", error);
+        q->nextSendTime_ = HAL_Timer_Get_Milli_Seconds() + RETRY_DELAY;
+        return;
+    }
+    q->queue_.popFront();
+    q->updateDiagnostics();
+}
+
+} // particle::system
+
+} // particle
+
+#endif // HAL_PLATFORM_FILESYSTEM && !defined(SPARK_NO_CLOUD)
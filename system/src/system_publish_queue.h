@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "hal_platform.h"
+
+#if HAL_PLATFORM_FILESYSTEM
+
+#include "system_cloud.h"
+#include "file_queue.h"
+
+namespace particle {
+
+namespace system {
+
+/**
+ * Persistent queue of the events published with PUBLISH_EVENT_FLAG_STORE_FORWARD.
+ *
+ * The events are stored on the filesystem and sent one at a time, in the order in which they were
+ * published, once the device is connected to the cloud. All methods are called in the system
+ * thread.
+ */
+class PublishQueue {
+public:
+    // Default maximum total size of the stored events
+    static const uint32_t DEFAULT_MAX_SIZE = 16 * 1024;
+    // Default minimum interval between sending of the stored events
+    static const system_tick_t DEFAULT_MIN_INTERVAL = 1000;
+    // Delay before a failed event is sent again
+    static const system_tick_t RETRY_DELAY = 10000;
+
+    void config(const spark_publish_queue_config& conf);
+
+    /**
+     * Store an event.
+     *
+     * @return 0 on success or a negative error code.
+     */
+    int push(const char* name, const char* data, int ttl, uint32_t flags);
+
+    /**
+     * Returns `true` if there are no stored events.
+     */
+    bool isEmpty();
+
+    /**
+     * Send the next stored event if the device is connected to the cloud and the sending of the
+     * previous event has completed.
+     */
+    void process(system_tick_t now);
+
+    int clear();
+
+    static PublishQueue* instance();
+
+private:
+    struct __attribute__((__packed__)) StoredEvent {
+        uint32_t time; // Time at which the event was stored (Unix time), or 0 if the time was unknown
+        int32_t ttl;
+        uint32_t flags; // PUBLISH_EVENT_FLAG_*
+        uint8_t nameLength;
+        // Followed by the event name and data
+    };
+
+    fs::SegmentedFileQueue queue_;
+    spark_publish_queue_config conf_;
+    system_tick_t nextSendTime_;
+    bool pending_;
+    bool inFlight_; // The event being sent is still at the front of the queue
+    bool active_; // The queue files exist
+    bool checked_; // The filesystem has been checked for the queue files
+
+    PublishQueue();
+
+    bool isActive();
+    bool isExpired(const StoredEvent& ev, uint32_t time) const;
+    void updateDiagnostics();
+
+    static void sendCompleted(int error, const void* data, void* callbackData, void* reserved);
+};
+
+} // particle::system
+
+} // particle
+
+#endif // HAL_PLATFORM_FILESYSTEM
@@ -48,14 +48,8 @@
 #include "spark_wiring_interrupts.h"
 #include "spark_wiring_led.h"
 #include "system_commands.h"
-
-#if HAL_PLATFORM_BLE
-#include "ble_hal.h"
-#include "system_control_internal.h"
-
-using namespace particle;
-
-#endif /* HAL_PLATFORM_BLE */
+#include "system_publish_queue.h"
+#include <algorithm>
 
 using spark::Network;
 using particle::LEDStatus;
@@ -81,7 +75,30 @@ static struct SetThreadCurrentFunctionPointers {
     }
 } s_SetThreadCurrentFunctionPointersInitializer;
 
-ISRTaskQueue SystemISRTaskQueue;
+ISRTaskQueue SystemISRTaskQueue(system_loop_wakeup);
+
+#if PLATFORM_THREADING
+namespace {
+
+// Signaled by system_loop_wakeup() when the system loop runs on the application thread
+os_semaphore_t s_loopEvent = nullptr;
+
+} // namespace
+#endif // PLATFORM_THREADING
+
+void system_loop_wakeup()
+{
+#if PLATFORM_THREADING
+    if (SystemThread.isStarted()) {
+        SystemThread.wakeup();
+        return;
+    }
+    const auto sem = s_loopEvent;
+    if (sem) {
+        os_semaphore_give(sem, false);
+    }
+#endif // PLATFORM_THREADING
+}
 
 void Network_Setup(bool threaded)
 {
@@ -464,19 +481,42 @@ void Spark_Idle_Events(bool force_events/*=false*/)
 // FIXME: there should be a separate feature macro
 #if HAL_PLATFORM_FILESYSTEM
         particle::system::fetchAndExecuteCommand(millis());
+        CLOUD_FN(particle::system::PublishQueue::instance()->process(millis()), (void)0);
 #endif // HAL_PLATFORM_FILESYSTEM
     }
     else
     {
         system_pending_shutdown();
     }
-#if HAL_PLATFORM_BLE
-    // TODO: Process BLE channel events in a separate thread
-    system::SystemControl::instance()->run();
-#endif
     system_shutdown_if_needed();
 }
 
+/**
+ * Blocks until there is an event for the loop running on the calling thread, or until the timeout
+ * expires. Returns `true` if the loop has been woken up by an event.
+ */
+static bool system_loop_wait(system_tick_t timeout, bool background)
+{
+#if PLATFORM_THREADING
+    if (!background) {
+        HAL_Delay_Milliseconds(timeout);
+        return false;
+    }
+    if (system_thread_get_state(nullptr) == spark::feature::ENABLED) {
+        // The application thread only needs to process the messages posted to its queue
+        return ApplicationThread.process(timeout);
+    }
+    if (!s_loopEvent && os_semaphore_create(&s_loopEvent, 1, 0) != 0) {
+        s_loopEvent = nullptr;
+    }
+    if (s_loopEvent) {
+        return os_semaphore_take(s_loopEvent, timeout, false) == 0;
+    }
+#endif // PLATFORM_THREADING
+    HAL_Delay_Milliseconds(std::min<system_tick_t>(timeout, 1));
+    return false;
+}
+
 /*
  * @brief This should block for a certain number of milliseconds and also execute spark_wlan_loop
  */
@@ -495,6 +535,8 @@ void system_delay_pump(unsigned long ms, bool force_no_background_loop=false)
         HAL_Notify_WDT();
 
         system_tick_t elapsed_millis = HAL_Timer_Get_Milli_Seconds() - start_millis;
+        const bool background = !(SPARK_WLAN_SLEEP || force_no_background_loop);
+        bool event = false;
 
         if (elapsed_millis > ms)
         {
@@ -514,14 +556,23 @@ void system_delay_pump(unsigned long ms, bool force_no_background_loop=false)
         }
         else
         {
-            HAL_Delay_Milliseconds(1);
+            // Sleep until the last millisecond, the next run of the background loop, or an event,
+            // whichever comes first
+            system_tick_t timeout = std::min<system_tick_t>(ms - 1 - elapsed_millis, SPARK_LOOP_DELAY_MILLIS);
+            if (background)
+            {
+                timeout = (spark_loop_elapsed_millis > elapsed_millis) ?
+                        std::min<system_tick_t>(timeout, spark_loop_elapsed_millis - elapsed_millis) : 0;
+            }
+            event = system_loop_wait(timeout, background);
+            elapsed_millis = HAL_Timer_Get_Milli_Seconds() - start_millis;
         }
 
-        if (SPARK_WLAN_SLEEP || force_no_background_loop)
+        if (!background)
         {
             //Do not yield for Spark_Idle()
         }
-        else if ((elapsed_millis >= spark_loop_elapsed_millis) || (spark_loop_total_millis >= SPARK_LOOP_DELAY_MILLIS))
+        else if (event || (elapsed_millis >= spark_loop_elapsed_millis) || (spark_loop_total_millis >= SPARK_LOOP_DELAY_MILLIS))
         {
         		bool threading = system_thread_get_state(nullptr);
             spark_loop_elapsed_millis = elapsed_millis + SPARK_LOOP_DELAY_MILLIS;
@@ -43,6 +43,7 @@
 #include "system_network_internal.h"
 #include "bytes2hexbuf.h"
 #include "system_threading.h"
+#include "system_diag_format.h"
 #if HAL_PLATFORM_DCT
 #include "dct.h"
 #endif // HAL_PLATFORM_DCT
@@ -368,6 +369,7 @@ int Spark_Finish_Firmware_Update(FileTransfer::Descriptor& file, uint32_t flags,
     }
     else
     {
+        HAL_FLASH_Abort(NULL);
         system_notify_event(firmware_update, firmware_update_failed, &file);
     }
 
@@ -389,52 +391,6 @@ int Spark_Save_Firmware_Chunk(FileTransfer::Descriptor& file, const uint8_t* chu
 }
 
 
-class AppendBase {
-
-    appender_fn fn;
-    void* data;
-
-protected:
-
-    template<typename T> inline bool writeDirect(const T& value) {
-		return fn(data, (const uint8_t*)&value, sizeof(value));
-	}
-
-public:
-
-    AppendBase(appender_fn fn, void* data) {
-        this->fn = fn; this->data = data;
-    }
-
-    bool write(const char* string) const {
-        return fn(data, (const uint8_t*)string, strlen(string));
-    }
-
-    bool write(char* string) const {
-        return fn(data, (const uint8_t*)string, strlen(string));
-    }
-
-    bool write(char c) {
-        return writeDirect(c);
-    }
-};
-
-
-class AppendData : public AppendBase {
-public:
-	AppendData(appender_fn fn, void* data) : AppendBase(fn, data) {}
-
-    bool write(uint16_t value) {
-    		return writeDirect(value);
-    }
-
-    bool write(int32_t value) {
-    		return writeDirect(value);
-    }
-
-};
-
-
 class AppendJson : public AppendBase
 {
 	using super = AppendBase;
@@ -477,6 +433,17 @@ public:
         return write(itoa(value, buf, 10));
     }
 
+    bool write_unsigned(unsigned value) {
+        char buf[12];
+        return write(utoa(value, buf, 10));
+    }
+
+    bool write_unsigned_value(const char* name, unsigned value) {
+        return write_attribute(name) &&
+               write_unsigned(value) &&
+               next();
+    }
+
     inline bool write(char c) {
     		return super::write(c);
     }
@@ -680,82 +647,6 @@ namespace {
 
 using namespace particle;
 
-template <typename T>
-class AbstractDiagnosticsFormatter {
-
-
-protected:
-
-	inline T& formatter() {
-		return formatter(this);
-	}
-
-	static inline T& formatter(void* fmt) {
-		return *reinterpret_cast<T*>(fmt);
-	}
-
-	static int formatSourceData(const diag_source* src, void* fmt) {
-		return formatter(fmt).formatSource(src);
-	}
-
-	int formatSource(const diag_source* src) {
-		T& fmt = formatter();
-		if (!fmt.isSourceOk(src)) {
-			return 0;
-		}
-	    switch (src->type) {
-	    case DIAG_TYPE_INT: {
-	        AbstractIntegerDiagnosticData::IntType val = 0;
-	        const int ret = AbstractIntegerDiagnosticData::get(src, val);
-	        if ((ret == 0 && !fmt.formatSourceInt(src, val)) || (ret != 0 && !fmt.formatSourceError(src, ret))) {
-	            return SYSTEM_ERROR_TOO_LARGE;
-	        }
-	        break;
-	    }
-	    default:
-	        return SYSTEM_ERROR_NOT_SUPPORTED;
-	    }
-	    return 0;
-	}
-
-	static int formatSources(T& formatter, const uint16_t* id, size_t count, unsigned flags) {
-	    if (!formatter.openDocument()) {
-			return SYSTEM_ERROR_TOO_LARGE;
-	    }
-		if (id) {
-			// Dump specified data sources
-			for (size_t i = 0; i < count; ++i) {
-				const diag_source* src = nullptr;
-				int ret = diag_get_source(id[i], &src, nullptr);
-				if (ret != 0) {
-					return ret;
-				}
-				ret = formatter.formatSource(src);
-				if (ret != 0) {
-					return ret;
-				}
-			}
-		} else {
-			// Dump all data sources
-			const int ret = diag_enum_sources(formatSourceData, nullptr, &formatter, nullptr);
-			if (ret != 0) {
-				return ret;
-			}
-		}
-		if (!formatter.closeDocument()) {
-			return SYSTEM_ERROR_TOO_LARGE;
-		}
-		return 0;
-	}
-
-public:
-
-	int format(const uint16_t* id, size_t count, unsigned flags) {
-		return formatSources(formatter(this), id, count, flags);
-	}
-};
-
-
 class JsonDiagnosticsFormatter : public AbstractDiagnosticsFormatter<JsonDiagnosticsFormatter> {
 
 	AppendJson& json;
@@ -787,44 +678,32 @@ public:
 	inline bool formatSourceInt(const diag_source* src, AbstractIntegerDiagnosticData::IntType val) {
 		return json.write_value(src->name, val);
 	}
-};
-
-
-class BinaryDiagnosticsFormatter : public AbstractDiagnosticsFormatter<BinaryDiagnosticsFormatter> {
-
-	AppendData& data;
 
-	using value = AbstractIntegerDiagnosticData::IntType;
-	using id = typeof(diag_source::id);
-
-public:
-	BinaryDiagnosticsFormatter(AppendData& appender_) : data(appender_) {}
-
-
-	inline bool openDocument() {
-		return data.write(uint16_t(sizeof(id))) && data.write(uint16_t(sizeof(value)));
-	}
-
-	inline bool closeDocument() {
-		return true;
-	}
-
-	/**
-	 *
-	 */
-	bool formatSourceError(const diag_source* src, int error) {
-		static_assert(sizeof(src->id)==2, "expected diagnostic id to be 16-bits");
-		return data.write(decltype(src->id)(src->id | 1<<15)) && data.write(int32_t(error));
-	}
-
-	inline bool isSourceOk(const diag_source* src) {
-	    return true;
+	// The buckets are summarized as percentiles
+	bool formatSourceHistogram(const diag_source* src, const diag_histogram_data& data) {
+	    return json.write_attribute(src->name) &&
+	            json.write('{') &&
+	            json.write_unsigned_value("n", data.count) &&
+	            json.write_unsigned_value("min", data.min) &&
+	            json.write_unsigned_value("max", data.max) &&
+	            json.write_unsigned_value("p50", AbstractHistogramDiagnosticData::percentile(data, 50)) &&
+	            json.write_attribute("p99") &&
+	            json.write_unsigned(AbstractHistogramDiagnosticData::percentile(data, 99)) &&
+	            json.write('}') &&
+	            json.next();
 	}
 
-	inline bool formatSourceInt(const diag_source* src, AbstractIntegerDiagnosticData::IntType val) {
-		return data.write(src->id) && data.write(val);
+	bool formatSourceTimeSeries(const diag_source* src, const diag_time_series_data& data) {
+	    if (!json.write_attribute(src->name) || !json.write('[')) {
+	        return false;
+	    }
+	    for (unsigned i = 0; i < data.count; ++i) {
+	        if ((i > 0 && !json.write(',')) || !json.write((int)data.values[i])) {
+	            return false;
+	        }
+	    }
+	    return json.write(']') && json.next();
 	}
-
 };
 
 
@@ -834,9 +713,14 @@ public:
 
 int system_format_diag_data(const uint16_t* id, size_t count, unsigned flags, appender_fn append, void* append_data,
         void* reserved) {
-	if (flags & 1) {
+	if ((flags & SYSTEM_FORMAT_DIAG_FLAG_BINARY) && (flags & SYSTEM_FORMAT_DIAG_FLAG_COMPACT)) {
+		AppendData data(append, append_data);
+		particle::CompactDiagnosticsFormatter fmt(data);
+	    return fmt.format(id, count, flags);
+	}
+	else if (flags & SYSTEM_FORMAT_DIAG_FLAG_BINARY) {
 		AppendData data(append, append_data);
-		BinaryDiagnosticsFormatter fmt(data);
+		particle::BinaryDiagnosticsFormatter fmt(data);
 	    return fmt.format(id, count, flags);
 	}
 	else {
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Host tests of the persistent publish queue. The queue runs on the Gen 3 filesystem over a RAM
+ * image of the external flash, see hal/tests/littlefs. The cloud connection, the clocks and the
+ * diagnostics are replaced with stubs.
+ */
+
+#include "system_publish_queue.h"
+#include "protocol_defs.h"
+#include "system_error.h"
+#include "rtc_hal.h"
+#include "timer_hal.h"
+#include "diagnostics.h"
+#include "filesystem.h"
+#include "exflash_host.h"
+
+// Defined by service_debug.h
+#undef INFO
+#undef WARN
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+
+using particle::system::PublishQueue;
+
+namespace {
+
+struct SentEvent {
+    std::string name;
+    std::string data;
+    int ttl;
+    uint32_t flags;
+};
+
+std::vector<SentEvent> g_sentEvents;
+int g_sendResult = 0;
+bool g_deferCompletion = false; // Complete the sending of an event via completeSend()
+spark_send_event_data g_pendingSend = {};
+bool g_connected = false;
+system_tick_t g_millis = 0;
+time_t g_unixTime = 0;
+
+filesystem_t* fs() {
+    return filesystem_get_instance(nullptr);
+}
+
+// Mounts the filesystem on a blank flash image
+void formatFilesystem() {
+    filesystem_unmount(fs());
+    particle::test::exflash_clear();
+    REQUIRE(filesystem_mount(fs()) == 0);
+}
+
+bool fileExists(const char* path) {
+    particle::fs::FsLock lk(fs());
+    lfs_info info = {};
+    return lfs_stat(&fs()->instance, path, &info) == 0;
+}
+
+// Advances the clock and runs the queue processing
+void process(PublishQueue* queue, system_tick_t ms) {
+    g_millis += ms;
+    queue->process(g_millis);
+}
+
+// Runs the queue processing until the stored events are sent
+void drain(PublishQueue* queue) {
+    for (int i = 0; i < 100 && !queue->isEmpty(); ++i) {
+        process(queue, PublishQueue::RETRY_DELAY);
+    }
+}
+
+// Completes the sending of the last event if the completion was deferred
+void completeSend(int result) {
+    REQUIRE(g_pendingSend.handler_callback);
+    const auto d = g_pendingSend;
+    g_pendingSend = {};
+    d.handler_callback(result, nullptr, d.handler_data, nullptr);
+}
+
+std::vector<std::string> sentNames() {
+    std::vector<std::string> names;
+    for (const auto& ev: g_sentEvents) {
+        names.push_back(ev.name);
+    }
+    return names;
+}
+
+void setConfig(PublishQueue* queue, uint32_t maxSize, uint32_t maxAge, uint32_t minInterval) {
+    spark_publish_queue_config conf = {};
+    conf.size = sizeof(conf);
+    conf.max_size = maxSize;
+    conf.max_age = maxAge;
+    conf.min_interval = minInterval;
+    queue->config(conf);
+}
+
+PublishQueue* resetQueue() {
+    const auto queue = PublishQueue::instance();
+    // Close the queue files before the filesystem is formatted
+    REQUIRE(queue->clear() == 0);
+    formatFilesystem();
+    setConfig(queue, PublishQueue::DEFAULT_MAX_SIZE, 0, PublishQueue::DEFAULT_MIN_INTERVAL);
+    g_sentEvents.clear();
+    g_sendResult = 0;
+    g_deferCompletion = false;
+    g_connected = false;
+    g_unixTime = 0;
+    // Let the minimum interval and retry delay of the previous test elapse
+    process(queue, PublishQueue::RETRY_DELAY);
+    return queue;
+}
+
+} // namespace
+
+// Stubs of the system and HAL functions used by the publish queue
+
+bool spark_cloud_flag_connected() {
+    return g_connected;
+}
+
+bool spark_send_event(const char* name, const char* data, int ttl, uint32_t flags, void* reserved) {
+    g_sentEvents.push_back({ name, data ? data : "", ttl, flags });
+    const auto d = (const spark_send_event_data*)reserved;
+    if (g_deferCompletion) {
+        g_pendingSend = *d;
+        return true;
+    }
+    d->handler_callback(g_sendResult, nullptr, d->handler_data, nullptr);
+    return g_sendResult == 0;
+}
+
+uint8_t HAL_RTC_Time_Is_Valid(void* reserved) {
+    return g_unixTime != 0;
+}
+
+time_t HAL_RTC_Get_UnixTime() {
+    return g_unixTime;
+}
+
+system_tick_t HAL_Timer_Get_Milli_Seconds() {
+    return g_millis;
+}
+
+int diag_register_source(const diag_source* src, void* reserved) {
+    return 0;
+}
+
+TEST_CASE("PublishQueue") {
+    const auto queue = resetQueue();
+
+    SECTION("doesn't create the queue files until an event is stored") {
+        g_connected = true;
+        process(queue, 1000);
+        process(queue, 1000);
+        CHECK(queue->isEmpty());
+        CHECK_FALSE(fileExists("pubqueue"));
+        REQUIRE(queue->push("a", "1", 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+        CHECK(fileExists("pubqueue"));
+        CHECK(fileExists("pubqueue/head"));
+    }
+
+    SECTION("stores events while offline and sends them in order once connected") {
+        REQUIRE(queue->push("e1", "d1", 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+        REQUIRE(queue->push("e2", nullptr, 120, PUBLISH_EVENT_FLAG_STORE_FORWARD | PUBLISH_EVENT_FLAG_PRIVATE) == 0);
+        REQUIRE(queue->push("e3", "d3", 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+        process(queue, 1000);
+        CHECK(g_sentEvents.empty());
+        CHECK_FALSE(queue->isEmpty());
+        g_connected = true;
+        drain(queue);
+        CHECK(queue->isEmpty());
+        REQUIRE(sentNames() == std::vector<std::string>({ "e1", "e2", "e3" }));
+        CHECK(g_sentEvents[0].data == "d1");
+        CHECK(g_sentEvents[1].data == "");
+        CHECK(g_sentEvents[1].ttl == 120);
+        CHECK(g_sentEvents[1].flags == PUBLISH_EVENT_FLAG_PRIVATE);
+        CHECK(g_sentEvents[2].flags == 0);
+    }
+
+    SECTION("sends one event per minimum interval") {
+        setConfig(queue, PublishQueue::DEFAULT_MAX_SIZE, 0, 1000);
+        REQUIRE(queue->push("e1", "d1", 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+        REQUIRE(queue->push("e2", "d2", 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+        g_connected = true;
+        process(queue, 0);
+        CHECK(g_sentEvents.size() == 1);
+        process(queue, 999);
+        CHECK(g_sentEvents.size() == 1);
+        process(queue, 1);
+        CHECK(g_sentEvents.size() == 2);
+        CHECK(queue->isEmpty());
+    }
+
+    SECTION("keeps an event that couldn't be sent and retries it later") {
+        REQUIRE(queue->push("e1", "d1", 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+        g_connected = true;
+        g_sendResult = SYSTEM_ERROR_TIMEOUT;
+        process(queue, 0);
+        CHECK(g_sentEvents.size() == 1);
+        CHECK_FALSE(queue->isEmpty());
+        g_sendResult = 0;
+        process(queue, PublishQueue::RETRY_DELAY - 1);
+        CHECK(g_sentEvents.size() == 1);
+        process(queue, 1);
+        REQUIRE(sentNames() == std::vector<std::string>({ "e1", "e1" }));
+        CHECK(queue->isEmpty());
+    }
+
+    SECTION("discards events older than the maximum age") {
+        setConfig(queue, PublishQueue::DEFAULT_MAX_SIZE, 60, PublishQueue::DEFAULT_MIN_INTERVAL);
+        g_unixTime = 1000000;
+        REQUIRE(queue->push("old", "1", 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+        g_unixTime += 30;
+        REQUIRE(queue->push("new", "2", 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+        g_unixTime += 45;
+        g_connected = true;
+        drain(queue);
+        CHECK(sentNames() == std::vector<std::string>({ "new" }));
+        CHECK(queue->isEmpty());
+    }
+
+    SECTION("discards events whose TTL has elapsed") {
+        g_unixTime = 1000000;
+        REQUIRE(queue->push("short", "1", 30, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+        REQUIRE(queue->push("long", "2", 120, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+        g_unixTime += 45;
+        g_connected = true;
+        drain(queue);
+        REQUIRE(sentNames() == std::vector<std::string>({ "long" }));
+        // The event is sent with the remaining part of its TTL
+        CHECK(g_sentEvents[0].ttl == 75);
+        CHECK(queue->isEmpty());
+    }
+
+    SECTION("doesn't expire events stored while the time was unknown") {
+        setConfig(queue, PublishQueue::DEFAULT_MAX_SIZE, 60, PublishQueue::DEFAULT_MIN_INTERVAL);
+        REQUIRE(queue->push("e1", "1", 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+        g_unixTime = 1000000;
+        g_connected = true;
+        drain(queue);
+        CHECK(sentNames() == std::vector<std::string>({ "e1" }));
+    }
+
+    SECTION("keeps the events stored after the queue is cleared while an event is being sent") {
+        REQUIRE(queue->push("e1", "1", 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+        g_connected = true;
+        g_deferCompletion = true;
+        process(queue, 0);
+        REQUIRE(sentNames() == std::vector<std::string>({ "e1" }));
+        REQUIRE(queue->clear() == 0);
+        REQUIRE(queue->push("e2", "2", 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+        completeSend(0);
+        CHECK_FALSE(queue->isEmpty());
+        g_deferCompletion = false;
+        drain(queue);
+        CHECK(sentNames() == std::vector<std::string>({ "e1", "e2" }));
+        CHECK(queue->isEmpty());
+    }
+
+    SECTION("rejects events that don't fit in the maximum size") {
+        // Each entry takes 13 bytes of event header, 2 bytes of name, 30 bytes of data and 4 bytes
+        // of queue entry header
+        const std::string data(30, 'x');
+        setConfig(queue, 200, 0, PublishQueue::DEFAULT_MIN_INTERVAL);
+        for (int i = 0; i < 4; ++i) {
+            REQUIRE(queue->push("e", data.c_str(), 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+        }
+        CHECK(queue->push("e", data.c_str(), 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == SYSTEM_ERROR_LIMIT_EXCEEDED);
+        g_connected = true;
+        drain(queue);
+        CHECK(g_sentEvents.size() == 4);
+        CHECK(queue->push("e", data.c_str(), 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == 0);
+    }
+
+    SECTION("rejects events with a name or data that is too long") {
+        const std::string name(particle::protocol::MAX_EVENT_NAME_LENGTH + 1, 'n');
+        const std::string data(particle::protocol::MAX_EVENT_DATA_LENGTH + 1, 'd');
+        CHECK(queue->push(name.c_str(), "1", 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == SYSTEM_ERROR_TOO_LARGE);
+        CHECK(queue->push("e", data.c_str(), 60, PUBLISH_EVENT_FLAG_STORE_FORWARD) == SYSTEM_ERROR_TOO_LARGE);
+        CHECK_FALSE(fileExists("pubqueue"));
+    }
+}
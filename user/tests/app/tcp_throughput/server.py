@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+#
+# Server side of the TCPClient throughput benchmark.
+#
+# Each connection starts with a request line:
+#   "D <size>\n" - the server sends <size> bytes and closes the connection.
+#   "U <size>\n" - the server receives <size> bytes, replies with a single byte and closes
+#                  the connection.
+
+import socket
+import sys
+
+
+def handle(conn):
+    f = conn.makefile('rb')
+    req = f.readline().split()
+    if len(req) != 2:
+        return
+    size = int(req[1])
+    if req[0] == b'D':
+        chunk = b'x' * 65536
+        while size > 0:
+            n = min(size, len(chunk))
+            conn.sendall(chunk[:n])
+            size -= n
+    elif req[0] == b'U':
+        while size > 0:
+            data = f.read1(min(size, 65536))
+            if not data:
+                return
+            size -= len(data)
+        conn.sendall(b'.')
+
+
+def main():
+    port = int(sys.argv[1]) if len(sys.argv) > 1 else 5555
+    srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind(('', port))
+    srv.listen(1)
+    print('Listening on port %d' % port)
+    while True:
+        conn, addr = srv.accept()
+        with conn:
+            handle(conn)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,154 @@
+/*
+ * TCPClient throughput benchmark.
+ *
+ * Start server.py on the host and run the application on the virtual device (or set
+ * SERVER_ADDRESS to the address of the host when running on a real device):
+ *
+ *     python3 server.py 5555
+ *
+ * The results are logged for the default configuration of TCPClient and for various
+ * combinations of the receive and send buffers.
+ */
+
+#include "application.h"
+
+SYSTEM_MODE(MANUAL);
+
+#ifndef SERVER_ADDRESS
+#define SERVER_ADDRESS 127, 0, 0, 1
+#endif
+
+#ifndef SERVER_PORT
+#define SERVER_PORT 5555
+#endif
+
+namespace {
+
+const SerialLogHandler logHandler(LOG_LEVEL_WARN, {
+    { "app", LOG_LEVEL_ALL }
+});
+
+const size_t TRANSFER_SIZE = 4 * 1024 * 1024;
+
+uint8_t buf[8192];
+
+enum class Method {
+    BYTE, // read() / write(uint8_t)
+    CHUNK // read(buf, n) / write(buf, n)
+};
+
+struct Config {
+    const char* name;
+    Method method;
+    size_t chunkSize;
+    size_t rxBufSize;
+    size_t txBufSize;
+};
+
+bool connect(TCPClient& client, const Config& conf) {
+    if (!client.connect(IPAddress(SERVER_ADDRESS), SERVER_PORT)) {
+        Log.error("Unable to connect to the server");
+        return false;
+    }
+    if (!client.setReceiveBuffer(conf.rxBufSize) || !client.setSendBuffer(conf.txBufSize)) {
+        Log.error("Unable to allocate buffers");
+        client.stop();
+        return false;
+    }
+    return true;
+}
+
+void logResult(const char* dir, const Config& conf, size_t bytes, system_tick_t t) {
+    Log.info("%s %s: %u bytes in %u ms, %u KB/s", dir, conf.name, (unsigned)bytes, (unsigned)t,
+            (unsigned)(t ? (uint64_t)bytes * 1000 / 1024 / t : 0));
+}
+
+void download(const Config& conf) {
+    TCPClient client;
+    if (!connect(client, conf)) {
+        return;
+    }
+    client.printf("D %u\n", (unsigned)TRANSFER_SIZE);
+    client.flush();
+    size_t bytes = 0;
+    const system_tick_t t1 = millis();
+    while (bytes < TRANSFER_SIZE && client.connected()) {
+        if (conf.method == Method::BYTE) {
+            if (client.read() >= 0) {
+                ++bytes;
+            }
+        } else {
+            const int n = client.read(buf, conf.chunkSize);
+            if (n > 0) {
+                bytes += n;
+            }
+        }
+    }
+    logResult("Download", conf, bytes, millis() - t1);
+    client.stop();
+}
+
+void upload(const Config& conf) {
+    TCPClient client;
+    if (!connect(client, conf)) {
+        return;
+    }
+    client.printf("U %u\n", (unsigned)TRANSFER_SIZE);
+    memset(buf, 'x', sizeof(buf));
+    size_t bytes = 0;
+    const system_tick_t t1 = millis();
+    while (bytes < TRANSFER_SIZE && client.connected()) {
+        if (conf.method == Method::BYTE) {
+            if (client.write(buf[0]) != 1) {
+                break;
+            }
+            ++bytes;
+        } else {
+            const size_t n = client.write(buf, std::min(conf.chunkSize, TRANSFER_SIZE - bytes));
+            if (!n || client.getWriteError()) {
+                break;
+            }
+            bytes += n;
+        }
+    }
+    client.flush();
+    // Wait for the server to confirm that all data has been received
+    while (client.connected() && client.read() < 0) {
+    }
+    logResult("Upload", conf, bytes, millis() - t1);
+    client.stop();
+}
+
+const Config DOWNLOAD_CONFIGS[] = {
+    { "read() default", Method::BYTE, 1, 0, 0 },
+    { "read(128) default", Method::CHUNK, 128, 0, 0 },
+    { "read(1024) direct", Method::CHUNK, 1024, 0, 0 },
+    { "read(8192) direct", Method::CHUNK, 8192, 0, 0 },
+    { "read() rx=2048", Method::BYTE, 1, 2048, 0 },
+    { "read(512) rx=2048", Method::CHUNK, 512, 2048, 0 }
+};
+
+const Config UPLOAD_CONFIGS[] = {
+    { "write() default", Method::BYTE, 1, 0, 0 },
+    { "write() tx=1024", Method::BYTE, 1, 0, 1024 },
+    { "write(64) default", Method::CHUNK, 64, 0, 0 },
+    { "write(64) tx=1024", Method::CHUNK, 64, 0, 1024 },
+    { "write(8192) default", Method::CHUNK, 8192, 0, 0 }
+};
+
+} // namespace
+
+void setup() {
+    Network.connect();
+    waitUntil(Network.ready);
+    for (const auto& conf: DOWNLOAD_CONFIGS) {
+        download(conf);
+    }
+    for (const auto& conf: UPLOAD_CONFIGS) {
+        upload(conf);
+    }
+    Log.info("Done");
+}
+
+void loop() {
+}
@@ -0,0 +1,285 @@
+#include "aes_ccm.h"
+
+#include "catch.hpp"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+// Reference AES-128 block encryption (FIPS 197)
+class TestAes {
+public:
+    TestAes() :
+            roundKeys_() {
+        initSbox();
+    }
+
+    void setKey(const std::string& key) {
+        REQUIRE(key.size() == 16);
+        memcpy(roundKeys_, key.data(), 16);
+        uint8_t rcon = 1;
+        for (size_t i = 16; i < sizeof(roundKeys_); i += 4) {
+            uint8_t t[4];
+            memcpy(t, roundKeys_ + i - 4, 4);
+            if (i % 16 == 0) {
+                const uint8_t t0 = t[0];
+                t[0] = sbox_[t[1]] ^ rcon;
+                t[1] = sbox_[t[2]];
+                t[2] = sbox_[t[3]];
+                t[3] = sbox_[t0];
+                rcon = xtime(rcon);
+            }
+            for (size_t j = 0; j < 4; ++j) {
+                roundKeys_[i + j] = roundKeys_[i + j - 16] ^ t[j];
+            }
+        }
+    }
+
+    int encrypt(const uint8_t* in, uint8_t* out) {
+        uint8_t s[16];
+        for (size_t i = 0; i < 16; ++i) {
+            s[i] = in[i] ^ roundKeys_[i];
+        }
+        for (size_t round = 1; round <= 10; ++round) {
+            // SubBytes and ShiftRows
+            uint8_t t[16];
+            for (size_t c = 0; c < 4; ++c) {
+                for (size_t r = 0; r < 4; ++r) {
+                    t[c * 4 + r] = sbox_[s[((c + r) % 4) * 4 + r]];
+                }
+            }
+            // MixColumns
+            if (round < 10) {
+                for (size_t c = 0; c < 4; ++c) {
+                    uint8_t* p = t + c * 4;
+                    const uint8_t a = p[0] ^ p[1] ^ p[2] ^ p[3];
+                    const uint8_t p0 = p[0];
+                    p[0] ^= a ^ xtime(p[0] ^ p[1]);
+                    p[1] ^= a ^ xtime(p[1] ^ p[2]);
+                    p[2] ^= a ^ xtime(p[2] ^ p[3]);
+                    p[3] ^= a ^ xtime(p[3] ^ p0);
+                }
+            }
+            for (size_t i = 0; i < 16; ++i) {
+                s[i] = t[i] ^ roundKeys_[round * 16 + i];
+            }
+        }
+        memcpy(out, s, 16);
+        return 0;
+    }
+
+private:
+    uint8_t roundKeys_[16 * 11];
+    uint8_t sbox_[256];
+
+    static uint8_t xtime(uint8_t x) {
+        return (x << 1) ^ ((x & 0x80) ? 0x1b : 0x00);
+    }
+
+    void initSbox() {
+        // Multiplicative inverses in GF(2^8) followed by the affine transformation
+        uint8_t p = 1, q = 1;
+        do {
+            p = p ^ (p << 1) ^ ((p & 0x80) ? 0x1b : 0x00);
+            q ^= q << 1;
+            q ^= q << 2;
+            q ^= q << 4;
+            if (q & 0x80) {
+                q ^= 0x09;
+            }
+            const uint8_t x = q ^ rotl(q, 1) ^ rotl(q, 2) ^ rotl(q, 3) ^ rotl(q, 4);
+            sbox_[p] = x ^ 0x63;
+        } while (p != 1);
+        sbox_[0] = 0x63;
+    }
+
+    static uint8_t rotl(uint8_t x, unsigned n) {
+        return (x << n) | (x >> (8 - n));
+    }
+};
+
+std::string fromHex(const std::string& hex) {
+    std::string s;
+    for (size_t i = 0; i + 1 < hex.size(); i += 2) {
+        s += (char)std::stoi(hex.substr(i, 2), nullptr, 16);
+    }
+    return s;
+}
+
+struct TestVector {
+    std::string key;
+    std::string nonce;
+    std::string aad;
+    std::string plaintext;
+    std::string ciphertext;
+    std::string tag;
+};
+
+template<typename CcmT>
+std::string encrypt(CcmT& ccm, const TestVector& v, char* tag) {
+    ccm.cipher().setKey(v.key);
+    REQUIRE(ccm.start(v.nonce.data(), v.aad.data(), v.aad.size(), v.plaintext.size()) == 0);
+    std::string out(v.plaintext.size(), '\0');
+    REQUIRE(ccm.encrypt(v.plaintext.data(), &out[0], out.size()) == 0);
+    REQUIRE(ccm.finish(tag) == 0);
+    return out;
+}
+
+// Decrypts the ciphertext in fragments of the given sizes, which are repeated until all data is processed
+template<typename CcmT>
+std::string decrypt(CcmT& ccm, const TestVector& v, const std::vector<size_t>& fragments, int* verifyResult) {
+    ccm.cipher().setKey(v.key);
+    REQUIRE(ccm.start(v.nonce.data(), v.aad.data(), v.aad.size(), v.ciphertext.size()) == 0);
+    std::string out(v.ciphertext.size(), '\0');
+    size_t offs = 0;
+    for (size_t i = 0; offs < out.size(); ++i) {
+        const size_t n = std::min(fragments.at(i % fragments.size()), out.size() - offs);
+        REQUIRE(ccm.decrypt(v.ciphertext.data() + offs, &out[offs], n) == 0);
+        offs += n;
+    }
+    *verifyResult = ccm.verify(v.tag.data());
+    return out;
+}
+
+// RFC 3610, section 8: packet vectors #1 to #6 (13-byte nonce, 8-byte tag)
+const TestVector RFC3610_VECTORS[] = {
+    { fromHex("c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"), fromHex("00000003020100a0a1a2a3a4a5"), fromHex("0001020304050607"),
+            fromHex("08090a0b0c0d0e0f101112131415161718191a1b1c1d1e"),
+            fromHex("588c979a61c663d2f066d0c2c0f989806d5f6b61dac384"), fromHex("17e8d12cfdf926e0") },
+    { fromHex("c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"), fromHex("00000004030201a0a1a2a3a4a5"), fromHex("0001020304050607"),
+            fromHex("08090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"),
+            fromHex("72c91a36e135f8cf291ca894085c87e3cc15c439c9e43a3b"), fromHex("a091d56e10400916") },
+    { fromHex("c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"), fromHex("00000005040302a0a1a2a3a4a5"), fromHex("0001020304050607"),
+            fromHex("08090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f20"),
+            fromHex("51b1e5f44a197d1da46b0f8e2d282ae871e838bb64da859657"), fromHex("4adaa76fbd9fb0c5") },
+    { fromHex("c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"), fromHex("00000006050403a0a1a2a3a4a5"), fromHex("000102030405060708090a0b"),
+            fromHex("0c0d0e0f101112131415161718191a1b1c1d1e"),
+            fromHex("a28c6865939a9a79faaa5c4c2a9d4a91cdac8c"), fromHex("96c861b9c9e61ef1") },
+    { fromHex("c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"), fromHex("00000007060504a0a1a2a3a4a5"), fromHex("000102030405060708090a0b"),
+            fromHex("0c0d0e0f101112131415161718191a1b1c1d1e1f"),
+            fromHex("dcf1fb7b5d9e23fb9d4e131253658ad86ebdca3e"), fromHex("51e83f077d9c2d93") },
+    { fromHex("c0c1c2c3c4c5c6c7c8c9cacbcccdcecf"), fromHex("00000008070605a0a1a2a3a4a5"), fromHex("000102030405060708090a0b"),
+            fromHex("0c0d0e0f101112131415161718191a1b1c1d1e1f20"),
+            fromHex("6fc1b011f006568b5171a42d953d469b2570a4bd87"), fromHex("405a0443ac91cb94") }
+};
+
+// NIST SP 800-38C, appendix C: example 3 (12-byte nonce, 8-byte tag, as used by the BLE control
+// request channel, and additional data longer than one block)
+const TestVector SP800_38C_VECTOR = {
+    fromHex("404142434445464748494a4b4c4d4e4f"), fromHex("101112131415161718191a1b"),
+    fromHex("000102030405060708090a0b0c0d0e0f10111213"),
+    fromHex("202122232425262728292a2b2c2d2e2f3031323334353637"),
+    fromHex("e3b201a9f5b71a7a9b1ceaeccd97e70b6176aad9a4428aa5"), fromHex("484392fbc1b09951")
+};
+
+typedef particle::AesCcm<TestAes, 13, 8> Rfc3610Ccm;
+typedef particle::AesCcm<TestAes, 12, 8> BleCcm;
+
+} // namespace
+
+TEST_CASE("TestAes") {
+    // FIPS 197, appendix C.1
+    TestAes aes;
+    aes.setKey(fromHex("000102030405060708090a0b0c0d0e0f"));
+    const auto in = fromHex("00112233445566778899aabbccddeeff");
+    uint8_t out[16] = {};
+    aes.encrypt((const uint8_t*)in.data(), out);
+    CHECK(std::string((const char*)out, 16) == fromHex("69c4e0d86a7b0430d8cdb78070b4c55a"));
+}
+
+TEST_CASE("AesCcm") {
+    SECTION("encrypts the RFC 3610 packet vectors") {
+        for (const auto& v: RFC3610_VECTORS) {
+            Rfc3610Ccm ccm;
+            char tag[8] = {};
+            CHECK(encrypt(ccm, v, tag) == v.ciphertext);
+            CHECK(std::string(tag, sizeof(tag)) == v.tag);
+        }
+    }
+
+    SECTION("decrypts the RFC 3610 packet vectors") {
+        for (const auto& v: RFC3610_VECTORS) {
+            Rfc3610Ccm ccm;
+            int ret = -1;
+            CHECK(decrypt(ccm, v, { v.ciphertext.size() }, &ret) == v.plaintext);
+            CHECK(ret == 0);
+        }
+    }
+
+    SECTION("encrypts and decrypts the SP 800-38C vector") {
+        const auto& v = SP800_38C_VECTOR;
+        BleCcm ccm;
+        char tag[8] = {};
+        CHECK(encrypt(ccm, v, tag) == v.ciphertext);
+        CHECK(std::string(tag, sizeof(tag)) == v.tag);
+        int ret = -1;
+        CHECK(decrypt(ccm, v, { v.ciphertext.size() }, &ret) == v.plaintext);
+        CHECK(ret == 0);
+    }
+
+    SECTION("decrypts data split into fragments") {
+        const std::vector<std::vector<size_t>> splits = {
+            { 1 }, { 3 }, { 15 }, { 16 }, { 17 }, { 5, 11 }, { 16, 1, 0, 2 }
+        };
+        for (const auto& fragments: splits) {
+            for (const auto& v: RFC3610_VECTORS) {
+                Rfc3610Ccm ccm;
+                int ret = -1;
+                CHECK(decrypt(ccm, v, fragments, &ret) == v.plaintext);
+                CHECK(ret == 0);
+            }
+            BleCcm ccm;
+            int ret = -1;
+            CHECK(decrypt(ccm, SP800_38C_VECTOR, fragments, &ret) == SP800_38C_VECTOR.plaintext);
+            CHECK(ret == 0);
+        }
+    }
+
+    SECTION("rejects a message with a modified tag, ciphertext or additional data") {
+        auto v = SP800_38C_VECTOR;
+        for (size_t i = 0; i < v.tag.size(); ++i) {
+            auto m = v;
+            m.tag[i] ^= 0x01;
+            BleCcm ccm;
+            int ret = 0;
+            decrypt(ccm, m, { 7 }, &ret);
+            CHECK(ret == SYSTEM_ERROR_BAD_DATA);
+        }
+        for (size_t i = 0; i < v.ciphertext.size(); ++i) {
+            auto m = v;
+            m.ciphertext[i] ^= 0x80;
+            BleCcm ccm;
+            int ret = 0;
+            decrypt(ccm, m, { 7 }, &ret);
+            CHECK(ret == SYSTEM_ERROR_BAD_DATA);
+        }
+        auto m = v;
+        m.aad[0] ^= 0x01;
+        BleCcm ccm;
+        int ret = 0;
+        decrypt(ccm, m, { 7 }, &ret);
+        CHECK(ret == SYSTEM_ERROR_BAD_DATA);
+    }
+
+    SECTION("handles messages without data") {
+        auto v = SP800_38C_VECTOR;
+        v.plaintext.clear();
+        BleCcm enc;
+        char tag[8] = {};
+        CHECK(encrypt(enc, v, tag).empty());
+        v.ciphertext.clear();
+        v.tag = std::string(tag, sizeof(tag));
+        BleCcm dec;
+        int ret = -1;
+        decrypt(dec, v, { 1 }, &ret);
+        CHECK(ret == 0);
+    }
+
+    SECTION("rejects data that doesn't fit the length field") {
+        BleCcm ccm;
+        ccm.cipher().setKey(SP800_38C_VECTOR.key);
+        CHECK(ccm.start(SP800_38C_VECTOR.nonce.data(), nullptr, 0, 1 << 24) == SYSTEM_ERROR_TOO_LARGE);
+        CHECK(ccm.start(SP800_38C_VECTOR.nonce.data(), nullptr, 0, (1 << 24) - 1) == 0);
+    }
+}
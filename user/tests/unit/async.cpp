@@ -727,6 +727,24 @@ TEST_CASE("CompletionHandlerMap") {
         CHECK(m.nearestTimeout() == CompletionHandlerMap::MAX_TIMEOUT);
     }
 
+    SECTION("restarting handler timeout") {
+        CompletionHandlerMap m;
+        CompletionData<int> d1, d2;
+        m.addHandler(1, d1.handler(), 10); // Handler 1, timeout: 10
+        m.addHandler(2, d2.handler(), 20); // Handler 2, timeout: 20
+        CHECK(m.update(8) == 0);
+        CHECK(m.nearestTimeout() == 2);
+        CHECK(m.restartTimeout(1) == true); // Handler 1 expires in 10 again
+        CHECK(m.restartTimeout(3) == false); // No such handler
+        CHECK(m.nearestTimeout() == 10);
+        CHECK(m.update(9) == 0);
+        CHECK(m.nearestTimeout() == 1); // Handler 1 is a nearest handler to expire
+        CHECK(m.update(1) == 1); // Handler 1 has expired
+        CHECK(d1.error() == Error::TIMEOUT);
+        CHECK(d2.hasError() == false);
+        CHECK(m.size() == 1);
+    }
+
     SECTION("modifying handler map while waiting for handlers expiration") {
         CompletionHandlerMap m;
         CompletionData<int> d1, d2, d3, d4, d5, d6;
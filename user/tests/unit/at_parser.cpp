@@ -0,0 +1,235 @@
+#include "at_parser.h"
+#include "at_response.h"
+
+#include "stream.h"
+#include "system_error.h"
+
+#include "catch.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+
+using namespace particle;
+
+// Loopback stream that returns the input data in chunks of a fixed size
+class TestStream: public Stream {
+public:
+    explicit TestStream(size_t chunkSize = 16) :
+            pos_(0),
+            chunkSize_(chunkSize) {
+    }
+
+    void input(const std::string& data) {
+        in_.append(data);
+    }
+
+    void rewind() {
+        pos_ = 0;
+    }
+
+    const std::string& output() const {
+        return out_;
+    }
+
+    int read(char* data, size_t size) override {
+        const size_t n = peek(data, size);
+        pos_ += n;
+        return n;
+    }
+
+    int peek(char* data, size_t size) override {
+        const size_t n = std::min(std::min(size, chunkSize_), in_.size() - pos_);
+        memcpy(data, in_.data() + pos_, n);
+        return n;
+    }
+
+    int skip(size_t size) override {
+        const size_t n = std::min(size, in_.size() - pos_);
+        pos_ += n;
+        return n;
+    }
+
+    int availForRead() override {
+        return in_.size() - pos_;
+    }
+
+    int write(const char* data, size_t size) override {
+        out_.append(data, size);
+        return size;
+    }
+
+    int flush() override {
+        return 0;
+    }
+
+    int availForWrite() override {
+        return 1024;
+    }
+
+    int waitEvent(unsigned flags, unsigned timeout) override {
+        if ((flags & Stream::WRITABLE) || availForRead() > 0) {
+            return flags;
+        }
+        return SYSTEM_ERROR_TIMEOUT;
+    }
+
+private:
+    std::string in_, out_;
+    size_t pos_, chunkSize_;
+};
+
+// Records the URCs passed to the handlers
+struct UrcLog {
+    std::vector<std::string> urcs;
+
+    static int handler(AtResponseReader* reader, const char* prefix, void* data) {
+        const auto log = (UrcLog*)data;
+        char buf[64] = {};
+        const int n = reader->readLine(buf, sizeof(buf) - 1);
+        if (n < 0) {
+            return n;
+        }
+        log->urcs.push_back(std::string(prefix) + '|' + buf);
+        return 0;
+    }
+};
+
+AtParserConfig parserConfig(TestStream* strm) {
+    AtParserConfig conf;
+    conf.stream(strm);
+    conf.commandTerminator(AtCommandTerminator::CRLF);
+    conf.echoEnabled(false);
+    conf.logEnabled(false);
+    conf.commandTimeout(1000);
+    conf.streamTimeout(100);
+    return conf;
+}
+
+// Processes all URCs available in the stream
+void processAllUrcs(AtParser* parser) {
+    for (;;) {
+        const int r = parser->processUrc(0);
+        if (r == SYSTEM_ERROR_WOULD_BLOCK) {
+            break;
+        }
+        REQUIRE(r >= 0);
+    }
+}
+
+} // namespace
+
+TEST_CASE("AtParser URC handlers") {
+    for (size_t chunkSize: { 1, 3, 64 }) {
+        TestStream strm(chunkSize);
+        AtParser parser;
+        REQUIRE(parser.init(parserConfig(&strm)) == 0);
+        UrcLog log;
+
+        SECTION("the handler with the longest matching prefix is called") {
+            REQUIRE(parser.addUrcHandler("+C", UrcLog::handler, &log) == 0);
+            REQUIRE(parser.addUrcHandler("+CEREG", UrcLog::handler, &log) == 0);
+            REQUIRE(parser.addUrcHandler("+CGREG", UrcLog::handler, &log) == 0);
+            REQUIRE(parser.addUrcHandler("+UUSORD", UrcLog::handler, &log) == 0);
+            strm.input("+CEREG: 5\r\n+CGREG: 1\r\n+CSQ: 20,99\r\n+CE: 1\r\n+UUSORD: 0,512\r\n+UUSOCL: 0\r\nRING\r\n");
+            processAllUrcs(&parser);
+            CHECK(log.urcs == std::vector<std::string>({ "+CEREG|+CEREG: 5", "+CGREG|+CGREG: 1",
+                    "+C|+CSQ: 20,99", "+C|+CE: 1", "+UUSORD|+UUSORD: 0,512" }));
+        }
+
+        SECTION("a prefix that spans the whole line is matched") {
+            REQUIRE(parser.addUrcHandler("RING", UrcLog::handler, &log) == 0);
+            REQUIRE(parser.addUrcHandler("RINGING", UrcLog::handler, &log) == 0);
+            strm.input("RING\r\nRINGING\r\nRINGER\r\nRIN\r\n");
+            processAllUrcs(&parser);
+            CHECK(log.urcs == std::vector<std::string>({ "RING|RING", "RINGING|RINGING", "RING|RINGER" }));
+        }
+
+        SECTION("removed handlers are no longer called") {
+            REQUIRE(parser.addUrcHandler("+CEREG", UrcLog::handler, &log) == 0);
+            REQUIRE(parser.addUrcHandler("+CE", UrcLog::handler, &log) == 0);
+            REQUIRE(parser.addUrcHandler("+UUSORD", UrcLog::handler, &log) == 0);
+            parser.removeUrcHandler("+CEREG");
+            strm.input("+CEREG: 5\r\n+UUSORD: 0,512\r\n");
+            processAllUrcs(&parser);
+            CHECK(log.urcs == std::vector<std::string>({ "+CE|+CEREG: 5", "+UUSORD|+UUSORD: 0,512" }));
+            log.urcs.clear();
+            parser.removeUrcHandler("+CE");
+            parser.removeUrcHandler("+UUSORD");
+            strm.input("+CEREG: 5\r\n+UUSORD: 0,512\r\n");
+            processAllUrcs(&parser);
+            CHECK(log.urcs.empty());
+        }
+
+        SECTION("a handler can be replaced") {
+            REQUIRE(parser.addUrcHandler("+CEREG", nullptr, nullptr) == 0);
+            REQUIRE(parser.addUrcHandler("+CEREG", UrcLog::handler, &log) == 0);
+            strm.input("+CEREG: 2\r\n");
+            processAllUrcs(&parser);
+            CHECK(log.urcs == std::vector<std::string>({ "+CEREG|+CEREG: 2" }));
+        }
+
+        SECTION("URCs are handled while reading a command response") {
+            REQUIRE(parser.addUrcHandler("+UUSORD", UrcLog::handler, &log) == 0);
+            REQUIRE(parser.addUrcHandler("+CEREG", UrcLog::handler, &log) == 0);
+            strm.input("+UUSORD: 0,10\r\n+USORD: 0,4,\"abcd\"\r\n+CEREG: 1\r\nOK\r\n");
+            auto resp = parser.sendCommand("AT+USORD=0,4");
+            char buf[64] = {};
+            REQUIRE(resp.readLine(buf, sizeof(buf) - 1) >= 0);
+            CHECK(std::string(buf) == "+USORD: 0,4,\"abcd\"");
+            CHECK(resp.readResult() == AtResponse::OK);
+            CHECK(strm.output() == "AT+USORD=0,4\r\n");
+            CHECK(log.urcs == std::vector<std::string>({ "+UUSORD|+UUSORD: 0,10", "+CEREG|+CEREG: 1" }));
+        }
+    }
+}
+
+TEST_CASE("AtParser URC dispatching benchmark", "[.][benchmark]") {
+    // URC prefixes registered by a typical cellular NCP client
+    const char* const prefixes[] = { "+CREG", "+CGREG", "+CEREG", "+CIEV", "+CMTI", "+CUSD", "+UUSORD",
+            "+UUSORF", "+UUSOLI", "+UUSOCL", "+UUPSDD", "+UUPSDA", "+UUHTTPCR", "+UULOC", "+UUPING",
+            "+UMWI", "+UUSIMSTAT", "+UUFWINSTALL", "RING", "NO CARRIER" };
+    // Traffic seen by the modem during a data transfer: every socket read is announced by
+    // a URC and followed by the response of a +USORD command
+    std::string trace;
+    for (int i = 0; i < 40; ++i) {
+        trace += "+UUSORD: 0,512\r\n";
+        trace += "+UUSORF: 1,64\r\n";
+        if (i % 8 == 0) {
+            trace += "+CEREG: 5,\"2B67\",\"01A2D001\",7\r\n";
+            trace += "+CIEV: 2,4\r\n";
+        }
+        trace += "+UUSOLI: 2,\"10.0.0.1\",5684,0,\"10.0.0.2\",5684\r\n";
+    }
+    int urcCount = 0;
+    const auto handler = [](AtResponseReader* reader, const char* prefix, void* data) {
+        ++*(int*)data;
+        return 0;
+    };
+    for (size_t chunkSize: { 16, 64 }) {
+        TestStream strm(chunkSize);
+        strm.input(trace);
+        AtParser parser;
+        REQUIRE(parser.init(parserConfig(&strm)) == 0);
+        for (auto prefix: prefixes) {
+            REQUIRE(parser.addUrcHandler(prefix, handler, &urcCount) == 0);
+        }
+        const int iterations = 500;
+        urcCount = 0;
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; ++i) {
+            strm.rewind();
+            while (parser.processUrc(0) >= 0) {
+            }
+        }
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        const double ns = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+        CHECK(urcCount == 40 * 3 * iterations + 5 * 2 * iterations);
+        printf("URC dispatching (%u byte reads): %.1f ns per URC, %.1f MB/s\n", (unsigned)chunkSize,
+                ns / urcCount, trace.size() * iterations * 1000.0 / ns);
+    }
+}
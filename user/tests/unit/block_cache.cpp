@@ -0,0 +1,192 @@
+#include "block_cache.h"
+#include "flash_storage.h"
+
+#include "catch.hpp"
+
+#include <random>
+#include <vector>
+
+namespace {
+
+const size_t SECTOR_SIZE = 4096;
+const size_t SECTOR_COUNT = 4;
+const size_t PAGE_SIZE = 256;
+const size_t PAGE_COUNT = 8;
+
+class TestStore: public RAMFlashStorage<0, SECTOR_COUNT, SECTOR_SIZE> {
+public:
+    typedef RAMFlashStorage<0, SECTOR_COUNT, SECTOR_SIZE> Base;
+
+    int reads = 0;
+    size_t lastReadSize = 0;
+
+    TestStore() {
+        for (size_t i = 0; i < SECTOR_COUNT; ++i) {
+            Base::eraseSector(i * SECTOR_SIZE);
+        }
+    }
+
+    int read(unsigned offset, void* data, unsigned size) {
+        ++reads;
+        lastReadSize = size;
+        return Base::read(offset, data, size);
+    }
+};
+
+typedef particle::BlockCache<TestStore, PAGE_SIZE, PAGE_COUNT, SECTOR_SIZE> TestCache;
+
+std::vector<uint8_t> readCache(TestCache& cache, unsigned offset, size_t size) {
+    std::vector<uint8_t> v(size);
+    REQUIRE(cache.read(offset, v.data(), size) == 0);
+    return v;
+}
+
+std::vector<uint8_t> readStore(TestStore& store, unsigned offset, size_t size) {
+    std::vector<uint8_t> v(size);
+    REQUIRE(store.Base::read(offset, v.data(), size) == 0);
+    return v;
+}
+
+void fill(TestStore& store, unsigned seed) {
+    std::mt19937 gen(seed);
+    std::vector<uint8_t> data(SECTOR_SIZE * SECTOR_COUNT);
+    for (auto& b: data) {
+        b = gen();
+    }
+    REQUIRE(store.write(0, data.data(), data.size()) == 0);
+}
+
+} // namespace
+
+TEST_CASE("BlockCache") {
+    TestCache cache(3);
+    auto& store = cache.store();
+    fill(store, 1);
+
+    SECTION("returns the same data as the store") {
+        std::mt19937 gen(2);
+        for (int i = 0; i < 1000; ++i) {
+            const unsigned offs = gen() % (SECTOR_SIZE * SECTOR_COUNT);
+            const size_t size = std::min<size_t>(gen() % (PAGE_SIZE * 4) + 1, SECTOR_SIZE * SECTOR_COUNT - offs);
+            REQUIRE(readCache(cache, offs, size) == readStore(store, offs, size));
+        }
+    }
+
+    SECTION("caches recently read pages") {
+        readCache(cache, 100, 10);
+        CHECK(store.reads == 1);
+        CHECK(store.lastReadSize == PAGE_SIZE);
+        readCache(cache, 0, PAGE_SIZE);
+        readCache(cache, 200, 56);
+        CHECK(store.reads == 1);
+        const auto& s = cache.stats();
+        CHECK(s.misses == 1);
+        CHECK(s.hits == 2);
+        CHECK(s.storeReads == 1);
+    }
+
+    SECTION("reads all missing pages of a read at once") {
+        readCache(cache, PAGE_SIZE * 2, PAGE_SIZE); // Page 2 is cached
+        readCache(cache, 10, PAGE_SIZE * 5); // Pages 0-1 and 3-5 are missing
+        CHECK(store.reads == 3);
+        CHECK(cache.stats().misses == 6);
+        CHECK(cache.stats().hits == 1);
+    }
+
+    SECTION("evicts the least recently used pages") {
+        for (size_t i = 0; i < PAGE_COUNT; ++i) {
+            readCache(cache, i * PAGE_SIZE * 2, 1); // Non-sequential
+        }
+        CHECK(store.reads == PAGE_COUNT);
+        readCache(cache, 0, 1); // Page 0 is the most recently used page now
+        readCache(cache, PAGE_SIZE * 2 * PAGE_COUNT, 1); // Evicts page 2
+        CHECK(store.reads == PAGE_COUNT + 1);
+        readCache(cache, 0, 1);
+        CHECK(store.reads == PAGE_COUNT + 1);
+        readCache(cache, PAGE_SIZE * 2, 1);
+        CHECK(store.reads == PAGE_COUNT + 2);
+    }
+
+    SECTION("reads ahead when reading sequentially") {
+        readCache(cache, 0, PAGE_SIZE);
+        CHECK(store.lastReadSize == PAGE_SIZE); // The first read is not known to be sequential
+        readCache(cache, PAGE_SIZE, PAGE_SIZE);
+        CHECK(store.lastReadSize == PAGE_SIZE * 4);
+        for (size_t i = 2; i < 6; ++i) {
+            REQUIRE(readCache(cache, i * PAGE_SIZE, PAGE_SIZE) == readStore(store, i * PAGE_SIZE, PAGE_SIZE));
+        }
+        CHECK(store.reads == 3);
+        const auto& s = cache.stats();
+        CHECK(s.misses == 3);
+        CHECK(s.readAhead == 6);
+        CHECK(s.readAheadHits == 3);
+        CHECK(s.hits == 3);
+    }
+
+    SECTION("doesn't read ahead past the end of the sector") {
+        readCache(cache, SECTOR_SIZE - PAGE_SIZE * 3, PAGE_SIZE);
+        readCache(cache, SECTOR_SIZE - PAGE_SIZE * 2, PAGE_SIZE);
+        CHECK(store.lastReadSize == PAGE_SIZE * 2);
+        CHECK(cache.stats().readAhead == 1);
+    }
+
+    SECTION("doesn't cache reads larger than the cache") {
+        REQUIRE(readCache(cache, 0, PAGE_SIZE * PAGE_COUNT) == readStore(store, 0, PAGE_SIZE * PAGE_COUNT));
+        readCache(cache, 0, 1);
+        CHECK(store.reads == 2);
+        CHECK(cache.stats().bypassed == 1);
+    }
+
+    SECTION("drops pages affected by a write") {
+        readCache(cache, 0, 1);
+        readCache(cache, PAGE_SIZE * 2, 1);
+        REQUIRE(cache.eraseSector(0) == 0);
+        const uint8_t d[] = { 0x01, 0x02, 0x03 };
+        REQUIRE(cache.write(PAGE_SIZE - 1, d, sizeof(d)) == 0);
+        CHECK(readCache(cache, PAGE_SIZE - 1, sizeof(d)) == std::vector<uint8_t>(d, d + sizeof(d)));
+        CHECK(readCache(cache, PAGE_SIZE * 2, 1) == std::vector<uint8_t>(1, 0xff));
+    }
+
+    SECTION("drops pages of an erased sector") {
+        readCache(cache, SECTOR_SIZE - 1, 2);
+        REQUIRE(cache.eraseSector(SECTOR_SIZE + 100) == 0);
+        const int reads = store.reads;
+        CHECK(readCache(cache, SECTOR_SIZE - 1, 2) == readStore(store, SECTOR_SIZE - 1, 2));
+        CHECK(store.reads == reads + 1);
+        CHECK(readCache(cache, SECTOR_SIZE, 1) == std::vector<uint8_t>(1, 0xff));
+    }
+
+    SECTION("doesn't cache pages that couldn't be read") {
+        uint8_t b = 0;
+        CHECK(cache.read(SECTOR_SIZE * SECTOR_COUNT, &b, 1) != 0);
+        CHECK(cache.read(SECTOR_SIZE * SECTOR_COUNT, &b, 1) != 0);
+        CHECK(store.reads == 2);
+    }
+
+    SECTION("stays consistent with the store under random operations") {
+        std::mt19937 gen(3);
+        std::vector<uint8_t> buf(PAGE_SIZE * 3);
+        for (int i = 0; i < 5000; ++i) {
+            const unsigned offs = gen() % (SECTOR_SIZE * SECTOR_COUNT - buf.size() - PAGE_SIZE);
+            const size_t size = gen() % buf.size() + 1;
+            const unsigned op = gen() % 8;
+            if (op == 0) {
+                REQUIRE(cache.eraseSector(offs) == 0);
+            } else if (op < 3) {
+                for (auto& b: buf) {
+                    b = gen();
+                }
+                REQUIRE(cache.write(offs, buf.data(), size) == 0);
+            } else {
+                REQUIRE(readCache(cache, offs, size) == readStore(store, offs, size));
+                if (op == 7) {
+                    // Continue reading sequentially
+                    REQUIRE(readCache(cache, offs + size, PAGE_SIZE) == readStore(store, offs + size, PAGE_SIZE));
+                }
+            }
+        }
+        const auto& s = cache.stats();
+        CHECK(s.hits > 0);
+        CHECK(s.readAheadHits > 0);
+    }
+}
@@ -0,0 +1,137 @@
+#include "crc32_util.h"
+
+#include "catch.hpp"
+
+#include <boost/crc.hpp>
+
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <cstdio>
+
+namespace {
+
+// Byte-at-a-time implementation that was used by the platforms before
+uint32_t crc32Bytewise(uint32_t crc, const uint8_t* data, size_t size) {
+    static uint32_t table[256] = {};
+    if (!table[1]) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int j = 0; j < 8; ++j) {
+                c = (c & 1) ? (c >> 1) ^ 0xedb88320 : (c >> 1);
+            }
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    while (size--) {
+        crc = table[(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Nibble-at-a-time implementation that was used by littlefs (operates on the raw CRC state)
+uint32_t crc32Nibble(uint32_t state, const uint8_t* data, size_t size) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+        0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+    for (size_t i = 0; i < size; ++i) {
+        state = (state >> 4) ^ table[(state ^ (data[i] >> 0)) & 0xf];
+        state = (state >> 4) ^ table[(state ^ (data[i] >> 4)) & 0xf];
+    }
+    return state;
+}
+
+uint32_t crc32Boost(const uint8_t* data, size_t size) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data, size);
+    return crc.checksum();
+}
+
+std::vector<uint8_t> randomData(size_t size, std::mt19937& gen) {
+    std::uniform_int_distribution<int> dist(0, 255);
+    std::vector<uint8_t> data(size);
+    for (auto& b: data) {
+        b = dist(gen);
+    }
+    return data;
+}
+
+} // namespace
+
+TEST_CASE("crc32_update()") {
+    SECTION("returns the initial value for empty data") {
+        CHECK(crc32_update(0, nullptr, 0) == 0);
+        CHECK(crc32_update(0x12345678, nullptr, 0) == 0x12345678);
+        CHECK(crc32_update_state(0xffffffff, nullptr, 0) == 0xffffffff);
+    }
+
+    SECTION("computes the standard CRC-32 check value") {
+        const char str[] = "123456789";
+        CHECK(crc32_update(0, str, sizeof(str) - 1) == 0xcbf43926);
+        CHECK(~crc32_update_state(0xffffffff, str, sizeof(str) - 1) == 0xcbf43926);
+    }
+
+    SECTION("matches the reference implementations for all sizes and alignments") {
+        std::mt19937 gen(1);
+        const auto data = randomData(256 + 8, gen);
+        for (size_t offs = 0; offs < 8; ++offs) {
+            for (size_t size = 0; size <= 256; ++size) {
+                const uint8_t* p = data.data() + offs;
+                const uint32_t expected = crc32Boost(p, size);
+                REQUIRE(crc32_update(0, p, size) == expected);
+                REQUIRE(crc32Bytewise(0, p, size) == expected);
+                REQUIRE(crc32_update_state(0xffffffff, p, size) == crc32Nibble(0xffffffff, p, size));
+            }
+        }
+    }
+
+    SECTION("can be computed incrementally") {
+        std::mt19937 gen(2);
+        std::uniform_int_distribution<size_t> sizeDist(0, 4096);
+        for (int i = 0; i < 100; ++i) {
+            const auto data = randomData(sizeDist(gen), gen);
+            const uint32_t expected = crc32Boost(data.data(), data.size());
+            uint32_t crc = 0;
+            uint32_t state = 0xffffffff;
+            size_t offs = 0;
+            while (offs < data.size()) {
+                const size_t n = std::min(std::uniform_int_distribution<size_t>(1, 67)(gen), data.size() - offs);
+                crc = crc32_update(crc, data.data() + offs, n);
+                state = crc32_update_state(state, data.data() + offs, n);
+                offs += n;
+            }
+            REQUIRE(crc == expected);
+            REQUIRE(~state == expected);
+        }
+    }
+}
+
+TEST_CASE("CRC-32 benchmark", "[.][benchmark]") {
+    std::mt19937 gen(3);
+    const auto data = randomData(1024 * 1024, gen);
+    const unsigned iterations = 20;
+    const auto run = [&](const char* name, std::function<uint32_t(const uint8_t*, size_t)> fn) {
+        uint32_t crc = 0;
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < iterations; ++i) {
+            crc += fn(data.data(), data.size());
+        }
+        const auto d = std::chrono::steady_clock::now() - start;
+        const double mbps = (double)data.size() * iterations / (1024 * 1024) /
+                std::chrono::duration<double>(d).count();
+        printf("%s: %.1f MB/s (%08x)\n", name, mbps, (unsigned)crc);
+    };
+    run("nibble-at-a-time", [](const uint8_t* p, size_t size) {
+        return crc32Nibble(0xffffffff, p, size);
+    });
+    run("byte-at-a-time", [](const uint8_t* p, size_t size) {
+        return crc32Bytewise(0, p, size);
+    });
+    run("crc32_update()", [](const uint8_t* p, size_t size) {
+        return crc32_update(0, p, size);
+    });
+}
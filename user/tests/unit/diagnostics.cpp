@@ -1,9 +1,12 @@
 #include "spark_wiring_diagnostics.h"
+#include "system_diag_format.h"
 
 #include "tools/catch.h"
 
 #include <functional>
 #include <unordered_set>
+#include <thread>
+#include <vector>
 #include <cassert>
 
 namespace {
@@ -196,6 +199,45 @@ private:
     ValueT val_, storedVal_;
 };
 
+// Clock that is advanced manually
+struct TestClock {
+    static system_tick_t time;
+
+    static system_tick_t now() {
+        return time;
+    }
+};
+
+system_tick_t TestClock::time = 0;
+
+// Appender writing to a byte vector
+bool appendToVector(void* data, const uint8_t* buf, size_t size) {
+    const auto v = static_cast<std::vector<uint8_t>*>(data);
+    v->insert(v->end(), buf, buf + size);
+    return true;
+}
+
+typedef std::vector<uint8_t> Bytes;
+
+Bytes operator+(Bytes a, const Bytes& b) {
+    a.insert(a.end(), b.begin(), b.end());
+    return a;
+}
+
+Bytes varint(uint32_t val) {
+    Bytes b;
+    AppendData data(appendToVector, &b);
+    REQUIRE(data.write_varint(val));
+    return b;
+}
+
+Bytes zigzag(int32_t val) {
+    Bytes b;
+    AppendData data(appendToVector, &b);
+    REQUIRE(data.write_zigzag(val));
+    return b;
+}
+
 template<template<typename ConcurrencyT> class DiagnosticDataT, typename ConcurrencyT>
 void testIntegerDiagnosticData(DiagService& diag) {
     using IntType = AbstractIntegerDiagnosticData::IntType;
@@ -624,4 +666,230 @@ TEST_CASE("Wiring API") {
         testPersistentEnumDiagnosticData<PersistentEnumDiagnosticData, NoConcurrency>(diag);
         // testPersistentEnumDiagnosticData<PersistentEnumDiagnosticData, AtomicConcurrency>(diag);
     }
+
+    SECTION("HistogramDiagnosticData") {
+        HistogramDiagnosticData d(1);
+        diag.start();
+
+        SECTION("bucketIndex() and bucketLowerBound() are consistent") {
+            CHECK(AbstractHistogramDiagnosticData::bucketIndex(0) == 0);
+            CHECK(AbstractHistogramDiagnosticData::bucketIndex(1) == 1);
+            CHECK(AbstractHistogramDiagnosticData::bucketIndex(2) == 2);
+            CHECK(AbstractHistogramDiagnosticData::bucketIndex(3) == 3);
+            CHECK(AbstractHistogramDiagnosticData::bucketIndex(4) == 4);
+            CHECK(AbstractHistogramDiagnosticData::bucketIndex(5) == 4);
+            CHECK(AbstractHistogramDiagnosticData::bucketIndex(6) == 5);
+            CHECK(AbstractHistogramDiagnosticData::bucketIndex(UINT32_MAX) == DIAG_HISTOGRAM_BUCKET_COUNT - 1);
+            for (unsigned i = 0; i < DIAG_HISTOGRAM_BUCKET_COUNT; ++i) {
+                const uint32_t low = AbstractHistogramDiagnosticData::bucketLowerBound(i);
+                CHECK(AbstractHistogramDiagnosticData::bucketIndex(low) == i);
+                if (i > 0) {
+                    CHECK(AbstractHistogramDiagnosticData::bucketIndex(low - 1) == i - 1);
+                }
+            }
+        }
+
+        SECTION("add()") {
+            diag_histogram_data h = {};
+            CHECK(AbstractHistogramDiagnosticData::get(1, h) == 0);
+            CHECK(h.count == 0);
+            CHECK(h.min == 0);
+            CHECK(h.max == 0);
+            for (uint32_t v: { 10, 1, 100, 7 }) {
+                d.add(v);
+            }
+            CHECK(AbstractHistogramDiagnosticData::get(1, h) == 0);
+            CHECK(h.count == 4);
+            CHECK(h.sum == 118);
+            CHECK(h.min == 1);
+            CHECK(h.max == 100);
+            CHECK(h.buckets[1] == 1);
+            CHECK(h.buckets[AbstractHistogramDiagnosticData::bucketIndex(7)] == 1);
+            CHECK(h.buckets[AbstractHistogramDiagnosticData::bucketIndex(10)] == 1);
+            CHECK(h.buckets[AbstractHistogramDiagnosticData::bucketIndex(100)] == 1);
+            d.reset();
+            CHECK(AbstractHistogramDiagnosticData::get(1, h) == 0);
+            CHECK(h.count == 0);
+            CHECK(h.buckets[1] == 0);
+        }
+
+        SECTION("percentile()") {
+            for (uint32_t v = 1; v <= 1000; ++v) {
+                d.add(v);
+            }
+            diag_histogram_data h = {};
+            CHECK(AbstractHistogramDiagnosticData::get(1, h) == 0);
+            CHECK(AbstractHistogramDiagnosticData::percentile(h, 0) == 1);
+            CHECK(AbstractHistogramDiagnosticData::percentile(h, 100) == 1000);
+            // The error is bounded by the width of the bucket, which is at most a half of its lower bound
+            const uint32_t p50 = AbstractHistogramDiagnosticData::percentile(h, 50);
+            CHECK(p50 >= 500 * 2 / 3);
+            CHECK(p50 <= 500 * 3 / 2);
+            const uint32_t p99 = AbstractHistogramDiagnosticData::percentile(h, 99);
+            CHECK(p99 >= 990 * 2 / 3);
+            CHECK(p99 <= 1000);
+        }
+
+        SECTION("samples can be added concurrently") {
+            const unsigned THREADS = 4;
+            const unsigned SAMPLES = 10000;
+            std::vector<std::thread> threads;
+            for (unsigned i = 0; i < THREADS; ++i) {
+                threads.emplace_back([&d, i]() {
+                    for (unsigned j = 0; j < SAMPLES; ++j) {
+                        d.add(i * SAMPLES + j);
+                    }
+                });
+            }
+            for (auto& t: threads) {
+                t.join();
+            }
+            diag_histogram_data h = {};
+            CHECK(AbstractHistogramDiagnosticData::get(1, h) == 0);
+            CHECK(h.count == THREADS * SAMPLES);
+            CHECK(h.min == 0);
+            CHECK(h.max == THREADS * SAMPLES - 1);
+            uint32_t total = 0;
+            for (auto n: h.buckets) {
+                total += n;
+            }
+            CHECK(total == THREADS * SAMPLES);
+        }
+    }
+
+    SECTION("TimeSeriesDiagnosticData") {
+        TestClock::time = 10000;
+        TimeSeriesDiagnosticData<4, TestClock> d(1, 1000 /* window */);
+        diag.start();
+
+        SECTION("values are accumulated per window") {
+            diag_time_series_data ts = {};
+            CHECK(AbstractTimeSeriesDiagnosticData::get(1, ts) == 0);
+            CHECK(ts.window == 1000);
+            CHECK(ts.count == 4);
+            CHECK(std::vector<int32_t>(ts.values, ts.values + 4) == std::vector<int32_t>({ 0, 0, 0, 0 }));
+            d += 1;
+            d += 2;
+            TestClock::time += 1000;
+            d += 5;
+            TestClock::time += 2000;
+            d.add(-1);
+            CHECK(AbstractTimeSeriesDiagnosticData::get(1, ts) == 0);
+            CHECK(std::vector<int32_t>(ts.values, ts.values + 4) == std::vector<int32_t>({ 3, 5, 0, -1 }));
+            TestClock::time += 1000;
+            CHECK(AbstractTimeSeriesDiagnosticData::get(1, ts) == 0);
+            CHECK(std::vector<int32_t>(ts.values, ts.values + 4) == std::vector<int32_t>({ 5, 0, -1, 0 }));
+        }
+
+        SECTION("old windows are discarded after a long pause") {
+            d += 10;
+            TestClock::time += 10000;
+            d += 1;
+            diag_time_series_data ts = {};
+            CHECK(AbstractTimeSeriesDiagnosticData::get(1, ts) == 0);
+            CHECK(std::vector<int32_t>(ts.values, ts.values + 4) == std::vector<int32_t>({ 0, 0, 0, 1 }));
+        }
+
+        SECTION("accepts NULL as the data argument") {
+            size_t size = 0;
+            CHECK(AbstractDiagnosticData::get(1, nullptr /* data */, size) == 0);
+            CHECK(size == sizeof(diag_time_series_data));
+        }
+    }
+}
+
+TEST_CASE("Binary formats") {
+    Bytes buf;
+    AppendData data(appendToVector, &buf);
+
+    SECTION("AppendData::write_varint()") {
+        CHECK(varint(0) == Bytes({ 0x00 }));
+        CHECK(varint(1) == Bytes({ 0x01 }));
+        CHECK(varint(127) == Bytes({ 0x7f }));
+        CHECK(varint(128) == Bytes({ 0x80, 0x01 }));
+        CHECK(varint(300) == Bytes({ 0xac, 0x02 }));
+        CHECK(varint(16384) == Bytes({ 0x80, 0x80, 0x01 }));
+        CHECK(varint(UINT32_MAX) == Bytes({ 0xff, 0xff, 0xff, 0xff, 0x0f }));
+    }
+
+    SECTION("AppendData::write_zigzag()") {
+        CHECK(zigzag(0) == Bytes({ 0x00 }));
+        CHECK(zigzag(-1) == Bytes({ 0x01 }));
+        CHECK(zigzag(1) == Bytes({ 0x02 }));
+        CHECK(zigzag(-2) == Bytes({ 0x03 }));
+        CHECK(zigzag(-64) == Bytes({ 0x7f }));
+        CHECK(zigzag(64) == Bytes({ 0x80, 0x01 }));
+        CHECK(zigzag(INT32_MAX) == Bytes({ 0xfe, 0xff, 0xff, 0xff, 0x0f }));
+        CHECK(zigzag(INT32_MIN) == Bytes({ 0xff, 0xff, 0xff, 0xff, 0x0f }));
+    }
+
+    SECTION("CompactDiagnosticsFormatter") {
+        DiagService diag;
+        auto d1 = DiagSource(1).type(DIAG_TYPE_INT).get([](GetData d) {
+            return d.setInt(-3);
+        }).add();
+        auto d2 = DiagSource(5).type(DIAG_TYPE_INT).get([](GetData) {
+            return SYSTEM_ERROR_UNKNOWN;
+        }).add();
+        TestClock::time = 10000;
+        TimeSeriesDiagnosticData<4, TestClock> d3(3, 1000 /* window */);
+        HistogramDiagnosticData d4(10);
+        diag.start();
+
+        SECTION("encodes the data sources") {
+            d3 += 5;
+            TestClock::time += 1000;
+            d3 += -2;
+            d4.add(1);
+            d4.add(1);
+            d4.add(100);
+            const unsigned b1 = AbstractHistogramDiagnosticData::bucketIndex(1);
+            const unsigned b2 = AbstractHistogramDiagnosticData::bucketIndex(100);
+            REQUIRE(b1 < b2);
+            const uint16_t ids[] = { 1, 5, 3, 10 };
+            CompactDiagnosticsFormatter fmt(data);
+            REQUIRE(fmt.format(ids, 4, 0) == 0);
+            const Bytes expected = Bytes({ 0x00, 0x00, 0x01, 0x00 }) + // Header
+                    // ID delta 1 (zigzag 2), integer
+                    Bytes({ 2 << 2 | 0 }) + zigzag(-3) +
+                    // ID delta 4 (zigzag 8), error
+                    Bytes({ 8 << 2 | 1 }) + zigzag(SYSTEM_ERROR_UNKNOWN) +
+                    // ID delta -2 (zigzag 3), time series: window, count and the value deltas
+                    Bytes({ 3 << 2 | 3 }) + varint(1000) + varint(4) + zigzag(0) + zigzag(0) + zigzag(5) + zigzag(-7) +
+                    // ID delta 7 (zigzag 14), histogram: count, min, max - min, sum and the buckets
+                    Bytes({ 14 << 2 | 2 }) + varint(3) + varint(1) + varint(99) + varint(102) + varint(2) +
+                    varint(b1) + varint(2) + varint(b2 - b1) + varint(1);
+            CHECK(buf == expected);
+        }
+
+        SECTION("encodes an empty histogram") {
+            const uint16_t ids[] = { 10 };
+            CompactDiagnosticsFormatter fmt(data);
+            REQUIRE(fmt.format(ids, 1, 0) == 0);
+            CHECK(buf == Bytes({ 0x00, 0x00, 0x01, 0x00, 20 << 2 | 2, 0, 0, 0, 0, 0 }));
+        }
+
+        SECTION("fails if the appender is full") {
+            AppendData full([](void*, const uint8_t*, size_t) {
+                return false;
+            }, nullptr);
+            CompactDiagnosticsFormatter fullFmt(full);
+            CHECK(fullFmt.format(nullptr, 0, 0) == SYSTEM_ERROR_TOO_LARGE);
+        }
+    }
+
+    SECTION("BinaryDiagnosticsFormatter skips the aggregate data sources") {
+        DiagService diag;
+        auto d1 = DiagSource(1).type(DIAG_TYPE_INT).get([](GetData d) {
+            return d.setInt(1234);
+        }).add();
+        HistogramDiagnosticData d2(2);
+        diag.start();
+        d2.add(1);
+        const uint16_t ids[] = { 1, 2 };
+        BinaryDiagnosticsFormatter fmt(data);
+        REQUIRE(fmt.format(ids, 2, 0) == 0);
+        const int32_t val = 1234;
+        CHECK(buf == Bytes({ 0x02, 0x00, 0x04, 0x00, 0x01, 0x00 }) + Bytes((const uint8_t*)&val, (const uint8_t*)&val + 4));
+    }
 }
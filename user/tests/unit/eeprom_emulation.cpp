@@ -2,6 +2,7 @@
 
 #include "catch.hpp"
 #include <string>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include "eeprom_emulation.h"
@@ -19,6 +20,7 @@ const size_t PageSize2 = TestPageSize / 4;
 
 using TestStore = RAMFlashStorage<TestBase, TestPageCount, TestPageSize>;
 using TestEEPROM = EEPROMEmulation<TestStore, PageBase1, PageSize1, PageBase2, PageSize2>;
+using ShadowEEPROM = EEPROMEmulation<TestStore, PageBase1, PageSize1, PageBase2, PageSize2, true>;
 using Record = TestEEPROM::Record;
 
 // Alias some constants, otherwise the linker is having issues when
@@ -1338,3 +1340,134 @@ TEST_CASE("Page swap with data in multiple batches", "[eeprom]")
         REQUIRE(dataRead == data);
     }
 }
+
+TEST_CASE("Multi-byte put is atomic at any interruption point", "[eeprom]")
+{
+    // More records than fit in a single write batch
+    uint8_t values[40];
+    for(size_t i = 0; i < sizeof(values); i++)
+    {
+        values[i] = i;
+    }
+
+    // Interrupt the write at each record boundary and after the data
+    // and status of a record were written
+    for(int writeCount = 0; writeCount <= (int)(sizeof(values) * sizeof(Record)); writeCount += 2)
+    {
+        TestEEPROM eeprom;
+        eeprom.init();
+
+        eeprom.store.discardWritesAfter(writeCount, [&] {
+            eeprom.put(10, values, sizeof(values));
+        });
+
+        uint8_t readValues[sizeof(values)];
+        eeprom.get(10, readValues, sizeof(readValues));
+
+        CAPTURE(writeCount);
+        if(writeCount < (int)(sizeof(values) * sizeof(Record)))
+        {
+            REQUIRE(std::count(readValues, readValues + sizeof(readValues), 0xFF) == sizeof(readValues));
+        }
+        else
+        {
+            REQUIRE(std::memcmp(readValues, values, sizeof(values)) == 0);
+        }
+    }
+}
+
+template <typename EEPROM>
+std::vector<uint8_t> readAll(EEPROM &eeprom)
+{
+    std::vector<uint8_t> data(eeprom.capacity());
+    eeprom.get(0, data.data(), data.size());
+    return data;
+}
+
+// Reads the contents of the flash without using a RAM shadow
+std::vector<uint8_t> readAllFromFlash(const TestStore &store)
+{
+    TestEEPROM eeprom;
+    eeprom.store = store;
+    eeprom.init();
+    return readAll(eeprom);
+}
+
+TEST_CASE("RAM shadow", "[eeprom]")
+{
+    ShadowEEPROM eeprom;
+    eeprom.init();
+
+    SECTION("Reads match the flash contents across page swaps")
+    {
+        uint32_t seed = 1;
+        auto random = [&seed]() {
+            seed = seed * 1103515245 + 12345;
+            return (seed >> 16) & 0x7FFF;
+        };
+
+        for(int i = 0; i < 3000; i++)
+        {
+            uint8_t values[8];
+            uint16_t length = random() % sizeof(values) + 1;
+            uint16_t index = random() % (eeprom.capacity() - length);
+            for(auto &v: values)
+            {
+                v = random() % 4; // Make sure some values don't change
+            }
+            eeprom.put(index, values, length);
+        }
+
+        REQUIRE(readAll(eeprom) == readAllFromFlash(eeprom.store));
+    }
+
+    SECTION("The shadow is built from the flash contents")
+    {
+        TestEEPROM flashEEPROM;
+        flashEEPROM.init();
+        uint8_t values[] = { 1, 2, 3 };
+        flashEEPROM.put(10, values, sizeof(values));
+        flashEEPROM.put(100, 0xAA);
+
+        eeprom.store = flashEEPROM.store;
+        eeprom.init();
+
+        uint8_t readValues[3];
+        eeprom.get(10, readValues, sizeof(readValues));
+        REQUIRE(std::memcmp(readValues, values, sizeof(values)) == 0);
+        uint8_t value;
+        eeprom.get(100, value);
+        REQUIRE(value == 0xAA);
+        REQUIRE(readAll(eeprom) == readAllFromFlash(eeprom.store));
+    }
+
+    SECTION("The shadow is consistent with the flash after an interrupted write")
+    {
+        uint8_t values[] = { 1, 2, 3 };
+        eeprom.put(10, values, sizeof(values));
+
+        uint8_t newValues[] = { 4, 5, 6 };
+        eeprom.store.discardWritesAfter(6, [&] {
+            eeprom.put(10, newValues, sizeof(newValues));
+        });
+
+        REQUIRE(readAll(eeprom) == readAllFromFlash(eeprom.store));
+
+        eeprom.put(10, newValues, sizeof(newValues));
+
+        uint8_t readValues[3];
+        eeprom.get(10, readValues, sizeof(readValues));
+        REQUIRE(std::memcmp(readValues, newValues, sizeof(newValues)) == 0);
+        REQUIRE(readAll(eeprom) == readAllFromFlash(eeprom.store));
+    }
+
+    SECTION("Clear resets the shadow")
+    {
+        eeprom.put(10, 0x55);
+        eeprom.clear();
+
+        uint8_t value;
+        eeprom.get(10, value);
+        REQUIRE(value == 0xFF);
+    }
+}
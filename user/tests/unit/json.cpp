@@ -7,8 +7,12 @@
 #include <boost/variant.hpp>
 
 #include <deque>
+#include <chrono>
+#include <functional>
 #include <string>
+#include <vector>
 #include <cstdlib>
+#include <cstdio>
 
 namespace {
 
@@ -361,6 +365,235 @@ TEST_CASE("Parsing JSON") {
     }
 }
 
+TEST_CASE("Parsing JSON with a token buffer") {
+    SECTION("tokens fit in the buffer") {
+        std::string json = "{\"a\":[1,2],\"b\":\"c\"}";
+        jsmntok_t tokens[8] = {};
+        const JSONValue v = JSONValue::parse(&json[0], json.size(), tokens, 8);
+        check(v).beginObject()
+                .name("a").beginArray().number(1).number(2).endArray()
+                .name("b").string("c")
+                .endObject();
+        CHECK(tokens[0].type == JSMN_OBJECT);
+        CHECK(tokens[0].size == 2);
+    }
+    SECTION("more tokens than the buffer can hold") {
+        std::string json = "[1,2,3,4,5,6,7,8,9,10]";
+        jsmntok_t tokens[2] = {};
+        Checker c = check(JSONValue::parse(&json[0], json.size(), tokens, 2));
+        c.beginArray();
+        for (int i = 1; i <= 10; ++i) {
+            c.number(i);
+        }
+        c.endArray();
+    }
+    SECTION("no buffer") {
+        std::string json = "{\"1\":{\"2\":{\"3\":{\"4\":{\"5\":{}}}}}}";
+        Checker c = check(JSONValue::parse(&json[0], json.size(), nullptr, 0));
+        c.beginObject();
+        for (int i = 1; i <= 5; ++i) {
+            c.name(std::to_string(i)).beginObject();
+        }
+        for (int i = 1; i <= 5; ++i) {
+            c.endObject();
+        }
+        c.endObject();
+    }
+    SECTION("primitive value followed by whitespace") {
+        std::string json = "123 ";
+        jsmntok_t tokens[1] = {};
+        check(JSONValue::parse(&json[0], json.size(), tokens, 1)).number(123);
+        CHECK(json[3] == '\0'); // Parsed in place
+    }
+    SECTION("parsing errors") {
+        std::string json = "[1,2,3";
+        jsmntok_t tokens[2] = {};
+        check(JSONValue::parse(&json[0], json.size(), tokens, 2)).invalid();
+    }
+}
+
+TEST_CASE("Reading JSON") {
+    // Reads all tokens and returns them as a string, e.g. "{ name:a value:1 }"
+    const auto readAll = [](JSONReader &r) {
+        std::string s;
+        while (r.next()) {
+            if (!s.empty()) {
+                s += ' ';
+            }
+            switch (r.token()) {
+            case JSON_TOKEN_BEGIN_OBJECT:
+                s += '{';
+                break;
+            case JSON_TOKEN_END_OBJECT:
+                s += '}';
+                break;
+            case JSON_TOKEN_BEGIN_ARRAY:
+                s += '[';
+                break;
+            case JSON_TOKEN_END_ARRAY:
+                s += ']';
+                break;
+            case JSON_TOKEN_NAME:
+                s += "name:" + std::string(r.data(), r.size());
+                break;
+            case JSON_TOKEN_VALUE:
+                s += "value:" + std::string(r.data(), r.size());
+                break;
+            default:
+                s += '?';
+                break;
+            }
+        }
+        return s;
+    };
+
+    const auto read = [&readAll](const std::string &json, size_t bufSize = 64) {
+        std::vector<char> buf(bufSize);
+        JSONBufferReader r(json.data(), json.size(), buf.data(), buf.size());
+        std::string s = readAll(r);
+        return r.hasError() ? std::string("error") : s;
+    };
+
+    SECTION("tokens") {
+        CHECK(read("{}") == "{ }");
+        CHECK(read("[]") == "[ ]");
+        CHECK(read(" { \"a\" : 1 , \"b\" : [ true , false , null ] , \"c\" : { } } ") ==
+                "{ name:a value:1 name:b [ value:true value:false value:null ] name:c { } }");
+        CHECK(read("[[1,2],[],{\"x\":\"y\"}]") == "[ [ value:1 value:2 ] [ ] { name:x value:y } ]");
+        CHECK(read("\"abc\"") == "value:abc");
+        CHECK(read("-12.5e+3") == "value:-12.5e+3");
+        CHECK(read("") == "error"); // Empty document
+    }
+
+    SECTION("value types") {
+        const std::string json = "[null,true,false,0,-1,3.25,\"123\",\"\"]";
+        char buf[16];
+        JSONBufferReader r(json.data(), json.size(), buf, sizeof(buf));
+        REQUIRE(r.next());
+        CHECK(r.token() == JSON_TOKEN_BEGIN_ARRAY);
+        CHECK(r.type() == JSON_TYPE_ARRAY);
+        CHECK(r.depth() == 0);
+        REQUIRE(r.next());
+        CHECK(r.isNull());
+        CHECK(r.depth() == 1);
+        REQUIRE(r.next());
+        CHECK(r.isBool());
+        CHECK(r.toBool() == true);
+        CHECK(r.toInt() == 1);
+        REQUIRE(r.next());
+        CHECK(r.isBool());
+        CHECK(r.toBool() == false);
+        REQUIRE(r.next());
+        CHECK(r.isNumber());
+        CHECK(r.toInt() == 0);
+        CHECK(r.toBool() == false);
+        REQUIRE(r.next());
+        CHECK(r.toInt() == -1);
+        REQUIRE(r.next());
+        CHECK(r.isNumber());
+        CHECK(r.toDouble() == 3.25);
+        REQUIRE(r.next());
+        CHECK(r.isString());
+        CHECK(r.toInt() == 123);
+        REQUIRE(r.next());
+        CHECK(r.isString());
+        CHECK(r.size() == 0);
+        CHECK(r.toBool() == false);
+        REQUIRE(r.next());
+        CHECK(r.token() == JSON_TOKEN_END_ARRAY);
+        CHECK(r.depth() == 0);
+        CHECK_FALSE(r.next());
+        CHECK_FALSE(r.hasError());
+    }
+
+    SECTION("escaped characters") {
+        CHECK(read("\"\\\"\\\\\\/\\b\\f\\n\\r\\t\"") == "value:\"\\/\b\f\n\r\t");
+        CHECK(read("\"\\u0041\\u00e9\\u20ac\"") == "value:A\xc3\xa9\xe2\x82\xac");
+        CHECK(read("\"\\ud83d\\ude00\"") == "value:\xf0\x9f\x98\x80"); // Surrogate pair
+        CHECK(read("\"\\ud83d\"") == "error"); // Missing low surrogate
+        CHECK(read("\"\\ude00\"") == "error");
+        CHECK(read("\"\\x\"") == "error");
+        CHECK(read("\"\\u12\"") == "error");
+        CHECK(read("\"a\nb\"") == "error"); // Unescaped control character
+    }
+
+    SECTION("values that don't fit the buffer are truncated") {
+        const std::string json = "{\"name\":\"abcdefghij\",\"n\":1234567890}";
+        char buf[5];
+        JSONBufferReader r(json.data(), json.size(), buf, sizeof(buf));
+        REQUIRE(r.next()); // {
+        REQUIRE(r.next());
+        CHECK(std::string(r.data()) == "name");
+        CHECK_FALSE(r.isTruncated());
+        REQUIRE(r.next());
+        CHECK(std::string(r.data()) == "abcd");
+        CHECK(r.isTruncated());
+        REQUIRE(r.next());
+        CHECK(std::string(r.data()) == "n");
+        CHECK_FALSE(r.isTruncated());
+        REQUIRE(r.next());
+        CHECK(std::string(r.data()) == "1234");
+        CHECK(r.isTruncated());
+        REQUIRE(r.next()); // }
+        CHECK_FALSE(r.next());
+        CHECK_FALSE(r.hasError());
+    }
+
+    SECTION("malformed input") {
+        CHECK(read("{") == "error");
+        CHECK(read("[1,]") == "error");
+        CHECK(read("[1 2]") == "error");
+        CHECK(read("{\"a\"}") == "error");
+        CHECK(read("{\"a\":1,}") == "error");
+        CHECK(read("{1:2}") == "error");
+        CHECK(read("[}") == "error");
+        CHECK(read("{]") == "error");
+        CHECK(read("]") == "error");
+        CHECK(read("[1]]") == "error");
+        CHECK(read("1 2") == "error");
+        CHECK(read("\"abc") == "error");
+        CHECK(read("tru") == "error");
+        CHECK(read("nulls") == "error");
+        CHECK(read("01") == "error");
+        CHECK(read("1.") == "error");
+        CHECK(read("-") == "error");
+        CHECK(read("1e") == "error");
+        CHECK(read("abc") == "error");
+    }
+
+    SECTION("nesting depth is limited") {
+        const std::string ok = std::string(JSONReader::MAX_DEPTH, '[') + std::string(JSONReader::MAX_DEPTH, ']');
+        CHECK(read(ok) != "error");
+        const std::string tooDeep = '[' + ok + ']';
+        CHECK(read(tooDeep) == "error");
+    }
+
+    SECTION("an error is final") {
+        const std::string json = "[1,,2]";
+        char buf[8];
+        JSONBufferReader r(json.data(), json.size(), buf, sizeof(buf));
+        CHECK(r.next());
+        CHECK(r.next());
+        CHECK_FALSE(r.next());
+        CHECK(r.hasError());
+        CHECK(r.token() == JSON_TOKEN_NONE);
+        CHECK_FALSE(r.next());
+    }
+
+    SECTION("reading from a stream") {
+        const std::string json = "{\"readings\":[21.5,-3e2,\"\\u00e9\"],\"ok\":true}";
+        const std::string expected = "{ name:readings [ value:21.5 value:-3e2 value:\xc3\xa9 ] name:ok value:true }";
+        for (size_t chunkSize: { 1, 2, 3, 7, 64 }) {
+            test::InputStream strm(json, chunkSize);
+            char buf[16];
+            JSONStreamReader r(strm, buf, sizeof(buf));
+            CHECK(r.stream() == &strm);
+            CHECK(readAll(r) == expected);
+            CHECK_FALSE(r.hasError());
+        }
+    }
+}
+
 TEST_CASE("Writing JSON") {
     test::OutputStream data;
     JSONStreamWriter json(data);
@@ -870,3 +1103,57 @@ TEST_CASE("JSONBufferWriter") {
         CHECK(buf.isPaddingValid());
     }
 }
+
+TEST_CASE("JSON parsing benchmark", "[.][benchmark]") {
+    // Typical function call and configuration payloads
+    const std::string payloads[] = {
+        "{\"cmd\":\"set\",\"pin\":\"D7\",\"value\":1}",
+        "{\"level\":\"warn\",\"filters\":[{\"app\":\"all\"},{\"system\":\"error\"}],\"type\":\"serial\","
+                "\"param\":{\"baud\":115200},\"id\":\"log1\"}",
+        "{\"readings\":[21.5,21.7,21.6,21.9,22.0,22.1,21.8,21.7,21.6,21.5,21.4,21.3,21.2,21.1,21.0,20.9],"
+                "\"unit\":\"C\",\"interval\":60,\"device\":{\"name\":\"sensor-1\",\"fw\":\"1.2.3\"}}"
+    };
+    const unsigned iterations = 100000;
+    for (const std::string& payload: payloads) {
+        std::string buf;
+        const auto run = [&](std::function<bool()> fn) {
+            unsigned ok = 0;
+            const auto start = std::chrono::steady_clock::now();
+            for (unsigned i = 0; i < iterations; ++i) {
+                buf = payload;
+                ok += fn();
+            }
+            const auto d = std::chrono::steady_clock::now() - start;
+            CHECK(ok == iterations);
+            return std::chrono::duration<double, std::micro>(d).count() / iterations;
+        };
+        // Tokenization as it was done before, counting the tokens first
+        const double twoPass = run([&]() {
+            jsmn_parser parser;
+            parser.size = sizeof(jsmn_parser);
+            jsmn_init(&parser, nullptr);
+            const int n = jsmn_parse(&parser, buf.data(), buf.size(), nullptr, 0, nullptr);
+            std::unique_ptr<jsmntok_t[]> t(new jsmntok_t[n]);
+            jsmn_init(&parser, nullptr);
+            return jsmn_parse(&parser, buf.data(), buf.size(), t.get(), n, nullptr) == n;
+        });
+        jsmntok_t tokens[64];
+        const double onePass = run([&]() {
+            jsmn_parser parser;
+            parser.size = sizeof(jsmn_parser);
+            jsmn_init(&parser, nullptr);
+            return jsmn_parse(&parser, buf.data(), buf.size(), tokens, 64, nullptr) > 0;
+        });
+        const double parseCopy = run([&]() {
+            return JSONValue::parseCopy(buf.data(), buf.size()).isValid();
+        });
+        const double parse = run([&]() {
+            return JSONValue::parse(&buf[0], buf.size()).isValid();
+        });
+        const double parseBuf = run([&]() {
+            return JSONValue::parse(&buf[0], buf.size(), tokens, 64).isValid();
+        });
+        printf("%3u bytes: tokenize: %.3f us (two-pass), %.3f us (single pass); parseCopy(): %.3f us; parse(): %.3f us, "
+                "%.3f us (token buffer)\n", (unsigned)payload.size(), twoPass, onePass, parseCopy, parse, parseBuf);
+    }
+}
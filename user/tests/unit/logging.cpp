@@ -17,6 +17,8 @@
 #include <boost/optional/optional_io.hpp>
 
 #include <queue>
+#include <chrono>
+#include <cstdio>
 #include <map>
 
 #define CHECK_LOG_ATTR_FLAG(flag, value) \
@@ -878,6 +880,61 @@ TEST_CASE("Miscellaneous") {
     }
 }
 
+TEST_CASE("Cached category level") {
+    // All calls go through the same call site and thus the same cached level
+    const auto logInfo = [](const char *category) {
+        LOG_C(INFO, category, "info");
+    };
+    DefaultLogHandler log1(LOG_LEVEL_WARN, {
+        { "a", LOG_LEVEL_INFO }
+    });
+    logInfo("b");
+    CHECK(!log1.hasNext());
+    logInfo("a"); // Category is different from the cached one
+    log1.checkNext().messageEquals("info").categoryEquals("a");
+    logInfo("b");
+    CHECK(!log1.hasNext());
+    {
+        DefaultLogHandler log2(LOG_LEVEL_INFO); // Adding a handler invalidates the cached level
+        logInfo("b");
+        log2.checkNext().messageEquals("info").categoryEquals("b");
+        CHECK(!log1.hasNext());
+    }
+    logInfo("b");
+    CHECK(!log1.hasNext());
+    logInfo(nullptr);
+    CHECK(!log1.hasNext());
+}
+
+TEST_CASE("Disabled message logging benchmark", "[.][benchmark]") {
+    // Verbose logging is enabled for one category only
+    DefaultLogHandler log(LOG_LEVEL_WARN, {
+        { "app.network", LOG_LEVEL_TRACE },
+        { "app.sensor.temp", LOG_LEVEL_INFO },
+        { "system", LOG_LEVEL_ERROR }
+    });
+    const unsigned iterations = 1000000;
+    const auto run = [iterations](bool cached) {
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned i = 0; i < iterations; ++i) {
+            if (cached) {
+                LOG_C(TRACE, "app.sensor.humidity", "value: %u", i);
+            } else {
+                // Equivalent to the logging macro without the cached level
+                LogAttributes attr = {};
+                attr.size = sizeof(LogAttributes);
+                log_message(LOG_LEVEL_TRACE, "app.sensor.humidity", &attr, nullptr, "value: %u", i);
+            }
+        }
+        const auto d = std::chrono::steady_clock::now() - start;
+        return std::chrono::duration<double, std::nano>(d).count() / iterations;
+    };
+    const double uncached = run(false);
+    const double cached = run(true);
+    printf("disabled message: %.1f ns (uncached), %.1f ns (cached)\n", uncached, cached);
+    CHECK(!log.hasNext());
+}
+
 TEST_CASE("Logger API") {
     SECTION("message logging") {
         DefaultLogHandler log(LOG_LEVEL_ALL);
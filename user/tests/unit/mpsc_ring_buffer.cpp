@@ -0,0 +1,109 @@
+#include "mpsc_ring_buffer.h"
+
+#include "catch.hpp"
+
+#include <thread>
+#include <vector>
+
+using particle::services::MpscRingBuffer;
+
+namespace {
+
+struct Item {
+    unsigned producer;
+    unsigned seq;
+};
+
+} // namespace
+
+TEST_CASE("MpscRingBuffer") {
+    MpscRingBuffer<Item> ring;
+
+    SECTION("capacity must be a power of two") {
+        CHECK_FALSE(ring.init(0));
+        CHECK_FALSE(ring.init(3));
+        CHECK(ring.capacity() == 0);
+        CHECK(ring.beginPush() == nullptr);
+        CHECK(ring.beginPop() == nullptr);
+        CHECK(ring.init(4));
+        CHECK(ring.capacity() == 4);
+    }
+
+    SECTION("items are popped in the order they were pushed") {
+        REQUIRE(ring.init(4));
+        CHECK(ring.beginPop() == nullptr);
+        for (unsigned i = 0; i < 10; ++i) {
+            Item* item = ring.beginPush();
+            REQUIRE(item != nullptr);
+            item->seq = i;
+            ring.endPush(item);
+            item = ring.beginPop();
+            REQUIRE(item != nullptr);
+            CHECK(item->seq == i);
+            ring.endPop();
+        }
+        CHECK(ring.beginPop() == nullptr);
+    }
+
+    SECTION("push fails when the ring is full") {
+        REQUIRE(ring.init(2));
+        Item* a = ring.beginPush();
+        Item* b = ring.beginPush();
+        REQUIRE(a != nullptr);
+        REQUIRE(b != nullptr);
+        CHECK(ring.beginPush() == nullptr);
+        // An item that is not completely pushed yet blocks the consumer
+        b->seq = 2;
+        ring.endPush(b);
+        CHECK(ring.beginPop() == nullptr);
+        a->seq = 1;
+        ring.endPush(a);
+        REQUIRE(ring.beginPop() == a);
+        ring.endPop();
+        CHECK(ring.beginPush() != nullptr);
+    }
+
+    SECTION("concurrent producers don't lose or duplicate items") {
+        const unsigned PRODUCERS = 4;
+        const unsigned ITEMS = 20000;
+        REQUIRE(ring.init(16));
+        std::vector<std::thread> threads;
+        for (unsigned p = 0; p < PRODUCERS; ++p) {
+            threads.emplace_back([&ring, p]() {
+                for (unsigned i = 0; i < ITEMS;) {
+                    Item* item = ring.beginPush();
+                    if (!item) {
+                        std::this_thread::yield();
+                        continue;
+                    }
+                    item->producer = p;
+                    item->seq = i++;
+                    ring.endPush(item);
+                }
+            });
+        }
+        std::vector<unsigned> next(PRODUCERS, 0);
+        unsigned received = 0;
+        bool ordered = true;
+        while (received < PRODUCERS * ITEMS) {
+            const Item* item = ring.beginPop();
+            if (!item) {
+                std::this_thread::yield();
+                continue;
+            }
+            // Items of each producer arrive in order
+            if (item->producer >= PRODUCERS || item->seq != next[item->producer]) {
+                ordered = false;
+            } else {
+                ++next[item->producer];
+            }
+            ring.endPop();
+            ++received;
+        }
+        for (auto& t: threads) {
+            t.join();
+        }
+        CHECK(ordered);
+        CHECK(ring.beginPop() == nullptr);
+    }
+}
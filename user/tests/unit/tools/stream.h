@@ -2,9 +2,11 @@
 #define TEST_TOOLS_STREAM_H
 
 #include "spark_wiring_print.h"
+#include "spark_wiring_stream.h"
 
 #include "check.h"
 
+#include <algorithm>
 #include <string>
 
 namespace test {
@@ -27,6 +29,22 @@ private:
     std::string s_;
 };
 
+// Input stream that returns at most `chunkSize` bytes per read
+class InputStream: public Stream {
+public:
+    explicit InputStream(std::string data, size_t chunkSize = 1);
+
+    virtual int available() override; // Stream
+    virtual int read() override; // Stream
+    virtual int peek() override; // Stream
+    virtual void flush() override; // Stream
+    virtual size_t write(uint8_t byte) override; // Print
+
+private:
+    std::string s_;
+    size_t pos_, chunkSize_;
+};
+
 } // namespace test
 
 // test::OutputStream
@@ -51,4 +69,31 @@ inline test::OutputStream::operator std::string() const {
     return s_;
 }
 
+// test::InputStream
+inline test::InputStream::InputStream(std::string data, size_t chunkSize) :
+        s_(std::move(data)),
+        pos_(0),
+        chunkSize_(chunkSize) {
+    setTimeout(0);
+}
+
+inline int test::InputStream::available() {
+    return std::min(s_.size() - pos_, chunkSize_);
+}
+
+inline int test::InputStream::read() {
+    return (pos_ < s_.size()) ? (uint8_t)s_[pos_++] : -1;
+}
+
+inline int test::InputStream::peek() {
+    return (pos_ < s_.size()) ? (uint8_t)s_[pos_] : -1;
+}
+
+inline void test::InputStream::flush() {
+}
+
+inline size_t test::InputStream::write(uint8_t byte) {
+    return 0;
+}
+
 #endif // TEST_TOOLS_STREAM_H
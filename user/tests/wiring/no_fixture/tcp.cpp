@@ -18,3 +18,18 @@ test(TCP_02_tcp_client_failed_connect_invalid_fqdn)
     assertFalse(client.connected());
     client.stop();
 }
+
+test(TCP_03_tcp_client_buffers_can_be_configured)
+{
+    TCPClient client;
+    uint8_t rxBuf[256];
+    uint8_t txBuf[256];
+    assertTrue(client.setReceiveBuffer(sizeof(rxBuf), rxBuf));
+    assertTrue(client.setSendBuffer(sizeof(txBuf), txBuf));
+    assertTrue(client.setReceiveBuffer(1024));
+    assertTrue(client.setSendBuffer(1024));
+    assertTrue(client.setReceiveBuffer(0));
+    assertTrue(client.setSendBuffer(0));
+    assertEqual(client.read(), -1);
+    client.stop();
+}
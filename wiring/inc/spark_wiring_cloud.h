@@ -64,6 +64,7 @@ const PublishFlag PUBLIC(PUBLISH_EVENT_FLAG_PUBLIC);
 const PublishFlag PRIVATE(PUBLISH_EVENT_FLAG_PRIVATE);
 const PublishFlag NO_ACK(PUBLISH_EVENT_FLAG_NO_ACK);
 const PublishFlag WITH_ACK(PUBLISH_EVENT_FLAG_WITH_ACK);
+const PublishFlag STORE_FORWARD(PUBLISH_EVENT_FLAG_STORE_FORWARD);
 
 // Test if the paramater a regular C "string" literal
 template <typename T>
@@ -287,6 +288,19 @@ public:
         CLOUD_FN(spark_unsubscribe(NULL), (void)0);
     }
 
+    /**
+     * Configures the rate limit for events whose name starts with `prefix`. An empty prefix
+     * configures the default limit. Events exceeding the limit are queued and sent once the
+     * limit allows it, events with a higher `priority` first.
+     *
+     * @param burst The number of events that can be sent back to back (at least 1).
+     * @param interval The time in milliseconds it takes to regain one event of the burst.
+     */
+    int setEventRateLimit(const char* prefix, uint16_t burst, system_tick_t interval, uint8_t priority = 0)
+    {
+        return CLOUD_FN(spark_set_event_rate_limit(prefix, burst, interval, priority, nullptr), SYSTEM_ERROR_NOT_SUPPORTED);
+    }
+
     bool syncTime(void)
     {
         return CLOUD_FN(spark_sync_time(NULL), false);
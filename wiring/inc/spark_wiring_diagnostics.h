@@ -23,11 +23,14 @@
 
 #include "diagnostics.h"
 #include "system_error.h"
+#include "timer_hal.h"
 #include "combine_hash.h"
 #include "underlying_type.h"
 #include "debug.h"
 
 #include <atomic>
+#include <cstddef>
+#include <cstring>
 
 #define PARTICLE_RETAINED_INTEGER_DIAGNOSTIC_DATA(_var, _id, _name, _val, ...) \
         PARTICLE_RETAINED ::particle::RetainedIntegerDiagnosticDataStorage _storage##_id; \
@@ -423,6 +426,179 @@ private:
     }
 };
 
+// Base abstract class for a data source containing a distribution of samples
+class AbstractHistogramDiagnosticData: public AbstractDiagnosticData {
+public:
+    static const unsigned BUCKET_COUNT = DIAG_HISTOGRAM_BUCKET_COUNT;
+
+    static int get(DiagnosticDataId id, diag_histogram_data& data);
+    static int get(const diag_source* src, diag_histogram_data& data);
+
+    // Returns the index of the bucket counting a given sample value
+    static unsigned bucketIndex(uint32_t val);
+    // Returns the smallest sample value counted by a given bucket
+    static uint32_t bucketLowerBound(unsigned index);
+    // Estimates a percentile (0-100) of the distribution
+    static uint32_t percentile(const diag_histogram_data& data, unsigned pct);
+
+protected:
+    explicit AbstractHistogramDiagnosticData(DiagnosticDataId id, const char* name = nullptr);
+
+    virtual int get(diag_histogram_data& data) = 0;
+
+private:
+    virtual int get(void* data, size_t& size) override; // AbstractDiagnosticData
+};
+
+// Data source counting samples in logarithmic buckets. Samples can be added from any thread or
+// an ISR, the counters are updated without locking
+class HistogramDiagnosticData: public AbstractHistogramDiagnosticData {
+public:
+    explicit HistogramDiagnosticData(DiagnosticDataId id, const char* name = nullptr) :
+            AbstractHistogramDiagnosticData(id, name) {
+        reset();
+    }
+
+    void add(uint32_t val) {
+        buckets_[bucketIndex(val)].fetch_add(1, std::memory_order_relaxed);
+        count_.fetch_add(1, std::memory_order_relaxed);
+        sum_.fetch_add(val, std::memory_order_relaxed);
+        uint32_t v = min_.load(std::memory_order_relaxed);
+        while (val < v && !min_.compare_exchange_weak(v, val, std::memory_order_relaxed)) {
+        }
+        v = max_.load(std::memory_order_relaxed);
+        while (val > v && !max_.compare_exchange_weak(v, val, std::memory_order_relaxed)) {
+        }
+    }
+
+    // Note: Samples that are added concurrently with this method may be partially discarded
+    void reset() {
+        for (auto& b: buckets_) {
+            b.store(0, std::memory_order_relaxed);
+        }
+        count_.store(0, std::memory_order_relaxed);
+        sum_.store(0, std::memory_order_relaxed);
+        min_.store(UINT32_MAX, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint32_t> buckets_[BUCKET_COUNT];
+    std::atomic<uint32_t> count_;
+    std::atomic<uint32_t> sum_;
+    std::atomic<uint32_t> min_;
+    std::atomic<uint32_t> max_;
+
+    virtual int get(diag_histogram_data& data) override { // AbstractHistogramDiagnosticData
+        data.count = count_.load(std::memory_order_relaxed);
+        data.sum = sum_.load(std::memory_order_relaxed);
+        data.min = data.count ? min_.load(std::memory_order_relaxed) : 0;
+        data.max = max_.load(std::memory_order_relaxed);
+        for (unsigned i = 0; i < BUCKET_COUNT; ++i) {
+            data.buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+        }
+        return SYSTEM_ERROR_NONE;
+    }
+};
+
+// Base abstract class for a data source containing a time series
+class AbstractTimeSeriesDiagnosticData: public AbstractDiagnosticData {
+public:
+    typedef int32_t IntType; // Underlying integer type
+
+    static int get(DiagnosticDataId id, diag_time_series_data& data);
+    static int get(const diag_source* src, diag_time_series_data& data);
+
+protected:
+    explicit AbstractTimeSeriesDiagnosticData(DiagnosticDataId id, const char* name = nullptr);
+
+    virtual int get(diag_time_series_data& data) = 0;
+
+private:
+    virtual int get(void* data, size_t& size) override; // AbstractDiagnosticData
+};
+
+// Default clock of the time series data sources
+struct DiagnosticDataClock {
+    static system_tick_t now() {
+        return HAL_Timer_Get_Milli_Seconds();
+    }
+};
+
+// Data source accumulating values over the last N windows of a fixed duration. Values can be added
+// from any thread or an ISR without locking.
+//
+// The source keeps a running total of all added values and the totals at the beginning of each
+// window, so a window is never cleared while other threads may be adding to it. A value that is
+// added concurrently with the start of a new window can be accounted to either of the two windows
+template<size_t N, typename ClockT = DiagnosticDataClock>
+class TimeSeriesDiagnosticData: public AbstractTimeSeriesDiagnosticData {
+public:
+    static_assert(N > 0 && N <= DIAG_TIME_SERIES_MAX_COUNT, "Invalid number of windows");
+
+    TimeSeriesDiagnosticData(DiagnosticDataId id, system_tick_t window) :
+            TimeSeriesDiagnosticData(id, nullptr, window) {
+    }
+
+    TimeSeriesDiagnosticData(DiagnosticDataId id, const char* name, system_tick_t window) :
+            AbstractTimeSeriesDiagnosticData(id, name),
+            total_(0),
+            epoch_(0),
+            window_(window) {
+        SPARK_ASSERT(window > 0);
+        for (auto& t: start_) {
+            t.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void add(IntType val) {
+        advance(ClockT::now());
+        total_.fetch_add((uint32_t)val, std::memory_order_relaxed);
+    }
+
+    TimeSeriesDiagnosticData& operator+=(IntType val) {
+        add(val);
+        return *this;
+    }
+
+private:
+    std::atomic<uint32_t> total_; // Running total of all values
+    std::atomic<uint32_t> start_[N]; // Running totals at the beginning of the last N windows
+    std::atomic<system_tick_t> epoch_; // Index of the current window
+    const system_tick_t window_; // Window duration
+
+    void advance(system_tick_t now) {
+        const system_tick_t w = now / window_;
+        system_tick_t e = epoch_.load(std::memory_order_acquire);
+        while (e != w) {
+            if (epoch_.compare_exchange_weak(e, w, std::memory_order_acq_rel)) {
+                // The windows that have been skipped start with the same total
+                const uint32_t t = total_.load(std::memory_order_relaxed);
+                const system_tick_t n = (w - e < N) ? w - e : N;
+                for (system_tick_t i = 0; i < n; ++i) {
+                    start_[(w - i) % N].store(t, std::memory_order_relaxed);
+                }
+                break;
+            }
+        }
+    }
+
+    virtual int get(diag_time_series_data& data) override { // AbstractTimeSeriesDiagnosticData
+        advance(ClockT::now());
+        const system_tick_t e = epoch_.load(std::memory_order_acquire);
+        uint32_t next = total_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < N; ++i) {
+            const uint32_t start = start_[(e - i) % N].load(std::memory_order_relaxed);
+            data.values[N - 1 - i] = (IntType)(next - start);
+            next = start;
+        }
+        data.window = window_;
+        data.count = N;
+        data.reserved = 0;
+        return SYSTEM_ERROR_NONE;
+    }
+};
+
 template<typename ValueT>
 class RetainedDiagnosticDataStorage {
 public:
@@ -552,4 +728,130 @@ inline int AbstractIntegerDiagnosticData::get(void* data, size_t& size) {
     return ret;
 }
 
+inline AbstractHistogramDiagnosticData::AbstractHistogramDiagnosticData(DiagnosticDataId id, const char* name) :
+        AbstractDiagnosticData(id, name, DIAG_TYPE_HISTOGRAM) {
+}
+
+inline int AbstractHistogramDiagnosticData::get(DiagnosticDataId id, diag_histogram_data& data) {
+    const diag_source* src = nullptr;
+    const int ret = diag_get_source(id, &src, nullptr);
+    if (ret != SYSTEM_ERROR_NONE) {
+        return ret;
+    }
+    return get(src, data);
+}
+
+inline int AbstractHistogramDiagnosticData::get(const diag_source* src, diag_histogram_data& data) {
+    SPARK_ASSERT(src->type == DIAG_TYPE_HISTOGRAM);
+    size_t size = sizeof(data);
+    return AbstractDiagnosticData::get(src, &data, size);
+}
+
+inline int AbstractHistogramDiagnosticData::get(void* data, size_t& size) {
+    if (!data) {
+        size = sizeof(diag_histogram_data);
+        return SYSTEM_ERROR_NONE;
+    }
+    if (size < sizeof(diag_histogram_data)) {
+        return SYSTEM_ERROR_TOO_LARGE;
+    }
+    const int ret = get(*(diag_histogram_data*)data);
+    if (ret == SYSTEM_ERROR_NONE) {
+        size = sizeof(diag_histogram_data);
+    }
+    return ret;
+}
+
+inline unsigned AbstractHistogramDiagnosticData::bucketIndex(uint32_t val) {
+    if (val < 2) {
+        return val;
+    }
+    const unsigned n = 31 - __builtin_clz(val);
+    const unsigned index = n * 2 + ((val >> (n - 1)) & 1);
+    return (index < BUCKET_COUNT) ? index : BUCKET_COUNT - 1;
+}
+
+inline uint32_t AbstractHistogramDiagnosticData::bucketLowerBound(unsigned index) {
+    if (index < 2) {
+        return index;
+    }
+    const unsigned n = index / 2;
+    return ((uint32_t)1 << n) + ((index & 1) ? ((uint32_t)1 << (n - 1)) : 0);
+}
+
+inline uint32_t AbstractHistogramDiagnosticData::percentile(const diag_histogram_data& data, unsigned pct) {
+    // The buckets are summed up instead of using the sample count, which may be off by the samples
+    // that were being added while the data was retrieved
+    uint64_t total = 0;
+    for (unsigned i = 0; i < BUCKET_COUNT; ++i) {
+        total += data.buckets[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = (total * pct + 99) / 100;
+    if (rank < 1) {
+        rank = 1;
+    } else if (rank > total) {
+        rank = total;
+    }
+    uint64_t count = 0;
+    for (unsigned i = 0; i < BUCKET_COUNT; ++i) {
+        const uint32_t n = data.buckets[i];
+        if (count + n < rank) {
+            count += n;
+            continue;
+        }
+        // Interpolate within the bucket
+        const uint64_t low = bucketLowerBound(i);
+        const uint64_t high = (i < BUCKET_COUNT - 1) ? bucketLowerBound(i + 1) : (uint64_t)data.max + 1;
+        uint64_t val = (high > low) ? low + (high - low) * (rank - count - 1) / n : low;
+        if (val < data.min) {
+            val = data.min;
+        } else if (val > data.max) {
+            val = data.max;
+        }
+        return val;
+    }
+    return data.max;
+}
+
+inline AbstractTimeSeriesDiagnosticData::AbstractTimeSeriesDiagnosticData(DiagnosticDataId id, const char* name) :
+        AbstractDiagnosticData(id, name, DIAG_TYPE_TIME_SERIES) {
+}
+
+inline int AbstractTimeSeriesDiagnosticData::get(DiagnosticDataId id, diag_time_series_data& data) {
+    const diag_source* src = nullptr;
+    const int ret = diag_get_source(id, &src, nullptr);
+    if (ret != SYSTEM_ERROR_NONE) {
+        return ret;
+    }
+    return get(src, data);
+}
+
+inline int AbstractTimeSeriesDiagnosticData::get(const diag_source* src, diag_time_series_data& data) {
+    SPARK_ASSERT(src->type == DIAG_TYPE_TIME_SERIES);
+    size_t size = sizeof(data);
+    return AbstractDiagnosticData::get(src, &data, size);
+}
+
+inline int AbstractTimeSeriesDiagnosticData::get(void* data, size_t& size) {
+    if (!data) {
+        size = sizeof(diag_time_series_data);
+        return SYSTEM_ERROR_NONE;
+    }
+    diag_time_series_data d = {};
+    const int ret = get(d);
+    if (ret != SYSTEM_ERROR_NONE) {
+        return ret;
+    }
+    const size_t n = offsetof(diag_time_series_data, values) + d.count * sizeof(d.values[0]);
+    if (size < n) {
+        return SYSTEM_ERROR_TOO_LARGE;
+    }
+    memcpy(data, &d, n);
+    size = n;
+    return SYSTEM_ERROR_NONE;
+}
+
 } // namespace particle
@@ -19,6 +19,7 @@
 #define SPARK_WIRING_JSON_H
 
 #include "spark_wiring_print.h"
+#include "spark_wiring_stream.h"
 #include "spark_wiring_string.h"
 
 #include "jsmn.h"
@@ -45,6 +46,17 @@ enum JSONType {
     JSON_TYPE_OBJECT
 };
 
+// Token types reported by JSONReader
+enum JSONToken {
+    JSON_TOKEN_NONE, // No token has been read yet
+    JSON_TOKEN_BEGIN_OBJECT,
+    JSON_TOKEN_END_OBJECT,
+    JSON_TOKEN_BEGIN_ARRAY,
+    JSON_TOKEN_END_ARRAY,
+    JSON_TOKEN_NAME, // Name of an object's property
+    JSON_TOKEN_VALUE // Primitive or string value
+};
+
 class JSONString;
 class JSONArrayIterator;
 class JSONObjectIterator;
@@ -71,6 +83,10 @@ public:
     bool isValid() const;
 
     static JSONValue parse(char *json, size_t size);
+    // Parses JSON data in place, storing the tokens in the provided buffer. The buffer needs to remain
+    // valid while the returned value or any value derived from it is in use. Tokens are allocated on
+    // the heap only if the buffer is too small
+    static JSONValue parse(char *json, size_t size, jsmntok_t *tokens, size_t maxTokens);
     static JSONValue parseCopy(const char *json, size_t size);
     static JSONValue parseCopy(const char *json);
 
@@ -80,7 +96,8 @@ private:
 
     JSONValue(const jsmntok_t *token, detail::JSONDataPtr data);
 
-    static bool tokenize(const char *json, size_t size, jsmntok_t **tokens, size_t *count);
+    static bool tokenize(const char *json, size_t size, jsmntok_t *buf, size_t bufSize, jsmntok_t **tokens,
+            size_t *count);
     static bool stringize(jsmntok_t *tokens, size_t count, char *json);
     static bool unescape(jsmntok_t *token, char *json);
 
@@ -230,6 +247,126 @@ private:
     size_t bufSize_, n_;
 };
 
+/*
+    Abstract incremental JSON document reader.
+
+    Input data is consumed in chunks, and only the current token is kept in memory, in the buffer
+    provided by the caller. Names and string values that don't fit in the buffer are truncated.
+
+        char buf[64];
+        JSONStreamReader reader(stream, buf, sizeof(buf));
+        while (reader.next()) {
+            if (reader.token() == JSON_TOKEN_NAME && reader.depth() == 1 && strcmp(reader.data(), "level") == 0) {
+                if (reader.next() && reader.isString()) {
+                    ...
+                }
+            }
+        }
+        if (reader.hasError()) {
+            ...
+        }
+*/
+class JSONReader {
+public:
+    // Maximum nesting level of arrays and objects
+    static const unsigned MAX_DEPTH = 32;
+
+    JSONReader(char *buf, size_t size);
+    virtual ~JSONReader() = default;
+
+    // Reads next token. Returns false at the end of the document or in case of an error
+    bool next();
+
+    JSONToken token() const;
+    JSONType type() const; // Type of a value token
+    unsigned depth() const; // Number of enclosing arrays and objects
+
+    bool isNull() const;
+    bool isBool() const;
+    bool isNumber() const;
+    bool isString() const;
+
+    bool toBool() const;
+    int toInt() const;
+    double toDouble() const;
+
+    const char* data() const; // Returns null-terminated name or value
+    size_t size() const;
+    bool isTruncated() const;
+
+    bool hasError() const;
+
+    // This class is non-copyable
+    JSONReader(const JSONReader&) = delete;
+    JSONReader& operator=(const JSONReader&) = delete;
+
+protected:
+    // Returns pointer to the next chunk of input data and its size, or 0 at the end of the input
+    virtual size_t read(const char **data) = 0;
+
+private:
+    enum State {
+        VALUE, // Expecting a value
+        VALUE_OR_END, // Expecting first element of an array or end of the array
+        NAME, // Expecting name of an object's property
+        NAME_OR_END, // Expecting name of the first property or end of the object
+        COLON, // Expecting name separator
+        NEXT, // Expecting element separator or end of the compound value
+        DONE, // Top-level value has been read
+        ERROR
+    };
+
+    const char *in_, *inEnd_;
+    char *buf_;
+    size_t bufSize_, n_;
+    uint32_t objects_; // Bit set for every enclosing object
+    unsigned depth_;
+    State state_;
+    JSONToken token_;
+    JSONType type_;
+    bool truncated_;
+    bool eof_;
+
+    int peekChar();
+    int readChar();
+    int skipSpace();
+    void append(char c);
+    void appendUtf8(uint32_t c);
+    bool readString();
+    bool readPrimitive();
+    bool readHex(uint32_t *val);
+    bool beginCompound(bool object);
+    bool endCompound(bool object);
+    bool setError();
+};
+
+class JSONStreamReader: public JSONReader {
+public:
+    JSONStreamReader(Stream &stream, char *buf, size_t size);
+
+    Stream* stream() const;
+
+protected:
+    // Input ends when no data has been received within the stream's timeout
+    virtual size_t read(const char **data) override;
+
+private:
+    Stream &strm_;
+    char chunk_[32];
+};
+
+class JSONBufferReader: public JSONReader {
+public:
+    JSONBufferReader(const char *data, size_t dataSize, char *buf, size_t size);
+
+protected:
+    virtual size_t read(const char **data) override;
+
+private:
+    const char *data_;
+    size_t size_;
+};
+
 bool operator==(const char *str1, const JSONString &str2);
 bool operator!=(const char *str1, const JSONString &str2);
 bool operator==(const String &str1, const JSONString &str2);
@@ -424,6 +561,68 @@ inline size_t spark::JSONBufferWriter::dataSize() const {
     return n_;
 }
 
+// spark::JSONReader
+inline spark::JSONToken spark::JSONReader::token() const {
+    return token_;
+}
+
+inline spark::JSONType spark::JSONReader::type() const {
+    return type_;
+}
+
+inline unsigned spark::JSONReader::depth() const {
+    return (token_ == JSON_TOKEN_BEGIN_OBJECT || token_ == JSON_TOKEN_BEGIN_ARRAY) ? depth_ - 1 : depth_;
+}
+
+inline bool spark::JSONReader::isNull() const {
+    return type_ == JSON_TYPE_NULL;
+}
+
+inline bool spark::JSONReader::isBool() const {
+    return type_ == JSON_TYPE_BOOL;
+}
+
+inline bool spark::JSONReader::isNumber() const {
+    return type_ == JSON_TYPE_NUMBER;
+}
+
+inline bool spark::JSONReader::isString() const {
+    return type_ == JSON_TYPE_STRING;
+}
+
+inline const char* spark::JSONReader::data() const {
+    return buf_;
+}
+
+inline size_t spark::JSONReader::size() const {
+    return n_;
+}
+
+inline bool spark::JSONReader::isTruncated() const {
+    return truncated_;
+}
+
+inline bool spark::JSONReader::hasError() const {
+    return state_ == ERROR;
+}
+
+// spark::JSONStreamReader
+inline spark::JSONStreamReader::JSONStreamReader(Stream &stream, char *buf, size_t size) :
+        JSONReader(buf, size),
+        strm_(stream) {
+}
+
+inline Stream* spark::JSONStreamReader::stream() const {
+    return &strm_;
+}
+
+// spark::JSONBufferReader
+inline spark::JSONBufferReader::JSONBufferReader(const char *data, size_t dataSize, char *buf, size_t size) :
+        JSONReader(buf, size),
+        data_(data),
+        size_(dataSize) {
+}
+
 // spark::
 inline bool spark::operator==(const char *str1, const JSONString &str2) {
     return str2 == str1;
@@ -599,6 +599,7 @@ private:
 
     static void setSystemCallbacks();
     static void resetSystemCallbacks();
+    void updateSystemCallbacks();
 
     // System callbacks
     static void logMessage(const char *msg, int level, const char *category, const LogAttributes *attr, void *reserved);
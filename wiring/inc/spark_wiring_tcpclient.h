@@ -56,8 +56,39 @@ public:
     virtual int read();
     virtual int read(uint8_t *buffer, size_t size);
     virtual int peek();
+    // Sends the data buffered by write()
     virtual void flush();
+    // Discards the received data that has not been read yet
     void flush_buffer();
+
+    /**
+     * Sets the receive buffer.
+     *
+     * Reads of at least `size` bytes bypass the buffer and receive the data directly into
+     * the caller's buffer.
+     *
+     * @param size Buffer size. If 0, the default buffer of TCPCLIENT_BUF_MAX_SIZE bytes is used.
+     * @param buffer Buffer storage. If `nullptr`, the buffer is allocated on the heap.
+     * @return `false` if the buffer cannot be allocated, or if the received data that has not
+     *         been read yet doesn't fit in the new buffer.
+     */
+    bool setReceiveBuffer(size_t size, uint8_t* buffer = nullptr);
+
+    /**
+     * Sets the send buffer.
+     *
+     * Writes are coalesced in the buffer and sent when the buffer is full, on `flush()`,
+     * before receiving data and before the connection is closed, including when the last copy
+     * of the client is destroyed without calling `stop()`. Errors are reported via
+     * `getWriteError()`, except for those that occur in the destructor. Writes of at least
+     * `size` bytes are sent directly. By default, there's no send buffer.
+     *
+     * @param size Buffer size. If 0, writes are not buffered.
+     * @param buffer Buffer storage. If `nullptr`, the buffer is allocated on the heap.
+     * @return `false` if the buffer cannot be allocated or the buffered data cannot be sent.
+     */
+    bool setSendBuffer(size_t size, uint8_t* buffer = nullptr);
+
     virtual void stop();
     virtual uint8_t connected();
     virtual operator bool();
@@ -75,17 +106,33 @@ private:
     struct Data {
         sock_handle_t sock;
         uint8_t buffer[TCPCLIENT_BUF_MAX_SIZE];
-        uint16_t offset;
-        uint16_t total;
+        uint8_t* rxBuf;
+        size_t rxSize;
+        size_t offset;
+        size_t total;
+        uint8_t* txBuf;
+        size_t txSize;
+        size_t txCount;
+        system_tick_t txTimeout;
+        std::unique_ptr<uint8_t[]> rxHeapBuf;
+        std::unique_ptr<uint8_t[]> txHeapBuf;
         IPAddress remoteIP;
 
         explicit Data(sock_handle_t sock);
+        // Sends the buffered data before closing the socket
         ~Data();
+
+        // Both return the number of bytes sent or a negative error code, which is also the code
+        // reported via getWriteError()
+        int send(const uint8_t* buffer, size_t size, system_tick_t timeout);
+        int sendBuffered();
     };
 
     std::shared_ptr<Data> d_;
 
-    inline int bufferCount();
+    int bufferCount();
+    int receive(uint8_t* buffer, size_t size);
+    int writeBuffered(const uint8_t* buffer, size_t size, system_tick_t timeout);
 };
 
 #endif
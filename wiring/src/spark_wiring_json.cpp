@@ -68,16 +68,20 @@ bool hexToInt(const char *s, size_t size, uint32_t *val) {
 struct spark::detail::JSONData {
     jsmntok_t *tokens;
     char *json;
+    bool freeTokens;
     bool freeJson;
 
     JSONData() :
             tokens(nullptr),
             json(nullptr),
+            freeTokens(false),
             freeJson(false) {
     }
 
     ~JSONData() {
-        delete[] tokens;
+        if (freeTokens) {
+            free(tokens);
+        }
         if (freeJson) {
             delete[] json;
         }
@@ -177,19 +181,24 @@ spark::JSONType spark::JSONValue::type() const {
 }
 
 spark::JSONValue spark::JSONValue::parse(char *json, size_t size) {
+    return parse(json, size, nullptr, 0);
+}
+
+spark::JSONValue spark::JSONValue::parse(char *json, size_t size, jsmntok_t *tokens, size_t maxTokens) {
     detail::JSONDataPtr d(new(std::nothrow) detail::JSONData);
     if (!d) {
         return JSONValue();
     }
     size_t tokenCount = 0;
-    if (!tokenize(json, size, &d->tokens, &tokenCount)) {
+    if (!tokenize(json, size, tokens, maxTokens, &d->tokens, &tokenCount)) {
         return JSONValue();
     }
+    d->freeTokens = (d->tokens != tokens);
     const jsmntok_t *t = d->tokens; // Root token
-    if (t->type == JSMN_PRIMITIVE) {
+    if (t->type == JSMN_PRIMITIVE && (size_t)t->end == size) {
         // RFC 7159 allows JSON document to consist of a single primitive value, such as a number.
-        // In this case, original data is copied to a larger buffer to ensure room for term. null
-        // character (see stringize() method)
+        // If there's no character following the value, original data is copied to a larger buffer
+        // to ensure room for term. null character (see stringize() method)
         d->json = new(std::nothrow) char[size + 1];
         if (!d->json) {
             return JSONValue();
@@ -211,9 +220,10 @@ spark::JSONValue spark::JSONValue::parseCopy(const char *json, size_t size) {
         return JSONValue();
     }
     size_t tokenCount = 0;
-    if (!tokenize(json, size, &d->tokens, &tokenCount)) {
+    if (!tokenize(json, size, nullptr, 0, &d->tokens, &tokenCount)) {
         return JSONValue();
     }
+    d->freeTokens = true;
     d->json = new(std::nothrow) char[size + 1];
     if (!d->json) {
         return JSONValue();
@@ -226,24 +236,49 @@ spark::JSONValue spark::JSONValue::parseCopy(const char *json, size_t size) {
     return JSONValue(d->tokens, d);
 }
 
-bool spark::JSONValue::tokenize(const char *json, size_t size, jsmntok_t **tokens, size_t *count) {
+bool spark::JSONValue::tokenize(const char *json, size_t size, jsmntok_t *buf, size_t bufSize, jsmntok_t **tokens,
+        size_t *count) {
     jsmn_parser parser;
     parser.size = sizeof(jsmn_parser);
     jsmn_init(&parser, nullptr);
-    const int n = jsmn_parse(&parser, json, size, nullptr, 0, nullptr); // Get number of tokens
-    if (n <= 0) {
-        return false; // Parsing error
+    jsmntok_t *t = buf;
+    size_t n = bufSize;
+    if (!t || !n) {
+        // Typical JSON documents have at least a few characters per token
+        n = std::max<size_t>(size / 8, 8);
+        t = (jsmntok_t*)malloc(n * sizeof(jsmntok_t));
+        if (!t) {
+            return false;
+        }
     }
-    std::unique_ptr<jsmntok_t[]> t(new(std::nothrow) jsmntok_t[n]);
-    if (!t) {
-        return false;
+    // Tokens are parsed in a single pass. The parser can be resumed with a larger token array
+    // if there are more tokens than expected
+    int ret = 0;
+    while ((ret = jsmn_parse(&parser, json, size, t, n, nullptr)) == JSMN_ERROR_NOMEM) {
+        const size_t newSize = n * 2;
+        jsmntok_t *newTokens = nullptr;
+        if (t == buf) {
+            newTokens = (jsmntok_t*)malloc(newSize * sizeof(jsmntok_t));
+            if (newTokens) {
+                memcpy(newTokens, buf, n * sizeof(jsmntok_t));
+            }
+        } else {
+            newTokens = (jsmntok_t*)realloc(t, newSize * sizeof(jsmntok_t));
+        }
+        if (!newTokens) {
+            break;
+        }
+        t = newTokens;
+        n = newSize;
     }
-    jsmn_init(&parser, nullptr); // Reset parser
-    if (jsmn_parse(&parser, json, size, t.get(), n, nullptr) <= 0) {
-        return false;
+    if (ret < 0 || parser.toknext == 0) {
+        if (t != buf) {
+            free(t);
+        }
+        return false; // Parsing error
     }
-    *tokens = t.release();
-    *count = n;
+    *tokens = t;
+    *count = parser.toknext;
     return true;
 }
 
@@ -574,3 +609,408 @@ void spark::JSONBufferWriter::printf(const char *fmt, ...) {
     va_end(args);
     n_ += n;
 }
+
+// spark::JSONReader
+spark::JSONReader::JSONReader(char *buf, size_t size) :
+        in_(nullptr),
+        inEnd_(nullptr),
+        buf_(buf),
+        bufSize_(size),
+        n_(0),
+        objects_(0),
+        depth_(0),
+        state_(VALUE),
+        token_(JSON_TOKEN_NONE),
+        type_(JSON_TYPE_INVALID),
+        truncated_(false),
+        eof_(false) {
+    if (buf_ && bufSize_) {
+        buf_[0] = '\0';
+    }
+}
+
+bool spark::JSONReader::next() {
+    if (state_ == ERROR) {
+        return false;
+    }
+    n_ = 0;
+    if (buf_ && bufSize_) {
+        buf_[0] = '\0';
+    }
+    truncated_ = false;
+    type_ = JSON_TYPE_INVALID;
+    for (;;) {
+        const int c = skipSpace();
+        switch (state_) {
+        case DONE: {
+            if (c < 0) {
+                token_ = JSON_TOKEN_NONE;
+                return false; // End of the document
+            }
+            return setError(); // Unexpected data after the top-level value
+        }
+        case VALUE_OR_END:
+            if (c == ']') {
+                readChar();
+                return endCompound(false);
+            }
+            // Fall through
+        case VALUE: {
+            if (c == '{' || c == '[') {
+                readChar();
+                return beginCompound(c == '{');
+            }
+            if (c == '"') {
+                readChar();
+                if (!readString()) {
+                    return setError();
+                }
+                type_ = JSON_TYPE_STRING;
+            } else if (!readPrimitive()) {
+                return setError();
+            }
+            token_ = JSON_TOKEN_VALUE;
+            state_ = depth_ ? NEXT : DONE;
+            return true;
+        }
+        case NAME_OR_END:
+            if (c == '}') {
+                readChar();
+                return endCompound(true);
+            }
+            // Fall through
+        case NAME: {
+            if (c != '"') {
+                return setError();
+            }
+            readChar();
+            if (!readString()) {
+                return setError();
+            }
+            token_ = JSON_TOKEN_NAME;
+            state_ = COLON;
+            return true;
+        }
+        case COLON: {
+            if (c != ':') {
+                return setError();
+            }
+            readChar();
+            state_ = VALUE;
+            break;
+        }
+        case NEXT: {
+            if (c == '}' || c == ']') {
+                readChar();
+                return endCompound(c == '}');
+            }
+            if (c != ',') {
+                return setError();
+            }
+            readChar();
+            state_ = (objects_ & (1u << (depth_ - 1))) ? NAME : VALUE;
+            break;
+        }
+        default:
+            return setError();
+        }
+    }
+}
+
+bool spark::JSONReader::toBool() const {
+    switch (type_) {
+    case JSON_TYPE_BOOL:
+        return *buf_ == 't';
+    case JSON_TYPE_NUMBER:
+        return strtod(buf_, nullptr) != 0.0;
+    case JSON_TYPE_STRING:
+        if (*buf_ == '\0' || strcmp(buf_, "false") == 0 || strcmp(buf_, "0") == 0 || strcmp(buf_, "0.0") == 0) {
+            return false; // Empty string, "false", "0" or "0.0"
+        }
+        return true; // Any other string
+    default:
+        return false;
+    }
+}
+
+int spark::JSONReader::toInt() const {
+    switch (type_) {
+    case JSON_TYPE_BOOL:
+        return *buf_ == 't';
+    case JSON_TYPE_NUMBER:
+    case JSON_TYPE_STRING:
+        return strtol(buf_, nullptr, 10);
+    default:
+        return 0;
+    }
+}
+
+double spark::JSONReader::toDouble() const {
+    switch (type_) {
+    case JSON_TYPE_BOOL:
+        return *buf_ == 't';
+    case JSON_TYPE_NUMBER:
+    case JSON_TYPE_STRING:
+        return strtod(buf_, nullptr);
+    default:
+        return 0.0;
+    }
+}
+
+int spark::JSONReader::peekChar() {
+    if (in_ == inEnd_) {
+        if (eof_) {
+            return -1;
+        }
+        const char *data = nullptr;
+        const size_t n = read(&data);
+        if (!n) {
+            eof_ = true;
+            return -1;
+        }
+        in_ = data;
+        inEnd_ = data + n;
+    }
+    return (uint8_t)*in_;
+}
+
+int spark::JSONReader::readChar() {
+    const int c = peekChar();
+    if (c >= 0) {
+        ++in_;
+    }
+    return c;
+}
+
+int spark::JSONReader::skipSpace() {
+    int c = 0;
+    while ((c = peekChar()) == ' ' || c == '\t' || c == '\r' || c == '\n') {
+        ++in_;
+    }
+    return c;
+}
+
+void spark::JSONReader::append(char c) {
+    if (n_ + 1 < bufSize_) {
+        buf_[n_++] = c;
+        buf_[n_] = '\0';
+    } else {
+        truncated_ = true;
+    }
+}
+
+void spark::JSONReader::appendUtf8(uint32_t c) {
+    if (c < 0x80) {
+        append(c);
+    } else if (c < 0x800) {
+        append(0xc0 | (c >> 6));
+        append(0x80 | (c & 0x3f));
+    } else if (c < 0x10000) {
+        append(0xe0 | (c >> 12));
+        append(0x80 | ((c >> 6) & 0x3f));
+        append(0x80 | (c & 0x3f));
+    } else {
+        append(0xf0 | (c >> 18));
+        append(0x80 | ((c >> 12) & 0x3f));
+        append(0x80 | ((c >> 6) & 0x3f));
+        append(0x80 | (c & 0x3f));
+    }
+}
+
+bool spark::JSONReader::readString() {
+    for (;;) {
+        int c = readChar();
+        if (c < 0 || c < 0x20) {
+            return false; // Unexpected end of string or unescaped control character
+        }
+        if (c == '"') {
+            return true;
+        }
+        if (c != '\\') {
+            append(c);
+            continue;
+        }
+        c = readChar();
+        switch (c) {
+        case '"':
+        case '\\':
+        case '/':
+            append(c);
+            break;
+        case 'b': // Backspace
+            append(0x08);
+            break;
+        case 't': // Tab
+            append(0x09);
+            break;
+        case 'n': // Line feed
+            append(0x0a);
+            break;
+        case 'f': // Form feed
+            append(0x0c);
+            break;
+        case 'r': // Carriage return
+            append(0x0d);
+            break;
+        case 'u': { // Arbitrary character, e.g. "\u001f"
+            uint32_t u = 0;
+            if (!readHex(&u)) {
+                return false;
+            }
+            if (u >= 0xd800 && u <= 0xdbff) { // High surrogate
+                uint32_t l = 0;
+                if (readChar() != '\\' || readChar() != 'u' || !readHex(&l) || l < 0xdc00 || l > 0xdfff) {
+                    return false; // Expecting low surrogate
+                }
+                u = 0x10000 + ((u - 0xd800) << 10) + (l - 0xdc00);
+            } else if (u >= 0xdc00 && u <= 0xdfff) {
+                return false; // Unexpected low surrogate
+            }
+            appendUtf8(u);
+            break;
+        }
+        default:
+            return false; // Invalid escaped sequence
+        }
+    }
+}
+
+bool spark::JSONReader::readHex(uint32_t *val) {
+    char s[4];
+    for (size_t i = 0; i < sizeof(s); ++i) {
+        const int c = readChar();
+        if (c < 0) {
+            return false;
+        }
+        s[i] = c;
+    }
+    return hexToInt(s, sizeof(s), val);
+}
+
+bool spark::JSONReader::readPrimitive() {
+    // Number syntax states
+    enum {
+        START, // Beginning of a number
+        SIGN, // After a minus sign
+        ZERO, // Leading zero
+        INT, // Integer part
+        POINT, // After a decimal point
+        FRAC, // Fractional part
+        EXP, // After an exponent character
+        EXP_SIGN, // After a sign of the exponent
+        EXP_DIGITS // Exponent
+    };
+    int c = peekChar();
+    const char *literal = nullptr;
+    if (c == 't') {
+        literal = "true";
+        type_ = JSON_TYPE_BOOL;
+    } else if (c == 'f') {
+        literal = "false";
+        type_ = JSON_TYPE_BOOL;
+    } else if (c == 'n') {
+        literal = "null";
+        type_ = JSON_TYPE_NULL;
+    } else {
+        type_ = JSON_TYPE_NUMBER;
+    }
+    int numState = START;
+    size_t n = 0;
+    while ((c = peekChar()) >= 0 && c != ',' && c != ']' && c != '}' && c != ':' && c != ' ' && c != '\t' &&
+            c != '\r' && c != '\n') {
+        ++in_;
+        if (literal) {
+            if (c != literal[n]) {
+                return false;
+            }
+        } else {
+            const bool digit = (c >= '0' && c <= '9');
+            switch (numState) {
+            case START:
+                numState = (c == '-') ? SIGN : (c == '0') ? ZERO : digit ? INT : -1;
+                break;
+            case SIGN:
+                numState = (c == '0') ? ZERO : digit ? INT : -1;
+                break;
+            case ZERO:
+            case INT:
+                numState = (c == '.') ? POINT : (c == 'e' || c == 'E') ? EXP : (digit && numState == INT) ? INT : -1;
+                break;
+            case POINT:
+            case FRAC:
+                numState = digit ? FRAC : ((c == 'e' || c == 'E') && numState == FRAC) ? EXP : -1;
+                break;
+            case EXP:
+                numState = (c == '+' || c == '-') ? EXP_SIGN : digit ? EXP_DIGITS : -1;
+                break;
+            case EXP_SIGN:
+            case EXP_DIGITS:
+                numState = digit ? EXP_DIGITS : -1;
+                break;
+            default:
+                break;
+            }
+            if (numState < 0) {
+                return false;
+            }
+        }
+        append(c);
+        ++n;
+    }
+    if (literal) {
+        return literal[n] == '\0';
+    }
+    return numState == ZERO || numState == INT || numState == FRAC || numState == EXP_DIGITS;
+}
+
+bool spark::JSONReader::beginCompound(bool object) {
+    if (depth_ == MAX_DEPTH) {
+        return setError();
+    }
+    if (object) {
+        objects_ |= (1u << depth_);
+    } else {
+        objects_ &= ~(1u << depth_);
+    }
+    ++depth_;
+    token_ = object ? JSON_TOKEN_BEGIN_OBJECT : JSON_TOKEN_BEGIN_ARRAY;
+    type_ = object ? JSON_TYPE_OBJECT : JSON_TYPE_ARRAY;
+    state_ = object ? NAME_OR_END : VALUE_OR_END;
+    return true;
+}
+
+bool spark::JSONReader::endCompound(bool object) {
+    if (!depth_ || !!(objects_ & (1u << (depth_ - 1))) != object) {
+        return setError(); // Mismatched bracket
+    }
+    --depth_;
+    token_ = object ? JSON_TOKEN_END_OBJECT : JSON_TOKEN_END_ARRAY;
+    type_ = object ? JSON_TYPE_OBJECT : JSON_TYPE_ARRAY;
+    state_ = depth_ ? NEXT : DONE;
+    return true;
+}
+
+bool spark::JSONReader::setError() {
+    state_ = ERROR;
+    token_ = JSON_TOKEN_NONE;
+    type_ = JSON_TYPE_INVALID;
+    return false;
+}
+
+// spark::JSONStreamReader
+size_t spark::JSONStreamReader::read(const char **data) {
+    // Wait for at least one character, but don't wait for more than what's already available
+    const int avail = strm_.available();
+    const size_t n = strm_.readBytes(chunk_, std::max(1, std::min<int>(avail, sizeof(chunk_))));
+    *data = chunk_;
+    return n;
+}
+
+// spark::JSONBufferReader
+size_t spark::JSONBufferReader::read(const char **data) {
+    const size_t n = size_;
+    *data = data_;
+    data_ += n;
+    size_ = 0;
+    return n;
+}
@@ -691,17 +691,15 @@ bool spark::LogManager::addHandler(LogHandler *handler) {
         if (activeHandlers_.contains(handler) || !activeHandlers_.append(handler)) {
             return false;
         }
-        if (activeHandlers_.size() == 1) {
-            setSystemCallbacks();
-        }
+        updateSystemCallbacks();
     }
     return true;
 }
 
 void spark::LogManager::removeHandler(LogHandler *handler) {
     LOG_WITH_LOCK(mutex_) {
-        if (activeHandlers_.removeOne(handler) && activeHandlers_.isEmpty()) {
-            resetSystemCallbacks();
+        if (activeHandlers_.removeOne(handler)) {
+            updateSystemCallbacks();
         }
     }
 }
@@ -749,9 +747,7 @@ bool spark::LogManager::addFactoryHandler(const char *id, const char *handlerTyp
             factoryHandlers_.takeLast(); // Revert factoryHandlers_.append()
             return false;
         }
-        if (activeHandlers_.size() == 1) {
-            setSystemCallbacks();
-        }
+        updateSystemCallbacks();
         handler.release(); // Release scope guard pointers
         stream.release();
     }
@@ -795,9 +791,7 @@ void spark::LogManager::destroyFactoryHandler(const char *id) {
         const FactoryHandler &h = factoryHandlers_.at(i);
         if (h.id == id) {
             activeHandlers_.removeOne(h.handler);
-            if (activeHandlers_.isEmpty()) {
-                resetSystemCallbacks();
-            }
+            updateSystemCallbacks();
             handlerFactory_->destroyHandler(h.handler);
             if (h.stream) {
                 streamFactory_->destroyStream(h.stream);
@@ -811,9 +805,7 @@ void spark::LogManager::destroyFactoryHandler(const char *id) {
 void spark::LogManager::destroyFactoryHandlers() {
     for (const FactoryHandler &h: factoryHandlers_) {
         activeHandlers_.removeOne(h.handler);
-        if (activeHandlers_.isEmpty()) {
-            resetSystemCallbacks();
-        }
+        updateSystemCallbacks();
         handlerFactory_->destroyHandler(h.handler);
         if (h.stream) {
             streamFactory_->destroyStream(h.stream);
@@ -832,6 +824,15 @@ void spark::LogManager::resetSystemCallbacks() {
     log_set_callbacks(nullptr, nullptr, nullptr, nullptr);
 }
 
+void spark::LogManager::updateSystemCallbacks() {
+    // Setting the callbacks also invalidates the logging levels cached for the categories
+    if (activeHandlers_.isEmpty()) {
+        resetSystemCallbacks();
+    } else {
+        setSystemCallbacks();
+    }
+}
+
 void spark::LogManager::logMessage(const char *msg, int level, const char *category, const LogAttributes *attr, void *reserved) {
 #ifndef LOG_FROM_ISR
     if (HAL_IsISR()) {
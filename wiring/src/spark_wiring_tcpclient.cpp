@@ -129,7 +129,7 @@ size_t TCPClient::write(uint8_t b, system_tick_t timeout)
 size_t TCPClient::write(const uint8_t *buffer, size_t size, system_tick_t timeout)
 {
     clearWriteError();
-    int ret = status() ? socket_send_ex(d_->sock, buffer, size, 0, timeout, nullptr) : -1;
+    int ret = status() ? writeBuffered(buffer, size, timeout) : -1;
     if (ret < 0) {
         setWriteError(ret);
     }
@@ -140,81 +140,43 @@ size_t TCPClient::write(const uint8_t *buffer, size_t size, system_tick_t timeou
     return ret;
 }
 
-int TCPClient::bufferCount()
+int TCPClient::receive(uint8_t* buffer, size_t size)
 {
-  return d_->total - d_->offset;
-}
-
-int TCPClient::available()
-{
-    int avail = 0;
-
-    // At EOB => Flush it
-    if (d_->total && (d_->offset == d_->total))
-    {
-        flush_buffer();
-    }
-
+    int ret = 0;
     if(Network.from(nif).ready() && isOpen(d_->sock))
     {
-        // Have room
-        if ( d_->total < arraySize(d_->buffer))
-        {
-            int ret = socket_receive(d_->sock, d_->buffer + d_->total , arraySize(d_->buffer)-d_->total, 0);
-            if (ret > 0)
-            {
-                DEBUG("recv(=%d)",ret);
-                if (d_->total == 0) d_->offset = 0;
-                d_->total += ret;
-            }
-        } // Have Space
-    } // WiFi.ready() && isOpen(d_->sock)
-    avail = bufferCount();
-    return avail;
-}
-
-int TCPClient::read()
-{
-  return (bufferCount() || available()) ? d_->buffer[d_->offset++] : -1;
-}
-
-int TCPClient::read(uint8_t *buffer, size_t size)
-{
-        int read = -1;
-        if (bufferCount() || available())
+        ret = socket_receive(d_->sock, buffer, size, 0);
+        if (ret > 0)
         {
-          read = (size > (size_t) bufferCount()) ? bufferCount() : size;
-          memcpy(buffer, &d_->buffer[d_->offset], read);
-          d_->offset += read;
+            DEBUG("recv(=%d)",ret);
         }
-        return read;
-}
-
-int TCPClient::peek()
-{
-  return  (bufferCount() || available()) ? d_->buffer[d_->offset] : -1;
-}
-
-void TCPClient::flush_buffer()
-{
-  d_->offset = 0;
-  d_->total = 0;
+    }
+    return ret;
 }
 
-void TCPClient::flush()
+int TCPClient::Data::send(const uint8_t* buffer, size_t size, system_tick_t timeout)
 {
+    return socket_send_ex(sock, buffer, size, 0, timeout, nullptr);
 }
 
-
 void TCPClient::stop()
 {
   // This log line pollutes the log too much
   // DEBUG("sock %d closesocket", d_->sock);
 
   if (isOpen(d_->sock))
+  {
+      if (d_->txCount)
+      {
+          const int ret = d_->sendBuffered();
+          if (ret < 0)
+              setWriteError(ret);
+      }
       socket_close(d_->sock);
+  }
   d_->sock = socket_handle_invalid();
   d_->remoteIP.clear();
+  d_->txCount = 0;
   flush_buffer();
 }
 
@@ -249,14 +211,11 @@ IPAddress TCPClient::remoteIP()
     return d_->remoteIP;
 }
 
-TCPClient::Data::Data(sock_handle_t sock)
-        : sock(sock),
-          offset(0),
-          total(0) {
-}
-
 TCPClient::Data::~Data() {
     if (socket_handle_valid(sock)) {
+        if (txCount) {
+            sendBuffered();
+        }
         socket_close(sock);
     }
 }
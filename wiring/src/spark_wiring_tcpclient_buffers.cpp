@@ -0,0 +1,227 @@
+/**
+ ******************************************************************************
+  Copyright (c) 2019 Particle Industries, Inc.  All rights reserved.
+
+  This library is free software; you can redistribute it and/or
+  modify it under the terms of the GNU Lesser General Public
+  License as published by the Free Software Foundation, either
+  version 3 of the License, or (at your option) any later version.
+
+  This library is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+  Lesser General Public License for more details.
+
+  You should have received a copy of the GNU Lesser General Public
+  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+  ******************************************************************************
+ */
+
+#include "hal_platform.h"
+
+#if HAL_USE_SOCKET_HAL_COMPAT || HAL_USE_SOCKET_HAL_POSIX
+
+// Buffering shared by the socket HAL specific implementations of TCPClient. The implementations
+// provide the TCPClient::receive() and TCPClient::Data::send() methods, which don't block for
+// receiving and send as much data as possible within the timeout respectively
+
+#include "spark_wiring_tcpclient.h"
+
+#include <algorithm>
+#include <new>
+#include <cstring>
+
+int TCPClient::bufferCount()
+{
+    return d_->total - d_->offset;
+}
+
+int TCPClient::available()
+{
+    // Send the buffered data first, the peer may be waiting for it before replying
+    if (d_->txCount) {
+        const int ret = d_->sendBuffered();
+        if (ret < 0) {
+            setWriteError(ret);
+        }
+    }
+
+    // At EOB => Flush it
+    if (d_->total && (d_->offset == d_->total)) {
+        flush_buffer();
+    }
+
+    // Have room
+    if (d_->total < d_->rxSize) {
+        const int ret = receive(d_->rxBuf + d_->total, d_->rxSize - d_->total);
+        if (ret > 0) {
+            if (d_->total == 0) {
+                d_->offset = 0;
+            }
+            d_->total += ret;
+        }
+    }
+    return bufferCount();
+}
+
+int TCPClient::read()
+{
+    return (bufferCount() || available()) ? d_->rxBuf[d_->offset++] : -1;
+}
+
+int TCPClient::read(uint8_t *buffer, size_t size)
+{
+    size_t read = 0;
+    if (bufferCount()) {
+        read = std::min(size, (size_t)bufferCount());
+        memcpy(buffer, d_->rxBuf + d_->offset, read);
+        d_->offset += read;
+    }
+    if (read < size && !bufferCount() && size - read >= d_->rxSize) {
+        // Large reads bypass the receive buffer
+        if (d_->txCount) {
+            const int ret = d_->sendBuffered();
+            if (ret < 0) {
+                setWriteError(ret);
+            }
+        }
+        flush_buffer();
+        const int ret = receive(buffer + read, size - read);
+        if (ret > 0) {
+            read += ret;
+        }
+    } else if (read == 0 && available()) {
+        read = std::min(size, (size_t)bufferCount());
+        memcpy(buffer, d_->rxBuf + d_->offset, read);
+        d_->offset += read;
+    }
+    return read ? (int)read : -1;
+}
+
+int TCPClient::peek()
+{
+    return (bufferCount() || available()) ? d_->rxBuf[d_->offset] : -1;
+}
+
+void TCPClient::flush_buffer()
+{
+    d_->offset = 0;
+    d_->total = 0;
+}
+
+void TCPClient::flush()
+{
+    if (d_->txCount) {
+        const int ret = d_->sendBuffered();
+        if (ret < 0) {
+            setWriteError(ret);
+        }
+    }
+}
+
+bool TCPClient::setReceiveBuffer(size_t size, uint8_t* buffer)
+{
+    std::unique_ptr<uint8_t[]> heapBuf;
+    if (!size) {
+        size = sizeof(d_->buffer);
+        buffer = d_->buffer;
+    } else if (!buffer) {
+        heapBuf.reset(new(std::nothrow) uint8_t[size]);
+        if (!heapBuf) {
+            return false;
+        }
+        buffer = heapBuf.get();
+    }
+    // Keep the received data that has not been read yet
+    const size_t count = bufferCount();
+    if (count > size) {
+        return false;
+    }
+    if (count) {
+        memmove(buffer, d_->rxBuf + d_->offset, count);
+    }
+    d_->offset = 0;
+    d_->total = count;
+    d_->rxBuf = buffer;
+    d_->rxSize = size;
+    d_->rxHeapBuf = std::move(heapBuf);
+    return true;
+}
+
+bool TCPClient::setSendBuffer(size_t size, uint8_t* buffer)
+{
+    if (d_->txCount && d_->sendBuffered() < 0) {
+        return false;
+    }
+    std::unique_ptr<uint8_t[]> heapBuf;
+    if (size && !buffer) {
+        heapBuf.reset(new(std::nothrow) uint8_t[size]);
+        if (!heapBuf) {
+            return false;
+        }
+        buffer = heapBuf.get();
+    }
+    d_->txBuf = size ? buffer : nullptr;
+    d_->txSize = size;
+    d_->txHeapBuf = std::move(heapBuf);
+    return true;
+}
+
+int TCPClient::writeBuffered(const uint8_t* buffer, size_t size, system_tick_t timeout)
+{
+    if (!d_->txSize) {
+        return d_->send(buffer, size, timeout);
+    }
+    d_->txTimeout = timeout;
+    if (d_->txCount && d_->txCount + size > d_->txSize) {
+        const int ret = d_->sendBuffered();
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    if (size >= d_->txSize) {
+        return d_->send(buffer, size, timeout);
+    }
+    memcpy(d_->txBuf + d_->txCount, buffer, size);
+    d_->txCount += size;
+    if (d_->txCount == d_->txSize) {
+        const int ret = d_->sendBuffered();
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    return size;
+}
+
+int TCPClient::Data::sendBuffered()
+{
+    // The data that can't be sent is discarded
+    const size_t count = txCount;
+    txCount = 0;
+    size_t sent = 0;
+    while (sent < count) {
+        const int ret = send(txBuf + sent, count - sent, txTimeout);
+        if (ret < 0) {
+            return ret;
+        }
+        if (ret == 0) {
+            return -1;
+        }
+        sent += ret;
+    }
+    return sent;
+}
+
+TCPClient::Data::Data(sock_handle_t sock)
+        : sock(sock),
+          rxBuf(buffer),
+          rxSize(sizeof(buffer)),
+          offset(0),
+          total(0),
+          txBuf(nullptr),
+          txSize(0),
+          txCount(0),
+          txTimeout(0) {
+}
+
+#endif // HAL_USE_SOCKET_HAL_COMPAT || HAL_USE_SOCKET_HAL_POSIX
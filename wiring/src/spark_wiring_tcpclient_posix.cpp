@@ -130,93 +130,61 @@ size_t TCPClient::write(uint8_t b, system_tick_t timeout) {
 
 size_t TCPClient::write(const uint8_t *buffer, size_t size, system_tick_t timeout) {
     clearWriteError();
-    struct timeval tv = {};
-    if (timeout != SOCKET_WAIT_FOREVER) {
-        tv.tv_sec = timeout / 1000;
-        tv.tv_usec = (timeout % 1000) * 1000;
-    }
-    int ret = sock_setsockopt(d_->sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    const int ret = writeBuffered(buffer, size, timeout);
     if (ret < 0) {
-        setWriteError(errno);
+        setWriteError(ret);
         return 0;
     }
 
-    ret = sock_send(d_->sock, buffer, size, 0);
+    return ret;
+}
+
+int TCPClient::receive(uint8_t* buffer, size_t size) {
+    if (!isOpen(d_->sock)) {
+        return 0;
+    }
+    const int ret = sock_recv(d_->sock, buffer, size, MSG_DONTWAIT);
     if (ret < 0) {
-        setWriteError(errno);
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            LOG(ERROR, "recv error = %d", errno);
+            sock_close(d_->sock);
+            d_->sock = -1;
+        }
         return 0;
     }
-
     return ret;
 }
 
-int TCPClient::bufferCount() {
-    return d_->total - d_->offset;
-}
-
-int TCPClient::available()
-{
-    int avail = 0;
-
-    // At EOB => Flush it
-    if (d_->total && (d_->offset == d_->total)) {
-        flush_buffer();
+int TCPClient::Data::send(const uint8_t* buffer, size_t size, system_tick_t timeout) {
+    struct timeval tv = {};
+    if (timeout != SOCKET_WAIT_FOREVER) {
+        tv.tv_sec = timeout / 1000;
+        tv.tv_usec = (timeout % 1000) * 1000;
     }
-
-    if (isOpen(d_->sock)) {
-        // Have room
-        if (d_->total < arraySize(d_->buffer)) {
-            int ret = sock_recv(d_->sock, d_->buffer + d_->total, arraySize(d_->buffer) - d_->total, MSG_DONTWAIT);
-            if (ret > 0) {
-                if (d_->total == 0) {
-                    d_->offset = 0;
-                }
-                d_->total += ret;
-            } else {
-                if (errno != EAGAIN && errno != EWOULDBLOCK) {
-                    LOG(ERROR, "recv error = %d", errno);
-                    sock_close(d_->sock);
-                    d_->sock = -1;
-                }
-            }
-        } // Have Space
-    } // isOpen(d_->sock)
-    avail = bufferCount();
-    return avail;
-}
-
-int TCPClient::read() {
-    return (bufferCount() || available()) ? d_->buffer[d_->offset++] : -1;
-}
-
-int TCPClient::read(uint8_t *buffer, size_t size) {
-    int read = -1;
-    if (bufferCount() || available()) {
-        read = (size > (size_t) bufferCount()) ? bufferCount() : size;
-        memcpy(buffer, &d_->buffer[d_->offset], read);
-        d_->offset += read;
+    // The errno value is passed along, as it may be changed before it's reported
+    if (sock_setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0) {
+        return -errno;
     }
-    return read;
-}
-
-int TCPClient::peek() {
-    return (bufferCount() || available()) ? d_->buffer[d_->offset] : -1;
-}
-
-void TCPClient::flush_buffer() {
-    d_->offset = 0;
-    d_->total = 0;
-}
-
-void TCPClient::flush() {
+    const int ret = sock_send(sock, buffer, size, 0);
+    if (ret < 0) {
+        return -errno;
+    }
+    return ret;
 }
 
 void TCPClient::stop() {
     if (isOpen(d_->sock)) {
+        if (d_->txCount) {
+            const int ret = d_->sendBuffered();
+            if (ret < 0) {
+                setWriteError(ret);
+            }
+        }
         sock_close(d_->sock);
     }
     d_->sock = -1;
     d_->remoteIP.clear();
+    d_->txCount = 0;
     flush_buffer();
 }
 
@@ -243,14 +211,11 @@ IPAddress TCPClient::remoteIP() {
     return d_->remoteIP;
 }
 
-TCPClient::Data::Data(sock_handle_t sock)
-        : sock(sock),
-          offset(0),
-          total(0) {
-}
-
 TCPClient::Data::~Data() {
     if (socket_handle_valid(sock)) {
+        if (txCount) {
+            sendBuffered();
+        }
         sock_close(sock);
     }
 }